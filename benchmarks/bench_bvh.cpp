@@ -0,0 +1,444 @@
+#include <benchmark/benchmark.h>
+
+#include "raytracer/accel/bvh.hpp"
+#include "raytracer/accel/triangles.hpp"
+#include "raytracer/math/tuples.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <memory>
+#include <vector>
+
+using namespace rt;
+using namespace rt::Accel;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// BVH traversal
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief An indexed triangle mesh, laid out as a parsed .OBJ file would be. The triangles tile a
+/// lumpy sphere, so that rays see a surface with depth complexity, like a scanned model.
+struct Mesh
+{
+    Mesh() = default;
+    explicit Mesh(size_t nTriangles)
+    {
+        // a UV sphere with twice as many segments as rings has 4 * rings^2 triangles
+        const auto nRings = static_cast<size_t>(std::sqrt(static_cast<double>(nTriangles) / 4.)) + 1;
+        const size_t nSegments = 2 * nRings;
+        for (size_t r{}; r <= nRings; ++r)
+        {
+            const double theta = PI * static_cast<double>(r) / nRings;
+            for (size_t s{}; s < nSegments; ++s)
+            {
+                const double phi = 2. * PI * static_cast<double>(s) / nSegments;
+                const double radius = 1. + 0.05 * std::sin(7. * theta) * std::cos(5. * phi);
+                vertices.push_back(Point{ radius * std::sin(theta) * std::cos(phi),
+                                          radius * std::cos(theta),
+                                          radius * std::sin(theta) * std::sin(phi) });
+            }
+        }
+        for (size_t r{}; r < nRings; ++r)
+        {
+            for (size_t s{}; s < nSegments; ++s)
+            {
+                const auto a = static_cast<uint32_t>(r * nSegments + s);
+                const auto b = static_cast<uint32_t>(r * nSegments + (s + 1) % nSegments);
+                const auto c = static_cast<uint32_t>(a + nSegments);
+                const auto d = static_cast<uint32_t>(b + nSegments);
+                addTriangle(a, b, c);
+                addTriangle(b, d, c);
+            }
+        }
+    }
+
+    void addTriangle(uint32_t a, uint32_t b, uint32_t c)
+    {
+        faces.push_back({ a, b, c });
+        BoundingBox box{};
+        box.add(vertices[a]);
+        box.add(vertices[b]);
+        box.add(vertices[c]);
+        bounds.push_back(box);
+    }
+
+    /// @brief Moller-Trumbore ray-triangle test, as in Triangle::localIntersect().
+    [[nodiscard]] double intersect(uint32_t face, const Ray& ray) const
+    {
+        const auto& p1 = vertices[faces[face][0]];
+        const auto e1 = vertices[faces[face][1]] - p1;
+        const auto e2 = vertices[faces[face][2]] - p1;
+        const auto dirCrossE2 = cross(ray.getDirection(), e2);
+        const double determinant = Tuple::dot(e1, dirCrossE2);
+        if (std::abs(determinant) < EPSILON)
+            return INF;
+        const double f = 1. / determinant;
+        const auto p1ToOrigin = ray.getOrigin() - p1;
+        const double u = f * Tuple::dot(p1ToOrigin, dirCrossE2);
+        if (u < 0. || u > 1.)
+            return INF;
+        const auto origCrossE1 = cross(p1ToOrigin, e1);
+        const double v = f * Tuple::dot(ray.getDirection(), origCrossE1);
+        if (v < 0. || u + v > 1.)
+            return INF;
+        return f * Tuple::dot(e2, origCrossE1);
+    }
+
+    /// @brief The bounds of the part of a triangle inside a box, for spatial split builds.
+    [[nodiscard]] ClipPrimitive clip() const
+    {
+        return [this](uint32_t face, const BoundingBox& box) {
+            return BoundingBox::ofTriangleWithin(vertices[faces[face][0]], vertices[faces[face][1]],
+                                                 vertices[faces[face][2]], box);
+        };
+    }
+
+    std::vector<Tuple> vertices;
+    std::vector<std::array<uint32_t, 3>> faces;
+    std::vector<BoundingBox> bounds;
+};
+
+/// @brief Long, thin triangles strewn diagonally through the view, like the blades of grass, wires
+/// and architectural trim whose boxes are mostly empty space, and overlap each other a great deal.
+const Mesh& getLongTriangles(size_t nTriangles)
+{
+    static std::map<size_t, std::unique_ptr<Mesh>> meshes;
+    auto& mesh = meshes[nTriangles];
+    if (mesh)
+        return *mesh;
+    mesh = std::make_unique<Mesh>();
+    std::mt19937 rng{ 1234 };
+    std::uniform_real_distribution<double> position{ -1.2, 1.2 };
+    std::uniform_real_distribution<double> width{ -0.01, 0.01 };
+    for (size_t i{}; i < nTriangles; ++i)
+    {
+        const Point from{ position(rng), position(rng), position(rng) };
+        const Point to{ position(rng), position(rng), position(rng) };
+        const auto a = static_cast<uint32_t>(mesh->vertices.size());
+        mesh->vertices.push_back(from);
+        mesh->vertices.push_back(to);
+        mesh->vertices.push_back(from + Vector{ width(rng), width(rng), width(rng) });
+        mesh->addTriangle(a, a + 1, a + 2);
+    }
+    return *mesh;
+}
+
+/// @brief Meshes are shared between benchmarks, since the largest take a while to generate.
+const Mesh& getMesh(size_t nTriangles)
+{
+    static std::map<size_t, std::unique_ptr<Mesh>> meshes;
+    auto& mesh = meshes[nTriangles];
+    if (!mesh)
+        mesh = std::make_unique<Mesh>(nTriangles);
+    return *mesh;
+}
+
+/// @brief A grid of camera rays looking at the mesh from a little way off.
+std::vector<Ray> getCameraRays()
+{
+    constexpr size_t SIZE{ 64 };
+    std::vector<Ray> rays;
+    const Point eye{ 0.3, 0.4, -3. };
+    for (size_t y{}; y < SIZE; ++y)
+    {
+        for (size_t x{}; x < SIZE; ++x)
+        {
+            const Point target{ -1.2 + 2.4 * static_cast<double>(x) / SIZE,
+                                -1.2 + 2.4 * static_cast<double>(y) / SIZE, 0. };
+            rays.emplace_back(eye, (target - eye).normalize());
+        }
+    }
+    return rays;
+}
+
+/// @brief Trace every camera ray to its closest hit on the mesh.
+template<typename Tree>
+void traceClosestHits(benchmark::State& state, const Tree& tree, const Mesh& mesh)
+{
+    const auto rays = getCameraRays();
+    for (auto _ : state)
+    {
+        for (const auto& ray: rays)
+        {
+            double closest{ INF };
+            tree.traverse(ray, [&](uint32_t face, double& tFar) {
+                const double t = mesh.intersect(face, ray);
+                if (t >= 0. && t < closest)
+                {
+                    closest = t;
+                    tFar = t;
+                }
+            });
+            benchmark::DoNotOptimize(closest);
+        }
+    }
+    state.counters["rays"] = benchmark::Counter(static_cast<double>(state.iterations() * rays.size()),
+                                                benchmark::Counter::kIsRate);
+}
+
+/// @brief Trace every camera ray to its closest hit on the mesh, testing the triangles of each leaf
+/// all at once with the watertight pack kernel, as ShapeBVH does for meshes.
+void traceClosestHitsInPacks(benchmark::State& state, const BVH& bvh, const Mesh& mesh)
+{
+    using Pack = TrianglePack<BinaryBVH::MAX_LEAF_SIZE>;
+    const auto& binary = bvh.getBinary();
+    const auto& references = binary.getPrimitiveIndices();
+    std::vector<Pack> packs;
+    std::vector<uint32_t> packAt(references.size(), 0);
+    for (const auto& node: binary.getNodes())
+    {
+        if (!node.isLeaf())
+            continue;
+        Pack pack{};
+        for (uint32_t lane{}; lane < node.count; ++lane)
+        {
+            const auto& face = mesh.faces[references[node.offset + lane]];
+            pack.set(lane, mesh.vertices[face[0]], mesh.vertices[face[1]], mesh.vertices[face[2]]);
+        }
+        pack.count = node.count;
+        packAt[node.offset] = static_cast<uint32_t>(packs.size());
+        packs.push_back(pack);
+    }
+    const auto rays = getCameraRays();
+    for (auto _ : state)
+    {
+        for (const auto& ray: rays)
+        {
+            double closest{ INF };
+            const WatertightRay watertight{ ray };
+            bvh.traverseLeaves(ray, [&](uint32_t first, uint32_t, double& tFar) {
+                alignas(32) double t[BinaryBVH::MAX_LEAF_SIZE], u[BinaryBVH::MAX_LEAF_SIZE], v[BinaryBVH::MAX_LEAF_SIZE];
+                for (auto hits = intersectTrianglePack(packs[packAt[first]], watertight, 0., tFar, t, u, v);
+                     hits != 0; hits &= hits - 1)
+                {
+                    closest = std::min(closest, t[std::countr_zero(hits)]);
+                    tFar = closest;
+                }
+            });
+            benchmark::DoNotOptimize(closest);
+        }
+    }
+    state.counters["rays"] = benchmark::Counter(static_cast<double>(state.iterations() * rays.size()),
+                                                benchmark::Counter::kIsRate);
+}
+
+/// @brief Trace every camera ray to its closest hit through a binary tree, as BinaryBVH::traverse()
+/// does, counting the nodes visited and triangles tested along the way. Primitives in several
+/// leaves are tested each time, so the counts include the cost of spatial splits' duplicates.
+void countTraversalSteps(benchmark::State& state, const BinaryBVH& bvh, const Mesh& mesh)
+{
+    const auto rays = getCameraRays();
+    const auto& nodes = bvh.getNodes();
+    const auto& primitives = bvh.getPrimitiveIndices();
+    size_t nNodes{}, nTests{};
+    for (const auto& ray: rays)
+    {
+        double tFar{ INF };
+        std::vector<uint32_t> stack{ 0 };
+        while (!stack.empty())
+        {
+            const auto& node = nodes[stack.back()];
+            const uint32_t index = stack.back();
+            stack.pop_back();
+            ++nNodes;
+            if (!node.bounds.intersects(ray, tFar))
+                continue;
+            if (node.isLeaf())
+            {
+                for (uint32_t i{ node.offset }; i < node.offset + node.count; ++i)
+                {
+                    ++nTests;
+                    const double t = mesh.intersect(primitives[i], ray);
+                    if (t >= 0. && t < tFar)
+                        tFar = t;
+                }
+                continue;
+            }
+            const bool isNegative = ray.isNegative(node.axis);
+            stack.push_back(isNegative ? index + 1 : node.offset);
+            stack.push_back(isNegative ? node.offset : index + 1);
+        }
+    }
+    state.counters["nodes/ray"] = static_cast<double>(nNodes) / static_cast<double>(rays.size());
+    state.counters["tris/ray"] = static_cast<double>(nTests) / static_cast<double>(rays.size());
+    state.counters["refs/tri"] = static_cast<double>(primitives.size()) / static_cast<double>(mesh.faces.size());
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BM_BinaryBVH(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    BinaryBVH bvh{};
+    bvh.build(mesh.bounds);
+    traceClosestHits(state, bvh, mesh);
+}
+
+template<size_t W>
+void BM_WideBVH(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    BinaryBVH binary{};
+    binary.build(mesh.bounds);
+    WideBVH<W> bvh{};
+    bvh.build(binary);
+    traceClosestHits(state, bvh, mesh);
+}
+
+/// @brief Trace through a wide BVH collapsed from a linear build, to compare its quality with SAH.
+template<MortonBits Bits, bool RefineTop>
+void BM_LinearWideBVH(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    BinaryBVH binary{};
+    binary.buildLinear(mesh.bounds, { Bits, RefineTop, 0 });
+    WideBVH<4> bvh{};
+    bvh.build(binary);
+    traceClosestHits(state, bvh, mesh);
+}
+
+/// @brief Trace the mesh through the wide tree picked for the CPU, with its leaves tested in packs
+/// rather than triangle by triangle. Compare with BM_WideBVH.
+void BM_WideBVHTrianglePacks(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    BVH bvh{};
+    bvh.build(mesh.bounds);
+    traceClosestHitsInPacks(state, bvh, mesh);
+}
+
+/// @brief Trace long, thin triangles through a tree built with the SAH alone, or with spatial
+/// splits too, counting the steps each ray takes.
+template<BuildMethod Method>
+void BM_LongTriangles(benchmark::State& state)
+{
+    const auto& mesh = getLongTriangles(static_cast<size_t>(state.range(0)));
+    BVH bvh{};
+    if constexpr (Method == BuildMethod::spatial)
+        bvh.build(mesh.bounds, mesh.clip());
+    else
+        bvh.build(mesh.bounds, Method);
+    countTraversalSteps(state, bvh.getBinary(), mesh);
+    traceClosestHits(state, bvh, mesh);
+}
+
+void BM_BuildBVH(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        BVH bvh{};
+        bvh.build(mesh.bounds);
+        benchmark::DoNotOptimize(bvh);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(mesh.bounds.size()));
+}
+
+/// @brief Build only the binary tree, on every hardware thread. Items per second is primitives.
+template<MortonBits Bits, bool RefineTop>
+void BM_BuildLinear(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        BinaryBVH bvh{};
+        bvh.buildLinear(mesh.bounds, { Bits, RefineTop, 0 });
+        benchmark::DoNotOptimize(bvh);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(mesh.bounds.size()));
+}
+
+void BM_BuildSAH(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        BinaryBVH bvh{};
+        bvh.build(mesh.bounds);
+        benchmark::DoNotOptimize(bvh);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(mesh.bounds.size()));
+}
+
+/// @brief Build a spatial split tree over the long triangles. Items per second is primitives.
+void BM_BuildSpatial(benchmark::State& state)
+{
+    const auto& mesh = getLongTriangles(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        BinaryBVH bvh{};
+        bvh.buildSpatial(mesh.bounds, mesh.clip());
+        benchmark::DoNotOptimize(bvh);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(mesh.bounds.size()));
+}
+
+/// @brief Load a tree saved to disk, in place of building it. Items per second is primitives.
+void BM_LoadCachedBVH(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    const auto file = std::filesystem::temp_directory_path() / "rt_bench_cached.bvh";
+    BVH built{};
+    built.build(mesh.bounds);
+    if (!built.save(file, 1))
+    {
+        state.SkipWithError("couldn't write the cache file");
+        return;
+    }
+    for (auto _ : state)
+    {
+        BVH bvh{};
+        benchmark::DoNotOptimize(bvh.load(file, 1));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(mesh.bounds.size()));
+    state.counters["MB"] = static_cast<double>(std::filesystem::file_size(file)) / 1e6;
+    std::filesystem::remove(file);
+}
+
+/// @brief Refit after nudging every n'th triangle, as when dragging part of a scene around.
+/// Items per second is primitives in the tree.
+void BM_RefitBVH(benchmark::State& state)
+{
+    const auto& mesh = getMesh(static_cast<size_t>(state.range(0)));
+    auto bounds = mesh.bounds;
+    std::vector<uint32_t> moved;
+    for (uint32_t i{}; i < bounds.size(); i += static_cast<uint32_t>(state.range(1)))
+        moved.push_back(i);
+    BVH bvh{};
+    bvh.build(bounds);
+    double offset{ 0.001 };
+    for (auto _ : state)
+    {
+        for (auto i: moved)
+        {
+            bounds[i].min.x = mesh.bounds[i].min.x + offset;
+            bounds[i].max.x = mesh.bounds[i].max.x + offset;
+        }
+        offset = -offset;
+        benchmark::DoNotOptimize(bvh.refit(bounds, moved));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(bounds.size()));
+}
+
+// 10k to 1M triangles; 10M triangles takes several GB and is left out of the default runs
+BENCHMARK(BM_BinaryBVH)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_WideBVH, 4)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_WideBVH, 8)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_WideBVHTrianglePacks)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_LinearWideBVH, MortonBits::thirty, false)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_LinearWideBVH, MortonBits::sixtyThree, true)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_LongTriangles, BuildMethod::sah)->RangeMultiplier(10)->Range(1'000, 100'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_LongTriangles, BuildMethod::spatial)->RangeMultiplier(10)->Range(1'000, 100'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BuildBVH)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadCachedBVH)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RefitBVH)->ArgsProduct({ { 10'000, 100'000, 1'000'000 }, { 1, 100, 100'000 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BuildSAH)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BuildSpatial)->RangeMultiplier(10)->Range(1'000, 100'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BuildLinear, MortonBits::thirty, false)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_BuildLinear, MortonBits::thirty, true)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_BuildLinear, MortonBits::sixtyThree, true)->RangeMultiplier(10)->Range(10'000, 1'000'000)->Unit(benchmark::kMillisecond)->UseRealTime();
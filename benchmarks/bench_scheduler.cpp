@@ -0,0 +1,171 @@
+#include <benchmark/benchmark.h>
+
+#include "raytracer/environment/camera.hpp"
+#include "raytracer/environment/world.hpp"
+#include "raytracer/renderer/job_scheduler.hpp"
+#include "raytracer/renderer/renderer.hpp"
+#include "raytracer/logging/logging.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+using namespace rt;
+using namespace rt::Render;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Job scheduling
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief One worker rendering single tile jobs of the default world.
+struct SchedulerFixture
+{
+    SchedulerFixture()
+    {
+        // the scheduler logs every job it ends, which would swamp the timings
+        Log::init();
+        Log::renderer()->set_level(spdlog::level::err);
+        camera.setTransform(Transform::viewTransform(Point{ 0., 1.5, -5. },
+                                                     Point{ 0., 1., 0. },
+                                                     Vector{ 0., 1., 0. }));
+        worker.start();
+    }
+    ~SchedulerFixture()
+    {
+        scheduler.shutdown();
+        worker.stop();
+    }
+
+    /// @brief Submit a job filling exactly one tile.
+    std::shared_ptr<JobState> submitTile()
+    {
+        return scheduler.getJobState(scheduler.submit(Job{ camera, world, JobType::background }));
+    }
+
+    static void waitFor(const auto& isDone)
+    {
+        // polled with short sleeps, so this thread wakes part way through a tile even when it shares
+        //  a CPU with the worker
+        while (!isDone())
+            std::this_thread::sleep_for(std::chrono::microseconds{ 10 });
+    }
+
+    static constexpr uint32_t SIZE{ 32 };
+    World world{ World::DefaultWorld() };
+    Camera camera{ SIZE, SIZE, THIRD_PI };
+    JobScheduler scheduler{};
+    Worker worker{ 0, scheduler };
+};
+}
+
+/// @brief Time for a job to end once cancelled, with a worker part way through its only tile.
+/// The worker stops at the end of the row it's on, rather than finishing the tile.
+static void BM_CancelMidTile(benchmark::State& state)
+{
+    SchedulerFixture f;
+    uint64_t nPixels{}, nJobs{};
+    for (auto _: state)
+    {
+        auto job = f.submitTile();
+        f.waitFor([&] { return job->nPixelsComplete.load(std::memory_order_relaxed) > 0; });
+        const auto t0 = std::chrono::steady_clock::now();
+        f.scheduler.cancel(job->job.id);
+        f.waitFor([&] { return job->isCompleted.load(); });
+        const auto elapsed = std::chrono::steady_clock::now() - t0;
+        state.SetIterationTime(std::chrono::duration<double>(elapsed).count());
+        nPixels += job->nPixelsComplete.load();
+        ++nJobs;
+        f.scheduler.eraseJobState(job->job.id);
+    }
+    // the share of each tile rendered before the worker let it go
+    state.counters["tile_rendered"] = static_cast<double>(nPixels) / (nJobs * f.SIZE * f.SIZE);
+}
+// the cancellations take a small part of each iteration, so their count is fixed
+BENCHMARK(BM_CancelMidTile)->UseManualTime()->Iterations(2000)->Unit(benchmark::kMicrosecond);
+
+/// @brief Time from cancelling a job of 16 tiles, with a worker part way through its first and the
+/// rest queued, to the end of a single tile job submitted straight after. The queued tiles go with
+/// the cancel, so the worker moves on once it stops at the end of its row.
+static void BM_CancelWithTilesQueued(benchmark::State& state)
+{
+    SchedulerFixture f;
+    Camera camera{ 4 * f.SIZE, 4 * f.SIZE, THIRD_PI };
+    camera.setTransform(f.camera.getTransform());
+    for (auto _: state)
+    {
+        auto job = f.scheduler.getJobState(f.scheduler.submit(Job{ camera, f.world, JobType::background }));
+        f.waitFor([&] { return job->nPixelsComplete.load(std::memory_order_relaxed) > 0; });
+        const auto t0 = std::chrono::steady_clock::now();
+        f.scheduler.cancel(job->job.id);
+        auto next = f.submitTile();
+        f.waitFor([&] { return next->isCompleted.load(); });
+        const auto elapsed = std::chrono::steady_clock::now() - t0;
+        state.SetIterationTime(std::chrono::duration<double>(elapsed).count());
+        f.scheduler.eraseJobState(job->job.id);
+        f.scheduler.eraseJobState(next->job.id);
+    }
+}
+BENCHMARK(BM_CancelWithTilesQueued)->UseManualTime()->Iterations(500)->Unit(benchmark::kMicrosecond);
+
+/// @brief Time to render a whole tile, ie: what each cancellation cost before workers checked
+/// for it between rows.
+static void BM_RenderWholeTile(benchmark::State& state)
+{
+    SchedulerFixture f;
+    for (auto _: state)
+    {
+        auto job = f.submitTile();
+        f.waitFor([&] { return job->isCompleted.load(); });
+        f.scheduler.eraseJobState(job->job.id);
+    }
+}
+BENCHMARK(BM_RenderWholeTile)->Unit(benchmark::kMicrosecond);
+
+/// @brief Time to render an offline job of 64 tiles, without (0) and with (1) a checkpoint saving
+/// each tile as it finishes. The difference is what checkpointing costs a long render.
+static void BM_RenderOfflineJob(benchmark::State& state)
+{
+    SchedulerFixture f;
+    f.scheduler.setMode(Mode::render_only);
+    Camera camera{ 8 * f.SIZE, 8 * f.SIZE, THIRD_PI };
+    camera.setTransform(f.camera.getTransform());
+    const auto file = std::filesystem::temp_directory_path() / "bench_offline_job.checkpoint";
+    for (auto _: state)
+    {
+        Job job{ camera, f.world, JobType::offline };
+        if (state.range(0) != 0)
+            job.checkpointFile = file;
+        auto s = f.scheduler.getJobState(f.scheduler.submit(job));
+        f.waitFor([&] { return s->isCompleted.load(); });
+        f.scheduler.eraseJobState(s->job.id);
+    }
+}
+BENCHMARK(BM_RenderOfflineJob)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+/// @brief Time to submit a 4K offline job of four passes, and cancel it again. Offline jobs aren't
+/// dispatched in the default mode, so no worker is needed. Making and freeing the job's image
+/// isn't timed.
+static void BM_SubmitLargeJob(benchmark::State& state)
+{
+    Log::init();
+    Log::renderer()->set_level(spdlog::level::err);
+    World world{ World::DefaultWorld() };
+    Camera camera{ 3840, 2160, THIRD_PI };
+    JobScheduler scheduler{};
+    for (auto _: state)
+    {
+        state.PauseTiming();
+        Job job{ camera, world, JobType::offline };
+        job.passes = { 8, 4, 2, 1 };
+        state.ResumeTiming();
+        const auto id = scheduler.submit(std::move(job));
+        scheduler.cancel(id);
+        state.PauseTiming();
+        scheduler.eraseJobState(id);
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_SubmitLargeJob)->Unit(benchmark::kMillisecond);
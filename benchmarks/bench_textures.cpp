@@ -0,0 +1,141 @@
+#include <benchmark/benchmark.h>
+
+#include "raytracer/environment/camera.hpp"
+#include "raytracer/materials/textures.hpp"
+#include "raytracer/shapes/plane.hpp"
+
+using namespace rt;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Generative textures, on the noise floor scene from demo/main.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief The object space points and world normals of every pixel which sees the noise floor.
+struct NoiseFloor
+{
+    NoiseFloor()
+    {
+        floor.setTransform(Transform::rotateX(-QUARTER_PI));
+        auto camera = Camera{ SIZE, SIZE, THIRD_PI };
+        camera.setTransform(Transform::viewTransform({ 0.0, 1.1, -7.2 },
+                                                     { 0.0, 0.75, 0.0 },
+                                                     { 0.0, 1.0, 0.0 }));
+        for (uint32_t y{}; y < SIZE; ++y)
+        {
+            for (uint32_t x{}; x < SIZE; ++x)
+            {
+                auto ray = camera.getRayForCanvasPixel(x, y);
+                auto xs = floor.intersect(ray);
+                const auto hit = xs.findHit();
+                if (hit.shape == nullptr)
+                    continue;
+                const auto pWorld = ray.position(hit.t);
+                points.push_back(floor.worldToObject(pWorld));
+                normals.push_back(floor.normalToWorld(Vector{ 0, 1, 0 }));
+            }
+        }
+    }
+
+    static constexpr uint32_t SIZE{ 256 };
+    Plane floor{};
+    std::vector<Tuple> points;
+    std::vector<Tuple> normals;
+};
+
+const NoiseFloor& noiseFloor()
+{
+    static const NoiseFloor scene{};
+    return scene;
+}
+
+/// @brief The floor texture used in the demo.
+Texture::Noise floorTexture()
+{
+    Texture::Noise tf{};
+    tf.setDensity(5);
+    tf.setAmplitude(0.08);
+    return tf;
+}
+
+void applyOneByOne(benchmark::State& state, Texture::Generative& texture)
+{
+    const auto& scene = noiseFloor();
+    for (auto _ : state)
+    {
+        for (size_t i{}; i < scene.points.size(); ++i)
+        {
+            auto n = texture.applyToNormal(scene.normals[i], scene.points[i]);
+            benchmark::DoNotOptimize(n);
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * scene.points.size()));
+}
+
+void applyBatched(benchmark::State& state, Texture::Generative& texture)
+{
+    const auto& scene = noiseFloor();
+    const TupleBatch points{ scene.points };
+    const TupleBatch normals{ scene.normals };
+    TupleBatch out{};
+    for (auto _ : state)
+    {
+        out = normals;
+        texture.applyToNormals(out, points);
+        benchmark::DoNotOptimize(out.x.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * scene.points.size()));
+}
+}
+
+static void BM_NoiseFloorSimplex(benchmark::State& state)
+{
+    auto tf = floorTexture();
+    applyOneByOne(state, tf);
+}
+BENCHMARK(BM_NoiseFloorSimplex)->Unit(benchmark::kMillisecond);
+
+static void BM_NoiseFloorSimplexBatched(benchmark::State& state)
+{
+    auto tf = floorTexture();
+    applyBatched(state, tf);
+}
+BENCHMARK(BM_NoiseFloorSimplexBatched)->Unit(benchmark::kMillisecond);
+
+static void BM_NoiseFloorPerlinFbm(benchmark::State& state)
+{
+    auto tf = floorTexture();
+    tf.setNoiseType(Texture::Noise::NoiseType::perlin);
+    tf.setFractalType(Texture::Noise::FractalType::fbm);
+    tf.setOctaves(4);
+    applyOneByOne(state, tf);
+}
+BENCHMARK(BM_NoiseFloorPerlinFbm)->Unit(benchmark::kMillisecond);
+
+static void BM_NoiseFloorPerlinFbmBatched(benchmark::State& state)
+{
+    auto tf = floorTexture();
+    tf.setNoiseType(Texture::Noise::NoiseType::perlin);
+    tf.setFractalType(Texture::Noise::FractalType::fbm);
+    tf.setOctaves(4);
+    applyBatched(state, tf);
+}
+BENCHMARK(BM_NoiseFloorPerlinFbmBatched)->Unit(benchmark::kMillisecond);
+
+static void BM_NoiseFloorWaves(benchmark::State& state)
+{
+    Texture::Waves waves{};
+    waves.setFrequency(4);
+    waves.setAmplitude(0.15);
+    applyOneByOne(state, waves);
+}
+BENCHMARK(BM_NoiseFloorWaves)->Unit(benchmark::kMillisecond);
+
+static void BM_NoiseFloorWavesBatched(benchmark::State& state)
+{
+    Texture::Waves waves{};
+    waves.setFrequency(4);
+    waves.setAmplitude(0.15);
+    applyBatched(state, waves);
+}
+BENCHMARK(BM_NoiseFloorWavesBatched)->Unit(benchmark::kMillisecond);
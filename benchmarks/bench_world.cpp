@@ -0,0 +1,221 @@
+#include <benchmark/benchmark.h>
+
+#include "raytracer/environment/camera.hpp"
+#include "raytracer/environment/world.hpp"
+#include "raytracer/renderer/ray_packet.hpp"
+#include "raytracer/shapes/plane.hpp"
+#include "raytracer/shapes/sphere.hpp"
+#include "raytracer/shapes/cube.hpp"
+#include "raytracer/shapes/group.hpp"
+#include "raytracer/shapes/instance.hpp"
+#include "raytracer/shapes/triangle.hpp"
+
+#include <array>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+using namespace rt;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// World shading
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief A floor with a grid of spheres and cubes on it, all matte and opaque. Nothing in the
+/// scene reflects or refracts, so every ray is a primary ray plus one shadow ray.
+struct OpaqueScene
+{
+    OpaqueScene()
+    {
+        world.addLight(PointLight{ Point{ -10., 10., -10. }, Colour{ 1., 1., 1. } });
+        floor.setColour(Colour{ 0.9, 0.85, 0.8 });
+        world.addShape(&floor);
+        for (int i{}; i < GRID; ++i)
+        {
+            for (int j{}; j < GRID; ++j)
+            {
+                const double x = (i - GRID / 2) * 1.5;
+                const double z = j * 1.5;
+                std::unique_ptr<Shape> shape;
+                if ((i + j) % 2 == 0)
+                    shape = std::make_unique<Sphere>();
+                else
+                    shape = std::make_unique<Cube>();
+                shape->setTransform(Transform::translation(x, 0.5, z) * Transform::scale(0.5, 0.5, 0.5));
+                shape->setColour(Colour{ 0.2 + 0.1 * i, 0.3, 0.9 - 0.1 * j });
+                world.addShape(shape.get());
+                shapes.push_back(std::move(shape));
+            }
+        }
+        camera.setTransform(Transform::viewTransform(Point{ 0., 4., -8. },
+                                                     Point{ 0., 0., 3. },
+                                                     Vector{ 0., 1., 0. }));
+    }
+
+    static constexpr int GRID{ 6 };
+    static constexpr uint32_t SIZE{ 96 };
+    World world{};
+    Plane floor{};
+    std::vector<std::unique_ptr<Shape>> shapes;
+    Camera camera{ SIZE, SIZE, THIRD_PI };
+};
+
+OpaqueScene& opaqueScene()
+{
+    static OpaqueScene scene{};
+    return scene;
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BM_TraceOpaqueScene(benchmark::State& state)
+{
+    auto& scene = opaqueScene();
+    for (auto _ : state)
+    {
+        for (uint32_t y{}; y < OpaqueScene::SIZE; ++y)
+        {
+            for (uint32_t x{}; x < OpaqueScene::SIZE; ++x)
+            {
+                auto pixel = scene.world.traceRayToPixel(scene.camera.getRayForCanvasPixel(x, y),
+                                                         World::MAX_RAYS);
+                benchmark::DoNotOptimize(pixel);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * OpaqueScene::SIZE * OpaqueScene::SIZE);
+}
+BENCHMARK(BM_TraceOpaqueScene)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Primary visibility throughput, tracing the scene in packets of N camera rays (and their
+/// shadow rays). N = 1 traces each pixel on its own, as a baseline.
+template<size_t N>
+void BM_TracePrimaryPackets(benchmark::State& state)
+{
+    auto& scene = opaqueScene();
+    for (auto _ : state)
+    {
+        if constexpr (N == 1)
+        {
+            for (uint32_t y{}; y < OpaqueScene::SIZE; ++y)
+            {
+                for (uint32_t x{}; x < OpaqueScene::SIZE; ++x)
+                {
+                    auto pixel = scene.world.traceRayToPixel(scene.camera.getRayForCanvasPixel(x, y),
+                                                             World::MAX_RAYS);
+                    benchmark::DoNotOptimize(pixel);
+                }
+            }
+        }
+        else
+        {
+            using Block = RayPacket<N>;
+            for (uint32_t y{}; y < OpaqueScene::SIZE; y += Block::BLOCK_HEIGHT)
+            {
+                for (uint32_t x{}; x < OpaqueScene::SIZE; x += Block::BLOCK_WIDTH)
+                {
+                    const auto packet = scene.camera.getRayPacketForCanvasBlock<N>(x, y);
+                    auto pixels = scene.world.tracePacketToPixels(packet, World::MAX_RAYS);
+                    benchmark::DoNotOptimize(pixels);
+                }
+            }
+        }
+    }
+    // each pixel casts a camera ray and a shadow ray
+    const auto nRays = static_cast<double>(state.iterations() * OpaqueScene::SIZE * OpaqueScene::SIZE * 2);
+    state.counters["rays"] = benchmark::Counter(nRays, benchmark::Counter::kIsRate);
+}
+BENCHMARK_TEMPLATE(BM_TracePrimaryPackets, 1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TracePrimaryPackets, 4)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TracePrimaryPackets, 8)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instancing
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief A floor covered in a square grid of nInstances instances of one triangle mesh. The mesh
+/// is stored once however many times it is placed; only the instances themselves are per copy.
+struct InstancedScene
+{
+    explicit InstancedScene(size_t nInstances)
+    {
+        world.addLight(PointLight{ Point{ -10., 10., -10. }, Colour{ 1., 1., 1. } });
+        world.addShape(&floor);
+        // a UV sphere of 2 * RINGS^2 triangles, standing on the floor
+        constexpr size_t RINGS{ 24 };
+        const auto vertexAt = [](size_t r, size_t s) {
+            const double theta = PI * static_cast<double>(r) / RINGS;
+            const double phi = PI * static_cast<double>(s) / RINGS;
+            return Point{ 0.5 * std::sin(theta) * std::cos(phi), 0.5 + 0.5 * std::cos(theta),
+                          0.5 * std::sin(theta) * std::sin(phi) };
+        };
+        for (size_t r{}; r < RINGS; ++r)
+        {
+            for (size_t s{}; s < 2 * RINGS; ++s)
+            {
+                for (auto [a, b, c]: { std::array{ vertexAt(r, s), vertexAt(r, s + 1), vertexAt(r + 1, s) },
+                                       std::array{ vertexAt(r, s + 1), vertexAt(r + 1, s + 1), vertexAt(r + 1, s) } })
+                {
+                    // the poles have degenerate triangles, which are left out
+                    if (a == b || b == c || a == c)
+                        continue;
+                    triangles.push_back(std::make_unique<Triangle>(a, b, c));
+                    mesh.addChild(triangles.back().get());
+                }
+            }
+        }
+        const auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(nInstances))));
+        const double spacing = 8. / static_cast<double>(side);
+        for (size_t i{}; i < nInstances; ++i)
+        {
+            auto& instance = *instances.emplace_back(std::make_unique<Instance>(&mesh));
+            const double x = -4. + spacing * (static_cast<double>(i % side) + 0.5);
+            const double z = spacing * static_cast<double>(i / side);
+            instance.setTransform(Transform::translation(x, 0., z)
+                                  * Transform::rotateY(0.3 * static_cast<double>(i))
+                                  * Transform::scale(spacing, spacing, spacing));
+            if (i % 3 == 0)
+                instance.setColour(Colour{ 0.9, 0.3, 0.2 });
+            world.addShape(&instance);
+        }
+        camera.setTransform(Transform::viewTransform(Point{ 0., 4., -8. },
+                                                     Point{ 0., 0., 3. },
+                                                     Vector{ 0., 1., 0. }));
+    }
+
+    static constexpr uint32_t SIZE{ 96 };
+    World world{};
+    Plane floor{};
+    Group mesh{};
+    std::vector<std::unique_ptr<Triangle>> triangles;
+    std::vector<std::unique_ptr<Instance>> instances;
+    Camera camera{ SIZE, SIZE, THIRD_PI };
+};
+}
+
+/// @brief Trace a field of instances of one mesh in packets of 8 rays. The time should grow with
+/// the depth of the top level tree, ie: logarithmically in the number of instances.
+void BM_TraceInstances(benchmark::State& state)
+{
+    InstancedScene scene{ static_cast<size_t>(state.range(0)) };
+    using Block = RayPacket<8>;
+    for (auto _ : state)
+    {
+        for (uint32_t y{}; y < InstancedScene::SIZE; y += Block::BLOCK_HEIGHT)
+        {
+            for (uint32_t x{}; x < InstancedScene::SIZE; x += Block::BLOCK_WIDTH)
+            {
+                const auto packet = scene.camera.getRayPacketForCanvasBlock<8>(x, y);
+                auto pixels = scene.world.tracePacketToPixels(packet, World::MAX_RAYS);
+                benchmark::DoNotOptimize(pixels);
+            }
+        }
+    }
+    const auto nRays = static_cast<double>(state.iterations() * InstancedScene::SIZE * InstancedScene::SIZE * 2);
+    state.counters["rays"] = benchmark::Counter(nRays, benchmark::Counter::kIsRate);
+    state.counters["triangles"] = static_cast<double>(scene.triangles.size() * scene.instances.size());
+}
+BENCHMARK(BM_TraceInstances)->RangeMultiplier(16)->Range(1, 4096)->Unit(benchmark::kMillisecond);
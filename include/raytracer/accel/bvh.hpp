@@ -0,0 +1,464 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Bounding Volume Hierarchies
+///     Binary SAH and linear BVHs, collapsed into 4 and 8 wide BVHs for SIMD traversal
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "raytracer/math/bounds.hpp"
+#include "raytracer/renderer/ray.hpp"
+#include "raytracer/renderer/ray_packet.hpp"
+#include "raytracer/common/static_vector.hpp"
+
+namespace rt::Accel
+{
+/// @brief Number of children in the nodes of a wide BVH.
+enum class NodeWidth : uint8_t
+{
+    four = 4,   /// one SSE register of floats per axis
+    eight = 8   /// one AVX2 register of floats per axis
+};
+
+/// @brief The widest node format the running CPU can test in a single SIMD instruction per axis.
+/// @details Eight when AVX2 is detected on Linux x86-64, and four everywhere else.
+NodeWidth detectNodeWidth();
+
+/// @brief How the binary tree of a BVH is built.
+enum class BuildMethod : uint8_t
+{
+    sah,    /// binned surface area heuristic: slower to build, faster to trace
+    linear, /// Morton code sort (an LBVH) with an SAH top: much faster to build, for large or changing scenes
+    spatial /// SAH with spatial splits (an SBVH): slowest to build, best for long, thin primitives
+};
+
+/// @brief Precision of the Morton codes a linear build sorts primitives by.
+enum class MortonBits : uint8_t
+{
+    thirty = 30,    /// 10 bits per axis, sorted in 4 passes
+    sixtyThree = 63 /// 21 bits per axis, sorted in 8 passes; separates primitives in large, detailed scenes
+};
+
+/// @brief Settings for a linear BVH build.
+struct LinearBuildSettings
+{
+    MortonBits bits{ MortonBits::sixtyThree };
+    bool refineTop{ true };  /// rebuild the levels above the treelets with the SAH
+    size_t nThreads{ 0 };    /// threads to build with, or 0 for every hardware thread
+};
+
+/// @brief The bounds of the part of a primitive which lies inside a box, or an empty box when no
+/// part of it does. Spatial splits use it to cut primitives in two.
+using ClipPrimitive = std::function<BoundingBox(uint32_t primitive, const BoundingBox& box)>;
+
+/// @brief Settings for a spatial split BVH build.
+struct SpatialBuildSettings
+{
+    /// extra references to primitives which splits may make, as a fraction of the primitive count
+    double duplicationBudget{ 0.5 };
+    /// spatial splits are only tried in nodes where the children of the best object split overlap
+    /// by more than this fraction of the root's surface area (alpha, in Stich et al. 2009)
+    double minOverlap{ 1e-5 };
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BinaryBVH
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A node of a binary BVH. The first child of an inner node directly follows it.
+struct BinaryNode
+{
+    BoundingBox bounds{};
+    uint32_t offset{};  /// index of the second child of an inner node, or the first primitive of a leaf
+    uint32_t count{};   /// number of primitives in a leaf, or 0 for inner nodes
+    uint8_t axis{};     /// axis an inner node's children are split along
+
+    [[nodiscard]] inline bool isLeaf() const { return count > 0; }
+};
+
+/// @brief A binary bounding volume hierarchy, built with the binned surface area heuristic (SAH).
+/// @details Primitives are referred to by their index in the span of bounds the tree was built
+/// from. The tree only stores those indices, so it works for any kind of primitive.
+class BinaryBVH
+{
+  public:
+    /// @brief Build the tree over the bounds of each primitive. Every box must be finite.
+    void build(std::span<const BoundingBox> primitives);
+    /// @brief Build the tree by sorting the primitives along a Morton curve (an LBVH).
+    /// @details The sorted primitives are cut into treelets by the leading bits of their codes, and
+    /// the treelets are built in parallel, splitting wherever the next bit of the code changes. The
+    /// levels above the treelets are then rebuilt with the SAH, unless settings.refineTop is off.
+    /// Leaves hold up to MAX_LEAF_SIZE primitives and are never deeper than MAX_DEPTH.
+    void buildLinear(std::span<const BoundingBox> primitives, const LinearBuildSettings& settings = {});
+    /// @brief Build the tree with the SAH, splitting space as well as lists of primitives (an SBVH).
+    /// @param clip Finds the part of a primitive inside a box, for primitives straddling a split.
+    /// @details Where the children of an object split would overlap, splitting space instead is
+    /// tried too: primitives straddling the split plane are cut in two, and referenced from both
+    /// children. A primitive may so be visited more than once by a traversal. Splits stop cutting
+    /// primitives once the duplication budget is spent. Trees with duplicates can't be refit.
+    void buildSpatial(std::span<const BoundingBox> primitives, const ClipPrimitive& clip,
+                      const SpatialBuildSettings& settings = {});
+    /// @brief Refit the tree after some primitives moved, keeping its structure.
+    /// @param primitives Bounds of every primitive, as the tree was built from, with the moved ones
+    /// updated.
+    /// @param moved Indices of the primitives which moved.
+    /// @param nThreads Threads to refit with, or 0 for every hardware thread.
+    /// @return The nodes whose bounds were recomputed.
+    /// @details Only nodes on the paths from the moved primitives' leaves up to the root are
+    /// recomputed. When there are many, each level of the tree is refit in parallel, deepest first.
+    const std::vector<uint32_t>& refit(std::span<const BoundingBox> primitives,
+                                       std::span<const uint32_t> moved, size_t nThreads = 0);
+    /// @brief Visit the primitives in every leaf a ray passes through, nearest leaves first.
+    /// @param visit Called as visit(primitiveIndex, tFar). It may shrink tFar (ie: to the closest
+    /// hit found so far), and any part of the tree lying further away is skipped.
+    template<typename Visit>
+    void traverse(const Ray& ray, Visit&& visit) const;
+    /// @brief Visit the primitives in every leaf which any lane of a packet passes through.
+    /// @param hits Closest hits so far, whose t limits each lane. visit may update them.
+    template<size_t N, typename Visit>
+    void traversePacket(const RayPacket<N>& packet, const PacketHit<N>& hits, Visit&& visit) const;
+    /// @brief The expected cost of tracing a ray through the tree, relative to intersecting a
+    /// single primitive, as estimated by the surface area heuristic.
+    [[nodiscard]] double getSAHCost() const;
+
+    [[nodiscard]] inline bool isEmpty() const { return nodes.empty(); }
+    [[nodiscard]] inline const std::vector<BinaryNode>& getNodes() const { return nodes; }
+    /// @brief Indices of the primitives, in the order the leaves refer to them.
+    [[nodiscard]] inline const std::vector<uint32_t>& getPrimitiveIndices() const { return primitives; }
+    /// @brief True if some primitives are referred to by more than one leaf (ie: after spatial splits).
+    [[nodiscard]] inline bool hasDuplicates() const { return primitives.size() > leafOf.size(); }
+    [[nodiscard]] inline BoundingBox getBounds() const { return nodes.empty() ? BoundingBox{} : nodes[0].bounds; }
+
+    static constexpr size_t MAX_LEAF_SIZE{ 4 };
+    static constexpr size_t MAX_DEPTH{ 64 };  /// deeper nodes are made leaves, which bounds traversal stacks
+    static constexpr size_t N_BINS{ 16 };
+    static constexpr size_t N_SPATIAL_BINS{ 32 };  /// bins per axis for spatial split builds
+    static constexpr double TRAVERSAL_COST{ 1. };     /// cost of visiting a node, relative to...
+    static constexpr double INTERSECTION_COST{ 1. };  /// ...intersecting a primitive
+    static constexpr size_t REFIT_SWEEP_FRACTION{ 16 };  /// refits of more than 1/16 of the nodes sweep them all
+
+  private:
+    friend class BVH;
+
+    uint32_t buildNode(std::span<const BoundingBox> boxes, std::span<const Tuple> centroids,
+                       uint32_t begin, uint32_t end, size_t depth);
+    template<typename Code>
+    void buildLinearWith(std::span<const BoundingBox> boxes, const LinearBuildSettings& settings);
+    /// @brief Find each node's parent and depth, each primitive's leaf, and the SAH cost of the tree.
+    /// @param nPrimitives Number of primitives the tree was built over.
+    void link(size_t nPrimitives);
+
+    std::vector<BinaryNode> nodes;
+    std::vector<uint32_t> primitives;
+    std::vector<uint32_t> parents;   /// parent of each node; the root is its own parent
+    std::vector<uint8_t> depths;     /// depth of each node
+    std::vector<uint32_t> leafOf;    /// leaf each primitive is in (the last, if several), by primitive index
+    std::vector<uint8_t> isDirty;    /// nodes already marked for the refit in progress
+    std::vector<uint32_t> refitted;  /// nodes recomputed by the last refit
+    double weightedArea{};  /// sum of each node's surface area times its cost; the SAH cost times the root's area
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// WideBVH
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A node of a wide BVH, holding the bounds of all W children in SoA layout, so that one
+/// SIMD instruction per slab plane tests every child.
+/// @details Bounds are stored in single precision, rounded outwards so that they only ever grow.
+/// Unused child slots have empty bounds, which no ray can pass through.
+template<size_t W>
+struct WideNode
+{
+    alignas(32) float lower[3][W];  /// [axis][child]
+    alignas(32) float upper[3][W];
+    uint32_t child[W];  /// index of an inner child node, or of the first primitive of a leaf child
+    uint32_t count[W];  /// primitives in a leaf child, or 0 for an inner child
+
+    static constexpr uint32_t EMPTY{ 0xFFFFFFFF };
+};
+
+/// @brief A ray in single precision, for testing against wide nodes.
+struct FloatRay
+{
+    explicit FloatRay(const Ray& ray);
+
+    float origin[3];
+    float invDirection[3];
+    bool isNegative[3];
+    float tMin;
+};
+
+/// @brief Slab test a ray against every child of a wide node at once.
+/// @param tFar Far limit of the ray. Nearer limits of the children which are hit are written to tNear.
+/// @return The children the ray passes through.
+/// @details Uses SSE for four wide nodes and AVX2 (when the CPU has it) for eight wide nodes.
+LaneMask intersectWideNode(const WideNode<4>& node, const FloatRay& ray, float tFar, float* tNear);
+LaneMask intersectWideNode(const WideNode<8>& node, const FloatRay& ray, float tFar, float* tNear);
+
+/// @brief A BVH with W children per node, collapsed from a binary BVH.
+/// @details Each node keeps the children of several levels of the binary tree, always opening up
+/// the largest inner child, so that traversal does one SIMD box test where the binary tree would
+/// do up to W - 1 scalar ones. Children are visited front to back.
+template<size_t W>
+class WideBVH
+{
+  public:
+    /// @brief Collapse a binary BVH into this one.
+    void build(const BinaryBVH& binary);
+    /// @brief Copy the bounds of refit binary nodes into the children they were collapsed into.
+    void refit(const BinaryBVH& binary, std::span<const uint32_t> refitted);
+    /// @brief Visit the primitives in every leaf a ray passes through, nearest leaves first.
+    /// @param visit Called as visit(primitiveIndex, tFar), and may shrink tFar.
+    template<typename Visit>
+    void traverse(const Ray& ray, Visit&& visit) const
+    {
+        traverseLeaves(ray, [&](uint32_t first, uint32_t count, double& tFar) {
+            for (uint32_t i{ first }; i < first + count; ++i)
+                visit(primitives[i], tFar);
+        });
+    }
+    /// @brief Visit every leaf a ray passes through, nearest first.
+    /// @param visitLeaf Called as visitLeaf(first, count, tFar), where the leaf's primitives are
+    /// those at [first, first + count) in BinaryBVH::getPrimitiveIndices(). It may shrink tFar.
+    template<typename VisitLeaf>
+    void traverseLeaves(const Ray& ray, VisitLeaf&& visitLeaf) const;
+
+    [[nodiscard]] inline bool isEmpty() const { return nodes.empty(); }
+    [[nodiscard]] inline const std::vector<WideNode<W>>& getNodes() const { return nodes; }
+
+  private:
+    friend class BVH;
+
+    uint32_t collapse(const BinaryBVH& binary, uint32_t binaryIndex);
+
+    std::vector<WideNode<W>> nodes;
+    std::vector<uint32_t> primitives;
+    std::vector<uint32_t> slotOf;  /// child slot (node * W + child) each binary node became, if any
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BVH
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A BVH whose node width is picked to suit the CPU it runs on.
+/// @details Single rays traverse the wide tree. Packets traverse the binary tree it was collapsed
+/// from, since they already test one box across several lanes at a time.
+class BVH
+{
+  public:
+    explicit BVH(NodeWidth width = detectNodeWidth()) : width(width) {}
+    /// @brief Build the tree over the bounds of each primitive. Every box must be finite.
+    void build(std::span<const BoundingBox> primitives, BuildMethod method = BuildMethod::sah);
+    /// @brief Build the tree with spatial splits (see BinaryBVH::buildSpatial()).
+    void build(std::span<const BoundingBox> primitives, const ClipPrimitive& clip,
+               const SpatialBuildSettings& settings = {});
+    /// @brief Refit the tree after some primitives moved, keeping its structure. Should the refit
+    /// leave the tree's SAH cost more than MAX_SAH_COST_GROWTH times what it was when built, the
+    /// tree is rebuilt instead, with the same method as before. Spatial split trees can't be
+    /// refit, and have to be built again.
+    /// @param primitives Bounds of every primitive, with the moved ones updated.
+    /// @param moved Indices of the primitives which moved.
+    /// @return True if the tree was rebuilt.
+    bool refit(std::span<const BoundingBox> primitives, std::span<const uint32_t> moved);
+    /// @brief Write the tree to a file, to be loaded instead of built next time.
+    /// @param key Hash of whatever the tree was built from, ie: the geometry and its transforms.
+    /// @return False if the file couldn't be written.
+    /// @details The file holds the binary and wide nodes just as they are laid out in memory, and
+    /// refer to each other and to primitives by index only, so loading needs no parsing or fixing
+    /// up. Files are only meant to be read back on the same kind of machine, by the same build.
+    bool save(const std::filesystem::path& file, uint64_t key) const;
+    /// @brief Load a tree saved by save(), in place of building it.
+    /// @param key Hash of whatever the tree should be built from now.
+    /// @return False, leaving the tree as it was, if the file is missing or unreadable, or was
+    /// saved with another key, node width or layout. The tree should then be built.
+    /// @details The file is memory mapped and its nodes copied straight out, since trees are
+    /// refit in place when shapes move, which a read only mapping wouldn't allow.
+    bool load(const std::filesystem::path& file, uint64_t key);
+    /// @brief How many times over the SAH cost of the tree has grown through refits since it was built.
+    [[nodiscard]] inline double getSAHCostGrowth() const
+                                { return builtSAHCost > 0. ? binary.getSAHCost() / builtSAHCost : 1.; }
+    /// @brief Visit the primitives in every leaf a ray passes through, nearest leaves first.
+    /// @param visit Called as visit(primitiveIndex, tFar), and may shrink tFar.
+    template<typename Visit>
+    void traverse(const Ray& ray, Visit&& visit) const
+    {
+        if (width == NodeWidth::eight)
+            wide8.traverse(ray, visit);
+        else
+            wide4.traverse(ray, visit);
+    }
+    /// @brief Visit every leaf a ray passes through, nearest first (see WideBVH::traverseLeaves()).
+    template<typename VisitLeaf>
+    void traverseLeaves(const Ray& ray, VisitLeaf&& visitLeaf) const
+    {
+        if (width == NodeWidth::eight)
+            wide8.traverseLeaves(ray, visitLeaf);
+        else
+            wide4.traverseLeaves(ray, visitLeaf);
+    }
+    /// @brief Visit the primitives in every leaf which any lane of a packet passes through.
+    template<size_t N, typename Visit>
+    void traversePacket(const RayPacket<N>& packet, const PacketHit<N>& hits, Visit&& visit) const
+    {
+        binary.traversePacket(packet, hits, visit);
+    }
+
+    [[nodiscard]] inline NodeWidth getWidth() const { return width; }
+    [[nodiscard]] inline BuildMethod getMethod() const { return method; }
+    [[nodiscard]] inline const BinaryBVH& getBinary() const { return binary; }
+    [[nodiscard]] inline bool isEmpty() const { return binary.isEmpty(); }
+
+    /// refits may degrade the tree's SAH cost by this factor before it is rebuilt
+    static constexpr double MAX_SAH_COST_GROWTH{ 1.5 };
+
+  private:
+    /// @brief Collapse the binary tree into the wide tree matching the node width.
+    void collapse();
+
+    NodeWidth width;
+    BuildMethod method{ BuildMethod::sah };
+    double builtSAHCost{};
+    BinaryBVH binary;
+    WideBVH<4> wide4;
+    WideBVH<8> wide8;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Traversal
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename Visit>
+void BinaryBVH::traverse(const Ray& ray, Visit&& visit) const
+{
+    if (nodes.empty())
+        return;
+    double tFar = ray.getTMax();
+    StaticVector<uint32_t, MAX_DEPTH + 2> stack{};
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        const BinaryNode& node = nodes[index];
+        if (!node.bounds.intersects(ray, tFar))
+            continue;
+        if (node.isLeaf())
+        {
+            for (uint32_t i{ node.offset }; i < node.offset + node.count; ++i)
+                visit(primitives[i], tFar);
+            continue;
+        }
+        // the child on the side the ray comes from is nearer; it goes on top of the stack
+        if (ray.isNegative(node.axis))
+        {
+            stack.push_back(index + 1);
+            stack.push_back(node.offset);
+        }
+        else
+        {
+            stack.push_back(node.offset);
+            stack.push_back(index + 1);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t N, typename Visit>
+void BinaryBVH::traversePacket(const RayPacket<N>& packet, const PacketHit<N>& hits,
+                               Visit&& visit) const
+{
+    if (nodes.empty() || packet.active == 0)
+        return;
+    // the rays of a packet are coherent, so one lane's direction orders the children for all of them
+    const size_t lane = static_cast<size_t>(std::countr_zero(packet.active));
+    const bool isNegative[3]{ packet.idx[lane] < 0., packet.idy[lane] < 0., packet.idz[lane] < 0. };
+    StaticVector<uint32_t, MAX_DEPTH + 2> stack{};
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        const BinaryNode& node = nodes[index];
+        if (Packet::intersectBox(node.bounds, packet, hits) == 0)
+            continue;
+        if (node.isLeaf())
+        {
+            for (uint32_t i{ node.offset }; i < node.offset + node.count; ++i)
+                visit(primitives[i]);
+            continue;
+        }
+        if (isNegative[node.axis])
+        {
+            stack.push_back(index + 1);
+            stack.push_back(node.offset);
+        }
+        else
+        {
+            stack.push_back(node.offset);
+            stack.push_back(index + 1);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t W>
+template<typename VisitLeaf>
+void WideBVH<W>::traverseLeaves(const Ray& ray, VisitLeaf&& visitLeaf) const
+{
+    if (nodes.empty())
+        return;
+    // a child still to be visited; leaves are pushed too, so that they are visited in order
+    struct Entry
+    {
+        uint32_t child, count;
+        float tNear;
+    };
+    // single precision has ~3 ulps of error in each slab distance, so the far limit is widened to
+    //  keep the test conservative
+    constexpr float FAR_SLACK{ 1.f + 4.f * std::numeric_limits<float>::epsilon() };
+    const FloatRay floatRay{ ray };
+    double tFar = ray.getTMax();
+    StaticVector<Entry, (W - 1) * (BinaryBVH::MAX_DEPTH + 1) + 1> stack{};
+    stack.push_back({ 0, 0, -std::numeric_limits<float>::infinity() });
+    while (!stack.empty())
+    {
+        const Entry entry = stack.back();
+        stack.pop_back();
+        if (entry.tNear > tFar)
+            continue;
+        if (entry.count > 0)
+        {
+            visitLeaf(entry.child, entry.count, tFar);
+            continue;
+        }
+        const WideNode<W>& node = nodes[entry.child];
+        alignas(32) float tNear[W];
+        LaneMask hits = intersectWideNode(node, floatRay, static_cast<float>(tFar) * FAR_SLACK, tNear);
+        // push the children hit from furthest to nearest, so the nearest is visited first
+        Entry sorted[W];
+        size_t nSorted{};
+        while (hits != 0)
+        {
+            const auto i = static_cast<size_t>(std::countr_zero(hits));
+            hits &= hits - 1;
+            Entry e{ node.child[i], node.count[i], tNear[i] };
+            size_t j{ nSorted++ };
+            for (; j > 0 && sorted[j - 1].tNear < e.tNear; --j)
+                sorted[j] = sorted[j - 1];
+            sorted[j] = e;
+        }
+        for (size_t i{}; i < nSorted; ++i)
+            stack.push_back(sorted[i]);
+    }
+}
+}
@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Morton Codes
+///     Morton (Z-order) codes and the parallel radix sort used by linear BVH builds
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace rt::Accel::Morton
+{
+/// @brief Interleave the low 10 bits of each coordinate into a 30 bit code, x in the highest bit.
+constexpr uint32_t encode30(uint32_t x, uint32_t y, uint32_t z)
+{
+    const auto spread = [](uint32_t v) {
+        v &= 0x3FF;
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    };
+    return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+/// @brief Interleave the low 21 bits of each coordinate into a 63 bit code, x in the highest bit.
+constexpr uint64_t encode63(uint32_t x, uint32_t y, uint32_t z)
+{
+    const auto spread = [](uint64_t v) {
+        v &= 0x1FFFFF;
+        v = (v | (v << 32)) & 0x001F00000000FFFF;
+        v = (v | (v << 16)) & 0x001F0000FF0000FF;
+        v = (v | (v << 8)) & 0x100F00F00F00F00F;
+        v = (v | (v << 4)) & 0x10C30C30C30C30C3;
+        v = (v | (v << 2)) & 0x1249249249249249;
+        return v;
+    };
+    return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+/// @brief The axis a bit of a Morton code subdivides: 0 for x, 1 for y and 2 for z.
+constexpr uint8_t axisOfBit(size_t bit) { return static_cast<uint8_t>(2 - bit % 3); }
+
+/// @brief A primitive's Morton code, paired with the primitive so it can be found after sorting.
+template<typename Code>
+struct Key
+{
+    Code code;
+    uint32_t primitive;
+};
+
+/// @brief Stable LSD radix sort of keys by their code, eight bits per pass.
+/// @param nBits Only the lowest nBits of each code are sorted on.
+/// @param nThreads Threads to sort with. Each pass histograms and then scatters one slice of the
+/// keys per thread.
+/// @details Passes where every key has the same digit are skipped.
+template<typename Code>
+void radixSort(std::vector<Key<Code>>& keys, size_t nBits, size_t nThreads);
+}
@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Parallel Loops
+///     Fanning work out over threads, for building and refitting acceleration structures
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace rt::Accel::Parallel
+{
+/// inputs are only split between threads when each thread gets at least this many items
+constexpr size_t MIN_ITEMS_PER_THREAD{ 1 << 14 };
+
+/// @brief Threads to work on nItems items with, given the number requested (0 for all of them).
+inline size_t getThreadCount(size_t requested, size_t nItems)
+{
+    const size_t available = requested > 0 ? requested
+                                           : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    return std::clamp<size_t>(nItems / MIN_ITEMS_PER_THREAD, 1, available);
+}
+
+/// @brief Run task(i) for every i in [0, nTasks), handing the tasks out to nThreads threads. The
+/// calling thread is one of them, and every task has finished when this returns.
+template<typename Task>
+void forEach(size_t nThreads, size_t nTasks, Task&& task)
+{
+    nThreads = std::min(nThreads, nTasks);
+    if (nThreads <= 1)
+    {
+        for (size_t i{}; i < nTasks; ++i)
+            task(i);
+        return;
+    }
+    std::atomic<size_t> next{ 0 };
+    const auto work = [&]() {
+        for (size_t i{ next++ }; i < nTasks; i = next++)
+            task(i);
+    };
+    std::vector<std::jthread> threads;
+    threads.reserve(nThreads - 1);
+    for (size_t t{ 1 }; t < nThreads; ++t)
+        threads.emplace_back(work);
+    work();
+}
+
+/// @brief The [begin, end) range of the i'th of n even slices of nItems items.
+inline std::pair<size_t, size_t> getSlice(size_t nItems, size_t i, size_t n)
+{
+    return { nItems * i / n, nItems * (i + 1) / n };
+}
+}
@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Shape BVHs
+///     Acceleration structures over the shapes in a World or Group
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "raytracer/accel/bvh.hpp"
+#include "raytracer/accel/triangles.hpp"
+#include "raytracer/renderer/intersection.hpp"
+
+namespace rt
+{
+class Shape;
+}
+
+namespace rt::Accel
+{
+/// @brief How much effort goes into building the trees over shapes.
+enum class BuildQuality : uint8_t
+{
+    fast,   /// SAH builds, or linear builds for long lists: quick to rebuild, for interactive renders
+    high    /// spatial split builds: slow to build, but fewer steps per ray through long, thin triangles
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A BVH over a list of shapes, using the bounds of each shape in its parent's space.
+/// @details The tree is built on first use, and rebuilt on the next use after invalidate(). When
+/// shapes only move, the tree is refit to their new bounds instead, until refitting has degraded it
+/// enough that it is rebuilt (see BVH::refit()). Shapes
+/// without finite bounds (ie: planes) can't go in the tree, so they are always tested. Short lists
+/// of shapes aren't worth a tree, and are tested one by one, while long lists (ie: large meshes)
+/// are built with the linear builder, so that edits don't stall the next frame. At high quality,
+/// trees are built with spatial splits instead, and are rebuilt rather than refit when shapes move.
+///
+/// Building is thread safe, so many threads may trace through the same shapes. Copies start out
+/// unbuilt, and build their own tree when first used.
+class ShapeBVH
+{
+  public:
+    /// @brief How the tree finds out which of its shapes have moved.
+    enum class MoveTracking : uint8_t
+    {
+        notified,   /// shapes call markMoved(), ie: through their parent Group
+        checked     /// each shape is checked whenever any Shape has moved, for shapes with no parent
+    };
+
+    explicit ShapeBVH(MoveTracking tracking = MoveTracking::notified) : tracking(tracking) {}
+    ShapeBVH(const ShapeBVH& other) : tracking(other.tracking), quality(other.quality) {}
+    ShapeBVH& operator=(const ShapeBVH&) { invalidate(); return *this; }
+
+    /// @brief Forget the tree, ie: after shapes are added. It is rebuilt on next use.
+    inline void invalidate() { isBuilt.store(false, std::memory_order_release); }
+    /// @brief Set how the tree is built. It is rebuilt on next use if the quality changes.
+    inline void setQuality(BuildQuality newQuality)
+    {
+        if (newQuality == quality)
+            return;
+        quality = newQuality;
+        invalidate();
+    }
+    [[nodiscard]] inline BuildQuality getQuality() const { return quality; }
+    /// @brief Cache the tree in a file: it is loaded from there instead of built, so long as it was
+    /// saved from the same shapes, and saved there whenever it is built. Refits aren't saved.
+    /// @details The cache is keyed on the content hash of every shape in the tree, in order, and
+    /// on the build quality, so editing or moving any shape means the tree is built afresh.
+    inline void setCacheFile(const std::filesystem::path& file)
+    {
+        std::scoped_lock lock{ m_build };
+        cacheFile = file;
+    }
+    /// @brief Note that one of the shapes has moved, so that it is refit on next update().
+    void markMoved(Shape& shape);
+    /// @brief Bring the tree up to date with the shapes: build it if it was invalidated, or else
+    /// refit the shapes which have moved.
+    void update(std::span<Shape* const> shapes);
+    [[nodiscard]] inline bool isBuiltNow() const { return isBuilt.load(std::memory_order_acquire); }
+    /// @brief True when the tree is built, and none of its shapes have been marked as moved since.
+    [[nodiscard]] inline bool isUpToDate() const
+                                 { return isBuiltNow() && !hasMoves.load(std::memory_order_acquire); }
+    /// @brief The bounds of every shape together, as of the last update().
+    [[nodiscard]] inline const BoundingBox& getBounds() const { return bounds; }
+    /// @brief Number of times the tree has been built from scratch, rather than refit.
+    [[nodiscard]] inline size_t getBuildCount() const { return nBuilds; }
+    /// @brief Number of times the tree was loaded from its cache file, rather than built.
+    [[nodiscard]] inline size_t getLoadCount() const { return nLoads; }
+    [[nodiscard]] inline const BVH& getBVH() const { return bvh; }
+
+    /// @brief Visit every shape whose bounds a ray passes through, once each. Shapes in the tree
+    /// are visited nearest first, after the listed shapes.
+    /// @param visit Called as visit(shape, tFar), and may shrink tFar to skip further shapes.
+    template<typename Visit>
+    void forEachShape(const Ray& ray, Visit&& visit) const
+    {
+        double tFar = ray.getTMax();
+        if (listedBounds.intersects(ray))
+        {
+            for (auto s: listed)
+                visit(s, tFar);
+        }
+        Ray culled{ ray };
+        culled.setRange(ray.getTMin(), tFar);
+        if (isSplit.empty())
+        {
+            bvh.traverse(culled, [&](uint32_t i, double& tFarTree) { visit(bounded[i], tFarTree); });
+            return;
+        }
+        // spatial splits leave some shapes in several leaves, but they are only visited the first time
+        VisitedSet visited{};
+        bvh.traverse(culled, [&](uint32_t i, double& tFarTree) {
+            if (!isSplit[i] || visited.insert(i))
+                visit(bounded[i], tFarTree);
+        });
+    }
+    /// @brief Visit every shape whose bounds a ray passes through, as above, except that leaves
+    /// holding only triangles test them all at once, with the watertight SIMD kernel, rather than
+    /// visiting each one.
+    /// @param tNear Triangle hits nearer than this are ignored.
+    /// @param visit Called as visit(shape, tFar) for shapes outside the triangle leaves.
+    /// @param hitTriangle Called as hitTriangle(hit, tFar) for each triangle in a triangle leaf which
+    /// the ray hits, from tNear up to tFar. Both may shrink tFar to skip further shapes.
+    template<typename Visit, typename HitTriangle>
+    void forEachShape(const Ray& ray, double tNear, Visit&& visit, HitTriangle&& hitTriangle) const
+    {
+        if (packs.empty())
+        {
+            forEachShape(ray, visit);
+            return;
+        }
+        double tFar = ray.getTMax();
+        if (listedBounds.intersects(ray))
+        {
+            for (auto s: listed)
+                visit(s, tFar);
+        }
+        Ray culled{ ray };
+        culled.setRange(ray.getTMin(), tFar);
+        const WatertightRay watertight{ ray };
+        const auto& references = bvh.getBinary().getPrimitiveIndices();
+        VisitedSet visited{};
+        // split triangles are only hit once, too
+        const auto isFirstVisit = [&](uint32_t i) { return isSplit.empty() || !isSplit[i] || visited.insert(i); };
+        bvh.traverseLeaves(culled, [&](uint32_t first, uint32_t count, double& tFarTree) {
+            const uint32_t pack = packAt[first];
+            if (pack == NO_PACK)
+            {
+                for (uint32_t r{ first }; r < first + count; ++r)
+                {
+                    if (isFirstVisit(references[r]))
+                        visit(bounded[references[r]], tFarTree);
+                }
+                return;
+            }
+            alignas(32) double t[PACK_WIDTH], u[PACK_WIDTH], v[PACK_WIDTH];
+            LaneMask hits = intersectTrianglePack(packs[pack], watertight, tNear, tFarTree, t, u, v);
+            while (hits != 0)
+            {
+                const auto lane = static_cast<size_t>(std::countr_zero(hits));
+                hits &= hits - 1;
+                const uint32_t i = references[first + lane];
+                if (isFirstVisit(i))
+                    hitTriangle(Intersection{ t[lane], bounded[i], u[lane], v[lane] }, tFarTree);
+            }
+        });
+    }
+    /// @brief Visit every shape whose bounds any lane of a packet passes through.
+    /// @param visit Called as visit(shape). It may record closer hits, which cull further shapes.
+    /// Shapes split between several leaves may be visited more than once, which only repeats hits
+    /// which are already recorded.
+    template<size_t N, typename Visit>
+    void forEachShape(const RayPacket<N>& packet, const PacketHit<N>& hits, Visit&& visit) const
+    {
+        if (Packet::intersectBox(listedBounds, packet, hits) != 0)
+        {
+            for (auto s: listed)
+                visit(s);
+        }
+        bvh.traversePacket(packet, hits, [&](uint32_t i) { visit(bounded[i]); });
+    }
+
+    /// triangle leaves are tested in packs as wide as the largest leaf
+    static constexpr size_t PACK_WIDTH{ BinaryBVH::MAX_LEAF_SIZE };
+    static constexpr uint32_t NO_PACK{ 0xFFFFFFFF };
+    /// lists shorter than this are tested one by one, without a tree
+    static constexpr size_t MIN_SHAPES_FOR_TREE{ 8 };
+    /// lists at least this long are built with the linear (Morton code) builder, rather than the SAH
+    static constexpr size_t MIN_SHAPES_FOR_LINEAR_BUILD{ 1 << 16 };
+
+  private:
+    /// @brief The shapes already visited by one traversal.
+    class VisitedSet
+    {
+      public:
+        /// @return False if the shape was visited already.
+        inline bool insert(uint32_t i)
+        {
+            if (std::find(recent.begin(), recent.end(), i) != recent.end()
+                || std::find(more.begin(), more.end(), i) != more.end())
+                return false;
+            if (recent.size() < recent.capacity())
+                recent.push_back(i);
+            else
+                more.push_back(i);
+            return true;
+        }
+
+      private:
+        StaticVector<uint32_t, 32> recent{};
+        std::vector<uint32_t> more{};  /// overflow, for rays passing through a great many shapes
+    };
+
+    void build(std::span<Shape* const> shapes);
+    /// @brief Refit the moved shapes, or rebuild the tree if one of them can no longer go in it.
+    void refit(std::span<Shape* const> shapes);
+    /// @brief Build the tree over the bounded shapes, or load it from the cache file.
+    void buildTree();
+    /// @brief Gather the corners of the triangles in each leaf holding nothing else into packs.
+    void packTriangles();
+    /// @brief Find the shapes which spatial splits left in more than one leaf.
+    void findSplitShapes();
+    /// @brief Find the bounds of the listed shapes, alone and with the tree's.
+    void boundListed();
+
+    MoveTracking tracking;
+    BuildQuality quality{ BuildQuality::fast };
+    BVH bvh{};
+    std::vector<Shape*> bounded;        /// shapes in the tree, by primitive index
+    std::vector<BoundingBox> boxes;     /// bounds of the shapes in the tree, by primitive index
+    std::vector<uint8_t> isSplit;       /// shapes in more than one leaf, or empty if there are none
+    std::vector<TrianglePack<PACK_WIDTH>> packs;  /// corners of the triangles in each triangle leaf
+    std::vector<uint32_t> packAt;       /// pack of the leaf starting at each primitive reference, if any
+    std::vector<uint32_t> packSlotOf;   /// pack * PACK_WIDTH + lane of each packed shape, for refits
+    std::vector<Shape*> listed;         /// shapes which are tested one by one
+    BoundingBox listedBounds{};         /// bounds of all the listed shapes together, for culling
+    BoundingBox bounds{};               /// bounds of every shape together
+    std::vector<Shape*> moved;          /// shapes to refit on next update
+    std::vector<uint32_t> movedPrimitives;
+    size_t nBuilds{};
+    size_t nLoads{};
+    std::filesystem::path cacheFile{};  /// where the tree is cached, or empty for no cache
+    std::atomic<uint64_t> seenMoveCount{ 0 };   /// Shape::getMoveCount() when shapes were last checked
+    std::atomic<bool> isBuilt{ false };
+    std::atomic<bool> hasMoves{ false };
+    std::mutex m_build;
+};
+}
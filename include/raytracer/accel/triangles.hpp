@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Triangle kernels
+///     Watertight ray-triangle tests, one triangle at a time or several at once
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+
+#include "raytracer/math/tuples.hpp"
+#include "raytracer/renderer/ray.hpp"
+#include "raytracer/renderer/ray_packet.hpp"
+
+namespace rt::Accel
+{
+/// @brief A ray set up for watertight triangle tests (Woop, Benthin & Wald 2013).
+/// @details The axes are permuted so that the ray travels furthest along z, and triangles are
+/// sheared so that the ray runs straight down it. Each test is then a 2D point in triangle test at
+/// the origin, whose edge functions are computed the same way for both triangles sharing an edge,
+/// so rays through shared edges and vertices never slip between them.
+struct WatertightRay
+{
+    explicit WatertightRay(const Ray& ray);
+
+    double origin[3];
+    uint8_t kx, ky, kz;     /// the ray's direction is largest along kz
+    double sx, sy, sz;      /// shear taking the ray's direction onto the z axis
+};
+
+/// @brief Where a ray hits a triangle.
+struct TriangleHit
+{
+    double t;
+    double u, v;    /// barycentric coordinates of the second and third corners, as Moller-Trumbore's
+};
+
+/// @brief Watertight test of a ray against a triangle. Both faces of the triangle are hit.
+/// @param tNear Hits nearer than this are ignored.
+/// @param tFar Hits this far or further are ignored.
+/// @return True, filling in the hit, if the ray hits the triangle in range.
+bool intersectTriangle(const WatertightRay& ray, const Tuple& p1, const Tuple& p2, const Tuple& p3,
+                       double tNear, double tFar, TriangleHit& hit);
+
+/// @brief The corners of up to W triangles, in SoA layout, so one ray can be tested against them
+/// all at once with SIMD instructions.
+/// @details Unused lanes are left degenerate, at the origin, and never report hits.
+template<size_t W>
+struct TrianglePack
+{
+    static_assert(W == 4 || W == 8, "triangle packs are 4 or 8 triangles wide");
+
+    /// @brief Put a triangle in a lane.
+    void set(size_t lane, const Tuple& p1, const Tuple& p2, const Tuple& p3)
+    {
+        for (size_t axis{}; axis < 3; ++axis)
+        {
+            a[axis][lane] = p1(axis);
+            b[axis][lane] = p2(axis);
+            c[axis][lane] = p3(axis);
+        }
+    }
+
+    alignas(32) double a[3][W]{};   /// [axis][lane]: first corners...
+    alignas(32) double b[3][W]{};   /// ...second corners...
+    alignas(32) double c[3][W]{};   /// ...and third corners
+    uint32_t count{};               /// lanes in use
+};
+
+/// @brief Watertight test of a ray against every triangle of a pack at once.
+/// @param tNear Hits nearer than this are ignored.
+/// @param tFar Hits this far or further are ignored.
+/// @param t, u, v Where the ray hits each triangle in the returned mask, by lane.
+/// @return The lanes whose triangles the ray hits.
+/// @details Uses AVX2 when the CPU has it, and plain C++ otherwise.
+LaneMask intersectTrianglePack(const TrianglePack<4>& pack, const WatertightRay& ray, double tNear,
+                               double tFar, double* t, double* u, double* v);
+LaneMask intersectTrianglePack(const TrianglePack<8>& pack, const WatertightRay& ray, double tNear,
+                               double tFar, double* t, double* u, double* v);
+}
@@ -0,0 +1,128 @@
+/**
+ *
+ *  Raytracer Lib
+ *
+ *  @file mpsc_queue.hpp
+ *  @brief Bounded, lock free queue for many producer threads and a single consumer
+ *  @author Stacy Gaudreau
+ *  @date 2026.10.18
+ *
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "raytracer/common/macros.hpp"
+
+namespace rt {
+
+/**
+ * @brief Bounded queue which any number of threads push to, and a single thread consumes.
+ * @details Each slot carries a sequence number (after Vyukov's bounded queue), so producers
+ * claim slots with a single CAS on the tail and never wait on one another. The consumer sees a
+ * slot once its producer has finished writing it; a slot claimed but still being written hides
+ * the slots after it until it is done, so the queue may briefly look empty to the consumer.
+ */
+template<typename T>
+class MPSCQueue {
+public:
+    /**
+     * @param capacity most items the queue holds, rounded up to a power of two
+     */
+    explicit MPSCQueue(size_t capacity) : capacity(std::bit_ceil(std::max<size_t>(capacity, 2))),
+                                          mask(this->capacity - 1),
+                                          slots(std::make_unique<Slot[]>(this->capacity)) {
+        for (size_t i{ }; i < this->capacity; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~MPSCQueue() {
+        while (front() != nullptr) {
+            pop();
+        }
+    }
+
+    /**
+     * @brief Push an item, from any thread
+     * @return false if the queue is full, leaving the item untouched
+     */
+    template<typename... Args>
+    bool try_emplace(Args&&... args) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & mask];
+            const auto sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        std::construct_at(slot->item(), std::forward<Args>(args)...);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool try_push(T&& item) { return try_emplace(std::move(item)); }
+    bool try_push(const T& item) { return try_emplace(item); }
+
+    /**
+     * @brief Get the oldest item, or nullptr if there is none. Consumer thread only.
+     */
+    T* front() {
+        auto& slot = slots[head & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1) return nullptr;
+        return slot.item();
+    }
+    /**
+     * @brief Remove the oldest item, which must exist. Consumer thread only.
+     */
+    void pop() {
+        auto& slot = slots[head & mask];
+        ASSERT(slot.sequence.load(std::memory_order_acquire) == head + 1, "pop() on an empty MPSCQueue");
+        std::destroy_at(slot.item());
+        // the slot is free again for the producer which comes round to it on the next lap
+        slot.sequence.store(head + capacity, std::memory_order_release);
+        ++head;
+    }
+    /**
+     * @brief True if the consumer has nothing ready to take. Consumer thread only.
+     */
+    bool empty() {
+        return front() == nullptr;
+    }
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+PRIVATE_IN_PRODUCTION
+    struct Slot {
+        std::atomic<size_t> sequence{ };
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* item() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> tail{ }; // next slot to claim
+    alignas(64) size_t head{ }; // next slot to consume
+
+DELETE_COPY_AND_MOVE(MPSCQueue)
+};
+
+}
@@ -0,0 +1,92 @@
+/**
+ *
+ *  Raytracer Lib
+ *
+ *  @file static_vector.hpp
+ *  @brief A vector with a fixed capacity, stored inline without any heap allocation
+ *  @author Stacy Gaudreau
+ *  @date 2026.10.18
+ *
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "raytracer/common/macros.hpp"
+
+namespace rt {
+
+/**
+ * @brief A vector with a compile time capacity, whose elements live inside the object itself.
+ * @details Used for the small, short lived stacks on the shading path (ie: ray trees and refraction
+ * stacks), where a std::vector would hit the allocator for every pixel. Elements need not be
+ * default constructible, since storage is only constructed as elements are pushed.
+ */
+template<typename T, size_t N>
+class StaticVector
+{
+  public:
+    StaticVector() = default;
+    StaticVector(const StaticVector& other) { for (const auto& e: other) push_back(e); }
+    StaticVector& operator=(const StaticVector& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            for (const auto& e: other)
+                push_back(e);
+        }
+        return *this;
+    }
+    ~StaticVector() { clear(); }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        ASSERT(count < N, "StaticVector is full");
+        return *std::construct_at(data() + count++, std::forward<Args>(args)...);
+    }
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+    void pop_back()
+    {
+        ASSERT(count > 0, "pop_back() on an empty StaticVector");
+        std::destroy_at(data() + --count);
+    }
+    /// @brief Remove the element at index, shifting any later elements down to fill the gap.
+    void erase(size_t index)
+    {
+        ASSERT(index < count, "erase() index out of range");
+        for (size_t i{ index }; i + 1 < count; ++i)
+            data()[i] = std::move(data()[i + 1]);
+        pop_back();
+    }
+    void clear() { while (count > 0) pop_back(); }
+
+    [[nodiscard]] inline T& back() { return data()[count - 1]; }
+    [[nodiscard]] inline const T& back() const { return data()[count - 1]; }
+    [[nodiscard]] inline T& operator[](size_t i) { return data()[i]; }
+    [[nodiscard]] inline const T& operator[](size_t i) const { return data()[i]; }
+    [[nodiscard]] inline size_t size() const { return count; }
+    [[nodiscard]] inline bool empty() const { return count == 0; }
+    [[nodiscard]] static constexpr size_t capacity() { return N; }
+
+    inline T* begin() { return data(); }
+    inline T* end() { return data() + count; }
+    inline const T* begin() const { return data(); }
+    inline const T* end() const { return data() + count; }
+
+  private:
+    inline T* data() { return std::launder(reinterpret_cast<T*>(storage)); }
+    inline const T* data() const { return std::launder(reinterpret_cast<const T*>(storage)); }
+
+    alignas(T) std::byte storage[N * sizeof(T)];
+    size_t count{ 0 };
+};
+
+}
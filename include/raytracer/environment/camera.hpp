@@ -12,6 +12,7 @@
 
 #include "raytracer/math/matrix.hpp"
 #include "raytracer/renderer/ray.hpp"
+#include "raytracer/renderer/ray_packet.hpp"
 #include "raytracer/environment/world.hpp"
 #include "raytracer/renderer/canvas.hpp"
 
@@ -36,12 +37,34 @@ class Camera
     /// @param pixelX x coordinate on the camera canvas the ray will pass through.
     /// @param pixelY y coordinate on the camera canvas the ray will pass through.
     Ray getRayForCanvasPixel(uint32_t pixelX, uint32_t pixelY);
+    /// @brief Generate a packet of rays for a block of neighbouring pixels, which is
+    /// RayPacket::BLOCK_WIDTH x RayPacket::BLOCK_HEIGHT pixels in size, filled row by row.
+    /// Lanes for pixels past the edge of the canvas are left inactive.
+    /// @param pixelX x coordinate of the top left pixel of the block.
+    /// @param pixelY y coordinate of the top left pixel of the block.
+    template<size_t N>
+    RayPacket<N> getRayPacketForCanvasBlock(uint32_t pixelX, uint32_t pixelY)
+    {
+        RayPacket<N> packet{};
+        for (uint32_t dy{}; dy < RayPacket<N>::BLOCK_HEIGHT; ++dy)
+        {
+            for (uint32_t dx{}; dx < RayPacket<N>::BLOCK_WIDTH; ++dx)
+            {
+                const uint32_t x = pixelX + dx, y = pixelY + dy;
+                if (x < _hSize && y < _vSize)
+                    packet.setRay(dy * RayPacket<N>::BLOCK_WIDTH + dx, getRayForCanvasPixel(x, y));
+            }
+        }
+        return packet;
+    }
     /// @brief Set the transform matrix for the camera's position and orientation in worldspace.
     void setTransform(TransformationMatrix newTransform);
 
-    void setVSize(uint32_t vSize) noexcept { _vSize = vSize; }
+    /// @brief Resize the canvas, keeping the field of view. The pixels are resized to fit.
+    void setVSize(uint32_t vSize) noexcept { _vSize = vSize; updateProjection(); }
     [[nodiscard]] inline uint32_t getVSize() const noexcept { return _vSize; }
-    void setHSize(uint32_t hSize) noexcept { _hSize = hSize; }
+    /// @brief Resize the canvas, keeping the field of view. The pixels are resized to fit.
+    void setHSize(uint32_t hSize) noexcept { _hSize = hSize; updateProjection(); }
     [[nodiscard]] inline uint32_t getHSize() const noexcept { return _hSize; }
     [[nodiscard]] inline double getPixelSize() const noexcept { return pixelSize; }
     /// @brief Returns true when the camera has a horizontal aspect ratio. False if it is vertical.
@@ -50,6 +73,9 @@ class Camera
     [[nodiscard]] inline TransformationMatrix getTransform() const { return transform; }
 
   private:
+    /// @brief Work out the size of the canvas and its pixels, from its size in pixels and the FOV.
+    void updateProjection() noexcept;
+
     uint32_t _hSize, _vSize;
     double hSizeF, vSizeF;  // cached double versions of hSize/vSize
     double fieldOfView;
@@ -10,11 +10,16 @@
 #include <vector>
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <array>
+#include <filesystem>
 
 #include "raytracer/shapes/shape.hpp"
 #include "raytracer/environment/lighting.hpp"
 #include "raytracer/renderer/ray.hpp"
+#include "raytracer/renderer/ray_packet.hpp"
 #include "raytracer/renderer/intersection.hpp"
+#include "raytracer/accel/shape_bvh.hpp"
 
 
 namespace rt
@@ -25,35 +30,46 @@ namespace rt
 struct IntersectionState
 {
     /// @brief Encapsulate some pre-computed state about an intersection, for use in shading pixels.
-    IntersectionState(Intersection& i, Ray& ray, Intersections& xs);
+    /// @details Only the state every surface needs is computed up front. State which is only
+    /// used for reflection and refraction is computed on first use, so opaque surfaces never pay
+    /// for it. The intersection and list of intersections must outlive this state.
+    IntersectionState(const Intersection& i, const Ray& ray, const Intersections& xs);
     Shape& shape;
+    Instance* instance;  /// the Instance() the shape was hit through, if any
+    const Material& material;  /// the shape's material, or the Instance's standing in for it
     double t;
     Tuple point;
     Tuple eye;
     Tuple normal;
     bool isInsideShape;
     Tuple pointAboveSurface;    /// an offset version of main point, slightly above the surface.
-    Tuple pointBelowSurface;    /// the point where refracted rays will originate, slightly below the surface
-    Tuple vReflect{}; /// reflection vector
-    double n1{}, n2{};  /// refraction indices of materials on either side of the intersection
+    double footprint;   /// width of the ray's cone at the intersection, for filtering textures
+    double coneSpread;  /// growth of the ray's cone per unit distance, inherited by secondary rays
 
-  private:
-    std::vector<Shape*> refractedShapes;
+    /// @brief The point where refracted rays will originate, slightly below the surface.
+    [[nodiscard]] inline Tuple getPointBelowSurface() const { return point - (normal * EPSILON); }
+    /// @brief The ray's direction reflected about the surface normal.
+    [[nodiscard]] inline Tuple getReflectVector() const { return Vector::reflect(-eye, normal); }
+    /// @brief True if the surface's material is reflective.
+    [[nodiscard]] inline bool isReflective() const { return material.reflectivity > 0.0; }
+    /// @brief True if the surface's material is transparent.
+    [[nodiscard]] inline bool isTransparent() const { return !APPROX_EQ(material.transparency, 0.0); }
+    /// @brief Refractive index of the material the ray is leaving.
+    inline double getN1() { findRefractiveIndices(); return n1; }
+    /// @brief Refractive index of the material the ray is entering.
+    inline double getN2() { findRefractiveIndices(); return n2; }
 
-    inline int refractedShapesContains(Shape* _shape)
-    {
-        int indexOfShape{ -1 };
-        for (int i{}; i < static_cast<int>(refractedShapes.size()); ++i) {
-            if (refractedShapes[i] == _shape)
-            {
-                indexOfShape = i;
-                break;
-            }
-        }
-        return indexOfShape;
-    }
+    /// deepest nesting of shapes tracked when finding refractive indices
+    static constexpr size_t MAX_NESTED_SHAPES{ 32 };
 
-    inline void findRefractiveIndices(Intersection& i, Intersections& xs);
+  private:
+    const Intersection* hit;
+    const Intersections* xs;
+    bool hasRefractiveIndices{ false };
+    double n1{}, n2{};  /// refraction indices of materials on either side of the intersection
+
+    /// @brief Walk the intersections up to the hit, tracking which shapes the ray is inside of.
+    void findRefractiveIndices();
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -84,16 +100,40 @@ class World
     bool containsObject(const Shape& shape);
     /// @brief Get an Intersection for a given Ray(), which may or may not be a visible hit on an
     /// object's surface in the World.
-    inline Intersection getHitForRay(Ray ray) { return intersect(ray).findHit(); }
+    /// @details Only the closest hit is needed, so shapes lying beyond it are skipped.
+    Intersection getHitForRay(const Ray& ray);
     /// @brief Intersect this World() with a Ray() and return the sorted Intersections()
-    Intersections intersect(Ray ray);
+    Intersections intersect(const Ray& ray);
+    /// @brief Rebuild the World's BVH on next use, rather than refitting it to shapes which moved.
+    inline void invalidateBVH() { accel.invalidate(); }
+    /// @brief Set how the World's BVH and those of the shapes in it are built, ie: with spatial
+    /// splits for offline renders. Trees are only rebuilt, on next use, if the quality changes, and
+    /// shapes added later are built at the same quality. Not to be called while other threads are
+    /// tracing through the World, since they traverse its trees without locks.
+    void setBuildQuality(Accel::BuildQuality quality);
+    [[nodiscard]] inline Accel::BuildQuality getBuildQuality() const { return accel.getQuality(); }
+    /// @brief Save the World's BVH over its shapes to a file once built, and load it from there
+    /// rather than building it after a reload, as long as the shapes and their transforms are the
+    /// same. Large meshes should cache their own BVHs too (see Group::setBVHCache()).
+    inline void setBVHCache(const std::filesystem::path& file) { accel.setCacheFile(file); }
     /// @brief Compute shading at a given Intersection() with a Ray().
     inline Colour shadeIntersection(Intersection i, Ray ray, Intersections& xs, size_t nRaysRemain) {
         return shadeIntersectionState(IntersectionState{i, ray, xs}, nRaysRemain);
     }
     /// @brief Cast a Ray() into the world and compute a given pixel Colour() for it.
-    /// @details This is called color_at() in the book.
+    /// @details This is called color_at() in the book. The tree of reflected and refracted rays
+    /// is evaluated iteratively, with a fixed size stack, rather than by recursion. Branches
+    /// whose weight in the final pixel falls below MIN_RAY_WEIGHT are not traced.
     Colour traceRayToPixel(Ray ray, size_t nRaysRemain);
+    /// @brief Intersect this World() with a packet of rays, finding the closest hit in each lane.
+    template<size_t N>
+    void intersectPacket(const RayPacket<N>& packet, PacketHit<N>& hits);
+    /// @brief Cast a packet of camera rays into the world and compute a pixel Colour() for each.
+    /// @details Primary hits and their shadow rays are traced as packets. Lanes which hit a
+    /// reflective or transparent surface go on to spawn rays in different directions, so they
+    /// fall back to traceRayToPixel(). Inactive lanes are left black.
+    template<size_t N>
+    std::array<Colour, N> tracePacketToPixels(const RayPacket<N>& packet, size_t nRaysRemain);
     /// @brief Get whether a given Point() is in the shadow of any objects in the current World.
     bool isPointInShadow(Tuple point);
     /// @brief Get a reflected Colour pixel in the World.
@@ -107,9 +147,11 @@ class World
     {
         double cos = Tuple::dot(i.eye, i.normal);
         // total internal reflection occurs only if n1 > n2
-        if (i.n1 > i.n2)
+        const double n1 = i.getN1();
+        const double n2 = i.getN2();
+        if (n1 > n2)
         {
-            const double n = i.n1 / i.n2;
+            const double n = n1 / n2;
             const double sin2_t = n*n * (1.0 - cos*cos);
             if (sin2_t > 1.0)
                 return 1.0;
@@ -117,16 +159,41 @@ class World
             // when n1 > n2 we use cos_t instead of cos
             cos = cos_t;
         }
-        const double r = ((i.n1 - i.n2) / (i.n1 + i.n2));
+        const double r = ((n1 - n2) / (n1 + n2));
         const double r0 = r*r;
         const double cos_1 = (1 - cos);
         return r0 + (1 - r0) * cos_1 * cos_1 * cos_1 * cos_1 * cos_1;
     }
 
     static constexpr size_t MAX_RAYS{ 4 }; // max number of recursive rays to cast
+    /// rays which would add less than this fraction of their colour to a pixel are not traced;
+    ///  1/512 is half a step of an 8-bit colour channel
+    static constexpr double MIN_RAY_WEIGHT{ 1. / 512. };
+    /// capacity of the stack of pending rays. A depth first walk of a binary ray tree holds at
+    ///  most depth + 2 rays, so this also caps the depth of the tree.
+    static constexpr size_t MAX_TRACE_STACK{ 16 };
 
   private:
+    /// @brief How much of the reflected and refracted colours are added to a surface.
+    struct SecondaryWeights
+    {
+        double reflected, refracted;
+    };
+    /// @brief Light the surface at an intersection, without any reflection or refraction.
+    Colour shadeSurface(IntersectionState& iState);
+    /// @brief Light the surface at an intersection, when its shadowing is already known.
+    static Colour shadeSurface(IntersectionState& iState, const Light& light, bool isShadowed);
+    /// @brief Weights of the reflected and refracted rays, including the Fresnel effect.
+    static SecondaryWeights getSecondaryWeights(IntersectionState& iState);
+    /// @brief The ray reflected from an intersection.
+    static Ray getReflectedRay(IntersectionState& iState);
+    /// @brief The ray refracted through an intersection, or nothing for total internal reflection.
+    static std::optional<Ray> getRefractedRay(IntersectionState& iState);
+
     std::vector<std::shared_ptr<Light>> lights;
     std::vector<Shape*> objects;
+    /// BVH over the objects, built on first intersection. The objects have no parent Group to tell
+    ///  it when they move, so it checks them whenever any shape has moved.
+    Accel::ShapeBVH accel{ Accel::ShapeBVH::MoveTracking::checked };
 };
 }
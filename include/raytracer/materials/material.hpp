@@ -28,8 +28,9 @@ class Material
     /// Compare equality.
     friend bool operator== (const Material& a, const Material& b);
     /// @brief Apply lighting to this material and compute a single pixel from it.
+    /// @param footprint Width of the shaded area in shape space, used to filter image patterns.
     Colour lightPixel(Light lighting, Tuple pWorld, Tuple pShape,
-                      Tuple vEye, Tuple vNormal, bool isShadowed=false);
+                      Tuple vEye, Tuple vNormal, bool isShadowed=false, double footprint=0.0) const;
 
     inline void setPattern(Pattern* newPattern) { pattern = newPattern; }
     [[nodiscard]] inline bool hasPattern() const { return pattern != nullptr; }
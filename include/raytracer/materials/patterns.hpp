@@ -7,37 +7,99 @@
 
 #pragma once
 
+#include <cmath>
+#include <cstdint>
+#include <span>
+
 #include "raytracer/renderer/colour.hpp"
 #include "raytracer/math/tuples.hpp"
 #include "raytracer/math/matrix.hpp"
 
 namespace rt
 {
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief The closed set of built-in pattern types.
+/// @details Built-in patterns are evaluated by switching on their type, so shading never pays for a
+/// virtual call. Only custom (user-derived) patterns are dispatched through colourAt().
+enum class PatternType : uint8_t
+{
+    custom,
+    stripes,
+    gradient,
+    rings,
+    checkers,
+    blended,
+    image
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 class Pattern
 {
   public:
-    Pattern(Colour a, Colour b);
+    Pattern(Colour a, Colour b, PatternType type = PatternType::custom);
+    /// @brief Construct a nested pattern, where each of a and b is itself a pattern. Nested
+    /// patterns are evaluated in this pattern's space, and then apply their own transform.
+    Pattern(Pattern* a, Pattern* b, PatternType type = PatternType::custom);
+    virtual ~Pattern() = default;
     /// @brief Get the pattern's colour at a given point in pattern space.
-    virtual Colour colourAt(Tuple point) = 0;
+    virtual Colour colourAt(Tuple point);
     /// @brief Get the pattern's colour at a given point in a shape's object space.
-    Colour colourAtShape(Tuple pShape);
+    /// @param footprint Width of the area being shaded, in shape space. Image patterns use it to
+    /// filter their lookups; 0 samples them at full detail.
+    Colour colourAtShape(Tuple pShape, double footprint = 0.);
+    /// @brief Get the pattern's colour at a whole batch of points in a shape's object space.
+    /// @param pShape Points in shape object space.
+    /// @param out Output colours, one for each point.
+    void colourAtShape(const TupleBatch& pShape, std::span<Colour> out);
     /// @brief Set the transformation applied to the pattern.
     inline void setTransform(TransformationMatrix newTransform)
     {
         transform = newTransform;
         inverseTransform = newTransform.inverse();
+        hasTransform = !(newTransform == TransformationMatrix::identity());
+        // average scale of the inverse transform, for taking footprints into pattern space
+        footprintScale = std::cbrt(std::abs(inverseTransform.determinant()));
     }
     /// @brief Get the transformation matrix applied to this pattern.
     inline const TransformationMatrix& getTransform() { return transform; };
     /// @brief Get the inverse of the transformation matrix applied to this pattern.
     inline const TransformationMatrix& getInverseTransform() { return inverseTransform; };
+    /// @brief Get which of the closed set of pattern types this is.
+    [[nodiscard]] inline PatternType getType() const { return type; }
+    /// @brief Nest a pair of patterns in place of this pattern's a and b colours.
+    inline void setNested(Pattern* newA, Pattern* newB) { nestedA = newA; nestedB = newB; }
+    [[nodiscard]] inline bool isNested() const { return nestedA != nullptr || nestedB != nullptr; }
 
     Colour a, b;
 
   protected:
     TransformationMatrix transform;
     TransformationMatrix inverseTransform;
+    bool hasTransform{ false };     /// false when the transform is identity, to skip multiplying
+    double footprintScale{ 1. };    /// scales a shape space footprint into pattern space
+    Pattern* nestedA{ nullptr };    /// optional pattern used in place of colour a
+    Pattern* nestedB{ nullptr };    /// optional pattern used in place of colour b
+    PatternType type;
+
+  private:
+    /// @brief Non-virtual evaluation of a built-in pattern at a point in pattern space.
+    Colour evaluate(const Tuple& pPattern, double footprint = 0.);
+    /// @brief Non-virtual evaluation of a built-in pattern at a batch of points in pattern space.
+    void evaluateBatch(const TupleBatch& pPattern, std::span<Colour> out);
+    /// @brief Colour a (or nested pattern a) at a point in this pattern's space.
+    inline Colour colourA(const Tuple& p, double footprint = 0.)
+    {
+        return nestedA ? nestedA->colourAtShape(p, footprint) : a;
+    }
+    /// @brief Colour b (or nested pattern b) at a point in this pattern's space.
+    inline Colour colourB(const Tuple& p, double footprint = 0.)
+    {
+        return nestedB ? nestedB->colourAtShape(p, footprint) : b;
+    }
+    /// @brief Fill out with colour a or b (or their nested patterns) for a batch of points.
+    void colourABatch(const TupleBatch& p, std::span<Colour> out);
+    void colourBBatch(const TupleBatch& p, std::span<Colour> out);
 };
 
 
@@ -45,8 +107,8 @@ class Pattern
 class StripedPattern: public Pattern
 {
   public:
-    StripedPattern(Colour a, Colour b) : Pattern(a, b) {};
-    Colour colourAt(Tuple point) override;
+    StripedPattern(Colour a, Colour b) : Pattern(a, b, PatternType::stripes) {};
+    StripedPattern(Pattern* a, Pattern* b) : Pattern(a, b, PatternType::stripes) {};
 };
 
 
@@ -54,8 +116,8 @@ class StripedPattern: public Pattern
 class GradientPattern: public Pattern
 {
   public:
-    GradientPattern(Colour a, Colour b): Pattern(a, b) {};
-    Colour colourAt(Tuple point) override;
+    GradientPattern(Colour a, Colour b): Pattern(a, b, PatternType::gradient) {};
+    GradientPattern(Pattern* a, Pattern* b): Pattern(a, b, PatternType::gradient) {};
 };
 
 
@@ -63,15 +125,35 @@ class GradientPattern: public Pattern
 class RingPattern: public Pattern
 {
   public:
-    RingPattern(Colour a, Colour b): Pattern(a, b) {};
-    Colour colourAt(Tuple point) override;
+    RingPattern(Colour a, Colour b): Pattern(a, b, PatternType::rings) {};
+    RingPattern(Pattern* a, Pattern* b): Pattern(a, b, PatternType::rings) {};
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 class CheckersPattern: public Pattern
 {
   public:
-    CheckersPattern(Colour a, Colour b): Pattern(a, b) {};
-    Colour colourAt(Tuple point) override;
+    CheckersPattern(Colour a, Colour b): Pattern(a, b, PatternType::checkers) {};
+    CheckersPattern(Pattern* a, Pattern* b): Pattern(a, b, PatternType::checkers) {};
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class BlendedPattern: public Pattern
+{
+  public:
+    /// @brief Blend two patterns together. A weight of 0 is all a, and 1 is all b.
+    BlendedPattern(Pattern* a, Pattern* b, double weight = 0.5)
+    :   Pattern(a, b, PatternType::blended),
+        weight(weight) {};
+    /// @brief Blend two solid colours together.
+    BlendedPattern(Colour a, Colour b, double weight = 0.5)
+    :   Pattern(a, b, PatternType::blended),
+        weight(weight) {};
+
+    inline void setWeight(double newWeight) { weight = newWeight; }
+    [[nodiscard]] inline double getWeight() const { return weight; }
+
+  private:
+    double weight;
 };
-}
\ No newline at end of file
+}
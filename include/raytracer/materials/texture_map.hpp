@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Texture Maps
+///     Image textures, mipmapping and UV projections onto shapes
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "raytracer/materials/patterns.hpp"
+#include "raytracer/renderer/colour.hpp"
+#include "raytracer/math/tuples.hpp"
+
+namespace rt
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// UV mapping
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A 2D texture coordinate. u runs left to right and v runs bottom to top, both over [0, 1).
+struct UV
+{
+    double u, v;
+};
+
+/// @brief The ways a point on a shape's surface can be projected into texture space.
+enum class UVMapping : uint8_t
+{
+    planar,         /// tile the xz plane, repeating every unit
+    spherical,      /// wrap around a unit sphere, like a globe
+    cylindrical,    /// wrap around the y axis, repeating every unit of height
+    cube            /// project onto whichever face of a unit cube the point lies on
+};
+
+/// @brief The faces of a unit cube, in the order their images are given to a cube mapped texture.
+enum class CubeFace : uint8_t
+{
+    left,
+    front,
+    right,
+    back,
+    up,
+    down
+};
+
+namespace UVMap
+{
+/// @brief Planar projection of a point onto the xz plane.
+UV planar(const Tuple& p);
+/// @brief Spherical projection of a point about the origin.
+UV spherical(const Tuple& p);
+/// @brief Cylindrical projection of a point about the y axis.
+UV cylindrical(const Tuple& p);
+/// @brief The face of a unit cube that a point lies on (or is nearest to).
+CubeFace cubeFace(const Tuple& p);
+/// @brief Project a point onto a given face of a unit cube.
+UV cube(const Tuple& p, CubeFace face);
+/// @brief Project a point using any of the mappings. For cube mapping, the face is chosen from the
+/// point itself.
+UV map(UVMapping mapping, const Tuple& p);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MipMappedImage
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief How texture coordinates outside of [0, 1) are treated when sampling an image.
+enum class TextureAddress : uint8_t
+{
+    repeat,
+    clamp
+};
+
+/// @brief An image which is stored as a chain of mip levels, each half the size of the last, for
+/// filtered texture lookups.
+/// @details Each level is stored in square tiles of TILE_SIZE x TILE_SIZE texels, so that the
+/// handful of texels touched by a bilinear lookup (and by lookups for neighbouring pixels) share a
+/// few cache lines, instead of being spread over as many image rows.
+class MipMappedImage
+{
+  public:
+    /// @brief Build the image and its mip chain from row-major pixels, with the top row first.
+    MipMappedImage(uint32_t width, uint32_t height, std::span<const Colour> pixels);
+
+    /// @brief Load an image from a PPM (P3 or P6) or QOI file. The format is detected from the
+    /// file's contents. Returns nullptr, logging why, when the file cannot be read.
+    static std::unique_ptr<MipMappedImage> fromFile(const std::string& fileName);
+    /// @brief Load an image from a stream of PPM (P3 or P6) data.
+    static std::unique_ptr<MipMappedImage> fromPPM(std::istream& in);
+    /// @brief Load an image from a stream of QOI data.
+    static std::unique_ptr<MipMappedImage> fromQOI(std::istream& in);
+
+    /// @brief Sample the image with trilinear filtering.
+    /// @param uv Texture coordinate to sample at.
+    /// @param footprint Width of the area being sampled, in texture space. 0 samples level 0.
+    [[nodiscard]] Colour sample(UV uv, double footprint,
+                                TextureAddress addressU = TextureAddress::repeat,
+                                TextureAddress addressV = TextureAddress::repeat) const;
+    /// @brief Sample a single mip level with bilinear filtering.
+    [[nodiscard]] Colour sampleLevel(UV uv, size_t level,
+                                     TextureAddress addressU = TextureAddress::repeat,
+                                     TextureAddress addressV = TextureAddress::repeat) const;
+    /// @brief The (fractional) mip level which matches a footprint in texture space.
+    [[nodiscard]] double levelOfDetail(double footprint) const;
+    /// @brief Get a single texel of a mip level, where x = 0, y = 0 is the top left.
+    [[nodiscard]] Colour texelAt(size_t level, uint32_t x, uint32_t y) const;
+
+    [[nodiscard]] inline size_t getLevelCount() const { return levels.size(); }
+    [[nodiscard]] inline uint32_t getWidth(size_t level = 0) const { return levels[level].width; }
+    [[nodiscard]] inline uint32_t getHeight(size_t level = 0) const { return levels[level].height; }
+
+    static constexpr uint32_t TILE_SIZE{ 8 };
+
+  private:
+    /// @brief Texels are kept in single precision to halve the memory traffic of Colour.
+    struct Texel
+    {
+        float r, g, b;
+    };
+
+    struct Level
+    {
+        Level(uint32_t width, uint32_t height);
+        /// @brief Index of a texel in the tiled storage.
+        [[nodiscard]] inline size_t indexOf(uint32_t x, uint32_t y) const
+        {
+            const size_t tile = (y / TILE_SIZE) * tilesX + (x / TILE_SIZE);
+            return tile * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE);
+        }
+        [[nodiscard]] inline const Texel& at(uint32_t x, uint32_t y) const { return texels[indexOf(x, y)]; }
+        inline Texel& at(uint32_t x, uint32_t y) { return texels[indexOf(x, y)]; }
+
+        uint32_t width, height;
+        uint32_t tilesX;
+        std::vector<Texel> texels;
+    };
+
+    /// @brief Downsample the last level in the chain with a box filter, adding a new level.
+    void addLevel();
+
+    std::vector<Level> levels;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// TextureMap
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A pattern which projects an image onto a shape. The pattern's transform places the
+/// projection on the shape, as with any other pattern.
+/// @details Images are not owned by the map, so that one image can be shared by many materials.
+class TextureMap: public Pattern
+{
+  public:
+    /// @brief Map a single image onto a shape with a planar, spherical or cylindrical projection.
+    TextureMap(const MipMappedImage* image, UVMapping mapping);
+    /// @brief Cube map a shape, with one image per face, given in CubeFace order.
+    explicit TextureMap(const std::array<const MipMappedImage*, 6>& faces);
+
+    /// @brief Get the mapped image's colour at a point in pattern space.
+    /// @param footprint Width of the area being shaded, in pattern space. Used to pick mip levels.
+    [[nodiscard]] Colour sampleAt(const Tuple& pPattern, double footprint) const;
+    /// @brief Estimate how wide an area of pattern space of the given width is in texture space.
+    [[nodiscard]] double footprintToUV(const Tuple& pPattern, double footprint) const;
+
+    [[nodiscard]] inline UVMapping getMapping() const { return mapping; }
+
+  private:
+    UVMapping mapping;
+    std::array<const MipMappedImage*, 6> images{};  /// one image, or one per face when cube mapped
+};
+}
@@ -7,9 +7,14 @@
 
 #pragma once
 
+#include <array>
+#include <memory>
+#include <vector>
+
 #include "raytracer/third_party/noise/FastNoiseLite.h"
 #include "raytracer/math/tuples.hpp"
 #include "raytracer/math/matrix.hpp"
+#include "raytracer/math/bounds.hpp"
 #include "raytracer/common/utils.hpp"
 
 namespace rt::Texture
@@ -25,10 +30,17 @@ class Generative
 
     /// @brief Applies the surface texture to a given normal, using normal perturbation.
     Tuple applyToNormal(Tuple normal, Tuple point);
+    /// @brief Applies the surface texture to a whole batch of normals at once.
+    /// @param normals Normal vectors, which are perturbed in place.
+    /// @param points Object space points, one for each normal.
+    void applyToNormals(TupleBatch& normals, const TupleBatch& points);
 
     /// @brief Compute the perturbation Vector() at a given point in object space.
     /// @return A modulated normal vector which includes the texture applied to it.
     virtual Tuple getPerturbation(Tuple& point) = 0;
+    /// @brief Compute the perturbation vectors for a batch of points in texture space. By default
+    /// this calls getPerturbation() for each point; textures override it with a batched kernel.
+    virtual void getPerturbations(const TupleBatch& points, TupleBatch& out);
 
     /// @brief Set a transformation to be applied to the texture itself.
     inline void setTransform(TransformationMatrix newTransform)
@@ -63,12 +75,56 @@ class Generative
         double x{ 0.25 }, y{ 0.25 }, z{ 0.25 };
     } A;  /// amplitude of texture applied to material
 
-  private:
+  protected:
     TransformationMatrix transform;
     TransformationMatrix inverseTransform;
 };
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A baked 3D grid of scalar noise values, sampled with trilinear interpolation.
+/// @details Samples are stored in 8x8x8 bricks so that neighbouring lookups stay within a few cache
+/// lines. Once baked the volume is immutable, so it can be shared between threads and render jobs.
+class NoiseVolume
+{
+  public:
+    /// @brief Allocate a volume over a region, with a given number of samples along its longest
+    /// axis. Shorter axes get proportionally fewer samples, with at least 2 along any axis.
+    NoiseVolume(const BoundingBox& region, size_t resolution);
+
+    /// @brief Sample the volume at a point, interpolating between the 8 surrounding samples.
+    /// Points outside the region are clamped to its surface.
+    [[nodiscard]] float sample(const Tuple& p) const;
+    /// @brief True when a point lies within the region covered by the volume.
+    [[nodiscard]] inline bool contains(const Tuple& p) const { return region.contains(p); }
+    [[nodiscard]] inline const BoundingBox& getRegion() const { return region; }
+    /// @brief Get the number of samples along an axis (0, 1, 2 for x, y, z).
+    [[nodiscard]] inline size_t getDimension(size_t axis) const { return dims[axis]; }
+    /// @brief Get the position of the sample at grid index i, j, k.
+    [[nodiscard]] Tuple positionOf(size_t i, size_t j, size_t k) const;
+    /// @brief Get or set the sample at grid index i, j, k.
+    [[nodiscard]] inline float at(size_t i, size_t j, size_t k) const { return data[indexOf(i, j, k)]; }
+    inline void set(size_t i, size_t j, size_t k, float v) { data[indexOf(i, j, k)] = v; }
+
+    static constexpr size_t BRICK_SIZE{ 8 };    /// samples along each edge of one brick
+
+  private:
+    /// @brief Map a grid index to its position in brick-tiled storage.
+    [[nodiscard]] inline size_t indexOf(size_t i, size_t j, size_t k) const
+    {
+        constexpr size_t B{ BRICK_SIZE };
+        const size_t brick = ((k / B) * nBricks[1] + (j / B)) * nBricks[0] + (i / B);
+        return brick * B * B * B + ((k % B) * B + (j % B)) * B + (i % B);
+    }
+
+    BoundingBox region;                 /// region covered, in noise space
+    std::array<size_t, 3> dims{};       /// number of samples along each axis
+    std::array<size_t, 3> nBricks{};    /// number of bricks along each axis
+    std::array<double, 3> cellsPerUnit{};   /// grid cells per world unit along each axis
+    std::vector<float> data;
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 class Noise : public Generative
 {
@@ -164,24 +220,28 @@ class Noise : public Generative
     {
         density = newDensity;
         noise.SetFrequency(static_cast<float>(density));
+        clearBake();
     }
     /// @brief Set the number of octaves of noise used in fractal generation.
     inline void setOctaves(int newNOctaves)
     {
         nOctaves = newNOctaves;
         noise.SetFractalOctaves(newNOctaves);
+        clearBake();
     }
     /// @brief Set the type of fractal noise to generate.
     inline void setFractalType(FractalType type)
     {
         fractalType = type;
         noise.SetFractalType(fractalTypeToFNL(fractalType));
+        clearBake();
     }
     /// @brief Set the base type of noise to be generated.
     inline void setNoiseType(NoiseType type)
     {
         noiseType = type;
         noise.SetNoiseType(noiseTypeToFNL(noiseType));
+        clearBake();
     }
 
     /// @brief Set the amount of domain warping applied. 0 results in no warping.
@@ -189,12 +249,14 @@ class Noise : public Generative
         warpAmp = amp;
         warpNoise.SetDomainWarpAmp(static_cast<float>(warpAmp));
         warpIsActive = !APPROX_ZERO(warpAmp);
+        clearBake();
     }
 
     /// @brief Set the density of domain warping applied.
     inline void setWarpDensity(double newDensity) {
         warpDensity = newDensity;
         warpNoise.SetFrequency(static_cast<float>(warpDensity));
+        clearBake();
     }
 
     /// @brief Set the type of domain warping applied.
@@ -207,15 +269,33 @@ class Noise : public Generative
         else
             warpIsActive = true;
         warpNoise.SetDomainWarpType(warpTypeToFNL(warpType));
+        clearBake();
     }
 
-
-
-
-
+    /// @brief Bake the noise field into a NoiseVolume covering a region, so that perturbations no
+    /// longer evaluate the noise (and its octaves/warping) at each point. Any point outside the
+    /// baked region falls back to evaluating the noise directly.
+    /// @param region The region to bake, in the same object space as points given to the texture.
+    /// @param resolution Number of samples along the longest axis of the region.
+    void bake(const BoundingBox& region, size_t resolution = 64);
+    /// @brief Discard any baked volume. Changing any noise setting also discards the bake.
+    inline void clearBake() { baked.reset(); }
+    [[nodiscard]] inline bool isBaked() const { return baked != nullptr; }
+    /// @brief Get the baked volume, to share with other identically configured Noise textures.
+    [[nodiscard]] inline std::shared_ptr<const NoiseVolume> getBakedVolume() const { return baked; }
+    /// @brief Use an already baked volume, shared from an identically configured Noise texture.
+    inline void setBakedVolume(std::shared_ptr<const NoiseVolume> volume) { baked = std::move(volume); }
 
     /// @brief Modulate a given normal vector with the presently configured noise function.
     Tuple getPerturbation(Tuple& point) override;
+    /// @brief Compute perturbations for a batch of points. Simplex and Perlin noise (with or
+    /// without fBm fractals, but without domain warping) are evaluated with vectorised kernels.
+    void getPerturbations(const TupleBatch& points, TupleBatch& out) override;
+    /// @brief True when the current configuration can be evaluated with the vectorised kernels.
+    [[nodiscard]] bool hasBatchKernel() const;
+    /// @brief Evaluate the configured noise function directly at a point in noise space (ie: with
+    /// coefficients already applied), bypassing any baked volume.
+    [[nodiscard]] float evaluateNoise(float x, float y, float z) const;
 
   protected:
     FastNoiseLite noise;    /// primary noise generator
@@ -230,6 +310,11 @@ class Noise : public Generative
     bool warpIsActive{ false };
     WarpType warpType{ WarpType::none };  // type of domain warping applied
     double warpDensity{ .01 };
+    std::shared_ptr<const NoiseVolume> baked;  /// optional baked noise field, in noise space
+
+    /// @brief Evaluate the configured noise with the vectorised kernels, for points in noise space.
+    void evaluateNoiseBatch(std::vector<float>& x, std::vector<float>& y, std::vector<float>& z,
+                            std::vector<float>& out) const;
 };
 
 
@@ -240,6 +325,7 @@ class Waves : public Generative
     Waves();
 
     Tuple getPerturbation(Tuple& point) override;
+    void getPerturbations(const TupleBatch& points, TupleBatch& out) override;
 
     /// @brief Set the period of one wave, in world distance units.
     //    inline void setPeriod(double period)
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Bounds
+///     Axis-aligned bounding boxes
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "raytracer/math/tuples.hpp"
+#include "raytracer/math/matrix.hpp"
+#include "raytracer/common/utils.hpp"
+#include "raytracer/renderer/ray.hpp"
+
+namespace rt
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief An axis-aligned bounding box. A default constructed box is empty, and grows as points or
+/// other boxes are added to it.
+struct BoundingBox
+{
+    BoundingBox() = default;
+    BoundingBox(Tuple min, Tuple max) : min(min), max(max) {};
+
+    /// @brief A box which is unbounded along every axis.
+    static BoundingBox infinite() { return { Point{ -INF, -INF, -INF }, Point{ INF, INF, INF } }; }
+
+    /// @brief Grow the box so that it includes a given point.
+    void add(const Tuple& p);
+    /// @brief Grow the box so that it includes another box.
+    void add(const BoundingBox& other);
+    /// @brief True when a point lies inside (or on the surface of) the box.
+    [[nodiscard]] bool contains(const Tuple& p) const;
+    /// @brief True when another box lies entirely inside this box.
+    [[nodiscard]] bool contains(const BoundingBox& other) const;
+    /// @brief True when nothing has been added to the box yet.
+    [[nodiscard]] inline bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    /// @brief True when the box has a finite extent along every axis.
+    [[nodiscard]] bool isFinite() const;
+    /// @brief The extent of the box along each axis, as a Vector.
+    [[nodiscard]] inline Tuple size() const { return Vector{ max.x - min.x, max.y - min.y, max.z - min.z }; }
+    /// @brief The surface area of the box, or 0 when it is empty.
+    [[nodiscard]] double surfaceArea() const;
+    /// @brief The centre of the box.
+    [[nodiscard]] inline Tuple centre() const
+                          { return Point{ (min.x + max.x) / 2., (min.y + max.y) / 2., (min.z + max.z) / 2. }; }
+    /// @brief Slab test of a ray against the box, within the ray's [tMin, tMax] range.
+    /// @details Uses the ray's cached reciprocal direction and sign bits, so it only multiplies.
+    [[nodiscard]] inline bool intersects(const Ray& ray) const { return intersects(ray, ray.getTMax()); }
+    /// @brief Slab test of a ray against the box, within [tMin, tFar], ie: up to the closest hit
+    /// found so far.
+    [[nodiscard]] bool intersects(const Ray& ray, double tFar) const;
+    /// @brief Transform the box, returning a new axis-aligned box which bounds the result.
+    [[nodiscard]] BoundingBox transform(const TransformationMatrix& M) const;
+    /// @brief The box shared by this box and another, which is empty when they don't overlap.
+    [[nodiscard]] BoundingBox overlap(const BoundingBox& other) const;
+    /// @brief The bounds of the part of a triangle which lies inside a box. Empty if none does.
+    /// @details The triangle is clipped against each face of the box in turn (Sutherland-Hodgman).
+    [[nodiscard]] static BoundingBox ofTriangleWithin(const Tuple& p1, const Tuple& p2, const Tuple& p3,
+                                                      const BoundingBox& box);
+
+    Tuple min{ Point{ INF, INF, INF } };
+    Tuple max{ Point{ -INF, -INF, -INF } };
+};
+}
@@ -84,6 +84,20 @@ class Matrix
         }
         return X;
     };
+    /// Multiply this 4x4 matrix with every tuple in a batch, writing the results to out.
+    void transformBatch(const TupleBatch& in, TupleBatch& out) const {
+        const size_t n = in.size();
+        out.resize(n);
+        // w is shared by the whole batch, so the translation column folds into a constant
+        const T tx = M[0][3] * in.w, ty = M[1][3] * in.w, tz = M[2][3] * in.w;
+        for (size_t i{}; i < n; ++i) {
+            const T x = in.x[i], y = in.y[i], z = in.z[i];
+            out.x[i] = M[0][0] * x + M[0][1] * y + M[0][2] * z + tx;
+            out.y[i] = M[1][0] * x + M[1][1] * y + M[1][2] * z + ty;
+            out.z[i] = M[2][0] * x + M[2][1] * y + M[2][2] * z + tz;
+        }
+        out.w = in.w;
+    };
 
   private:
     std::array<std::array<T, N>, N> M{};
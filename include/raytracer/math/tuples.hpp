@@ -2,6 +2,8 @@
 
 #include "raytracer/common/utils.hpp"
 #include <ostream>
+#include <span>
+#include <vector>
 
 namespace rt
 {
@@ -55,6 +57,30 @@ struct Point : public Tuple
 };
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A batch of tuples stored as a structure of arrays (SoA).
+/// @details Each component lives in its own contiguous array so that loops evaluating many points
+/// at once (eg: a tile's worth of shading points) can be vectorised by the compiler. All tuples in a
+/// batch share the same w component, ie: a batch is either all points or all vectors.
+struct TupleBatch
+{
+    TupleBatch() = default;
+    explicit TupleBatch(size_t n, double w = 1.0) : x(n), y(n), z(n), w(w) {};
+    /// Gather a span of tuples into a new batch. w is taken from the first tuple.
+    explicit TupleBatch(std::span<const Tuple> tuples);
+
+    [[nodiscard]] inline size_t size() const { return x.size(); }
+    inline void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+    /// @brief Store a tuple at index i of the batch.
+    inline void set(size_t i, const Tuple& t) { x[i] = t.x; y[i] = t.y; z[i] = t.z; }
+    /// @brief Get the tuple at index i of the batch.
+    [[nodiscard]] inline Tuple get(size_t i) const { return { x[i], y[i], z[i], w }; }
+
+    std::vector<double> x, y, z;
+    double w{ 1.0 };
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 Tuple cross(const Tuple& a, const Tuple& b);
 }
\ No newline at end of file
@@ -25,7 +25,7 @@ class Canvas
     bool isBlank();
     void writePixel(uint32_t x, uint32_t y, Colour colour);
     void setAllPixelsTo(Colour colour);
-    Colour pixelAt(uint32_t x, uint32_t y);
+    Colour pixelAt(uint32_t x, uint32_t y) const;
     /// @brief Generates a PPM-compatible header string for this canvas's pixel matrix.
     std::string generatePPMHeader() const;
     /// @brief Generate a Portable PixMap data string for the entire pixel matrix in this Canvas().
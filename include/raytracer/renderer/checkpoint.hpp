@@ -0,0 +1,106 @@
+/**
+ *
+ *  Raytracer Lib - Render::Checkpoint
+ *
+ *  @file checkpoint.hpp
+ *  @brief Saves the finished tiles of a job as it renders, so an interrupted job can be resumed
+ *  @author Stacy Gaudreau
+ *  @date 2026.10.18
+ *
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "raytracer/renderer/render_common.hpp"
+#include "raytracer/common/macros.hpp"
+
+
+namespace rt::Render {
+
+/**
+ * @brief Append-only file of a job's finished tiles, with their pixels
+ * @details The file starts with a header keyed on the job's tile layout, and a record follows for
+ * each tile as it finishes: the tile's index, then the pixels of its whole rect as floats.
+ * Records are buffered and written every FLUSH_INTERVAL, so saving costs only the new tiles, and
+ * a record cut short by a crash is ignored on resume. Only the tile layout and the block size of
+ * each pass are checked, so a job is resumed with the same world and camera it was started with.
+ */
+class Checkpoint {
+public:
+    static constexpr auto FLUSH_INTERVAL{ std::chrono::seconds{ 2 } };
+
+    Checkpoint() = default;
+    ~Checkpoint() {
+        flush();
+    }
+
+    /**
+     * @brief Open a job's checkpoint file, restoring the pixels of the tiles it holds into the image
+     * @details A file saved for another tile layout or other passes, or not a checkpoint at all, is
+     * started over.
+     * @param layout the job's tiles
+     * @param passes the block size of each of the job's passes
+     * @return false if the file can't be written, ie: the job goes without a checkpoint
+     */
+    bool open(const std::filesystem::path& path, const TileCursor& layout, const std::vector<uint32_t>& passes,
+              Canvas& image);
+    /**
+     * @brief True if a tile needn't be rendered again, as it or a later pass over its rect was restored
+     */
+    bool isTileRestored(uint32_t nTile) const {
+        return isRestored[nTile] != 0;
+    }
+    uint32_t getRestoredCount() const {
+        return nRestored;
+    }
+    /**
+     * @brief Save a finished tile's pixels. Thread safe.
+     */
+    void record(const Tile& t, const Canvas& image);
+    /**
+     * @brief Write out the tiles recorded since the last flush. Thread safe.
+     */
+    void flush();
+    /**
+     * @brief Delete the file, once the job it saves has been rendered in full. Thread safe.
+     */
+    void remove();
+
+PRIVATE_IN_PRODUCTION
+    /**
+     * @brief Hash of the tile layout and pass block sizes, so a file saved for others isn't restored
+     */
+    uint64_t getLayoutKey(uint32_t width, uint32_t height, const std::vector<uint32_t>& passes) const;
+    /**
+     * @brief Read the file's tiles into the image
+     * @return the length of the file up to the end of its last whole record, or zero if it
+     * couldn't be read or was saved for another layout
+     */
+    size_t restore(uint64_t key, Canvas& image);
+    /**
+     * @brief Write the pending records to the file
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void writePending();
+
+    std::filesystem::path file;
+    std::vector<TileRect> rects; // of every tile, by index
+    std::vector<uint8_t> isRestored;
+    uint32_t nRestored{ };
+    std::mutex m_file;
+    std::ofstream out;
+    std::vector<char> pending; // records not yet written
+    std::chrono::steady_clock::time_point tLastFlush{ };
+
+DELETE_COPY_AND_MOVE(Checkpoint)
+};
+
+}
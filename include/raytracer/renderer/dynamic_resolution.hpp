@@ -0,0 +1,91 @@
+/**
+ *  
+ *  Raytracer Lib - Render::DynamicResolution
+ *
+ *  @file dynamic_resolution.hpp
+ *  @brief Scales the resolution of realtime frames to hold a frame rate while the camera moves
+ *  @author Stacy Gaudreau
+ *  @date 2026.10.18
+ *
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <mutex>
+
+#include "raytracer/renderer/render_common.hpp"
+#include "raytracer/renderer/job_scheduler.hpp"
+
+
+namespace rt::Render {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Interactive rendering mode for a GUI viewport, which holds a target frame time while the
+ * camera moves by rendering frames coarser or finer.
+ * @details While moving, each frame is a single pass whose block size (NxN pixels traced with one
+ * ray, and filled into the ImageTarget) is scaled from the achieved frame times. Once the camera
+ * stops, a frame refines progressively from that block size down to full resolution.
+ * The viewport drives it: each frame goes through submitFrame(), and the job's JobEndedCallback
+ * passes its summary on to onFrameEnded().
+ */
+class DynamicResolution {
+public:
+    explicit DynamicResolution(std::chrono::nanoseconds targetFrameTime) : targetFrameTime(targetFrameTime) {
+    }
+
+    /**
+     * @brief Set up a realtime job to render the next frame
+     * @param isCameraMoving true while the camera moves, for a frame which must be done in time.
+     * False once it stops, for a frame which refines to full resolution.
+     */
+    void prepare(Job& job, bool isCameraMoving);
+    /**
+     * @brief Prepare and submit the next frame, cancelling the last one if it hasn't finished, as
+     * it shows a view which has already gone.
+     * @return ID of the frame's job
+     */
+    JobID submitFrame(JobScheduler& scheduler, Job job, bool isCameraMoving);
+    /**
+     * @brief Feed back a frame which has ended, from the job's JobEndedCallback
+     * @details Only frames rendered while moving are measured; refining frames take as long as
+     * they take. A frame superseded by the next before its pass was done is measured too, by how
+     * much of it was rendered in the time it had, once it has had at least the target time; the
+     * camera may never keep still long enough for a frame to finish otherwise.
+     */
+    void onFrameEnded(const JobSummary& summary);
+    /**
+     * @brief Get the block size moving frames are rendered with
+     */
+    uint32_t getBlockSize() const {
+        return toBlockSize(blockScale.load(std::memory_order_relaxed));
+    }
+    std::chrono::nanoseconds getTargetFrameTime() const { return targetFrameTime; }
+
+PRIVATE_IN_PRODUCTION
+    static constexpr double MAX_BLOCK_SIZE{ 16. };
+    static constexpr double DEADBAND{ 0.15 }; // frame times this close to the target change nothing
+    static constexpr double SMOOTHING{ 0.5 }; // weight of each new frame in the scale
+    static constexpr size_t MAX_MOVING_FRAMES{ 16 }; // moving frames remembered until they end
+
+    static uint32_t toBlockSize(double scale) {
+        return static_cast<uint32_t>(std::lround(std::clamp(scale, 1., MAX_BLOCK_SIZE)));
+    }
+
+    std::chrono::nanoseconds targetFrameTime;
+    // linear scale of the blocks moving frames are traced with; it's kept fractional between
+    //  frames so that small errors add up to a change of block size
+    std::atomic<double> blockScale{ 1. };
+    std::atomic<JobID> lastFrame{ JobID_INVALID };
+    // moving frames submitted which haven't ended, oldest first
+    std::deque<JobID> movingFrames{ };
+    std::mutex m_frames;
+};
+
+}
@@ -14,6 +14,8 @@
 namespace rt
 {
 class Shape;
+class Instance;
+class Material;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 struct Intersection
@@ -37,9 +39,14 @@ struct Intersection
     double t;
     Shape* shape;
     double u, v;  /// Coordinates an intersection took place at on the Triangle() or SmoothTriangle()
+    Instance* instance{ nullptr };  /// the Instance() the shape was hit through, if any
 
     /// @brief True if this Intersection() is a visible "hit" in the scene.
     [[nodiscard]] inline bool isHit() { return t >= 0.0; }
+    /// @brief The material the hit is rendered with, which an Instance() may override.
+    [[nodiscard]] const Material& getMaterial() const;
+    /// @brief True if the hit shape casts a shadow, and so does the Instance() it was hit through.
+    [[nodiscard]] bool castsShadow() const;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -59,7 +66,7 @@ class Intersections
     /// @brief Get the nth intersection in the collection.
     inline Intersection& operator()(size_t n) { return intersections[n]; }
     /// @brief Get a const version of the intersections to iterate over.
-    inline const std::vector<Intersection>& getIntersections() { return intersections; }
+    inline const std::vector<Intersection>& getIntersections() const { return intersections; }
     /// Get the number of intersections.
     [[nodiscard]] size_t count() const;
     /// @brief True if there are no intersections.
@@ -14,22 +14,43 @@
 
 #include <thread>
 #include <condition_variable>
+#include <deque>
+#include <list>
+#include <semaphore>
 
 #include "raytracer/logging/logging.hpp"
 #include "raytracer/renderer/render_common.hpp"
 #include "raytracer/common/macros.hpp"
-#include "raytracer/third_party/rigtorp/SPSCQueue.h"
+#include "raytracer/common/mpsc_queue.hpp"
 
 
 namespace rt::Render {
 
 class JobScheduler;
 
+/**
+ * @brief Limits on the finalized job summaries kept for getSummary()
+ * @details Past the count or byte limits, the least recently finalized or looked up summaries go
+ * first. Summaries older than maxAge go regardless.
+ */
+struct RetentionPolicy {
+    size_t maxCount{ 1024 };
+    size_t maxBytes{ 256 << 20 };
+    std::chrono::nanoseconds maxAge{ std::chrono::minutes{ 10 } };
+    // a job's pixels are freed after its callback, which is expected to have taken what it needs
+    bool isBufferKeptAfterCallback{ false };
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  * @brief Finalizes jobs which have completed in the scheduler
  * @details Takes care of eg: rendering files to disk, and calling back to
- * any programmer-supplied callbacks for eg: the GUI when a render job ends
+ * any programmer-supplied callbacks for eg: the GUI when a render job ends.
+ * Jobs end on whichever worker finishes their last tile, so any number of threads push to the
+ * queue. Finalizing runs as a small pipeline on two threads of its own: the first drains the
+ * queue in batches and encodes images, and the second writes them to disk. Jobs which aren't
+ * written are called back from the first straight away, so slow disk writes hold up neither
+ * the workers nor other jobs' callbacks. Callbacks never run concurrently with one another.
  */
 class JobFinalizer {
 public:
@@ -41,48 +62,87 @@ public:
     }
 
     /**
-     * @brief Push a job onto the finalization queue
+     * @brief Push a job onto the finalization queue. Safe to call from any thread.
      */
     void push(JobToFinalize&& job) {
-        while (!queue.try_push(std::move(job))) {
-            std::this_thread::yield();
+        if (!queue.try_push(std::move(job))) [[unlikely]] {
             RENDER_WARN("Finalizer queue overrun, consider adjusting size");
+            // the finalizer empties the queue in batches, so a slot soon comes free
+            wake();
+            while (!queue.try_push(std::move(job))) {
+                std::this_thread::yield();
+            }
         }
-        signal.release();   // signal work avail.
+        wake();
     }
     /**
-     * @brief Start the worker thread. Call stop to shutdown.
+     * @brief Start the worker threads. Call stop to shutdown.
      */
     void start() {
-        if (isRunning.load())
+        if (isRunning.exchange(true))
             return;
         RENDER_DEBUG("JobFinalizer starting");
+        isWriterRunning = true;
+        writerThread = std::make_unique<std::thread>([this](){ runWriter(); });
         thread = std::make_unique<std::thread>([this](){ run(); });
     }
     /**
      * @brief Shutdown the Finalizer and its queue.
+     * @details Jobs already taken from the queue are finished, including their disk writes.
      */
     void stop() {
         if (!isRunning.exchange(false))
             return;
         RENDER_DEBUG("JobFinalizer stopping");
-        signal.release();   // signal to stop
+        wake();   // signal to stop
         if (thread->joinable()) {
             thread->join();
         }
+        {
+            std::scoped_lock lock{ m_writes };
+            isWriterRunning = false;
+        }
+        cv_writes.notify_one();
+        if (writerThread->joinable()) {
+            writerThread->join();
+        }
     }
 
     /**
      * @brief Get a JobSummary report of a finalized job
-     * @details This will return nothing until the job is actually processed from the queue
+     * @details This will return nothing until the job is actually processed from the queue,
+     * or once the retention policy has evicted it. Looking a summary up keeps it for longer.
      */
-    JobSummary* getSummary(JobID id) {
+    std::shared_ptr<JobSummary> getSummary(JobID id) {
         std::scoped_lock lock{ m_finalized };
         if (auto it = finalized.find(id); it != finalized.end()) {
-            return &(it->second);
+            lru.splice(lru.begin(), lru, it->second.inLru);
+            return it->second.summary;
         }
         return nullptr;
     }
+    /**
+     * @brief Set the limits on finalized summaries kept, evicting any now over them
+     */
+    void setRetention(const RetentionPolicy& policy) {
+        std::scoped_lock lock{ m_finalized };
+        retention = policy;
+        evict(std::chrono::steady_clock::now());
+    }
+    /**
+     * @brief Get the memory held by finalized summaries, in bytes
+     */
+    size_t getMemoryUse() {
+        std::scoped_lock lock{ m_finalized };
+        return finalizedBytes;
+    }
+    /**
+     * @brief Get the number of finalized summaries kept
+     */
+    size_t getSummaryCount() {
+        std::scoped_lock lock{ m_finalized };
+        return finalized.size();
+    }
 
     void attachToScheduler(JobScheduler& s) {
         scheduler = &s;
@@ -90,55 +150,82 @@ public:
 
 
 PRIVATE_IN_PRODUCTION
-    void run() {
-        RENDER_DEBUG("JobFinalizer running");
-        isRunning = true;
-
-        while (isRunning.load(std::memory_order_relaxed)) {
-            finalizeAll();
-            // sleep until signalled for jobs or shutdown
-            using namespace std::literals::chrono_literals;
-            signal.try_acquire_for(50ms);
-        }
-        RENDER_DEBUG("JobFinalizer stopped");
-    }
+    /**
+     * @brief A job between the pipeline's stages, with its image encoded for writing
+     */
+    struct PendingWrite {
+        JobToFinalize job;
+        std::string encoded;
+    };
 
     /**
-     * @brief Flush the queue, finalizing all jobs in it
+     * @brief Wake the finalizer's thread, if it isn't already woken
+     * @details The semaphore is only released by whoever sets the flag, and the flag is only
+     * cleared once that release is acquired, so it never counts past one.
      */
-    void finalizeAll() {
-        while (!queue.empty()) {
-            const auto& job = queue.front();
-            RENDER_INFO("finalized job id: {}", job->summary.id);
-            if (job->callback != nullptr) {
-                job->callback(job->summary);
-            }
-            std::scoped_lock lock{ m_finalized };
-            {
-                if (finalized.contains(job->summary.id)) [[unlikely]] {
-                    RENDER_ERROR("duplicate job summary with id {} in finalizer", job->summary.id);
-                }
-                finalized.emplace(job->summary.id, std::move(job->summary));
-                if (scheduler != nullptr) {
-                    // scheduler->erase
-                } else [[unlikely]] {
-                }
-            }
-            queue.pop();
+    void wake() {
+        if (!isSignalled.test_and_set(std::memory_order_acq_rel)) {
+            signal.release();
         }
     }
+    /**
+     * @brief First stage: drain the queue in batches, encoding images to be written
+     */
+    void run();
+    /**
+     * @brief Second stage: write encoded images to disk, then finish their jobs
+     */
+    void runWriter();
+    /**
+     * @brief Flush the queue, finalizing all jobs in it
+     */
+    void finalizeAll();
+    /**
+     * @brief Last stage: call back and register a job, and release its state in the scheduler
+     */
+    void complete(JobToFinalize& job);
+    /**
+     * @brief Drop summaries past the retention policy's limits
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void evict(std::chrono::steady_clock::time_point now);
+    /**
+     * @brief Drop a finalized summary
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void eraseSummary(JobID id);
 
 
 PRIVATE_IN_PRODUCTION
     static constexpr size_t QUEUE_SIZE{ 1024 };
-    rigtorp::SPSCQueue<JobToFinalize> queue;
+    static constexpr size_t BATCH_SIZE{ 64 }; // most jobs taken from the queue at once
+    MPSCQueue<JobToFinalize> queue;
     std::unique_ptr<std::thread> thread{ nullptr };
     std::atomic<bool> isRunning{ false };
-    std::binary_semaphore signal{ 0 };  // binary fine since queue flushed for every call
-    std::unordered_map<JobID, JobSummary> finalized;    // map of finalized job summaries
-    std::mutex m_finalized; // protects summaries map
+    std::binary_semaphore signal{ 0 };
+    std::atomic_flag isSignalled{ }; // set while the semaphore is released and not yet acquired
+    std::vector<JobToFinalize> batch; // jobs taken from the queue, being finalized
+    // disk write stage
+    std::unique_ptr<std::thread> writerThread{ nullptr };
+    std::deque<PendingWrite> writes; // encoded images waiting to be written
+    bool isWriterRunning{ false };
+    std::mutex m_writes; // protects writes
+    std::condition_variable cv_writes;
+    std::mutex m_callbacks; // keeps the stages' callbacks from running at once
+    // finalized job summaries, most recently finalized or looked up first in the LRU list
+    struct FinalizedEntry {
+        std::shared_ptr<JobSummary> summary;
+        std::list<JobID>::iterator inLru;
+        std::chrono::steady_clock::time_point tFinalized;
+        size_t bytes;
+    };
+    std::unordered_map<JobID, FinalizedEntry> finalized;
+    std::list<JobID> lru;
+    size_t finalizedBytes{ };
+    RetentionPolicy retention{ };
+    std::mutex m_finalized; // protects summaries map, LRU and retention
     JobScheduler* scheduler{ nullptr };
 
 DELETE_COPY_AND_MOVE(JobFinalizer)
 };
-}
\ No newline at end of file
+}
@@ -13,12 +13,18 @@
 #pragma once
 
 #include <queue>
+#include <array>
+#include <deque>
+#include <vector>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <atomic>
+#include <utility>
 
 #include "raytracer/logging/logging.hpp"
 #include "raytracer/renderer/render_common.hpp"
+#include "raytracer/renderer/checkpoint.hpp"
 #include "raytracer/common/macros.hpp"
 #include "raytracer/third_party/rigtorp/SPSCQueue.h"
 
@@ -29,12 +35,97 @@ class JobFinalizer;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
- * @brief Comparison functor helps sort tiles by max priority (lesser pkey value)
+ * @brief How the tiles of different jobs of the same type are ordered
  */
-struct LesserPKeyValue {
-    bool operator()(const Tile& A, const Tile& B) const {
-        return A.priority > B.priority;
+enum class ClassOrder : uint8_t {
+    interleaved,  // by pass, then distance from the centre, so every job's preview shows at once
+    oldest_first  // by job rank, so the oldest (or heaviest) job finishes before the next starts
+};
+
+/**
+ * @brief Tiles' waits in the queue, for one type of job
+ * @details A tile's wait includes the time spent behind other tiles of its own job, so the
+ * longest gap between tiles of the type being taken is what shows whether it is starved.
+ */
+struct WaitStats {
+    uint64_t nTaken{ };
+    std::chrono::nanoseconds totalWait{ }, maxWait{ };
+    std::chrono::nanoseconds maxGap{ }; // longest the type went without a tile taken, while it had some
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Priority queue of tiles, with a heap for each type of job
+ * @details The most urgent type goes first, except that a less urgent type passed over for longer
+ * than its aging limit gets the next tile, so a steady stream of realtime jobs can't starve the
+ * others. Within a type, tiles are ordered by their ClassOrder.
+ */
+class TileQueue {
+public:
+    static constexpr size_t N_CLASSES{ 3 };
+
+    static constexpr size_t classOf(JobType type) {
+        return std::min(static_cast<size_t>(type_to_priority(type)), N_CLASSES - 1);
     }
+
+    void push(Tile t);
+    void emplace(const Tile& t) { push(t); }
+    /**
+     * @brief Get the tile which would be taken next
+     */
+    const Tile& top() const { return heaps[selectClass(std::chrono::steady_clock::now())].front(); }
+    /**
+     * @brief Get the priority of the most urgent tile queued, whether or not it is taken next
+     */
+    PKey urgentPriority() const {
+        for (const auto& heap: heaps) {
+            if (!heap.empty()) return heap.front().priority;
+        }
+        return PKey_MIN;
+    }
+    /**
+     * @brief Take the next tile, which is top() at the time of calling
+     */
+    Tile take();
+    void pop() { (void) take(); }
+    /**
+     * @brief Take every tile, in no particular order, ie: to sort them into other queues
+     */
+    std::vector<Tile> drain();
+    /**
+     * @brief Take every tile of one job, leaving the others queued as they were
+     */
+    std::vector<Tile> takeTilesOf(JobID id);
+    bool empty() const { return size() == 0; }
+    size_t size() const {
+        return heaps[0].size() + heaps[1].size() + heaps[2].size();
+    }
+    void setOrder(JobType type, ClassOrder order);
+    void setAgingLimit(JobType type, std::chrono::nanoseconds limit) { agingLimits[classOf(type)] = limit; }
+    const WaitStats& getWaitStats(JobType type) const { return stats[classOf(type)]; }
+
+PRIVATE_IN_PRODUCTION
+    /**
+     * @brief Key a tile is ordered by within its class, lowest first
+     */
+    PKey orderKey(const Tile& t, size_t c) const;
+    /**
+     * @brief Pick the class to take a tile from: the most urgent, unless another is past its aging limit
+     */
+    size_t selectClass(std::chrono::steady_clock::time_point now) const;
+    auto heapOrder(size_t c) const {
+        return [this, c](const Tile& a, const Tile& b) { return orderKey(a, c) > orderKey(b, c); };
+    }
+
+    std::array<std::vector<Tile>, N_CLASSES> heaps{ };
+    std::array<ClassOrder, N_CLASSES> orders{ ClassOrder::interleaved, ClassOrder::interleaved,
+                                              ClassOrder::interleaved };
+    std::array<std::chrono::nanoseconds, N_CLASSES> agingLimits{ std::chrono::nanoseconds::max(),
+                                                                 std::chrono::milliseconds{ 200 },
+                                                                 std::chrono::seconds{ 1 } };
+    // when each class last had a tile taken, or last became non-empty
+    std::array<std::chrono::steady_clock::time_point, N_CLASSES> tLastServed{ };
+    std::array<WaitStats, N_CLASSES> stats{ };
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -46,7 +137,7 @@ struct LesserPKeyValue {
 class JobScheduler {
 public:
 
-    JobScheduler() {
+    JobScheduler() : tEpoch(std::chrono::steady_clock::now()) {
     }
 
     ~JobScheduler() {
@@ -56,39 +147,114 @@ public:
     /**
      * @brief Submit a job to the queue for rendering. The job is consumed
      * and no longer valid once submitted.
+     * @details The job is admitted once its tiles fit in the in-flight tile budget, after any
+     * jobs of its type (or more urgent ones) already waiting; until then it is pending, and its
+     * state may be tracked, paused or cancelled as usual. Admitted jobs queue a few tiles at a
+     * time, and make the rest as those are taken.
      * @param job Job to render.
      * @return ID of the job which can be used to track it.
      */
     JobID submit(Job job) {
-        job.id = getNextJobID();
-        auto state = std::make_shared<JobState>(job);
-        auto jobTiles = getTilesForJobState(state);
-        state->nTiles = static_cast<uint32_t>(jobTiles.size());
-        state->nTilesRemain = state->nTiles;
-        state->tSubmit = std::chrono::steady_clock::now();
-        // queue is loaded with the job's tiles
+        const auto tileSize = prepareJob(job);
+        auto state = makeJobState(std::move(job), tileSize);
+        std::vector<std::shared_ptr<JobState>> endedJobs;
         {
             std::scoped_lock lock{ m_tiles };
             jobs.emplace(state->job.id, state);
-            for (auto& t: jobTiles) {
-                tiles.push(std::move(t));
-            }
+            pending[TileQueue::classOf(state->job.type)].push_back(state);
+            admitPending();
+            endedJobs.swap(ended);
         }
-        state->isStarted = true;
+        finalize(endedJobs);
         // notify waiting workers
         // TODO: optimize to notify min(n_pool_size, n_tiles_loaded) times
         //  => may reduce job to work completion latency and reduce context switching
         cv_tiles.notify_all();
         return state->job.id;
     }
+    /**
+     * @brief Submit a job only if it can be admitted at once, rather than wait for the tile budget
+     * @return ID of the job, or JobID_INVALID if it would have had to wait, in which case the job
+     * is discarded
+     */
+    JobID trySubmit(Job job);
+    /**
+     * @brief Set the most tiles which admitted, unfinished jobs may have between them
+     * @details A job with more tiles than the whole budget is still admitted, once it would be the
+     * only one in flight. Jobs already admitted are unaffected by a lower budget.
+     */
+    void setTileBudget(uint32_t nTiles);
+    /**
+     * @brief Get the number of jobs waiting to be admitted
+     */
+    size_t getPendingJobCount() {
+        std::scoped_lock lock{ m_tiles };
+        return pending[0].size() + pending[1].size() + pending[2].size();
+    }
     /**
      * @brief Cancel a job with the given ID
+     * @details Its queued tiles are dropped at once, so the job ends as soon as workers in the
+     * middle of one of its tiles stop, at the end of the row they're on.
+     */
+    void cancel(JobID id);
+    /**
+     * @brief Stop dispatching a job's tiles, until it is resumed
+     * @details Its queued tiles are parked, and workers in the middle of one hand the rest of it
+     * back at the end of the row they're on. Pixels already rendered are kept.
+     * @return false if the job isn't in progress
      */
-    void cancel(JobID id) {
+    bool pause(JobID id);
+    /**
+     * @brief Dispatch a paused job's remaining tiles again, in priority order
+     * @return false if the job isn't in progress
+     */
+    bool resume(JobID id);
+    /**
+     * @brief Switch the rendering mode
+     * @details Queued tiles of job types the new mode doesn't allow are parked, and parked tiles
+     * it does allow are queued again, in priority order. Workers in the middle of a tile the new
+     * mode doesn't allow hand the rest of it back at the end of the scanline they're on.
+     */
+    void setMode(Mode newMode);
+    /**
+     * @brief Get the current rendering mode
+     */
+    Mode getMode() const {
+        return mode.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief True if a worker rendering the given tile should stop at the end of its scanline
+     * @details That is, if a tile of a more urgent type of job is waiting, the mode no longer
+     * allows the tile's job, or the job is paused. A tile taken once its class was past its aging
+     * limit isn't preempted by more urgent ones, which it was taken ahead of on purpose. Cheap
+     * enough to call for every scanline; no lock is taken.
+     */
+    bool shouldYield(const Tile& t) const {
+        const auto waiting = queuedPriority.load(std::memory_order_relaxed);
+        return (!t.isAged && (waiting >> 56) < (t.priority >> 56))
+               || !is_type_allowed_in_mode(t.state->job.type, getMode())
+               || t.state->isPaused.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Hand back the unrendered rest of a tile, after yielding part way through it
+     * @details The tile still counts as one of the job's remaining tiles, and is dispatched again
+     * (or parked) with its original priority.
+     */
+    void yieldTile(Tile t);
+    /**
+     * @brief Set how tiles of different jobs of a type are ordered against each other
+     */
+    void setClassOrder(JobType type, ClassOrder order);
+    /**
+     * @brief Set the longest a type of job waits for a tile while more urgent types are served
+     */
+    void setAgingLimit(JobType type, std::chrono::nanoseconds limit);
+    /**
+     * @brief Get how long the tiles of a type of job have waited in the queue to be dispatched
+     */
+    WaitStats getWaitStats(JobType type) {
         std::scoped_lock lock{ m_tiles };
-        if (auto it = jobs.find(id); it != jobs.end()) {
-            it->second->isCancelled = true;
-        }
+        return tiles.getWaitStats(type);
     }
 
     /**
@@ -98,31 +264,55 @@ public:
     void attachToFinalizer(JobFinalizer& f);
     /**
      * @brief Get the next (highest priority) tile in the render queue to work on
+     * @details Waits for a tile to render, discarding any of jobs which have ended or run out of
+     * time on the way.
+     * @return the tile, or nothing once the scheduler is shut down
      */
     std::optional<Tile> getNextTile() {
         std::unique_lock lock{ m_tiles };
-        cv_tiles.wait(lock, [&] { return !tiles.empty() || inShutdown; });
-        if (inShutdown) {
-            RENDER_DEBUG("shutdown signal received");
-            return std::nullopt;
-        }
-        // discard any tiles for inactive or cancelled jobs
-        while (!tiles.empty()) {
-            auto t = std::move(const_cast<Tile&>(tiles.top()));
-            tiles.pop();
+        while (true) {
+            cv_tiles.wait(lock, [&] { return !tiles.empty() || inShutdown; });
+            if (inShutdown) {
+                RENDER_DEBUG("shutdown signal received");
+                return std::nullopt;
+            }
+            // discard any tiles for inactive or cancelled jobs, or jobs out of time
+            auto t = tiles.take();
+            publishQueuedPriority();
             auto it = jobs.find(t.jobID);
             const bool isInvalid = it == jobs.end()
                                    || it->second->isCancelled.load(std::memory_order_relaxed);
-            if (isInvalid) {
-                // on last tile in job, send to Finalizer
-                if (t.state != nullptr && t.state->nTilesRemain.fetch_sub(1) <= 1) {
-                    setCompleteAndFinalize(t.state);
+            const bool isOutOfTime = !isInvalid && t.state->isPastDeadline();
+            if (isInvalid || isOutOfTime) {
+                if (isOutOfTime) {
+                    t.state->isDeadlineHit = true;
+                }
+                // the tiles the job hasn't queued yet go with it, and a job ended makes room for others
+                dropUnqueuedTiles(t.state);
+                dropQueuedTile(t);
+                if (admitPending()) {
+                    cv_tiles.notify_all();
                 }
+                if (!ended.empty()) {
+                    auto endedJobs = std::exchange(ended, { });
+                    lock.unlock();
+                    finalize(endedJobs);
+                    lock.lock();
+                }
+                // back to waiting, since an empty queue is no reason for the worker to stop
                 continue;
             }
+            // the job's next tile takes this one's place in the queue
+            queueNextTile(t.state);
+            publishQueuedPriority();
+            if (!buildWorldFor(lock, *t.state)) {
+                RENDER_DEBUG("shutdown signal received");
+                return std::nullopt;
+            }
+            t.isDispatched = true;
+            nTilesDispatched.fetch_add(1);
             return t;
         }
-        return std::nullopt;
     }
     /**
      * @brief Mark a given tile completely rendered.
@@ -133,12 +323,71 @@ public:
         auto state = t.state;
         if (state == nullptr) return;
         state->tLastTile = std::chrono::steady_clock::now();
+        if (state->checkpoint != nullptr) {
+            state->checkpoint->record(t, state->job.target.buffer);
+        }
         ++state->nTilesComplete;
+        if (state->nPassTilesRemain != nullptr) {
+            state->nPassTilesRemain[t.nPass].fetch_sub(1);
+        }
         // if it's the final tile, we send to finalizer with the most recent
         //  tile completion timestamp for completion time
         if (state->nTilesRemain.fetch_sub(1) <= 1) {
             setCompleteAndFinalize(state);
+            // the job's tiles no longer count against the budget, so pending jobs may fit
+            bool isAdmitted;
+            std::vector<std::shared_ptr<JobState>> endedJobs;
+            {
+                std::scoped_lock lock{ m_tiles };
+                isAdmitted = admitPending();
+                endedJobs.swap(ended);
+            }
+            finalize(endedJobs);
+            if (isAdmitted) {
+                cv_tiles.notify_all();
+            }
         }
+        handBack(t);
+    }
+    /**
+     * @brief Give up on a tile without rendering (the rest of) it, ie: when its job is cancelled
+     * or has run out of time. The job completes if it was its last tile.
+     */
+    void dropTile(const Tile& t) {
+        // on last tile in job, send to Finalizer
+        if (t.state != nullptr && t.state->nTilesRemain.fetch_sub(1) <= 1) {
+            setCompleteAndFinalize(t.state);
+        }
+        handBack(t);
+    }
+    /**
+     * @brief Record how long a worker took to trace some rays, feeding the throughput estimate
+     * which budgeted jobs are planned with
+     */
+    void recordThroughput(uint64_t nRays, std::chrono::nanoseconds elapsed) {
+        if (nRays == 0) return;
+        const double sample = static_cast<double>(elapsed.count()) / static_cast<double>(nRays);
+        // a lost update between workers only loses one sample, so no CAS loop is needed
+        const double estimate = nsPerRay.load(std::memory_order_relaxed);
+        nsPerRay.store(estimate + THROUGHPUT_SMOOTHING * (sample - estimate), std::memory_order_relaxed);
+    }
+    /**
+     * @brief Get the recent time taken for a worker to trace one pixel's rays, in nanoseconds
+     */
+    double getNsPerRay() const {
+        return nsPerRay.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Count a worker rendering tiles, or one which has stopped
+     */
+    void addWorker() {
+        nWorkers.fetch_add(1, std::memory_order_relaxed);
+    }
+    void removeWorker() {
+        nWorkers.fetch_sub(1, std::memory_order_relaxed);
+    }
+    uint32_t getWorkerCount() const {
+        return std::max(1u, nWorkers.load(std::memory_order_relaxed));
     }
     /**
      * @brief Request all threads waiting on tiles to shutdown
@@ -167,6 +416,19 @@ public:
         std::scoped_lock lock{ m_tiles };
         jobs.erase(id);
     }
+    /**
+     * @brief Get the memory held by the states of jobs in progress, in bytes, counting their images
+     */
+    size_t getMemoryUse() {
+        std::scoped_lock lock{ m_tiles };
+        size_t bytes{ };
+        for (const auto& [id, state]: jobs) {
+            bytes += sizeof(JobState) + state->job.target.getMemoryUse()
+                     + state->job.passes.size() * (sizeof(uint32_t) + sizeof(std::atomic<uint32_t>))
+                     + state->cursor.cells.capacity() * sizeof(uint32_t);
+        }
+        return bytes;
+    }
     /**
      * @brief Construct a summary snapshot of a job
      */
@@ -180,6 +442,13 @@ public:
         s.nTilesComplete = state->nTilesComplete.load(std::memory_order::relaxed);
         s.nPixelsComplete = state->nPixelsComplete.load(std::memory_order::relaxed);
         s.nPasses = std::max(static_cast<uint32_t>(state->job.passes.size()), 1u);
+        if (state->nPassTilesRemain != nullptr) {
+            while (s.nPassesComplete < state->job.passes.size()
+                   && state->nPassTilesRemain[s.nPassesComplete].load(std::memory_order::relaxed) == 0) {
+                ++s.nPassesComplete;
+            }
+        }
+        s.isDeadlineHit = state->isDeadlineHit.load(std::memory_order::relaxed);
         s.tSubmit = state->tSubmit;
         s.tStart = state->tStart;
         s.tComplete = state->tComplete;
@@ -194,10 +463,14 @@ public:
     }
 
 PRIVATE_IN_PRODUCTION
-    /**
-     * @brief Maximum render priority tile queue, sorted by PKey value
-     */
-    using TileQueue = std::priority_queue<Tile, std::vector<Tile>, LesserPKeyValue>;
+    static constexpr uint32_t TILE_SIZE{ 32 }; // NxN pixels in a tile
+    static constexpr uint32_t MIN_TILE_SIZE{ 8 }; // smallest tile budgeted jobs are cut into
+    static constexpr uint32_t MIN_TILES_PER_WORKER{ 4 }; // within a budget, so little is lost at the deadline
+    static constexpr double THROUGHPUT_SMOOTHING{ 0.2 }; // weight of each new throughput sample
+    static constexpr double DEFAULT_NS_PER_RAY{ 2000. }; // a guess, until tiles have been rendered
+    static constexpr int64_t WEIGHT_HEADSTART_MS{ 1000 }; // rank a weight of 1 adds over an infinite one
+    static constexpr uint32_t DEFAULT_TILE_BUDGET{ 1u << 16 }; // tiles in flight, ie: eight passes of a 4K image
+    static constexpr uint32_t TILES_QUEUED_PER_JOB{ 16 }; // a job's tiles made ahead of being taken
     /**
      * @brief Make a 64bit scheduler priority key for a given tile render configuration
      * @details Priority is determined by JobType, progressive pass number, and tile distance to
@@ -228,46 +501,228 @@ PRIVATE_IN_PRODUCTION
         return p_type | p_pass | p_dist;
     }
     /**
-     * @brief Break up a Job into a sequence of prioritized RenderTiles.
+     * @brief Get the rank of a job submitted now, for the low 32 bits of its tiles' priority keys
+     * @details Milliseconds since the scheduler started, so earlier jobs rank first, plus a
+     * headstart which heavier jobs mostly skip; a job of weight 2 ranks as though it were
+     * submitted half a headstart earlier than one of weight 1.
      */
-    static std::vector<Tile> getTilesForJobState(const std::shared_ptr<JobState>& state,
-                                                 const uint32_t tileSize = 32) {
+    PKey getJobRank(uint32_t weight) const {
+        const auto sinceEpoch = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - tEpoch).count();
+        const auto rank = sinceEpoch + WEIGHT_HEADSTART_MS / std::max(1u, weight);
+        return static_cast<PKey>(std::clamp<int64_t>(rank, 0, 0xFFFFFFFF));
+    }
+    /**
+     * @brief Trim a job with a budget to fit it, given the recent throughput of the workers.
+     * @details The coarsest pass is always kept, and as many of the following passes as fit.
+     * When even the coarsest doesn't, fewer bounces are traced. Tiles are made small enough that
+     * each worker gets several within the budget, so that little is lost at the deadline.
+     * @param nsPerRay time taken for a worker to trace one pixel's rays
+     * @param nWorkers workers rendering in parallel
+     * @return the size of the tiles to break the job into
+     */
+    static uint32_t fitJobToBudget(Job& job, double nsPerRay, uint32_t nWorkers);
+    /**
+     * @brief Lay out the grid of a job's tiles, and the order its cells are visited in each pass
+     */
+    static TileCursor makeTileCursor(const Job& job, uint32_t tileSize = TILE_SIZE);
+    /**
+     * @brief Make one of a job's tiles, by its index, with its priority in the queue
+     */
+    static Tile makeTile(const std::shared_ptr<JobState>& state, const TileCursor& layout, uint32_t nTile) {
         const auto& job = state->job;
-        ASSERT(job.type != JobType::invalid, "job type must be specified before getting tiles");
-        const auto W = job.width, H = job.height;
+        const auto r = layout.getRect(nTile);
+        Tile t{ state };
+        t.jobID = job.id;
+        t.nTile = nTile;
+        t.nPass = r.nPass;
+        t.blockSize = std::max(1u, job.passes.at(r.nPass));
+        // x0 y0 are inclusive, x1 y1 exclusive
+        t.x0 = r.x0;
+        t.y0 = r.y0;
+        t.x1 = r.x1;
+        t.y1 = r.y1;
+        // priority in queue
+        const auto cx = (t.x1 + t.x0) / 2;
+        const auto cy = (t.y1 + t.y0) / 2;
+        t.priority = getPriorityKeyForTile(job.type, r.nPass, cx, cy, job.width, job.height) | state->rank;
+        return t;
+    }
+    /**
+     * @brief Break up a Job into all of its prioritized RenderTiles at once, in index order
+     * @details Submitted jobs make theirs a few at a time instead, with their TileCursor.
+     */
+    static std::vector<Tile> getTilesForJobState(const std::shared_ptr<JobState>& state,
+                                                 const uint32_t tileSize = TILE_SIZE) {
+        ASSERT(state->job.type != JobType::invalid, "job type must be specified before getting tiles");
+        const auto layout = makeTileCursor(state->job, tileSize);
         std::vector<Tile> tiles;
-        // one or more sets of tiles are created -- one for each progressive pass
-        for (size_t nPass{ }; nPass < job.passes.size(); ++nPass) {
-            const auto blockSize = std::max(1u, job.passes.at(nPass));
-            // tiles for a single pass
-            for (uint32_t y{ }; y < H; y += tileSize) {
-                for (uint32_t x{ }; x < W; x += tileSize) {
-                    Tile t{ state };
-                    t.jobID = state->job.id;
-                    t.nPass = nPass;
-                    t.blockSize = blockSize;
-                    // x0 y0 are inclusive
-                    t.x0 = x;
-                    t.y0 = y;
-                    // x1 y1 are exclusive
-                    t.x1 = std::min(W, x + tileSize);
-                    t.y1 = std::min(H, y + tileSize);
-                    // priority in queue
-                    const auto cx = (t.x1 + t.x0) / 2;
-                    const auto cy = (t.y1 + t.y0) / 2;
-                    t.priority = getPriorityKeyForTile(job.type, nPass, cx, cy, W, H);
-                    tiles.emplace_back(std::move(t));
-                }
-            }
+        tiles.reserve(layout.getTileCount());
+        for (uint32_t n{ }; n < layout.getTileCount(); ++n) {
+            tiles.emplace_back(makeTile(state, layout, n));
         }
         return tiles;
     }
-
     /**
-     * @brief Helper to complete a job and send it to the finalizer
+     * @brief Give a job its ID, and trim it to its budget if it has one
+     * @details The World's build quality is left alone here, since other jobs may be tracing
+     * through it; it is switched as the job's tiles are dispatched (see buildWorldFor()).
+     * @return the size of the tiles to break the job into
+     */
+    uint32_t prepareJob(Job& job) {
+        job.id = getNextJobID();
+        // jobs with a budget are trimmed to what recent tiles say can be rendered in time
+        return job.budget.count() > 0 ? fitJobToBudget(job, getNsPerRay(), getWorkerCount()) : TILE_SIZE;
+    }
+    /**
+     * @brief Make the state of a job about to be submitted, with its tile cursor, ranks and
+     * counts, restoring any tiles its checkpoint holds
+     */
+    std::shared_ptr<JobState> makeJobState(Job job, uint32_t tileSize);
+    /**
+     * @brief Open a job's checkpoint, restoring the tiles it holds into the job's image and
+     * counting them complete; its cursor skips them
+     * @details The job goes without a checkpoint if its file can't be written.
+     */
+    static void restoreCheckpoint(const std::shared_ptr<JobState>& state);
+    /**
+     * @brief Make sure a job's World is built at the quality its type of job calls for, before one
+     * of its tiles is dispatched
+     * @details Workers trace through the World's trees without locks, so switching quality (which
+     * rebuilds them on next use) waits until every tile out has been handed back. Only a change
+     * of mode mixes types which build differently, so the wait is a scanline or so, once.
+     * NOT thread safe! Intended to be called within a thread-safe block, with its lock.
+     * @return false if the scheduler was shut down while waiting
+     */
+    bool buildWorldFor(std::unique_lock<std::mutex>& lock, const JobState& state);
+    /**
+     * @brief Count a tile handed back by a worker, whether rendered, dropped or yielded, waking
+     * any dispatch waiting for the workers to be idle
+     */
+    void handBack(const Tile& t) {
+        if (!t.isDispatched) return;
+        if (nTilesDispatched.fetch_sub(1) == 1 && nWaitingForIdle.load() > 0) {
+            // taken so the waiting worker can't miss the wake between its check and its wait
+            { std::scoped_lock lock{ m_tiles }; }
+            cv_tiles.notify_all();
+        }
+    }
+    /**
+     * @brief Queue a tile for dispatch, or park it if the mode doesn't allow its job or the job is paused
      * @details NOT thread safe! Intended to be called within a thread-safe block.
      */
-    void setCompleteAndFinalize(const std::shared_ptr<JobState>& state);
+    void enqueue(Tile&& t) {
+        if (isDispatchable(*t.state)) {
+            tiles.push(std::move(t));
+        } else {
+            parked.push(std::move(t));
+        }
+    }
+    /**
+     * @brief True if a job's tiles can be dispatched, ie: the mode allows its type and it isn't paused
+     */
+    bool isDispatchable(const JobState& state) const {
+        return is_type_allowed_in_mode(state.job.type, getMode())
+               && !state.isPaused.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Count an admitted job's tiles against the budget while they can be dispatched, and
+     * release them while they're parked, so it's only jobs which can run that keep others pending
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void updateBudgetShare(JobState& state);
+    /**
+     * @brief True if a job with some number of tiles fits in the tile budget now
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    bool fitsTileBudget(uint32_t nTiles) const {
+        const auto inFlight = nTilesInFlight.load(std::memory_order_relaxed);
+        // a job bigger than the whole budget is still admitted, alone
+        return inFlight == 0 || inFlight + nTiles <= tileBudget;
+    }
+    /**
+     * @brief Admit pending jobs in order, most urgent type first, for as long as they fit
+     * @details Jobs which can't be dispatched yet are admitted without waiting, since they don't
+     * count against the budget until they can.
+     * NOT thread safe! Intended to be called within a thread-safe block.
+     * @return true if any job was admitted
+     */
+    bool admitPending();
+    /**
+     * @brief Count a job's tiles in flight, and queue the first few of them
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void admit(const std::shared_ptr<JobState>& state);
+    /**
+     * @brief Make a job's next tile from its cursor, and queue (or park) it
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     * @return false if the job has no more tiles to make
+     */
+    bool queueNextTile(const std::shared_ptr<JobState>& state);
+    /**
+     * @brief Give up on the tiles a job hasn't queued yet, ie: when it is cancelled or out of time
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void dropUnqueuedTiles(const std::shared_ptr<JobState>& state);
+    /**
+     * @brief Give up on a tile taken from a queue rather than from a worker, ending its job if it was
+     * the last one
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void dropQueuedTile(const Tile& t) {
+        if (t.state != nullptr && t.state->nTilesRemain.fetch_sub(1) <= 1) {
+            endJob(t.state);
+        }
+    }
+    /**
+     * @brief Take every tile from a queue and queue or park each again, ie: after a change in the
+     * mode
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void requeue(TileQueue& from) {
+        for (auto& t: from.drain()) {
+            enqueue(std::move(t));
+        }
+    }
+    /**
+     * @brief Publish the priority of the most urgent queued tile, for workers deciding to yield
+     * @details NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void publishQueuedPriority() {
+        queuedPriority.store(tiles.urgentPriority(), std::memory_order_relaxed);
+    }
+    /**
+     * @brief Helper to complete a job and send it to the finalizer
+     * @details Never called within a thread-safe block; see endJob().
+     */
+    void setCompleteAndFinalize(const std::shared_ptr<JobState>& state) {
+        setComplete(state);
+        finalize(state);
+    }
+    /**
+     * @brief Complete a job while the lock is held, leaving it in ended to be finalized once the
+     * lock is let go
+     * @details The finalizer erases the states of the jobs it's done with, which takes the lock,
+     * so a full finalizer queue would never drain while this thread held it.
+     * NOT thread safe! Intended to be called within a thread-safe block.
+     */
+    void endJob(const std::shared_ptr<JobState>& state) {
+        setComplete(state);
+        ended.push_back(state);
+    }
+    /**
+     * @brief Mark a job complete, taking its tiles out of the budget and settling its checkpoint
+     */
+    void setComplete(const std::shared_ptr<JobState>& state);
+    /**
+     * @brief Send ended jobs to the finalizer
+     */
+    void finalize(const std::shared_ptr<JobState>& state);
+    void finalize(const std::vector<std::shared_ptr<JobState>>& states) {
+        for (const auto& state: states) {
+            finalize(state);
+        }
+    }
 
     /**
      * @brief Get the next Job number in the sequence
@@ -279,13 +734,25 @@ PRIVATE_IN_PRODUCTION
 
 PRIVATE_IN_PRODUCTION
     TileQueue tiles;
+    TileQueue parked; // tiles of jobs the current mode doesn't allow
+    // jobs waiting for room in the tile budget, by type, in the order they were submitted
+    std::array<std::deque<std::shared_ptr<JobState>>, TileQueue::N_CLASSES> pending{ };
+    uint32_t tileBudget{ DEFAULT_TILE_BUDGET };
+    std::atomic<uint64_t> nTilesInFlight{ 0 }; // tiles of admitted, dispatchable jobs which haven't ended
+    std::atomic<uint32_t> nTilesDispatched{ 0 }; // tiles in workers' hands
+    std::atomic<uint32_t> nWaitingForIdle{ 0 }; // dispatches waiting for no tiles to be in workers' hands
+    std::atomic<PKey> queuedPriority{ PKey_MIN }; // priority of the most urgent tile in the queue
+    const std::chrono::steady_clock::time_point tEpoch; // job ranks count from here
     std::unordered_map<JobID, std::shared_ptr<JobState>> jobs;  // jobs in progress
+    std::vector<std::shared_ptr<JobState>> ended; // jobs ended under the lock, to be finalized after it
     std::mutex m_tiles;
     std::condition_variable cv_tiles; // signal for tiles queue status
     bool inShutdown{ false };
     JobID jobID{ JobID_INVALID };
     mutable std::mutex m_jobID;
-    Mode mode{ Mode::live_gui };
+    std::atomic<Mode> mode{ Mode::live_gui };
+    std::atomic<double> nsPerRay{ DEFAULT_NS_PER_RAY }; // smoothed worker throughput
+    std::atomic<uint32_t> nWorkers{ 0 };
     JobFinalizer* finalizer{ nullptr };
 
     DELETE_COPY_AND_MOVE(JobScheduler)
@@ -9,9 +9,11 @@
 
 #include <vector>
 #include <cmath>
+#include <cstdint>
 
 #include "raytracer/math/tuples.hpp"
 #include "raytracer/math/matrix.hpp"
+#include "raytracer/common/utils.hpp"
 
 namespace rt
 {
@@ -19,17 +21,45 @@ namespace rt
 class Ray
 {
   public:
-    Ray(Tuple origin, Tuple direction);
-    [[nodiscard]] Tuple getOrigin() const;
-    [[nodiscard]] Tuple getDirection() const;
+    /// @brief A ray cast from an origin along a direction.
+    /// @details Alongside the direction, the ray caches its reciprocal and the sign of each
+    /// component, so that slab tests against boxes only multiply. The range [tMin, tMax] is the
+    /// part of the ray which can still affect the image; bounding volumes lying entirely outside
+    /// of it may be skipped. Shapes themselves still report every intersection they find, since
+    /// refraction and CSG need both ends of a shape's interval.
+    Ray(Tuple origin, Tuple direction, double tMin = 0., double tMax = INF);
+    [[nodiscard]] inline const Tuple& getOrigin() const { return origin; }
+    [[nodiscard]] inline const Tuple& getDirection() const { return direction; }
+    /// @brief The reciprocal of each component of the direction. Zero components give infinity.
+    [[nodiscard]] inline const Tuple& getInvDirection() const { return invDirection; }
+    /// @brief True when the direction is negative along the given axis (0 = x, 1 = y, 2 = z).
+    [[nodiscard]] inline bool isNegative(size_t axis) const { return sign[axis] != 0; }
+    [[nodiscard]] inline double getTMin() const { return tMin; }
+    [[nodiscard]] inline double getTMax() const { return tMax; }
+    /// @brief Limit the range of t which can still affect the image, ie: the distance to a light.
+    inline void setRange(double newTMin, double newTMax) { tMin = newTMin; tMax = newTMax; }
     /// Get the position at the given distance t along the ray
-    Tuple position(double t);
+    [[nodiscard]] inline Tuple position(double t) const { return origin + direction * t; }
     /// Apply a Transform() Matrix(), returning a new Ray.
-    [[nodiscard]] Ray transform(TransformationMatrix t) const;
+    [[nodiscard]] Ray transform(const TransformationMatrix& t) const;
+    /// @brief Give the ray a cone footprint, used to filter textures sampled by the ray.
+    /// @param width Width of the footprint at the ray's origin, in world units.
+    /// @param spread Growth of the footprint per unit of distance travelled along the ray.
+    inline void setCone(double width, double spread) { coneWidth = width; coneSpread = spread; }
+    /// @brief Width of the ray's footprint at distance t along it, in world units. A ray without
+    /// a cone has a footprint of 0 everywhere, which samples textures at full detail.
+    [[nodiscard]] inline double footprintAt(double t) const { return coneWidth + coneSpread * t; }
+    [[nodiscard]] inline double getConeWidth() const { return coneWidth; }
+    [[nodiscard]] inline double getConeSpread() const { return coneSpread; }
 
   private:
     Tuple origin;
     Tuple direction;
+    Tuple invDirection;
+    uint8_t sign[3];
+    double tMin, tMax;
+    double coneWidth{ 0. };
+    double coneSpread{ 0. };
 };
 }
 
@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Ray Packets
+///     Small bundles of coherent rays, traced together in structure of arrays (SoA) layout
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "raytracer/math/tuples.hpp"
+#include "raytracer/math/matrix.hpp"
+#include "raytracer/math/bounds.hpp"
+#include "raytracer/renderer/ray.hpp"
+#include "raytracer/renderer/intersection.hpp"
+#include "raytracer/common/utils.hpp"
+
+namespace rt
+{
+/// @brief One bit per lane of a packet, with lane 0 in the lowest bit.
+using LaneMask = uint32_t;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// RayPacket
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief A packet of N rays, stored as a structure of arrays so that each step of an intersection
+/// test runs across every lane at once.
+/// @details Packets are built from small blocks of neighbouring pixels, BLOCK_WIDTH x BLOCK_HEIGHT,
+/// whose rays take nearly the same path through the scene. Lanes which hold no ray (ie: past the
+/// edge of the canvas) are left out of the active mask and never report hits.
+template<size_t N>
+struct RayPacket
+{
+    static_assert(N == 4 || N == 8, "ray packets are 4 or 8 rays wide");
+    static constexpr size_t SIZE{ N };
+    static constexpr uint32_t BLOCK_WIDTH{ N / 2 };
+    static constexpr uint32_t BLOCK_HEIGHT{ 2 };
+    static constexpr LaneMask ALL_LANES{ (1u << N) - 1 };
+
+    /// @brief Store a ray in a lane, and make the lane active.
+    void setRay(size_t lane, const Ray& ray)
+    {
+        const auto& o = ray.getOrigin();
+        const auto& d = ray.getDirection();
+        const auto& id = ray.getInvDirection();
+        ox[lane] = o.x; oy[lane] = o.y; oz[lane] = o.z;
+        dx[lane] = d.x; dy[lane] = d.y; dz[lane] = d.z;
+        idx[lane] = id.x; idy[lane] = id.y; idz[lane] = id.z;
+        tMin[lane] = ray.getTMin();
+        tMax[lane] = ray.getTMax();
+        coneWidth[lane] = ray.getConeWidth();
+        coneSpread[lane] = ray.getConeSpread();
+        active |= 1u << lane;
+    }
+    /// @brief Rebuild the single ray in a lane, ie: to shade it or trace it on its own.
+    [[nodiscard]] Ray getRay(size_t lane) const
+    {
+        Ray ray{ Point{ ox[lane], oy[lane], oz[lane] }, Vector{ dx[lane], dy[lane], dz[lane] },
+                 tMin[lane], tMax[lane] };
+        ray.setCone(coneWidth[lane], coneSpread[lane]);
+        return ray;
+    }
+    [[nodiscard]] inline bool isActive(size_t lane) const { return (active >> lane) & 1u; }
+    /// @brief Apply a Transform() Matrix() to every lane, returning a new packet.
+    /// @details Directions are not renormalised, so distances t along each ray carry over
+    /// unchanged between the two spaces, just as with Ray::transform().
+    [[nodiscard]] RayPacket transform(const TransformationMatrix& M) const
+    {
+        RayPacket out{ *this };
+        for (size_t i{}; i < N; ++i)
+        {
+            out.ox[i] = M(0, 0) * ox[i] + M(0, 1) * oy[i] + M(0, 2) * oz[i] + M(0, 3);
+            out.oy[i] = M(1, 0) * ox[i] + M(1, 1) * oy[i] + M(1, 2) * oz[i] + M(1, 3);
+            out.oz[i] = M(2, 0) * ox[i] + M(2, 1) * oy[i] + M(2, 2) * oz[i] + M(2, 3);
+            out.dx[i] = M(0, 0) * dx[i] + M(0, 1) * dy[i] + M(0, 2) * dz[i];
+            out.dy[i] = M(1, 0) * dx[i] + M(1, 1) * dy[i] + M(1, 2) * dz[i];
+            out.dz[i] = M(2, 0) * dx[i] + M(2, 1) * dy[i] + M(2, 2) * dz[i];
+        }
+        for (size_t i{}; i < N; ++i)
+        {
+            out.idx[i] = 1. / out.dx[i];
+            out.idy[i] = 1. / out.dy[i];
+            out.idz[i] = 1. / out.dz[i];
+        }
+        return out;
+    }
+
+    alignas(64) double ox[N]{}, oy[N]{}, oz[N]{};       /// origins
+    alignas(64) double dx[N]{}, dy[N]{}, dz[N]{};       /// directions
+    alignas(64) double idx[N]{}, idy[N]{}, idz[N]{};    /// reciprocal directions
+    alignas(64) double tMin[N]{}, tMax[N]{};
+    double coneWidth[N]{}, coneSpread[N]{};
+    LaneMask active{ 0 };
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// PacketHit
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief The closest hit found so far in each lane of a RayPacket.
+/// @details Each lane's t starts at the end of its ray's range, and only shrinks as closer hits
+/// are found, so it doubles as the far limit for the rest of the traversal. Inactive lanes start
+/// at -INF, which no hit can beat, so kernels don't need to test the active mask.
+template<size_t N>
+struct PacketHit
+{
+    explicit PacketHit(const RayPacket<N>& packet)
+    {
+        for (size_t i{}; i < N; ++i)
+            t[i] = packet.isActive(i) ? packet.tMax[i] : -INF;
+    }
+    /// @brief Keep a hit in a lane if it is in the ray's range and closer than the current one.
+    inline void record(const RayPacket<N>& packet, size_t lane, double tHit, Shape* hitShape,
+                       double hitU = 0., double hitV = 0., Instance* hitInstance = nullptr)
+    {
+        if (tHit >= packet.tMin[lane] && tHit < t[lane])
+        {
+            t[lane] = tHit;
+            shape[lane] = hitShape;
+            u[lane] = hitU;
+            v[lane] = hitV;
+            instance[lane] = hitInstance;
+        }
+    }
+    /// @brief Lanes which have hit something.
+    [[nodiscard]] LaneMask getHitMask() const
+    {
+        LaneMask mask{ 0 };
+        for (size_t i{}; i < N; ++i)
+            mask |= static_cast<LaneMask>(shape[i] != nullptr) << i;
+        return mask;
+    }
+    /// @brief The hit in a lane as an Intersection, which is a miss if the lane hit nothing.
+    [[nodiscard]] Intersection getIntersection(size_t lane) const
+    {
+        if (shape[lane] == nullptr)
+            return Intersection::makeMissedHit();
+        Intersection hit{ t[lane], shape[lane], u[lane], v[lane] };
+        hit.instance = instance[lane];
+        return hit;
+    }
+
+    alignas(64) double t[N]{};
+    Shape* shape[N]{};
+    double u[N]{}, v[N]{};  /// coordinates of the hit on a triangle's face
+    Instance* instance[N]{};  /// the Instance() each lane's shape was hit through, if any
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Packet kernels
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @details The kernels run every lane through the same branch free arithmetic, and only select
+/// the result per lane at the end, so that the loops vectorise. Invalid lanes (ie: negative
+/// discriminants) may produce NaNs along the way, which then fail every comparison.
+namespace Packet
+{
+/// @brief Slab test of a packet against a box, limited to each lane's range and closest hit.
+/// @return The lanes whose rays pass through the box.
+template<size_t N>
+LaneMask intersectBox(const BoundingBox& box, const RayPacket<N>& packet, const PacketHit<N>& hits)
+{
+    alignas(64) double tNear[N], tFar[N];
+    for (size_t i{}; i < N; ++i)
+    {
+        tNear[i] = packet.tMin[i];
+        tFar[i] = hits.t[i];
+    }
+    const auto slab = [&](const double* o, const double* id, double lo, double hi) {
+        for (size_t i{}; i < N; ++i)
+        {
+            // a negative direction meets the far plane first; written so that a NaN (a ray
+            //  lying exactly in a slab plane) leaves the range untouched, as in the scalar test
+            const bool isNegative = id[i] < 0.;
+            const double t0 = ((isNegative ? hi : lo) - o[i]) * id[i];
+            const double t1 = ((isNegative ? lo : hi) - o[i]) * id[i];
+            tNear[i] = t0 > tNear[i] ? t0 : tNear[i];
+            tFar[i] = t1 < tFar[i] ? t1 : tFar[i];
+        }
+    };
+    slab(packet.ox, packet.idx, box.min.x, box.max.x);
+    slab(packet.oy, packet.idy, box.min.y, box.max.y);
+    slab(packet.oz, packet.idz, box.min.z, box.max.z);
+    LaneMask mask{ 0 };
+    for (size_t i{}; i < N; ++i)
+        mask |= static_cast<LaneMask>(tNear[i] <= tFar[i]) << i;
+    return mask & packet.active;
+}
+
+/// @brief Intersect a packet of object space rays with a unit sphere, keeping closer hits.
+template<size_t N>
+void intersectSphere(const Tuple& centre, const RayPacket<N>& packet, PacketHit<N>& hits,
+                     Shape* shape)
+{
+    alignas(64) double tHit[N];
+    for (size_t i{}; i < N; ++i)
+    {
+        const double sx = packet.ox[i] - centre.x;
+        const double sy = packet.oy[i] - centre.y;
+        const double sz = packet.oz[i] - centre.z;
+        const double a = packet.dx[i] * packet.dx[i] + packet.dy[i] * packet.dy[i]
+                         + packet.dz[i] * packet.dz[i];
+        const double b = 2.0 * (packet.dx[i] * sx + packet.dy[i] * sy + packet.dz[i] * sz);
+        const double c = (sx * sx + sy * sy + sz * sz) - 1.0;
+        const double discriminant = b * b - 4.0 * a * c;
+        const double SQRT_D = std::sqrt(discriminant >= 0. ? discriminant : 0.);
+        const double INV_2A = 0.5 / a;
+        const double t0 = (-b - SQRT_D) * INV_2A;
+        const double t1 = (-b + SQRT_D) * INV_2A;
+        // the nearer root, unless it lies behind the start of the ray
+        const double t = t0 >= packet.tMin[i] ? t0 : t1;
+        tHit[i] = discriminant >= 0. ? t : -INF;
+    }
+    for (size_t i{}; i < N; ++i)
+    {
+        const bool isCloser = tHit[i] >= packet.tMin[i] && tHit[i] < hits.t[i];
+        hits.t[i] = isCloser ? tHit[i] : hits.t[i];
+        hits.shape[i] = isCloser ? shape : hits.shape[i];
+        hits.instance[i] = isCloser ? nullptr : hits.instance[i];
+    }
+}
+
+/// @brief Intersect a packet of object space rays with a triangle, keeping closer hits.
+/// @details The same watertight test as Accel::intersectTriangle(), one lane at a time. Each lane
+/// permutes and shears the triangle's corners for its own ray, by selects rather than indexing,
+/// so that the loop still vectorises.
+template<size_t N>
+void intersectTriangle(const Tuple& p1, const Tuple& p2, const Tuple& p3,
+                       const RayPacket<N>& packet, PacketHit<N>& hits, Shape* shape)
+{
+    alignas(64) double tHit[N], uHit[N], vHit[N];
+    for (size_t i{}; i < N; ++i)
+    {
+        const double dx = packet.dx[i], dy = packet.dy[i], dz = packet.dz[i];
+        const double adx = std::abs(dx), ady = std::abs(dy), adz = std::abs(dz);
+        // 0, 1 or 2 for the axis the ray travels furthest along, which becomes z
+        const int kz = adx >= ady ? (adx >= adz ? 0 : 2) : (ady >= adz ? 1 : 2);
+        const int kxNext = kz == 2 ? 0 : kz + 1;
+        const int kyNext = kxNext == 2 ? 0 : kxNext + 1;
+        const auto pick = [](int k, double x, double y, double z) { return k == 0 ? x : (k == 1 ? y : z); };
+        const double dkz = pick(kz, dx, dy, dz);
+        // keep the winding of the triangle the same, whichever way along z the ray runs
+        const int kx = dkz < 0. ? kyNext : kxNext;
+        const int ky = dkz < 0. ? kxNext : kyNext;
+        const double sx = pick(kx, dx, dy, dz) / dkz;
+        const double sy = pick(ky, dx, dy, dz) / dkz;
+        const double sz = 1. / dkz;
+        const double ax3 = p1.x - packet.ox[i], ay3 = p1.y - packet.oy[i], az3 = p1.z - packet.oz[i];
+        const double bx3 = p2.x - packet.ox[i], by3 = p2.y - packet.oy[i], bz3 = p2.z - packet.oz[i];
+        const double cx3 = p3.x - packet.ox[i], cy3 = p3.y - packet.oy[i], cz3 = p3.z - packet.oz[i];
+        const double az = pick(kz, ax3, ay3, az3);
+        const double bz = pick(kz, bx3, by3, bz3);
+        const double cz = pick(kz, cx3, cy3, cz3);
+        const double ax = pick(kx, ax3, ay3, az3) - sx * az;
+        const double ay = pick(ky, ax3, ay3, az3) - sy * az;
+        const double bx = pick(kx, bx3, by3, bz3) - sx * bz;
+        const double by = pick(ky, bx3, by3, bz3) - sy * bz;
+        const double cx = pick(kx, cx3, cy3, cz3) - sx * cz;
+        const double cy = pick(ky, cx3, cy3, cz3) - sy * cz;
+        const double U = cx * by - cy * bx;
+        const double V = ax * cy - ay * cx;
+        const double W = bx * ay - by * ax;
+        const double determinant = U + V + W;
+        const double t = (U * az + V * bz + W * cz) * sz / determinant;
+        const bool isOutside = (U < 0. || V < 0. || W < 0.) && (U > 0. || V > 0. || W > 0.);
+        tHit[i] = !isOutside && determinant != 0. ? t : -INF;
+        uHit[i] = V / determinant;
+        vHit[i] = W / determinant;
+    }
+    for (size_t i{}; i < N; ++i)
+    {
+        const bool isCloser = tHit[i] >= packet.tMin[i] && tHit[i] < hits.t[i];
+        hits.t[i] = isCloser ? tHit[i] : hits.t[i];
+        hits.shape[i] = isCloser ? shape : hits.shape[i];
+        hits.instance[i] = isCloser ? nullptr : hits.instance[i];
+        hits.u[i] = isCloser ? uHit[i] : hits.u[i];
+        hits.v[i] = isCloser ? vHit[i] : hits.v[i];
+    }
+}
+}
+}
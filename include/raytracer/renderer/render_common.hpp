@@ -12,13 +12,18 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <chrono>
 #include <limits>
 #include <atomic>
+#include <filesystem>
 #include <functional>
+#include <memory>
+#include <vector>
 #include "raytracer/environment/world.hpp"
 #include "raytracer/environment/camera.hpp"
+#include "raytracer/common/mpsc_queue.hpp"
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,13 +42,22 @@ inline constexpr uint64_t type_to_priority(JobType type) noexcept {
     return static_cast<uint64_t>(type);
 }
 
+/**
+ * @brief How the World's BVHs are built for a type of job. Offline renders trace enough rays to
+ * pay back slower, spatial split builds; the others keep the fast builders.
+ */
+inline constexpr Accel::BuildQuality type_to_build_quality(JobType type) noexcept {
+    return type == JobType::offline ? Accel::BuildQuality::high : Accel::BuildQuality::fast;
+}
+
 /** @brief Numerical identifier for render job */
 using JobID = uint64_t;
 constexpr auto JobID_INVALID = std::numeric_limits<JobID>::max();
 
 /**
  * @brief Priority key ranks tile priority in the render queue
- * @details Bit packing: [JobType:8 | n_pass:8 | dist:16 | reserved:32]
+ * @details Bit packing: [JobType:8 | n_pass:8 | dist:16 | rank:32], where the rank orders the jobs
+ * within a type by age and weight
  */
 using PKey = uint64_t;
 constexpr auto PKey_MIN = std::numeric_limits<uint64_t>::max();
@@ -57,6 +71,15 @@ enum class Mode : uint8_t {
     invalid = std::numeric_limits<uint8_t>::max()
 };
 
+/**
+ * @brief True if tiles of a type of job are dispatched in a rendering mode
+ * @details live_gui renders realtime and background jobs, and render_only renders offline jobs
+ * alone. Tiles of the other types are parked until the mode changes back.
+ */
+inline constexpr bool is_type_allowed_in_mode(JobType type, Mode mode) noexcept {
+    return mode == Mode::render_only ? type == JobType::offline : type != JobType::offline;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  * @brief Target image output for rendering a job to
@@ -67,6 +90,21 @@ struct ImageTarget {
 
     Canvas buffer;                          // output in-memory image buffer
     std::string path{ "image_target.ppm" }; // target image path when rendering to disk
+    bool isWrittenToDisk{ false };          // the finalizer also saves the image to path as a PPM
+
+    /**
+     * @brief Get the memory the target holds beyond its own size, in bytes, mostly its pixels
+     */
+    size_t getMemoryUse() const {
+        return path.capacity()
+               + static_cast<size_t>(buffer.getWidth()) * buffer.getHeight() * sizeof(Colour);
+    }
+    /**
+     * @brief Free the pixels, once nothing will read them again
+     */
+    void releaseBuffer() {
+        buffer = Canvas{ 0, 0 };
+    }
     bool operator==(const ImageTarget& other) const {
         return path == other.path
                && buffer.getWidth() == other.buffer.getWidth()
@@ -74,6 +112,64 @@ struct ImageTarget {
     }
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief A region of a job's image which has just been rendered
+ */
+struct TileEvent {
+    JobID jobID{ JobID_INVALID };
+    uint32_t nPass{ };
+    uint32_t x0{ }, y0{ }, x1{ }, y1{ }; // x0 y0 inclusive, x1 y1 exclusive
+};
+
+/**
+ * @brief Stream of the regions of one or more jobs' images as they land, eg: for a GUI to blit
+ * only what has changed in the image targets
+ * @details Workers publish into a lock-free ring and never wait on the consumer: when the ring is
+ * full, events are dropped and counted, so a consumer seeing drops should refresh the whole
+ * image. Drained from a single thread.
+ */
+class TileEventStream {
+public:
+    static constexpr size_t DEFAULT_CAPACITY{ 1024 };
+
+    explicit TileEventStream(size_t capacity = DEFAULT_CAPACITY) : ring(capacity) { }
+
+    /**
+     * @brief Publish an event, from any thread
+     * @return false if the ring was full and the event was dropped
+     */
+    bool publish(const TileEvent& e) {
+        if (ring.try_push(e)) return true;
+        nDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    /**
+     * @brief Visit and remove every event published so far. Consumer thread only.
+     * @return the number of events visited
+     */
+    template<typename Visitor>
+    size_t drain(Visitor&& visit) {
+        size_t n{ };
+        while (auto* e = ring.front()) {
+            visit(static_cast<const TileEvent&>(*e));
+            ring.pop();
+            ++n;
+        }
+        return n;
+    }
+    /**
+     * @brief Get the number of events dropped since last asked, resetting it
+     */
+    uint64_t takeDroppedCount() {
+        return nDropped.exchange(0, std::memory_order_relaxed);
+    }
+
+PRIVATE_IN_PRODUCTION
+    MPSCQueue<TileEvent> ring;
+    std::atomic<uint64_t> nDropped{ };
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  * @brief Describes a single rendering task request in the render queue.
@@ -100,6 +196,18 @@ struct Job {
     // progressive refinement pass block sizes in (NxN) pixels
     // eg: { 32, 16, 8, 1 } gives you 4 passes with 32px, 16px 8px and 1px resolutions
     std::vector<uint32_t> passes{ 1 };
+    // time from submission the job must be delivered within, or zero for none. The scheduler
+    //  trims passes, tiles and ray depth to fit it, and ends the job when it runs out
+    std::chrono::nanoseconds budget{ 0 };
+    size_t rayDepth{ World::MAX_RAYS }; // reflected/refracted bounces traced from each pixel
+    // share of the workers relative to other jobs of its type; heavier jobs rank as though they
+    //  had been submitted earlier
+    uint32_t weight{ 1 };
+    // if set, workers publish each region of the image as it is rendered; may be shared by jobs
+    std::shared_ptr<TileEventStream> tileEvents{ nullptr };
+    // if set, finished tiles are saved here as they land, and a job submitted again with the same
+    //  file and tile layout (ie: after a restart) only renders the tiles it is missing
+    std::filesystem::path checkpointFile{ };
     JobID id{ JobID_INVALID };
 };
 
@@ -130,6 +238,8 @@ struct JobSummary {
     uint32_t nTilesComplete{};
     uint64_t nPixelsComplete{};
     uint32_t nPasses{};
+    uint32_t nPassesComplete{}; // leading passes rendered in full
+    bool isDeadlineHit{ false }; // the job's budget ran out before all of its passes were rendered
     // timestamps
     std::chrono::steady_clock::time_point tSubmit{}, tStart{}, tComplete{};
 };
@@ -149,6 +259,64 @@ struct JobToFinalize {
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ * @brief Where a tile is in its job's image, and which pass it renders
+ */
+struct TileRect {
+    uint32_t x0{ }, y0{ }, x1{ }, y1{ }; // x0 y0 inclusive, x1 y1 exclusive
+    uint32_t nPass{ };
+
+    size_t area() const {
+        return static_cast<size_t>(x1 - x0) * (y1 - y0);
+    }
+};
+
+/**
+ * @brief Walks a job's tiles in the order they're dispatched, so they can be made a few at a time
+ * rather than all at once
+ * @details Tiles are indexed pass by pass, and row by row within a pass. Every pass visits the
+ * cells of the grid in the same order, most urgent (nearest the centre) first.
+ */
+struct TileCursor {
+    uint32_t width{ }, height{ };
+    uint32_t tileSize{ 1 };
+    uint32_t nCols{ }, nRows{ }, nPasses{ };
+    std::vector<uint32_t> cells{ }; // cells of a pass, in the order they're visited
+    uint32_t nNext{ }; // position of the next tile in the walk
+
+    uint32_t getCellCount() const {
+        return nCols * nRows;
+    }
+    uint32_t getTileCount() const {
+        return nPasses * getCellCount();
+    }
+    bool isDone() const {
+        return nNext >= getTileCount();
+    }
+    /**
+     * @brief Get the index of the next tile, and move past it
+     */
+    uint32_t next() {
+        const auto nCells = getCellCount();
+        const auto n = nNext++;
+        return n / nCells * nCells + cells[n % nCells];
+    }
+    TileRect getRect(uint32_t nTile) const {
+        const auto nCells = getCellCount();
+        const auto cell = nTile % nCells;
+        TileRect r;
+        r.x0 = cell % nCols * tileSize;
+        r.y0 = cell / nCols * tileSize;
+        r.x1 = std::min(width, r.x0 + tileSize);
+        r.y1 = std::min(height, r.y0 + tileSize);
+        r.nPass = nTile / nCells;
+        return r;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class Checkpoint;
+
 /**
  * @brief Render job state for the Scheduler
  */
@@ -161,17 +329,30 @@ struct JobState {
     }
 
     Job job;
-    std::atomic<bool> isStarted{ false };   // flagged when rendering has begun
+    std::atomic<bool> isStarted{ false };   // flagged when admitted, and its tiles begin to be queued
+    std::atomic<bool> isBudgeted{ false };  // its tiles count against the tile budget, while it can be dispatched
     std::atomic<bool> isCompleted{ false }; // true when completed (even if not 100% done)
     std::atomic<bool> isCancelled{ false }; // flag to stop queueing job tiles for render
+    std::atomic<bool> isPaused{ false }; // the job's tiles are parked until it resumes
+    std::atomic<bool> isDeadlineHit{ false }; // flagged when tiles were dropped at the deadline
     JobEndedCallback onJobEnd{ nullptr }; // callback fires on job end, after finalize
+    std::shared_ptr<Checkpoint> checkpoint{ nullptr }; // saves finished tiles, if the job has a checkpointFile
+    TileCursor cursor{ }; // the tiles not yet queued; guarded by the scheduler
+    PKey rank{ }; // low bits of its tiles' priority keys, ranking it among jobs of its type
     // metrics
     uint32_t nTiles{};
     std::atomic<uint32_t> nTilesRemain{}; // tiles left in job
     std::atomic<uint32_t> nTilesComplete{}; // tiles actually rendered to completion
     std::atomic<uint64_t> nPixelsComplete{};
+    std::unique_ptr<std::atomic<uint32_t>[]> nPassTilesRemain{ }; // tiles left in each pass
     // timestamps
     std::chrono::steady_clock::time_point tSubmit{}, tStart{}, tLastTile{}, tComplete{};
+    std::chrono::steady_clock::time_point deadline{ std::chrono::steady_clock::time_point::max() };
+
+    bool isPastDeadline() const {
+        return deadline != std::chrono::steady_clock::time_point::max()
+               && std::chrono::steady_clock::now() >= deadline;
+    }
 };
 
 /**
@@ -187,6 +368,10 @@ struct Tile {
     uint32_t x0{ }, y0{ }, x1{ }, y1{ };
     uint32_t nPass{ 0 };
     uint32_t blockSize{ 1 };
+    uint32_t nTile{ 0 }; // index of the tile within its job
+    std::chrono::steady_clock::time_point tQueued{}; // when the tile last joined the queue
+    bool isDispatched{ false }; // handed to a worker, and not yet handed back
+    bool isAged{ false }; // taken ahead of more urgent tiles, as its class was past its aging limit
 
     bool operator==(const Tile& other) const {
         return x0 == other.x0
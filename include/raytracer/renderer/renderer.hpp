@@ -46,6 +46,7 @@ public:
     void start() {
         if (isRunning.exchange(true))
             return;
+        scheduler.addWorker();
         thread = std::make_unique<std::thread>([this]() { run(); });
         RENDER_DEBUG("<{}> worker started", id);
     }
@@ -55,6 +56,7 @@ public:
             return;
         if (thread != nullptr && thread->joinable())
             thread->join();
+        scheduler.removeWorker();
         RENDER_DEBUG("<{}> worker stopped", id);
     }
 
@@ -68,19 +70,36 @@ PRIVATE_IN_PRODUCTION
                 break;
             }
             if (t->state->isCancelled.load(std::memory_order_relaxed)) {
-                scheduler.setTileComplete(*t);
+                scheduler.dropTile(*t);
                 continue;
             }
-            // todo: RENDER TILE
-            scheduler.setTileComplete(*t);
+            if (renderTile(*t)) {
+                scheduler.setTileComplete(*t);
+            }
         }
     }
+    /**
+     * @brief Render a tile into its job's image target, a row at a time. Between rows, the rest of
+     * the tile is handed back to the scheduler if something more urgent is waiting for a worker
+     * or the job is paused, or dropped if the job has been cancelled or has run out of time.
+     * @return True if the whole tile was rendered, false if the worker stopped part way through.
+     */
+    bool renderTile(Tile& t);
+    /**
+     * @brief Publish rows of a tile just rendered to its job's tile event stream, if it has one
+     */
+    static void publishRows(const Tile& t, uint32_t y0, uint32_t y1) {
+        const auto& state = *t.state;
+        const auto& events = state.job.tileEvents;
+        // nobody is waiting on a cancelled job's image
+        if (events == nullptr || y0 >= y1 || state.isCancelled.load(std::memory_order_relaxed)) return;
+        events->publish({ t.jobID, t.nPass, t.x0, y0, t.x1, y1 });
+    }
 
     uint32_t id;
     JobScheduler& scheduler;
     std::unique_ptr<std::thread> thread{ nullptr };
     std::atomic<bool> isRunning{ false };
-    // todo: render output buffer target
 };
 
 
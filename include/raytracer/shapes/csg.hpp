@@ -48,7 +48,13 @@ class CSG:  public Group
     /// @brief Test whether this CSG includes another given Shape.
     bool includes(Shape* s) const override;
     /// @brief Intersect a *locally transformed/object space* ray with this Shape.
-    Intersections localIntersect(Ray localRay) override;
+    Intersections localIntersect(const Ray& localRay) override;
+    /// @brief CSG intersections are filtered over both children's full lists of intersections,
+    /// so packets are intersected one ray at a time.
+    void localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits) override
+                             { intersectLanes(localPacket, hits); }
+    void localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits) override
+                             { intersectLanes(localPacket, hits); }
 
   private:
     Operation op;
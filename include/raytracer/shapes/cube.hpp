@@ -19,7 +19,9 @@ class Cube : public Shape
     Cube() : Shape() {}
 
     Tuple localNormalAt(Tuple localPoint, Intersection iHit = {}) override;
-    Intersections localIntersect(Ray localRay) override;
+    Intersections localIntersect(const Ray& localRay) override;
+    [[nodiscard]] BoundingBox bounds() const override
+                              { return { Point{ -1, -1, -1 }, Point{ 1, 1, 1 } }; }
 
     struct IntersectionTimes
     {
@@ -27,6 +29,9 @@ class Cube : public Shape
     };
 
     /// @brief Get minimum and maximum intersection times with one of the axis' plane of the cube.
-    static IntersectionTimes checkAxis(double origin, double direction);
+    /// @param origin The ray origin's component along the axis.
+    /// @param invDirection The reciprocal of the ray direction's component along the axis.
+    /// @param isNegative Whether the ray travels in the negative direction along the axis.
+    static IntersectionTimes checkAxis(double origin, double invDirection, bool isNegative);
 };
 }
\ No newline at end of file
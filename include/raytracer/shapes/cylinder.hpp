@@ -17,9 +17,11 @@ class Cylinder : public Shape
   public:
     Cylinder() : Shape() {}
 
-    Intersections localIntersect(Ray localRay) override;
+    Intersections localIntersect(const Ray& localRay) override;
     /// @brief Calculate the normal vector in *locally transformed/object space*.
     Tuple localNormalAt(Tuple localPoint, Intersection iHit = {}) override;
+    [[nodiscard]] BoundingBox bounds() const override
+                              { return { Point{ -1, minY, -1 }, Point{ 1, maxY, 1 } }; }
 
 
     [[nodiscard]] inline bool getIsClosed() const { return isClosed; }
@@ -44,8 +46,8 @@ class Cylinder : public Shape
     double maxY{ INF };      // maximum bound to truncate cylinder with
     /// @brief Checks to see if intersection at time t is within the radius of the
     /// cylinder from the y-axis.
-    inline static bool checkCap(Ray& r, double t);
+    inline static bool checkCap(const Ray& r, double t);
     /// @brief Intersect a given Ray with the caps of this cylinder.
-    inline void intersectCaps(Ray& r, Intersections& xs);
+    inline void intersectCaps(const Ray& r, Intersections& xs);
 };
 }
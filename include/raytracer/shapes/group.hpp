@@ -7,11 +7,13 @@
 
 #pragma once
 
+#include <filesystem>
 #include <memory>
 #include <vector>
 #include <cstdint>
 
 #include "raytracer/shapes/shape.hpp"
+#include "raytracer/accel/shape_bvh.hpp"
 
 namespace rt
 {
@@ -22,7 +24,11 @@ class Group : public Shape
     Group() : Shape() {}
 
     /// @brief Intersect a *locally transformed/object space* ray with this Group.
-    Intersections localIntersect(Ray localRay) override;
+    Intersections localIntersect(const Ray& localRay) override;
+    /// @brief Intersect a *locally transformed/object space* packet of rays with this Group. The
+    /// children are skipped when no ray in the packet passes through the Group's bounds.
+    void localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits) override;
+    void localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits) override;
     /// @brief Calculate the normal vector in *locally transformed/object space*.
     Tuple localNormalAt(Tuple localPoint, Intersection iHit) override;
     /// @brief Get whether the group is empty of other shapes or not.
@@ -32,15 +38,36 @@ class Group : public Shape
     {
         children.push_back(shape);
         shape->setGroup(this);
+        // this group's bounds grow, so every BVH above it is out of date too
+        for (Group* g{ this }; g != nullptr; g = g->parent)
+            g->accel.invalidate();
     }
+    /// @brief Rebuild the Group's BVH on next use, rather than refitting it.
+    inline void invalidateBVH() { accel.invalidate(); }
+    /// @brief Note that a child has moved, so the Group's BVH refits it on next use. The Group's
+    /// own bounds change with it, so the news is passed up to whatever holds the Group.
+    void markChildMoved(Shape& child);
     /// @brief Get the nth child in the grouping.
     inline Shape& getChild(size_t n) { return *children.at(n); }
     /// @brief Set the material for all of the children in this group at once.
     void setMaterial(Material newMaterial) override;
     /// @brief Test whether this Group includes another given Shape.
     bool includes(Shape* s) const override;
+    /// @brief Get the bounds enclosing every child of this Group, in the Group's object space.
+    [[nodiscard]] BoundingBox bounds() const override;
+    /// @brief Set how this Group's BVH, and those of any Groups in it, are built.
+    void setBuildQuality(Accel::BuildQuality quality) override;
+    /// @brief Hashes every child in turn, so it changes when any of them is moved or edited.
+    [[nodiscard]] uint64_t contentHash() const override;
+    /// @brief Save this Group's BVH to a file once built, and load it from there rather than
+    /// building it next time, as long as the children haven't changed since (see contentHash()).
+    inline void setBVHCache(const std::filesystem::path& file) { accel.setCacheFile(file); }
 
   protected:
+    template<size_t N>
+    void intersectChildren(const RayPacket<N>& localPacket, PacketHit<N>& hits);
+
     std::vector<Shape*> children;
+    Accel::ShapeBVH accel;  /// BVH over the children, built on first intersection
 };
 }
\ No newline at end of file
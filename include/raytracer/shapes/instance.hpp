@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Raytracer Libs: Instance
+///     Placing shared geometry in a scene many times, each with its own transform and material
+///     Stacy Gaudreau
+///     18.10.2026
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "raytracer/shapes/shape.hpp"
+
+namespace rt
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class Instance : public Shape
+{
+  public:
+    /// @brief Place shared geometry in the scene. The geometry (ie: a Group holding a mesh, which
+    /// builds its own BVH) is neither copied nor owned, and is not added to any Group; every
+    /// Instance of it shares it, and its BVH, as it is.
+    /// @details Instances go into the World or a Group like any other Shape, so the BVH over them
+    /// is the top level, and the geometry's own BVH the bottom level. Geometry which itself holds
+    /// Instances isn't supported, since a hit only remembers the Instance it was found through.
+    explicit Instance(Shape* geometry);
+    /// @brief Copies place the same geometry, and are told when it moves just as the original is.
+    Instance(const Instance& other);
+    Instance& operator=(const Instance& other);
+    ~Instance() override;
+
+    /// @brief Intersect a *locally transformed/object space* ray with the shared geometry. The ray
+    /// is transformed into the Instance's space once, on the way in, and each hit remembers the
+    /// Instance so it can be shaded in its place.
+    Intersections localIntersect(const Ray& localRay) override;
+    /// @brief Intersect a *locally transformed/object space* packet of rays with the shared
+    /// geometry, marking the lanes whose closest hit was found through this Instance.
+    void localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits) override;
+    void localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits) override;
+    /// @brief Hits report the shape within the geometry, which works out its own normal.
+    Tuple localNormalAt(Tuple localPoint, Intersection iHit) override;
+    /// @brief Get the bounds of the shared geometry, in the Instance's object space.
+    [[nodiscard]] BoundingBox bounds() const override;
+    /// @brief True if the shape is part of the shared geometry, or is this Instance.
+    bool includes(Shape* s) const override;
+    /// @brief Set how the shared geometry's BVHs are built, for every Instance of it.
+    void setBuildQuality(Accel::BuildQuality quality) override { geometry->setBuildQuality(quality); }
+    [[nodiscard]] uint64_t contentHash() const override { return hashWithTransform(geometry->contentHash()); }
+
+    /// @brief Render this Instance with a material of its own, rather than its geometry's.
+    void setMaterial(Material newMaterial) override;
+    /// @brief Render this Instance in a colour of its own, overriding its geometry's materials.
+    void setColour(Colour colour) override;
+    /// @brief Go back to rendering with the geometry's own materials.
+    inline void clearMaterial() { hasMaterial = false; }
+    /// @brief True if this Instance overrides the materials of its geometry.
+    [[nodiscard]] inline bool overridesMaterial() const { return hasMaterial; }
+    /// @brief The material a shape in the geometry is rendered with, through this Instance.
+    [[nodiscard]] inline const Material& getMaterialFor(const Shape& shape) const
+                                     { return hasMaterial ? material : shape.getMaterial(); }
+    /// @brief Get the shared geometry this Instance places.
+    [[nodiscard]] inline Shape& getGeometry() { return *geometry; }
+
+  private:
+    template<size_t N>
+    void intersectGeometry(const RayPacket<N>& localPacket, PacketHit<N>& hits);
+
+    Shape* geometry;  /// the shared geometry, which outlives every Instance of it
+    bool hasMaterial{ false };  /// true if the material of this Instance overrides its geometry's
+};
+}
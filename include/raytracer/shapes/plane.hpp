@@ -20,7 +20,9 @@ class Plane : public Shape
     Plane(): Shape(){};
 
     Tuple localNormalAt(Tuple localPoint, Intersection iHit = {}) override;
-    Intersections localIntersect(Ray localRay) override;
+    Intersections localIntersect(const Ray& localRay) override;
+    [[nodiscard]] BoundingBox bounds() const override
+                              { return { Point{ -INF, 0, -INF }, Point{ INF, 0, INF } }; }
 };
 }
 
@@ -9,18 +9,28 @@
 
 #include "raytracer/math/tuples.hpp"
 #include "raytracer/math/matrix.hpp"
+#include "raytracer/math/bounds.hpp"
 #include "raytracer/materials/material.hpp"
 #include "raytracer/renderer/intersection.hpp"
 #include "raytracer/renderer/ray.hpp"
+#include "raytracer/renderer/ray_packet.hpp"
 #include "raytracer/materials/patterns.hpp"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace rt
 {
 
 class Intersections;
 class Group;
+namespace Accel
+{
+class ShapeBVH;
+enum class BuildQuality : uint8_t;
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 class Shape
@@ -33,25 +43,32 @@ class Shape
     explicit Shape(Tuple position);
     /// @brief Intersect this Shape() with a Ray().
     /// @return Collection of Intersections from the cast Ray.
-    inline Intersections intersect(Ray worldRay) {
+    inline Intersections intersect(const Ray& worldRay) {
         // transform the worldRay into a local object-space ray before calling localIntersect
         return localIntersect(worldRay.transform(inverseTransform));
     }
+    /// @brief Intersect this Shape() with a packet of rays, keeping the closest hit in each lane.
+    template<size_t N>
+    inline void intersectPacket(const RayPacket<N>& worldPacket, PacketHit<N>& hits) {
+        localIntersectPacket(worldPacket.transform(inverseTransform), hits);
+    }
     /// @brief Calculate the normal vector at a specified **world** point on this shape
     /// @param worldPoint A world point on this shape.
-    /// @param iHit The "hit" intersection.
+    /// @param iHit The "hit" intersection. When it was found through an Instance(), the normal is
+    /// taken through the Instance's transform too.
     /// @return The normal vector at this point on the shape.
     Tuple normalAt(Tuple worldPoint, Intersection iHit = {});
     /// Compare identity. Are a and b the same shape?
     friend bool operator== (const Shape& a, const Shape& b);
     /// Get the transformation matrix applied to this Shape
     [[nodiscard]] TransformationMatrix getTransform() const;
-    /// Set the transformation matrix applied to this Shape
+    /// Set the transformation matrix applied to this Shape. Any BVH holding the Shape is refit to
+    /// its new bounds on next use.
     void setTransform(TransformationMatrix t);
     /// Set the material for this Shape to be rendered with
     virtual void setMaterial(Material newMaterial);
     /// Get the material this Shape is rendered with
-    [[nodiscard]] inline Material getMaterial() const { return material; }
+    [[nodiscard]] inline const Material& getMaterial() const { return material; }
     /// @brief Set the colour of this Shape's material.
     inline virtual void setColour(Colour colour) { material.colour = colour; }
     /// @brief Set the ambient lighting amount on this Shape's Material().
@@ -77,7 +94,11 @@ class Shape
     /// @brief Set the optional pattern the material on this shape should use.
     inline void setPattern(Pattern* pattern) { material.setPattern(pattern); };
     /// Apply lighting to this shape and compute a single pixel from it.
-    Colour lightPixel(Light lighting, Tuple pWorld, Tuple vEye, Tuple vNormal, bool isShadowed);
+    /// @param footprint Width of the shaded area in world space, used to filter image patterns.
+    /// @param instance The Instance() this Shape was hit through, if any, whose transform places
+    /// it in the world and whose material may stand in for its own.
+    Colour lightPixel(Light lighting, Tuple pWorld, Tuple vEye, Tuple vNormal, bool isShadowed,
+                      double footprint = 0., Instance* instance = nullptr);
     /// @brief Transform a world point to this Shape's object space.
     inline Tuple transformPoint(Tuple worldPoint) { return inverseTransform * worldPoint; }
     /// @brief Convert a world point to this Shape's object space, recursively traversing through
@@ -87,9 +108,34 @@ class Shape
     /// shapes.
     Tuple normalToWorld(Tuple objectNormal);
     /// @brief Intersect a *locally transformed/object space* ray with this Shape.
-    virtual Intersections localIntersect(Ray localRay) = 0;
+    virtual Intersections localIntersect(const Ray& localRay) = 0;
+    /// @brief Intersect a *locally transformed/object space* packet of rays with this Shape.
+    /// @details Shapes without a packet kernel intersect each lane's ray on its own.
+    virtual void localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits)
+                                     { intersectLanes(localPacket, hits); }
+    virtual void localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits)
+                                     { intersectLanes(localPacket, hits); }
     /// @brief Calculate the normal vector in *locally transformed/object space*.
     virtual Tuple localNormalAt(Tuple localPoint, Intersection iHit) = 0;
+    /// @brief Get the bounds of this Shape in *object space*. Unbounded unless overridden.
+    [[nodiscard]] virtual BoundingBox bounds() const { return BoundingBox::infinite(); }
+    /// @brief Get the bounds of this Shape in its parent's space, ie: with its transform applied.
+    [[nodiscard]] inline BoundingBox parentSpaceBounds() const
+                                     { return bounds().transform(transformation); }
+    /// @brief Get the bounds of the part of this Shape inside a box, in its parent's space. Used
+    /// to cut shapes in two when building spatial split BVHs; unless overridden, it is just the
+    /// overlap of the box with the Shape's bounds.
+    [[nodiscard]] virtual BoundingBox parentSpaceBoundsWithin(const BoundingBox& box) const
+                                     { return parentSpaceBounds().overlap(box); }
+    /// @brief Set how the BVHs inside this Shape (ie: a Group's) are built. They are rebuilt on
+    /// next use if the quality changes. Shapes without any ignore it.
+    virtual void setBuildQuality(Accel::BuildQuality quality) { (void) quality; }
+    /// @brief A hash of the Shape's geometry and transform, which BVH caches are keyed on. Unless
+    /// overridden, the Shape's bounds stand in for its geometry.
+    [[nodiscard]] virtual uint64_t contentHash() const;
+    /// @brief Get the corners of this Shape in its parent's space, if it is a triangle, so that BVH
+    /// leaves can test it along with its neighbours. False for every other kind of Shape.
+    virtual bool getParentSpaceCorners(Tuple (&corners)[3]) const { (void) corners; return false; }
 
     /// @brief Get the parent group of this Shape.
     inline Group& getGroup() { return *parent; };
@@ -99,15 +145,49 @@ class Shape
     inline void setGroup(Group* newGroup) { parent = newGroup; }
     /// @brief Test whether this shape includes another shape.
     virtual bool includes(Shape* s) const { return this == s; }
+    /// @brief True if the Shape has moved since the BVH holding it was last refit.
+    [[nodiscard]] inline bool hasMovedSinceRefit() const { return hasMoved; }
+    /// @brief Count of moves made by every Shape so far. Lists of shapes without a parent Group to
+    /// tell them (ie: the World's) compare it to see whether any of their shapes may have moved.
+    [[nodiscard]] static inline uint64_t getMoveCount() { return moveCount.load(std::memory_order_acquire); }
 
 
   protected:
+    /// @brief Tell whatever holds this Shape that its bounds have changed: the parent Group, which
+    /// passes it up to its own parent, the Instances placing it if it is shared geometry, or else
+    /// the World, which finds out through getMoveCount().
+    void notifyMoved();
+    /// @brief Carry on a hash of the Shape's geometry with its transform.
+    [[nodiscard]] uint64_t hashWithTransform(uint64_t hash) const;
+    /// @brief Packet intersection fallback, which traces the active lanes one ray at a time.
+    template<size_t N>
+    void intersectLanes(const RayPacket<N>& localPacket, PacketHit<N>& hits)
+    {
+        for (size_t lane{}; lane < N; ++lane)
+        {
+            if (!localPacket.isActive(lane))
+                continue;
+            const auto xs = localIntersect(localPacket.getRay(lane));
+            for (const auto& x: xs.getIntersections())
+                hits.record(localPacket, lane, x.t, x.shape, x.u, x.v, x.instance);
+        }
+    }
+
     Tuple position; /// position of the Shape in the Scene right now
     TransformationMatrix transformation; /// the transformation to be applied during raycasting
     TransformationMatrix inverseTransform;  /// cached inverse transform matrix
     Material material;  /// The surface material to render this shape with.
     bool castsShadow; /// flag which lets shapes opt out of casting shadows
     Group* parent{ nullptr };  /// pointer to the parent group (if any) this Shape belongs to
+
+  private:
+    friend class Accel::ShapeBVH;
+    friend class Instance;
+
+    bool hasMoved{ false };  /// moved since the BVH holding the Shape was last refit
+    std::vector<Instance*> instances{};  /// the Instances placing this Shape, if it is shared geometry
+    uint32_t accelIndex{ 0xFFFFFFFF };  /// primitive index of the Shape in the BVH holding it, if any
+    static inline std::atomic<uint64_t> moveCount{ 0 };
 };
 
 }
@@ -22,7 +22,11 @@ class Sphere : public Shape
 
 
     Tuple localNormalAt(Tuple localPoint, Intersection iHit = {}) override;
-    Intersections localIntersect(Ray localRay) override;
+    Intersections localIntersect(const Ray& localRay) override;
+    void localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits) override;
+    void localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits) override;
+    [[nodiscard]] BoundingBox bounds() const override
+                              { return { Point{ -1, -1, -1 }, Point{ 1, 1, 1 } }; }
 };
 
 }
@@ -22,8 +22,15 @@ class Triangle: public Shape
     /// @brief Basic triangle with a flat face. Surface normal is the same at each point on face.
     Triangle(Tuple p1, Tuple p2, Tuple p3);
 
-    Intersections localIntersect(Ray localRay) override;
+    Intersections localIntersect(const Ray& localRay) override;
+    void localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits) override;
+    void localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits) override;
     Tuple localNormalAt(Tuple localPoint, Intersection iHit = {}) override;
+    [[nodiscard]] BoundingBox bounds() const override;
+    /// @brief Clips the triangle itself to the box, so that spatial splits bound it tightly.
+    [[nodiscard]] BoundingBox parentSpaceBoundsWithin(const BoundingBox& box) const override;
+    [[nodiscard]] uint64_t contentHash() const override;
+    bool getParentSpaceCorners(Tuple (&corners)[3]) const override;
 
     inline Tuple getNormal() { return normal; }
     inline Tuple getEdge1() { return e1; }
@@ -0,0 +1,613 @@
+#include "raytracer/accel/bvh.hpp"
+#include "raytracer/accel/parallel.hpp"
+#include "raytracer/common/macros.hpp"
+
+#include <array>
+#include <cmath>
+#include <functional>
+#include <numeric>
+
+#if defined(__x86_64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#define RT_ACCEL_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace rt::Accel
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+NodeWidth detectNodeWidth()
+{
+#ifdef RT_ACCEL_X86_SIMD
+    static const NodeWidth width = __builtin_cpu_supports("avx2") ? NodeWidth::eight : NodeWidth::four;
+    return width;
+#else
+    return NodeWidth::four;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BinaryBVH
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief A node's surface area, weighted by the cost of visiting it (inner nodes) or of
+/// intersecting its primitives (leaves).
+inline double getWeightedArea(const BinaryNode& node)
+{
+    return node.bounds.surfaceArea() * (node.isLeaf() ? node.count * BinaryBVH::INTERSECTION_COST
+                                                      : BinaryBVH::TRAVERSAL_COST);
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BinaryBVH::build(std::span<const BoundingBox> boxes)
+{
+    nodes.clear();
+    primitives.resize(boxes.size());
+    std::iota(primitives.begin(), primitives.end(), 0u);
+    if (boxes.empty())
+    {
+        link(0);
+        return;
+    }
+    std::vector<Tuple> centroids;
+    centroids.reserve(boxes.size());
+    for (const auto& box: boxes)
+    {
+        ASSERT(box.isFinite(), "BVH primitives must have finite bounds");
+        centroids.push_back(box.centre());
+    }
+    nodes.reserve(2 * boxes.size() / MAX_LEAF_SIZE + 1);
+    buildNode(boxes, centroids, 0, static_cast<uint32_t>(boxes.size()), 0);
+    link(boxes.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t BinaryBVH::buildNode(std::span<const BoundingBox> boxes, std::span<const Tuple> centroids,
+                              uint32_t begin, uint32_t end, size_t depth)
+{
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    BoundingBox bounds{}, centroidBounds{};
+    for (uint32_t i{ begin }; i < end; ++i)
+    {
+        bounds.add(boxes[primitives[i]]);
+        centroidBounds.add(centroids[primitives[i]]);
+    }
+    nodes[index].bounds = bounds;
+    const uint32_t count = end - begin;
+    const auto makeLeaf = [&]() {
+        nodes[index].offset = begin;
+        nodes[index].count = count;
+        return index;
+    };
+    if (count == 1 || depth >= MAX_DEPTH)
+        return makeLeaf();
+    // split along the axis the centroids are most spread out on
+    const Tuple extent = centroidBounds.size();
+    size_t axis{ 0 };
+    if (extent.y > extent(axis)) axis = 1;
+    if (extent.z > extent(axis)) axis = 2;
+    const double lo = centroidBounds.min(axis);
+    const double width = extent(axis);
+    auto* first = primitives.data() + begin;
+    auto* last = primitives.data() + end;
+    auto* mid = first + count / 2;
+    if (width > 0.)
+    {
+        // bin the centroids, then sweep the bins from both ends to find the cheapest split
+        struct Bin
+        {
+            BoundingBox bounds{};
+            uint32_t count{};
+        };
+        const double binScale = static_cast<double>(N_BINS) / width;
+        const auto binOf = [&](uint32_t primitive) {
+            const auto b = static_cast<size_t>((centroids[primitive](axis) - lo) * binScale);
+            return std::min(b, N_BINS - 1);
+        };
+        std::array<Bin, N_BINS> bins{};
+        for (auto* p{ first }; p != last; ++p)
+        {
+            auto& bin = bins[binOf(*p)];
+            bin.bounds.add(boxes[*p]);
+            ++bin.count;
+        }
+        std::array<double, N_BINS> areaRight{};
+        std::array<uint32_t, N_BINS> countRight{};
+        BoundingBox right{};
+        uint32_t nRight{};
+        for (size_t b{ N_BINS - 1 }; b > 0; --b)
+        {
+            right.add(bins[b].bounds);
+            nRight += bins[b].count;
+            areaRight[b] = right.surfaceArea();
+            countRight[b] = nRight;
+        }
+        const double area = bounds.surfaceArea();
+        const double invArea = area > 0. ? 1. / area : 0.;
+        double bestCost{ INF };
+        size_t bestSplit{ 0 };  // the last bin on the left of the split
+        BoundingBox left{};
+        uint32_t nLeft{};
+        for (size_t b{}; b + 1 < N_BINS; ++b)
+        {
+            left.add(bins[b].bounds);
+            nLeft += bins[b].count;
+            if (nLeft == 0 || countRight[b + 1] == 0)
+                continue;
+            const double cost = TRAVERSAL_COST + INTERSECTION_COST * invArea
+                                * (left.surfaceArea() * nLeft + areaRight[b + 1] * countRight[b + 1]);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+        if (count <= MAX_LEAF_SIZE && count * INTERSECTION_COST <= bestCost)
+            return makeLeaf();
+        mid = std::partition(first, last, [&](uint32_t p) { return binOf(p) <= bestSplit; });
+        if (mid == first || mid == last)
+        {
+            // every centroid fell in one bin; fall back to splitting at the median
+            mid = first + count / 2;
+            std::nth_element(first, mid, last, [&](uint32_t a, uint32_t b) {
+                return centroids[a](axis) < centroids[b](axis);
+            });
+        }
+    }
+    else if (count <= MAX_LEAF_SIZE)
+        // the centroids all coincide, so no split can separate them
+        return makeLeaf();
+    nodes[index].axis = static_cast<uint8_t>(axis);
+    const auto split = static_cast<uint32_t>(mid - primitives.data());
+    buildNode(boxes, centroids, begin, split, depth + 1);
+    const uint32_t second = buildNode(boxes, centroids, split, end, depth + 1);
+    nodes[index].offset = second;
+    return index;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+double BinaryBVH::getSAHCost() const
+{
+    if (nodes.empty())
+        return 0.;
+    // each node is visited by the fraction of rays through the root which pass through it
+    const double rootArea = nodes[0].bounds.surfaceArea();
+    if (rootArea <= 0.)
+        return static_cast<double>(primitives.size()) * INTERSECTION_COST;
+    return weightedArea / rootArea;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BinaryBVH::link(size_t nPrimitives)
+{
+    parents.assign(nodes.size(), 0);
+    depths.assign(nodes.size(), 0);
+    isDirty.assign(nodes.size(), 0);
+    leafOf.assign(nPrimitives, 0);
+    refitted.clear();
+    weightedArea = 0.;
+    // parents always come before their children
+    for (uint32_t i{}; i < nodes.size(); ++i)
+    {
+        const BinaryNode& node = nodes[i];
+        weightedArea += getWeightedArea(node);
+        if (node.isLeaf())
+        {
+            for (uint32_t j{ node.offset }; j < node.offset + node.count; ++j)
+                leafOf[primitives[j]] = i;
+            continue;
+        }
+        parents[i + 1] = parents[node.offset] = i;
+        depths[i + 1] = depths[node.offset] = static_cast<uint8_t>(depths[i] + 1);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+const std::vector<uint32_t>& BinaryBVH::refit(std::span<const BoundingBox> boxes,
+                                              std::span<const uint32_t> moved, size_t nThreads)
+{
+    refitted.clear();
+    if (nodes.empty())
+        return refitted;
+    ASSERT(!hasDuplicates(), "trees with primitives in several leaves can't be refit");
+    // mark the path from each moved primitive up to the root, until it joins a path already marked
+    for (const auto p: moved)
+    {
+        for (uint32_t index{ leafOf[p] }; !isDirty[index]; index = parents[index])
+        {
+            isDirty[index] = 1;
+            refitted.push_back(index);
+            if (index == 0)
+                break;
+        }
+    }
+    const auto refitNode = [&](uint32_t index) {
+        BinaryNode& node = nodes[index];
+        const double before = getWeightedArea(node);
+        BoundingBox bounds{};
+        if (node.isLeaf())
+        {
+            for (uint32_t i{ node.offset }; i < node.offset + node.count; ++i)
+                bounds.add(boxes[primitives[i]]);
+        }
+        else
+        {
+            bounds = nodes[index + 1].bounds;
+            bounds.add(nodes[node.offset].bounds);
+        }
+        node.bounds = bounds;
+        isDirty[index] = 0;
+        return getWeightedArea(node) - before;
+    };
+    nThreads = Parallel::getThreadCount(nThreads, refitted.size());
+    if (nThreads == 1)
+    {
+        // children always come after their parents, so refitting backwards goes bottom up. Large
+        //  refits sweep every node, rather than sorting the marked ones
+        if (refitted.size() * REFIT_SWEEP_FRACTION >= nodes.size())
+        {
+            refitted.clear();
+            for (auto index{ static_cast<uint32_t>(nodes.size()) }; index-- > 0;)
+            {
+                if (isDirty[index])
+                {
+                    refitted.push_back(index);
+                    weightedArea += refitNode(index);
+                }
+            }
+            return refitted;
+        }
+        std::sort(refitted.begin(), refitted.end(), std::greater<>{});
+        for (const auto index: refitted)
+            weightedArea += refitNode(index);
+        return refitted;
+    }
+    // nodes on the same level don't depend on each other, so each level is refit in parallel,
+    //  deepest first. The marked nodes are counting sorted by depth into levels
+    std::array<size_t, MAX_DEPTH + 2> levelStart{};
+    for (const auto index: refitted)
+        ++levelStart[depths[index] + 1];
+    for (size_t d{ 1 }; d < levelStart.size(); ++d)
+        levelStart[d] += levelStart[d - 1];
+    std::vector<uint32_t> byLevel(refitted.size());
+    {
+        auto next = levelStart;
+        for (const auto index: refitted)
+            byLevel[next[depths[index]]++] = index;
+    }
+    refitted.swap(byLevel);
+    std::vector<double> sliceDeltas(nThreads);
+    for (size_t depth{ MAX_DEPTH + 1 }; depth-- > 0;)
+    {
+        const size_t begin = levelStart[depth];
+        const size_t end = levelStart[depth + 1];
+        const size_t nLevelThreads = Parallel::getThreadCount(nThreads, end - begin);
+        Parallel::forEach(nLevelThreads, nLevelThreads, [&](size_t t) {
+            const auto [first, last] = Parallel::getSlice(end - begin, t, nLevelThreads);
+            for (size_t i{ begin + first }; i < begin + last; ++i)
+                sliceDeltas[t] += refitNode(refitted[i]);
+        });
+    }
+    for (const double delta: sliceDeltas)
+        weightedArea += delta;
+    return refitted;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// WideBVH
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief Round a bound down or up to the nearest float, so the float box contains the double one.
+inline float roundDown(double x)
+{
+    const auto f = static_cast<float>(x);
+    return static_cast<double>(f) > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+inline float roundUp(double x)
+{
+    const auto f = static_cast<float>(x);
+    return static_cast<double>(f) < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+template<size_t W>
+WideNode<W> makeEmptyNode()
+{
+    WideNode<W> node{};
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        for (size_t i{}; i < W; ++i)
+        {
+            node.lower[axis][i] = std::numeric_limits<float>::infinity();
+            node.upper[axis][i] = -std::numeric_limits<float>::infinity();
+        }
+    }
+    for (size_t i{}; i < W; ++i)
+    {
+        node.child[i] = WideNode<W>::EMPTY;
+        node.count[i] = 0;
+    }
+    return node;
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t W>
+void WideBVH<W>::build(const BinaryBVH& binary)
+{
+    nodes.clear();
+    primitives = binary.getPrimitiveIndices();
+    slotOf.assign(binary.getNodes().size(), WideNode<W>::EMPTY);
+    if (binary.isEmpty())
+        return;
+    collapse(binary, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t W>
+void WideBVH<W>::refit(const BinaryBVH& binary, std::span<const uint32_t> refitted)
+{
+    const auto& binaryNodes = binary.getNodes();
+    const size_t nThreads = Parallel::getThreadCount(0, refitted.size());
+    Parallel::forEach(nThreads, nThreads, [&](size_t t) {
+        const auto [begin, end] = Parallel::getSlice(refitted.size(), t, nThreads);
+        for (size_t i{ begin }; i < end; ++i)
+        {
+            // binary nodes opened up by the collapse have no slot of their own
+            const uint32_t slot = slotOf[refitted[i]];
+            if (slot == WideNode<W>::EMPTY)
+                continue;
+            const BoundingBox& bounds = binaryNodes[refitted[i]].bounds;
+            for (size_t axis{}; axis < 3; ++axis)
+            {
+                nodes[slot / W].lower[axis][slot % W] = roundDown(bounds.min(axis));
+                nodes[slot / W].upper[axis][slot % W] = roundUp(bounds.max(axis));
+            }
+        }
+    });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t W>
+uint32_t WideBVH<W>::collapse(const BinaryBVH& binary, uint32_t binaryIndex)
+{
+    const auto& binaryNodes = binary.getNodes();
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(makeEmptyNode<W>());
+    // gather the node's children, repeatedly opening up the inner child with the largest area,
+    //  as it is the one most likely to be hit
+    StaticVector<uint32_t, W> children{};
+    const BinaryNode& root = binaryNodes[binaryIndex];
+    if (root.isLeaf())
+        children.push_back(binaryIndex);
+    else
+    {
+        children.push_back(binaryIndex + 1);
+        children.push_back(root.offset);
+    }
+    while (children.size() < W)
+    {
+        size_t largest{ W };
+        double largestArea{ -1. };
+        for (size_t i{}; i < children.size(); ++i)
+        {
+            const BinaryNode& c = binaryNodes[children[i]];
+            if (!c.isLeaf() && c.bounds.surfaceArea() > largestArea)
+            {
+                largest = i;
+                largestArea = c.bounds.surfaceArea();
+            }
+        }
+        if (largest == W)
+            break;
+        const uint32_t opened = children[largest];
+        children[largest] = opened + 1;
+        children.push_back(binaryNodes[opened].offset);
+    }
+    for (size_t i{}; i < children.size(); ++i)
+    {
+        const BinaryNode& c = binaryNodes[children[i]];
+        slotOf[children[i]] = static_cast<uint32_t>(index * W + i);
+        for (size_t axis{}; axis < 3; ++axis)
+        {
+            nodes[index].lower[axis][i] = roundDown(c.bounds.min(axis));
+            nodes[index].upper[axis][i] = roundUp(c.bounds.max(axis));
+        }
+        if (c.isLeaf())
+        {
+            nodes[index].child[i] = c.offset;
+            nodes[index].count[i] = c.count;
+        }
+        else
+        {
+            // nodes may reallocate while the child is collapsed, so it is written by index after
+            const uint32_t child = collapse(binary, children[i]);
+            nodes[index].child[i] = child;
+            nodes[index].count[i] = 0;
+        }
+    }
+    return index;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Wide node kernels
+////////////////////////////////////////////////////////////////////////////////////////////////////
+FloatRay::FloatRay(const Ray& ray)
+:   tMin(static_cast<float>(ray.getTMin()))
+{
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        origin[axis] = static_cast<float>(ray.getOrigin()(axis));
+        invDirection[axis] = static_cast<float>(ray.getInvDirection()(axis));
+        isNegative[axis] = ray.isNegative(axis);
+    }
+}
+
+namespace
+{
+/// @brief Plain C++ kernel, for CPUs without the SIMD kernels.
+template<size_t W>
+LaneMask intersectNodePortable(const WideNode<W>& node, const FloatRay& ray, float tFar, float* tNear)
+{
+    float tEnter[W], tExit[W];
+    for (size_t i{}; i < W; ++i)
+    {
+        tEnter[i] = ray.tMin;
+        tExit[i] = tFar;
+    }
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        const float* nearPlane = ray.isNegative[axis] ? node.upper[axis] : node.lower[axis];
+        const float* farPlane = ray.isNegative[axis] ? node.lower[axis] : node.upper[axis];
+        for (size_t i{}; i < W; ++i)
+        {
+            // written so that a NaN (a ray lying exactly in a slab plane) leaves the range untouched
+            const float t0 = (nearPlane[i] - ray.origin[axis]) * ray.invDirection[axis];
+            const float t1 = (farPlane[i] - ray.origin[axis]) * ray.invDirection[axis];
+            tEnter[i] = t0 > tEnter[i] ? t0 : tEnter[i];
+            tExit[i] = t1 < tExit[i] ? t1 : tExit[i];
+        }
+    }
+    LaneMask mask{ 0 };
+    for (size_t i{}; i < W; ++i)
+    {
+        tNear[i] = tEnter[i];
+        mask |= static_cast<LaneMask>(tEnter[i] <= tExit[i]) << i;
+    }
+    return mask;
+}
+
+#ifdef RT_ACCEL_X86_SIMD
+/// @brief SSE kernel. x86-64 always has SSE2, so this needs no runtime check.
+LaneMask intersectNodeSSE(const WideNode<4>& node, const FloatRay& ray, float tFar, float* tNear)
+{
+    __m128 tEnter = _mm_set1_ps(ray.tMin);
+    __m128 tExit = _mm_set1_ps(tFar);
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        const float* nearPlane = ray.isNegative[axis] ? node.upper[axis] : node.lower[axis];
+        const float* farPlane = ray.isNegative[axis] ? node.lower[axis] : node.upper[axis];
+        const __m128 origin = _mm_set1_ps(ray.origin[axis]);
+        const __m128 invDirection = _mm_set1_ps(ray.invDirection[axis]);
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearPlane), origin), invDirection);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farPlane), origin), invDirection);
+        // max/min return their second operand when either is NaN, which leaves the range as is
+        tEnter = _mm_max_ps(t0, tEnter);
+        tExit = _mm_min_ps(t1, tExit);
+    }
+    _mm_storeu_ps(tNear, tEnter);
+    return static_cast<LaneMask>(_mm_movemask_ps(_mm_cmple_ps(tEnter, tExit)));
+}
+
+/// @brief AVX2 kernel, only called once the CPU is known to support it.
+__attribute__((target("avx2")))
+LaneMask intersectNodeAVX2(const WideNode<8>& node, const FloatRay& ray, float tFar, float* tNear)
+{
+    __m256 tEnter = _mm256_set1_ps(ray.tMin);
+    __m256 tExit = _mm256_set1_ps(tFar);
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        const float* nearPlane = ray.isNegative[axis] ? node.upper[axis] : node.lower[axis];
+        const float* farPlane = ray.isNegative[axis] ? node.lower[axis] : node.upper[axis];
+        const __m256 origin = _mm256_set1_ps(ray.origin[axis]);
+        const __m256 invDirection = _mm256_set1_ps(ray.invDirection[axis]);
+        const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearPlane), origin), invDirection);
+        const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farPlane), origin), invDirection);
+        tEnter = _mm256_max_ps(t0, tEnter);
+        tExit = _mm256_min_ps(t1, tExit);
+    }
+    _mm256_storeu_ps(tNear, tEnter);
+    return static_cast<LaneMask>(_mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ)));
+}
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+LaneMask intersectWideNode(const WideNode<4>& node, const FloatRay& ray, float tFar, float* tNear)
+{
+#ifdef RT_ACCEL_X86_SIMD
+    return intersectNodeSSE(node, ray, tFar, tNear);
+#else
+    return intersectNodePortable(node, ray, tFar, tNear);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+LaneMask intersectWideNode(const WideNode<8>& node, const FloatRay& ray, float tFar, float* tNear)
+{
+#ifdef RT_ACCEL_X86_SIMD
+    using Kernel = LaneMask (*)(const WideNode<8>&, const FloatRay&, float, float*);
+    static const Kernel kernel = detectNodeWidth() == NodeWidth::eight ? intersectNodeAVX2
+                                                                       : intersectNodePortable<8>;
+    return kernel(node, ray, tFar, tNear);
+#else
+    return intersectNodePortable(node, ray, tFar, tNear);
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BVH
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BVH::build(std::span<const BoundingBox> primitives, BuildMethod buildMethod)
+{
+    ASSERT(buildMethod != BuildMethod::spatial, "spatial split builds need primitives to clip");
+    method = buildMethod;
+    if (method == BuildMethod::linear)
+        binary.buildLinear(primitives);
+    else
+        binary.build(primitives);
+    collapse();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BVH::build(std::span<const BoundingBox> primitives, const ClipPrimitive& clip,
+                const SpatialBuildSettings& settings)
+{
+    method = BuildMethod::spatial;
+    binary.buildSpatial(primitives, clip, settings);
+    collapse();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BVH::collapse()
+{
+    builtSAHCost = binary.getSAHCost();
+    // only the tree matching the node width is kept
+    if (width == NodeWidth::eight)
+    {
+        wide8.build(binary);
+        wide4 = {};
+    }
+    else
+    {
+        wide4.build(binary);
+        wide8 = {};
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BVH::refit(std::span<const BoundingBox> primitives, std::span<const uint32_t> moved)
+{
+    ASSERT(method != BuildMethod::spatial, "spatial split trees can't be refit");
+    const auto& refitted = binary.refit(primitives, moved);
+    if (getSAHCostGrowth() > MAX_SAH_COST_GROWTH)
+    {
+        build(primitives, method);
+        return true;
+    }
+    if (width == NodeWidth::eight)
+        wide8.refit(binary, refitted);
+    else
+        wide4.refit(binary, refitted);
+    return false;
+}
+}
@@ -0,0 +1,271 @@
+#include "raytracer/accel/bvh.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_ACCEL_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rt::Accel
+{
+namespace
+{
+constexpr char MAGIC[8]{ 'R', 'T', 'B', 'V', 'H', 'C', 'A', 'C' };
+constexpr uint32_t VERSION{ 1 };
+constexpr size_t ALIGNMENT{ 64 };  /// each array starts on a cache line, as the wide nodes need 32 bytes
+
+static_assert(std::is_trivially_copyable_v<BinaryNode>);
+static_assert(std::is_trivially_copyable_v<WideNode<4>> && std::is_trivially_copyable_v<WideNode<8>>);
+
+/// @brief The start of a cache file. The arrays follow it in the order of their counts here.
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t binaryNodeSize;    /// sizeof(BinaryNode), which catches builds with another layout
+    uint32_t wideNodeSize;      /// sizeof(WideNode<W>)
+    uint8_t width;
+    uint8_t method;
+    uint8_t padding[2];
+    uint64_t key;
+    uint64_t nPrimitives;       /// primitives the tree was built over
+    uint64_t nBinaryNodes;
+    uint64_t nReferences;       /// primitive indices in the leaves, more than nPrimitives after spatial splits
+    uint64_t nWideNodes;
+    double builtSAHCost;
+};
+
+/// @brief Offsets of each array in a cache file, from its start.
+struct CacheLayout
+{
+    explicit CacheLayout(const CacheHeader& header)
+    {
+        binaryNodes = alignUp(sizeof(CacheHeader));
+        references = alignUp(binaryNodes + header.nBinaryNodes * sizeof(BinaryNode));
+        wideNodes = alignUp(references + header.nReferences * sizeof(uint32_t));
+        slots = alignUp(wideNodes + header.nWideNodes * header.wideNodeSize);
+        size = slots + header.nBinaryNodes * sizeof(uint32_t);
+    }
+
+    static size_t alignUp(size_t offset) { return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+    size_t binaryNodes, references, wideNodes, slots, size;
+};
+
+/// @brief A whole file, mapped read only into memory, or read into it where mapping isn't available.
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::filesystem::path& file)
+    {
+#ifdef RT_ACCEL_MMAP
+        const int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info{};
+        if (::fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* mapped = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                bytes = static_cast<const char*>(mapped);
+                size = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream in{ file, std::ios::binary | std::ios::ate };
+        if (!in)
+            return;
+        buffer.resize(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        if (in.read(buffer.data(), static_cast<std::streamsize>(buffer.size())))
+        {
+            bytes = buffer.data();
+            size = buffer.size();
+        }
+#endif
+    }
+    ~MappedFile()
+    {
+#ifdef RT_ACCEL_MMAP
+        if (bytes != nullptr)
+            ::munmap(const_cast<char*>(bytes), size);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// @brief Copy count items out of the file, from an offset in bytes.
+    template<typename T>
+    void copyTo(std::vector<T>& out, size_t offset, size_t count) const
+    {
+        out.resize(count);
+        if (count > 0)
+            std::memcpy(out.data(), bytes + offset, count * sizeof(T));
+    }
+
+    const char* bytes{ nullptr };
+    size_t size{};
+
+  private:
+#ifndef RT_ACCEL_MMAP
+    std::vector<char> buffer;
+#endif
+};
+
+/// @brief True if every node of a binary tree refers to nodes and primitives which exist.
+bool isValidTree(std::span<const BinaryNode> nodes, std::span<const uint32_t> references, size_t nPrimitives)
+{
+    for (uint32_t i{}; i < nodes.size(); ++i)
+    {
+        const auto& node = nodes[i];
+        if (node.isLeaf() ? static_cast<size_t>(node.offset) + node.count > references.size()
+                          : node.offset <= i + 1 || node.offset >= nodes.size())
+            return false;
+    }
+    for (const auto primitive: references)
+    {
+        if (primitive >= nPrimitives)
+            return false;
+    }
+    return true;
+}
+
+/// @brief True if every child of a wide tree refers to nodes and primitives which exist.
+template<size_t W>
+bool isValidTree(std::span<const WideNode<W>> nodes, size_t nReferences)
+{
+    for (const auto& node: nodes)
+    {
+        for (size_t i{}; i < W; ++i)
+        {
+            if (node.child[i] == WideNode<W>::EMPTY)
+                continue;
+            if (node.count[i] > 0 ? static_cast<size_t>(node.child[i]) + node.count[i] > nReferences
+                                  : node.child[i] >= nodes.size())
+                return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Write count items to a file, padded to the given offset first.
+template<typename T>
+void writeAt(std::ofstream& out, size_t offset, const T* items, size_t count)
+{
+    static constexpr char ZEROS[ALIGNMENT]{};
+    const auto at = static_cast<size_t>(out.tellp());
+    out.write(ZEROS, static_cast<std::streamsize>(offset - at));
+    out.write(reinterpret_cast<const char*>(items), static_cast<std::streamsize>(count * sizeof(T)));
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BVH::save(const std::filesystem::path& file, uint64_t key) const
+{
+    const bool isEight = width == NodeWidth::eight;
+    CacheHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.binaryNodeSize = sizeof(BinaryNode);
+    header.wideNodeSize = isEight ? sizeof(WideNode<8>) : sizeof(WideNode<4>);
+    header.width = static_cast<uint8_t>(width);
+    header.method = static_cast<uint8_t>(method);
+    header.key = key;
+    header.nPrimitives = binary.leafOf.size();
+    header.nBinaryNodes = binary.nodes.size();
+    header.nReferences = binary.primitives.size();
+    header.nWideNodes = isEight ? wide8.nodes.size() : wide4.nodes.size();
+    header.builtSAHCost = builtSAHCost;
+    const CacheLayout layout{ header };
+    // written beside the old file, then swapped in, so a reader never sees half a file
+    auto temporary = file;
+    temporary += ".tmp";
+    {
+        std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeAt(out, layout.binaryNodes, binary.nodes.data(), binary.nodes.size());
+        writeAt(out, layout.references, binary.primitives.data(), binary.primitives.size());
+        if (isEight)
+        {
+            writeAt(out, layout.wideNodes, wide8.nodes.data(), wide8.nodes.size());
+            writeAt(out, layout.slots, wide8.slotOf.data(), wide8.slotOf.size());
+        }
+        else
+        {
+            writeAt(out, layout.wideNodes, wide4.nodes.data(), wide4.nodes.size());
+            writeAt(out, layout.slots, wide4.slotOf.data(), wide4.slotOf.size());
+        }
+        if (!out.flush())
+            return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, file, error);
+    return !error;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BVH::load(const std::filesystem::path& file, uint64_t key)
+{
+    const MappedFile mapped{ file };
+    if (mapped.size < sizeof(CacheHeader))
+        return false;
+    CacheHeader header;
+    std::memcpy(&header, mapped.bytes, sizeof(header));
+    const bool isEight = width == NodeWidth::eight;
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+        || header.key != key || header.width != static_cast<uint8_t>(width)
+        || header.binaryNodeSize != sizeof(BinaryNode)
+        || header.wideNodeSize != (isEight ? sizeof(WideNode<8>) : sizeof(WideNode<4>))
+        || header.method > static_cast<uint8_t>(BuildMethod::spatial))
+        return false;
+    // counts from a corrupt file could overflow the layout, so they are bounded by its size first
+    const uint64_t maxCount = mapped.size / sizeof(uint32_t);
+    if (header.nBinaryNodes > maxCount || header.nReferences > maxCount || header.nWideNodes > maxCount
+        || header.nPrimitives > maxCount || CacheLayout{ header }.size != mapped.size)
+        return false;
+    const CacheLayout layout{ header };
+    const auto* nodes = reinterpret_cast<const BinaryNode*>(mapped.bytes + layout.binaryNodes);
+    const auto* references = reinterpret_cast<const uint32_t*>(mapped.bytes + layout.references);
+    if (!isValidTree({ nodes, header.nBinaryNodes }, { references, header.nReferences }, header.nPrimitives))
+        return false;
+    const bool isValidWide = isEight
+        ? isValidTree<8>({ reinterpret_cast<const WideNode<8>*>(mapped.bytes + layout.wideNodes), header.nWideNodes },
+                         header.nReferences)
+        : isValidTree<4>({ reinterpret_cast<const WideNode<4>*>(mapped.bytes + layout.wideNodes), header.nWideNodes },
+                         header.nReferences);
+    if (!isValidWide)
+        return false;
+
+    method = static_cast<BuildMethod>(header.method);
+    builtSAHCost = header.builtSAHCost;
+    mapped.copyTo(binary.nodes, layout.binaryNodes, header.nBinaryNodes);
+    mapped.copyTo(binary.primitives, layout.references, header.nReferences);
+    binary.link(header.nPrimitives);
+    const auto loadWide = [&]<size_t W>(WideBVH<W>& wide) {
+        mapped.copyTo(wide.nodes, layout.wideNodes, header.nWideNodes);
+        mapped.copyTo(wide.slotOf, layout.slots, header.nBinaryNodes);
+        wide.primitives = binary.primitives;
+    };
+    if (isEight)
+    {
+        loadWide(wide8);
+        wide4 = {};
+    }
+    else
+    {
+        loadWide(wide4);
+        wide8 = {};
+    }
+    return true;
+}
+}
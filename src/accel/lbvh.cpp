@@ -0,0 +1,407 @@
+#include "raytracer/accel/bvh.hpp"
+#include "raytracer/accel/morton.hpp"
+#include "raytracer/accel/parallel.hpp"
+#include "raytracer/common/macros.hpp"
+
+#include <array>
+#include <numeric>
+
+namespace rt::Accel
+{
+namespace
+{
+/// the sorted primitives are cut into about this many treelets, which are built in parallel
+constexpr size_t N_TREELETS{ 1024 };
+constexpr size_t MIN_TREELET_SIZE{ 64 };
+/// deepest level of the tree above the treelets, so that treelets know how deep they may go
+constexpr size_t TOP_DEPTH{ 24 };
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Radix sort
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename Code>
+void Morton::radixSort(std::vector<Key<Code>>& keys, size_t nBits, size_t nThreads)
+{
+    constexpr size_t DIGIT_BITS{ 8 };
+    constexpr size_t N_DIGITS{ 1 << DIGIT_BITS };
+    const size_t n = keys.size();
+    nThreads = std::clamp<size_t>(n / Parallel::MIN_ITEMS_PER_THREAD, 1, std::max<size_t>(nThreads, 1));
+    std::vector<Key<Code>> sorted(n);
+    std::vector<std::array<size_t, N_DIGITS>> offsets(nThreads);
+    for (size_t shift{}; shift < nBits; shift += DIGIT_BITS)
+    {
+        const auto digitOf = [shift](const Key<Code>& key) {
+            return static_cast<size_t>(key.code >> shift) & (N_DIGITS - 1);
+        };
+        Parallel::forEach(nThreads, nThreads, [&](size_t t) {
+            auto& histogram = offsets[t];
+            histogram.fill(0);
+            const auto [begin, end] = Parallel::getSlice(n, t, nThreads);
+            for (size_t i{ begin }; i < end; ++i)
+                ++histogram[digitOf(keys[i])];
+        });
+        // each slice scatters its keys after every key with a lower digit, and after the keys with
+        //  the same digit in earlier slices, which keeps the sort stable
+        size_t total{};
+        bool isSorted{ false };
+        for (size_t d{}; d < N_DIGITS; ++d)
+        {
+            const size_t digitStart = total;
+            for (size_t t{}; t < nThreads; ++t)
+            {
+                const size_t count = offsets[t][d];
+                offsets[t][d] = total;
+                total += count;
+            }
+            isSorted |= total - digitStart == n;
+        }
+        if (isSorted)
+            continue;
+        Parallel::forEach(nThreads, nThreads, [&](size_t t) {
+            auto& next = offsets[t];
+            const auto [begin, end] = Parallel::getSlice(n, t, nThreads);
+            for (size_t i{ begin }; i < end; ++i)
+                sorted[next[digitOf(keys[i])]++] = keys[i];
+        });
+        keys.swap(sorted);
+    }
+}
+
+template void Morton::radixSort<uint32_t>(std::vector<Key<uint32_t>>&, size_t, size_t);
+template void Morton::radixSort<uint64_t>(std::vector<Key<uint64_t>>&, size_t, size_t);
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Linear BVH
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief Where to split a range of sorted keys, and the axis the split lies across.
+struct Split
+{
+    uint32_t mid;
+    uint8_t axis;
+};
+
+/// @brief Split the sorted keys [begin, end) where the highest bit that differs within the range
+/// turns on. Every key before the split lies on one side of a plane and every key after on the other.
+/// @param isBalanced Split at the middle instead, which keeps the tree shallow.
+template<typename Code>
+Split findSplit(const std::vector<Morton::Key<Code>>& keys, uint32_t begin, uint32_t end, bool isBalanced)
+{
+    const Code difference = keys[begin].code ^ keys[end - 1].code;
+    const auto bit = difference == 0 ? 0 : static_cast<size_t>(std::bit_width(difference) - 1);
+    const uint8_t axis = Morton::axisOfBit(bit);
+    // identical codes can't be told apart, so they are split in half too
+    if (isBalanced || difference == 0)
+        return { begin + (end - begin) / 2, axis };
+    const Code mask = Code{ 1 } << bit;
+    const auto first = keys.begin() + begin;
+    const auto mid = std::partition_point(first, keys.begin() + end, [mask](const Morton::Key<Code>& key) {
+        return (key.code & mask) == 0;
+    });
+    return { static_cast<uint32_t>(mid - keys.begin()), axis };
+}
+
+/// @brief A subtree over a range of the sorted primitives, built on its own thread. Its nodes are
+/// numbered from its root, and copied into the whole tree once the top levels are known.
+struct Treelet
+{
+    uint32_t begin, end;
+    std::vector<BinaryNode> nodes;
+};
+
+/// @brief A node of the levels above the treelets. Leaves are whole treelets.
+struct TopNode
+{
+    static constexpr uint32_t NONE{ 0xFFFFFFFF };
+
+    BoundingBox bounds{};
+    uint32_t first{}, second{};
+    uint32_t treelet{ NONE };
+    uint8_t axis{};
+};
+
+/// @brief Build the nodes of a treelet over the sorted keys [begin, end), depth first.
+template<typename Code>
+uint32_t buildTreeletNode(std::vector<BinaryNode>& nodes, std::span<const BoundingBox> boxes,
+                          const std::vector<Morton::Key<Code>>& keys, uint32_t begin, uint32_t end,
+                          size_t depth)
+{
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    const uint32_t count = end - begin;
+    if (count <= BinaryBVH::MAX_LEAF_SIZE)
+    {
+        BoundingBox bounds{};
+        for (uint32_t i{ begin }; i < end; ++i)
+            bounds.add(boxes[keys[i].primitive]);
+        nodes[index].bounds = bounds;
+        nodes[index].offset = begin;
+        nodes[index].count = count;
+        return index;
+    }
+    // halving the range from here on still reaches the leaves by MAX_DEPTH
+    const bool isBalanced = depth + std::bit_width(count) >= BinaryBVH::MAX_DEPTH;
+    const Split split = findSplit(keys, begin, end, isBalanced);
+    buildTreeletNode(nodes, boxes, keys, begin, split.mid, depth + 1);
+    const uint32_t second = buildTreeletNode(nodes, boxes, keys, split.mid, end, depth + 1);
+    nodes[index].bounds = nodes[index + 1].bounds;
+    nodes[index].bounds.add(nodes[second].bounds);
+    nodes[index].offset = second;
+    nodes[index].axis = split.axis;
+    return index;
+}
+
+/// @brief Cut the sorted keys [begin, end) into treelets, splitting along the Morton curve.
+template<typename Code>
+uint32_t splitIntoTreelets(std::vector<TopNode>& top, std::vector<Treelet>& treelets,
+                           const std::vector<Morton::Key<Code>>& keys, uint32_t begin, uint32_t end,
+                           size_t treeletSize, size_t depth)
+{
+    const auto index = static_cast<uint32_t>(top.size());
+    top.emplace_back();
+    if (end - begin <= treeletSize || depth >= TOP_DEPTH)
+    {
+        top[index].treelet = static_cast<uint32_t>(treelets.size());
+        treelets.push_back({ begin, end, {} });
+        return index;
+    }
+    const Split split = findSplit(keys, begin, end, false);
+    const uint32_t first = splitIntoTreelets(top, treelets, keys, begin, split.mid, treeletSize, depth + 1);
+    const uint32_t second = splitIntoTreelets(top, treelets, keys, split.mid, end, treeletSize, depth + 1);
+    top[index].first = first;
+    top[index].second = second;
+    top[index].axis = split.axis;
+    return index;
+}
+
+/// @brief What the SAH top levels need to know of each treelet.
+struct TreeletSummary
+{
+    BoundingBox bounds;
+    double centre[3];
+    double count;
+};
+
+/// @brief Build the levels above the treelets with the SAH, by sweeping the treelets' centres
+/// along each axis. There are few treelets, so every split is considered.
+uint32_t buildTopSAH(std::vector<TopNode>& top, const std::vector<TreeletSummary>& treelets,
+                     std::span<uint32_t> ids, size_t depth)
+{
+    const auto index = static_cast<uint32_t>(top.size());
+    top.emplace_back();
+    if (ids.size() == 1)
+    {
+        top[index].treelet = ids[0];
+        top[index].bounds = treelets[ids[0]].bounds;
+        return index;
+    }
+    const auto byCentre = [&treelets](size_t axis) {
+        return [&treelets, axis](uint32_t a, uint32_t b) {
+            return treelets[a].centre[axis] < treelets[b].centre[axis];
+        };
+    };
+    size_t bestAxis{ 0 }, bestSplit{ ids.size() / 2 };
+    if (depth + std::bit_width(ids.size()) >= TOP_DEPTH)
+    {
+        // too deep to follow the SAH; split the treelets in half across the widest axis
+        BoundingBox centres{};
+        for (auto id: ids)
+            centres.add(Point{ treelets[id].centre[0], treelets[id].centre[1], treelets[id].centre[2] });
+        const Tuple extent = centres.size();
+        if (extent.y > extent(bestAxis)) bestAxis = 1;
+        if (extent.z > extent(bestAxis)) bestAxis = 2;
+    }
+    else
+    {
+        double bestCost{ INF };
+        std::vector<double> costRight(ids.size());
+        for (size_t axis{}; axis < 3; ++axis)
+        {
+            std::sort(ids.begin(), ids.end(), byCentre(axis));
+            BoundingBox right{};
+            double nRight{};
+            for (size_t i{ ids.size() - 1 }; i > 0; --i)
+            {
+                right.add(treelets[ids[i]].bounds);
+                nRight += treelets[ids[i]].count;
+                costRight[i] = right.surfaceArea() * nRight;
+            }
+            BoundingBox left{};
+            double nLeft{};
+            for (size_t i{ 1 }; i < ids.size(); ++i)
+            {
+                left.add(treelets[ids[i - 1]].bounds);
+                nLeft += treelets[ids[i - 1]].count;
+                const double cost = left.surfaceArea() * nLeft + costRight[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+    }
+    std::sort(ids.begin(), ids.end(), byCentre(bestAxis));
+    const uint32_t first = buildTopSAH(top, treelets, ids.first(bestSplit), depth + 1);
+    const uint32_t second = buildTopSAH(top, treelets, ids.subspan(bestSplit), depth + 1);
+    top[index].first = first;
+    top[index].second = second;
+    top[index].axis = static_cast<uint8_t>(bestAxis);
+    top[index].bounds = top[first].bounds;
+    top[index].bounds.add(top[second].bounds);
+    return index;
+}
+
+/// @brief Bounds of the Morton split top levels, which are known once the treelets are built.
+BoundingBox boundTop(std::vector<TopNode>& top, const std::vector<Treelet>& treelets, uint32_t index)
+{
+    TopNode& node = top[index];
+    if (node.treelet != TopNode::NONE)
+        node.bounds = treelets[node.treelet].nodes[0].bounds;
+    else
+    {
+        node.bounds = boundTop(top, treelets, node.first);
+        node.bounds.add(boundTop(top, treelets, node.second));
+    }
+    return node.bounds;
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BinaryBVH::buildLinear(std::span<const BoundingBox> boxes, const LinearBuildSettings& settings)
+{
+    if (settings.bits == MortonBits::thirty)
+        buildLinearWith<uint32_t>(boxes, settings);
+    else
+        buildLinearWith<uint64_t>(boxes, settings);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename Code>
+void BinaryBVH::buildLinearWith(std::span<const BoundingBox> boxes, const LinearBuildSettings& settings)
+{
+    nodes.clear();
+    primitives.resize(boxes.size());
+    if (boxes.empty())
+    {
+        link(0);
+        return;
+    }
+    const size_t n = boxes.size();
+    const size_t nThreads = Parallel::getThreadCount(settings.nThreads, n);
+
+    // quantise the centres within their bounds, and sort them along the Morton curve
+    std::vector<BoundingBox> sliceBounds(nThreads);
+    Parallel::forEach(nThreads, nThreads, [&](size_t t) {
+        const auto [begin, end] = Parallel::getSlice(n, t, nThreads);
+        for (size_t i{ begin }; i < end; ++i)
+        {
+            ASSERT(boxes[i].isFinite(), "BVH primitives must have finite bounds");
+            sliceBounds[t].add(boxes[i].centre());
+        }
+    });
+    BoundingBox centreBounds{};
+    for (const auto& bounds: sliceBounds)
+        centreBounds.add(bounds);
+    constexpr uint32_t BITS_PER_AXIS = sizeof(Code) == 4 ? 10 : 21;
+    constexpr uint32_t MAX_CELL = (1u << BITS_PER_AXIS) - 1;
+    const Tuple extent = centreBounds.size();
+    double scale[3];
+    for (size_t axis{}; axis < 3; ++axis)
+        scale[axis] = extent(axis) > 0. ? MAX_CELL / extent(axis) : 0.;
+    std::vector<Morton::Key<Code>> keys(n);
+    Parallel::forEach(nThreads, nThreads, [&](size_t t) {
+        const auto [begin, end] = Parallel::getSlice(n, t, nThreads);
+        for (size_t i{ begin }; i < end; ++i)
+        {
+            const Tuple centre = boxes[i].centre();
+            uint32_t cell[3];
+            for (size_t axis{}; axis < 3; ++axis)
+                cell[axis] = std::min(MAX_CELL, static_cast<uint32_t>((centre(axis) - centreBounds.min(axis))
+                                                                      * scale[axis]));
+            if constexpr (sizeof(Code) == 4)
+                keys[i] = { Morton::encode30(cell[0], cell[1], cell[2]), static_cast<uint32_t>(i) };
+            else
+                keys[i] = { Morton::encode63(cell[0], cell[1], cell[2]), static_cast<uint32_t>(i) };
+        }
+    });
+    Morton::radixSort(keys, 3 * BITS_PER_AXIS, nThreads);
+    Parallel::forEach(nThreads, nThreads, [&](size_t t) {
+        const auto [begin, end] = Parallel::getSlice(n, t, nThreads);
+        for (size_t i{ begin }; i < end; ++i)
+            primitives[i] = keys[i].primitive;
+    });
+
+    // cut the curve into treelets, and build them in parallel. Treelets can't tell how deep the top
+    //  levels will be, so they assume the deepest
+    std::vector<TopNode> top;
+    std::vector<Treelet> treelets;
+    const size_t treeletSize = std::max(MIN_TREELET_SIZE, n / N_TREELETS);
+    uint32_t root = splitIntoTreelets(top, treelets, keys, 0, static_cast<uint32_t>(n), treeletSize, 0);
+    Parallel::forEach(nThreads, treelets.size(), [&](size_t i) {
+        auto& treelet = treelets[i];
+        treelet.nodes.reserve(2 * (treelet.end - treelet.begin) / MAX_LEAF_SIZE + 1);
+        buildTreeletNode(treelet.nodes, boxes, keys, treelet.begin, treelet.end, TOP_DEPTH);
+    });
+    if (settings.refineTop && treelets.size() > 2)
+    {
+        std::vector<TreeletSummary> summaries;
+        summaries.reserve(treelets.size());
+        for (const auto& treelet: treelets)
+        {
+            const auto& bounds = treelet.nodes[0].bounds;
+            const Tuple centre = bounds.centre();
+            summaries.push_back({ bounds, { centre.x, centre.y, centre.z },
+                                  static_cast<double>(treelet.end - treelet.begin) });
+        }
+        top.clear();
+        std::vector<uint32_t> ids(treelets.size());
+        std::iota(ids.begin(), ids.end(), 0u);
+        root = buildTopSAH(top, summaries, ids, 0);
+    }
+    else
+        boundTop(top, treelets, root);
+
+    // lay the top levels out depth first, leaving room for each treelet, then copy the treelets in
+    size_t nNodes{ top.size() };
+    for (const auto& treelet: treelets)
+        nNodes += treelet.nodes.size() - 1;
+    nodes.resize(nNodes);
+    std::vector<uint32_t> treeletStart(treelets.size());
+    uint32_t next{ 0 };
+    const auto layOut = [&](const auto& self, uint32_t index) -> uint32_t {
+        const TopNode& node = top[index];
+        const uint32_t position = next;
+        if (node.treelet != TopNode::NONE)
+        {
+            treeletStart[node.treelet] = position;
+            next += static_cast<uint32_t>(treelets[node.treelet].nodes.size());
+            return position;
+        }
+        ++next;
+        nodes[position].bounds = node.bounds;
+        nodes[position].axis = node.axis;
+        self(self, node.first);
+        nodes[position].offset = self(self, node.second);
+        return position;
+    };
+    layOut(layOut, root);
+    Parallel::forEach(nThreads, treelets.size(), [&](size_t i) {
+        const uint32_t start = treeletStart[i];
+        const auto& treeletNodes = treelets[i].nodes;
+        for (size_t j{}; j < treeletNodes.size(); ++j)
+        {
+            BinaryNode node = treeletNodes[j];
+            if (!node.isLeaf())
+                node.offset += start;
+            nodes[start + j] = node;
+        }
+    });
+    link(boxes.size());
+}
+}
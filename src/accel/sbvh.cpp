@@ -0,0 +1,342 @@
+#include "raytracer/accel/bvh.hpp"
+#include "raytracer/common/macros.hpp"
+
+#include <array>
+
+namespace rt::Accel
+{
+namespace
+{
+constexpr size_t N_BINS{ BinaryBVH::N_SPATIAL_BINS };
+
+/// @brief A reference to a primitive, bounding only the part of it inside the node it is in.
+struct Reference
+{
+    BoundingBox box;
+    uint32_t primitive;
+};
+
+/// @brief The cheapest split of a node's references found so far.
+struct Split
+{
+    double cost{ INF };
+    size_t axis{};
+    size_t bin{};   /// the last bin on the left of the split
+    double position{};  /// the split plane, for spatial splits
+    BoundingBox left{}, right{};
+    uint32_t nLeft{}, nRight{};
+};
+
+/// @brief Builds a BVH top down, splitting each node's references either by their centroids (an
+/// object split) or by a plane through space (a spatial split), whichever has the lower SAH cost.
+class SpatialBuilder
+{
+  public:
+    SpatialBuilder(std::vector<BinaryNode>& nodes, std::vector<uint32_t>& primitives,
+                   const ClipPrimitive& clip, double minOverlapArea, size_t nSplitsLeft)
+    :   nodes(nodes), primitives(primitives), clip(clip), minOverlapArea(minOverlapArea),
+        nSplitsLeft(nSplitsLeft)
+    {}
+
+    uint32_t build(std::vector<Reference> refs, size_t depth)
+    {
+        const auto index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        BoundingBox bounds{}, centroidBounds{};
+        for (const auto& ref: refs)
+        {
+            bounds.add(ref.box);
+            centroidBounds.add(ref.box.centre());
+        }
+        nodes[index].bounds = bounds;
+        const auto count = static_cast<uint32_t>(refs.size());
+        const auto makeLeaf = [&]() {
+            nodes[index].offset = static_cast<uint32_t>(primitives.size());
+            nodes[index].count = count;
+            for (const auto& ref: refs)
+                primitives.push_back(ref.primitive);
+            return index;
+        };
+        if (count == 1 || depth >= BinaryBVH::MAX_DEPTH)
+            return makeLeaf();
+        const double area = bounds.surfaceArea();
+        const double invArea = area > 0. ? 1. / area : 0.;
+        const Split objectSplit = findObjectSplit(refs, centroidBounds, invArea);
+        Split best = objectSplit;
+        bool isSpatial{ false };
+        // only nodes whose object split leaves overlapping children gain from splitting space
+        if (nSplitsLeft > 0 && (best.cost == INF || best.left.overlap(best.right).surfaceArea() > minOverlapArea))
+        {
+            const Split spatial = findSpatialSplit(refs, bounds, invArea);
+            if (spatial.cost < best.cost)
+            {
+                best = spatial;
+                isSpatial = true;
+            }
+        }
+        if (count <= BinaryBVH::MAX_LEAF_SIZE && count * BinaryBVH::INTERSECTION_COST <= best.cost)
+            return makeLeaf();
+        std::vector<Reference> left, right;
+        if (isSpatial)
+            splitSpace(refs, best, left, right);
+        if (left.empty() || right.empty())
+        {
+            left.clear();
+            right.clear();
+            best = objectSplit;
+            if (!splitObjects(refs, best, centroidBounds, left, right))
+            {
+                if (count <= BinaryBVH::MAX_LEAF_SIZE)
+                    // the centroids all coincide, so no split can separate them
+                    return makeLeaf();
+                left.clear();
+                right.clear();
+                best.axis = splitAtMedian(refs, centroidBounds, left, right);
+            }
+        }
+        nodes[index].axis = static_cast<uint8_t>(best.axis);
+        // the references are copied into the children by now, so they are freed before recursing
+        std::vector<Reference>{}.swap(refs);
+        build(std::move(left), depth + 1);
+        const uint32_t second = build(std::move(right), depth + 1);
+        nodes[index].offset = second;
+        return index;
+    }
+
+  private:
+    struct Bin
+    {
+        BoundingBox bounds{};
+        uint32_t entries{};  /// references which start in the bin (or whose centroid is in it)
+        uint32_t exits{};    /// references which end in the bin
+    };
+
+    /// @brief Sweep the bins from both ends, keeping the cheapest split between two of them.
+    static void sweep(const std::array<Bin, N_BINS>& bins, size_t axis, double invArea, Split& best)
+    {
+        std::array<BoundingBox, N_BINS> rightBounds{};
+        std::array<uint32_t, N_BINS> nRight{};
+        BoundingBox right{};
+        uint32_t n{};
+        for (size_t b{ N_BINS - 1 }; b > 0; --b)
+        {
+            right.add(bins[b].bounds);
+            n += bins[b].exits;
+            rightBounds[b] = right;
+            nRight[b] = n;
+        }
+        BoundingBox left{};
+        uint32_t nLeft{};
+        for (size_t b{}; b + 1 < N_BINS; ++b)
+        {
+            left.add(bins[b].bounds);
+            nLeft += bins[b].entries;
+            if (nLeft == 0 || nRight[b + 1] == 0)
+                continue;
+            const double cost = BinaryBVH::TRAVERSAL_COST + BinaryBVH::INTERSECTION_COST * invArea
+                                * (left.surfaceArea() * nLeft + rightBounds[b + 1].surfaceArea() * nRight[b + 1]);
+            if (cost < best.cost)
+                best = { cost, axis, b, 0., left, rightBounds[b + 1], nLeft, nRight[b + 1] };
+        }
+    }
+
+    static size_t binOf(double x, double lo, double binScale)
+    {
+        const double b = (x - lo) * binScale;
+        return b <= 0. ? 0 : std::min(static_cast<size_t>(b), N_BINS - 1);
+    }
+
+    /// @brief The cheapest split of the references by their centroids, along any axis.
+    static Split findObjectSplit(const std::vector<Reference>& refs, const BoundingBox& centroidBounds,
+                                 double invArea)
+    {
+        Split best{};
+        for (size_t axis{}; axis < 3; ++axis)
+        {
+            const double width = centroidBounds.size()(axis);
+            if (width <= 0.)
+                continue;
+            const double lo = centroidBounds.min(axis);
+            const double binScale = static_cast<double>(N_BINS) / width;
+            std::array<Bin, N_BINS> bins{};
+            for (const auto& ref: refs)
+            {
+                auto& bin = bins[binOf(ref.box.centre()(axis), lo, binScale)];
+                bin.bounds.add(ref.box);
+                ++bin.entries;
+                ++bin.exits;
+            }
+            sweep(bins, axis, invArea, best);
+        }
+        return best;
+    }
+
+    /// @brief The cheapest split of the node's space by a plane between two bins, along any axis.
+    /// References straddling the plane count towards both sides.
+    Split findSpatialSplit(const std::vector<Reference>& refs, const BoundingBox& bounds, double invArea) const
+    {
+        Split best{};
+        for (size_t axis{}; axis < 3; ++axis)
+        {
+            const double width = bounds.size()(axis);
+            if (width <= 0.)
+                continue;
+            const double lo = bounds.min(axis);
+            const double binWidth = width / static_cast<double>(N_BINS);
+            const double binScale = 1. / binWidth;
+            std::array<Bin, N_BINS> bins{};
+            for (const auto& ref: refs)
+            {
+                const size_t first = binOf(ref.box.min(axis), lo, binScale);
+                const size_t last = binOf(ref.box.max(axis), lo, binScale);
+                ++bins[first].entries;
+                ++bins[last].exits;
+                if (first == last)
+                {
+                    bins[first].bounds.add(ref.box);
+                    continue;
+                }
+                // chop the reference into the part in each bin it spans
+                for (size_t b{ first }; b <= last; ++b)
+                {
+                    BoundingBox slab{ ref.box };
+                    if (b > first)
+                        slab.min(axis) = lo + static_cast<double>(b) * binWidth;
+                    if (b < last)
+                        slab.max(axis) = lo + static_cast<double>(b + 1) * binWidth;
+                    bins[b].bounds.add(clip(ref.primitive, slab));
+                }
+            }
+            const double before = best.cost;
+            sweep(bins, axis, invArea, best);
+            if (best.cost < before)
+                best.position = lo + static_cast<double>(best.bin + 1) * binWidth;
+        }
+        return best;
+    }
+
+    /// @brief Share the references out by which side of the split their centroid is on.
+    /// @return False if they all fell on one side.
+    static bool splitObjects(const std::vector<Reference>& refs, const Split& split,
+                             const BoundingBox& centroidBounds, std::vector<Reference>& left,
+                             std::vector<Reference>& right)
+    {
+        if (split.cost == INF)
+            return false;
+        const double lo = centroidBounds.min(split.axis);
+        const double binScale = static_cast<double>(N_BINS) / centroidBounds.size()(split.axis);
+        for (const auto& ref: refs)
+        {
+            auto& side = binOf(ref.box.centre()(split.axis), lo, binScale) <= split.bin ? left : right;
+            side.push_back(ref);
+        }
+        return !left.empty() && !right.empty();
+    }
+
+    /// @brief Share the references out in two halves, along the axis their centroids spread most on.
+    /// @return The axis they were split along.
+    static size_t splitAtMedian(std::vector<Reference>& refs, const BoundingBox& centroidBounds,
+                              std::vector<Reference>& left, std::vector<Reference>& right)
+    {
+        const Tuple extent = centroidBounds.size();
+        size_t axis{ 0 };
+        if (extent.y > extent(axis)) axis = 1;
+        if (extent.z > extent(axis)) axis = 2;
+        const auto mid = refs.begin() + static_cast<std::ptrdiff_t>(refs.size() / 2);
+        std::nth_element(refs.begin(), mid, refs.end(), [axis](const Reference& a, const Reference& b) {
+            return a.box.centre()(axis) < b.box.centre()(axis);
+        });
+        left.assign(refs.begin(), mid);
+        right.assign(mid, refs.end());
+        return axis;
+    }
+
+    /// @brief Share the references out by which side of the split plane they are on, cutting
+    /// those which straddle it in two, unless moving them whole to one side is cheaper.
+    void splitSpace(const std::vector<Reference>& refs, const Split& split,
+                    std::vector<Reference>& left, std::vector<Reference>& right)
+    {
+        const size_t axis = split.axis;
+        const double position = split.position;
+        const double areaLeft = split.left.surfaceArea();
+        const double areaRight = split.right.surfaceArea();
+        const auto nLeft = static_cast<double>(split.nLeft);
+        const auto nRight = static_cast<double>(split.nRight);
+        for (const auto& ref: refs)
+        {
+            if (ref.box.max(axis) <= position)
+            {
+                left.push_back(ref);
+                continue;
+            }
+            if (ref.box.min(axis) >= position)
+            {
+                right.push_back(ref);
+                continue;
+            }
+            // "unsplitting" (Stich et al.): leave the reference whole on one side if the bigger
+            //  box on that side costs less than the extra reference would
+            BoundingBox withLeft{ split.left }, withRight{ split.right };
+            withLeft.add(ref.box);
+            withRight.add(ref.box);
+            const double costSplit = areaLeft * nLeft + areaRight * nRight;
+            const double costLeft = withLeft.surfaceArea() * nLeft + areaRight * (nRight - 1.);
+            const double costRight = areaLeft * (nLeft - 1.) + withRight.surfaceArea() * nRight;
+            if (nSplitsLeft == 0 || std::min(costLeft, costRight) <= costSplit)
+            {
+                (costLeft <= costRight ? left : right).push_back(ref);
+                continue;
+            }
+            BoundingBox leftSlab{ ref.box }, rightSlab{ ref.box };
+            leftSlab.max(axis) = position;
+            rightSlab.min(axis) = position;
+            const BoundingBox leftPart = clip(ref.primitive, leftSlab);
+            const BoundingBox rightPart = clip(ref.primitive, rightSlab);
+            if (leftPart.isEmpty() || rightPart.isEmpty())
+            {
+                // the primitive only touches the plane, so it isn't really split
+                (leftPart.isEmpty() ? right : left).push_back(ref);
+                continue;
+            }
+            left.push_back({ leftPart, ref.primitive });
+            right.push_back({ rightPart, ref.primitive });
+            --nSplitsLeft;
+        }
+    }
+
+    std::vector<BinaryNode>& nodes;
+    std::vector<uint32_t>& primitives;
+    const ClipPrimitive& clip;
+    double minOverlapArea;  /// overlap of object split children, past which spatial splits are tried
+    size_t nSplitsLeft;     /// references which may still be cut in two
+};
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BinaryBVH::buildSpatial(std::span<const BoundingBox> boxes, const ClipPrimitive& clip,
+                             const SpatialBuildSettings& settings)
+{
+    nodes.clear();
+    primitives.clear();
+    if (boxes.empty())
+    {
+        link(0);
+        return;
+    }
+    std::vector<Reference> refs;
+    refs.reserve(boxes.size());
+    BoundingBox root{};
+    for (uint32_t i{}; i < boxes.size(); ++i)
+    {
+        ASSERT(boxes[i].isFinite(), "BVH primitives must have finite bounds");
+        refs.push_back({ boxes[i], i });
+        root.add(boxes[i]);
+    }
+    const auto nSplits = static_cast<size_t>(static_cast<double>(boxes.size()) * std::max(settings.duplicationBudget, 0.));
+    primitives.reserve(boxes.size() + nSplits);
+    nodes.reserve(2 * (boxes.size() + nSplits) / MAX_LEAF_SIZE + 1);
+    SpatialBuilder builder{ nodes, primitives, clip, root.surfaceArea() * settings.minOverlap, nSplits };
+    builder.build(std::move(refs), 0);
+    link(boxes.size());
+}
+}
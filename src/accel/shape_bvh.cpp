@@ -0,0 +1,214 @@
+#include "raytracer/accel/shape_bvh.hpp"
+#include "raytracer/shapes/shape.hpp"
+
+namespace rt::Accel
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::markMoved(Shape& shape)
+{
+    std::scoped_lock lock{ m_build };
+    if (shape.hasMoved)
+        return;
+    shape.hasMoved = true;
+    moved.push_back(&shape);
+    hasMoves.store(true, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::update(std::span<Shape* const> shapes)
+{
+    const auto mayHaveMoves = [&]() {
+        return tracking == MoveTracking::checked
+               && seenMoveCount.load(std::memory_order_acquire) != Shape::getMoveCount();
+    };
+    if (isUpToDate() && !mayHaveMoves())
+        return;
+    std::scoped_lock lock{ m_build };
+    if (mayHaveMoves())
+    {
+        // shapes without a parent flag themselves when they move, and wait to be found
+        const uint64_t moveCount = Shape::getMoveCount();
+        for (auto s: shapes)
+        {
+            if (s->hasMoved)
+                moved.push_back(s);
+        }
+        seenMoveCount.store(moveCount, std::memory_order_release);
+    }
+    if (!isBuilt.load(std::memory_order_relaxed))
+        build(shapes);
+    else if (!moved.empty())
+        refit(shapes);
+    hasMoves.store(false, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::build(std::span<Shape* const> shapes)
+{
+    bounded.clear();
+    boxes.clear();
+    listed.clear();
+    moved.clear();
+    const bool useTree = shapes.size() >= MIN_SHAPES_FOR_TREE;
+    for (auto s: shapes)
+    {
+        s->hasMoved = false;
+        const auto box = s->parentSpaceBounds();
+        if (useTree && box.isFinite())
+        {
+            s->accelIndex = static_cast<uint32_t>(bounded.size());
+            bounded.push_back(s);
+            boxes.push_back(box);
+        }
+        else
+        {
+            s->accelIndex = 0xFFFFFFFF;
+            listed.push_back(s);
+        }
+    }
+    buildTree();
+    packTriangles();
+    boundListed();
+    isBuilt.store(true, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::buildTree()
+{
+    isSplit.clear();
+    uint64_t key{};
+    if (!cacheFile.empty())
+    {
+        key = Utils::hashValue(quality);
+        for (auto s: bounded)
+            key = Utils::hashValue(s->contentHash(), key);
+        if (bvh.load(cacheFile, key))
+        {
+            findSplitShapes();
+            ++nLoads;
+            return;
+        }
+    }
+    if (quality == BuildQuality::high)
+    {
+        bvh.build(boxes, [this](uint32_t i, const BoundingBox& box) {
+            return bounded[i]->parentSpaceBoundsWithin(box);
+        });
+        findSplitShapes();
+    }
+    else
+        bvh.build(boxes, boxes.size() >= MIN_SHAPES_FOR_LINEAR_BUILD ? BuildMethod::linear : BuildMethod::sah);
+    ++nBuilds;
+    // a cache which can't be written only costs the next run a build
+    if (!cacheFile.empty())
+        (void) bvh.save(cacheFile, key);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::refit(std::span<Shape* const> shapes)
+{
+    if (bvh.getMethod() == BuildMethod::spatial)
+    {
+        // the shapes were cut up to the tree's leaves, which a refit can't redo
+        build(shapes);
+        return;
+    }
+    movedPrimitives.clear();
+    for (auto s: moved)
+    {
+        s->hasMoved = false;
+        const uint32_t i = s->accelIndex;
+        // listed shapes have no box of their own to refit
+        if (i >= bounded.size() || bounded[i] != s)
+            continue;
+        const auto box = s->parentSpaceBounds();
+        if (!box.isFinite())
+        {
+            // ie: a group which has lost its bounds, and has to be listed now
+            build(shapes);
+            return;
+        }
+        boxes[i] = box;
+        movedPrimitives.push_back(i);
+    }
+    moved.clear();
+    if (!movedPrimitives.empty() && bvh.refit(boxes, movedPrimitives))
+    {
+        ++nBuilds;
+        packTriangles();
+    }
+    else
+    {
+        for (const auto i: movedPrimitives)
+        {
+            const uint32_t slot = packSlotOf[i];
+            Tuple corners[3];
+            if (slot != NO_PACK && bounded[i]->getParentSpaceCorners(corners))
+                packs[slot / PACK_WIDTH].set(slot % PACK_WIDTH, corners[0], corners[1], corners[2]);
+        }
+    }
+    boundListed();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::packTriangles()
+{
+    packs.clear();
+    const auto& binary = bvh.getBinary();
+    const auto& references = binary.getPrimitiveIndices();
+    packAt.assign(references.size(), NO_PACK);
+    packSlotOf.assign(bounded.size(), NO_PACK);
+    for (const auto& node: binary.getNodes())
+    {
+        // leaves cut short by the depth limit may be wider than a pack
+        if (!node.isLeaf() || node.count > PACK_WIDTH)
+            continue;
+        TrianglePack<PACK_WIDTH> pack{};
+        bool isAllTriangles{ true };
+        for (uint32_t lane{}; lane < node.count && isAllTriangles; ++lane)
+        {
+            Tuple corners[3];
+            isAllTriangles = bounded[references[node.offset + lane]]->getParentSpaceCorners(corners);
+            if (isAllTriangles)
+                pack.set(lane, corners[0], corners[1], corners[2]);
+        }
+        if (!isAllTriangles)
+            continue;
+        pack.count = node.count;
+        const auto index = static_cast<uint32_t>(packs.size());
+        packAt[node.offset] = index;
+        for (uint32_t lane{}; lane < node.count; ++lane)
+            packSlotOf[references[node.offset + lane]] = index * PACK_WIDTH + lane;
+        packs.push_back(pack);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::findSplitShapes()
+{
+    const auto& binary = bvh.getBinary();
+    if (!binary.hasDuplicates())
+        return;
+    std::vector<uint8_t> isSeen(bounded.size(), 0);
+    isSplit.assign(bounded.size(), 0);
+    for (const auto i: binary.getPrimitiveIndices())
+    {
+        isSplit[i] |= isSeen[i];
+        isSeen[i] = 1;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void ShapeBVH::boundListed()
+{
+    listedBounds = {};
+    bounds = bvh.getBinary().getBounds();
+    for (auto s: listed)
+    {
+        const auto box = s->parentSpaceBounds();
+        bounds.add(box);
+        // an empty shape has empty bounds, yet is still tested in case it gains children
+        listedBounds.add(box.isEmpty() ? BoundingBox::infinite() : box);
+    }
+}
+}
@@ -0,0 +1,201 @@
+#include "raytracer/accel/triangles.hpp"
+#include "raytracer/accel/bvh.hpp"
+
+#include <cmath>
+#include <utility>
+
+#if defined(__x86_64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#define RT_ACCEL_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace rt::Accel
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+WatertightRay::WatertightRay(const Ray& ray)
+{
+    const auto& o = ray.getOrigin();
+    const auto& d = ray.getDirection();
+    origin[0] = o.x;
+    origin[1] = o.y;
+    origin[2] = o.z;
+    const double ax = std::abs(d.x), ay = std::abs(d.y), az = std::abs(d.z);
+    kz = ax >= ay ? (ax >= az ? 0 : 2) : (ay >= az ? 1 : 2);
+    kx = static_cast<uint8_t>((kz + 1) % 3);
+    ky = static_cast<uint8_t>((kx + 1) % 3);
+    // keep the winding of the triangles the same, whichever way along z the ray runs
+    if (d(kz) < 0.)
+        std::swap(kx, ky);
+    sx = d(kx) / d(kz);
+    sy = d(ky) / d(kz);
+    sz = 1. / d(kz);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool intersectTriangle(const WatertightRay& ray, const Tuple& p1, const Tuple& p2, const Tuple& p3,
+                       double tNear, double tFar, TriangleHit& hit)
+{
+    // corners relative to the ray's origin, sheared so that the ray runs down the z axis
+    const double az = p1(ray.kz) - ray.origin[ray.kz];
+    const double bz = p2(ray.kz) - ray.origin[ray.kz];
+    const double cz = p3(ray.kz) - ray.origin[ray.kz];
+    const double ax = p1(ray.kx) - ray.origin[ray.kx] - ray.sx * az;
+    const double ay = p1(ray.ky) - ray.origin[ray.ky] - ray.sy * az;
+    const double bx = p2(ray.kx) - ray.origin[ray.kx] - ray.sx * bz;
+    const double by = p2(ray.ky) - ray.origin[ray.ky] - ray.sy * bz;
+    const double cx = p3(ray.kx) - ray.origin[ray.kx] - ray.sx * cz;
+    const double cy = p3(ray.ky) - ray.origin[ray.ky] - ray.sy * cz;
+    // scaled barycentric coordinates; the ray passes inside when they all share a sign, and a
+    //  zero (the ray through an edge) counts as either sign, so neither neighbour lets it slip by
+    const double U = cx * by - cy * bx;
+    const double V = ax * cy - ay * cx;
+    const double W = bx * ay - by * ax;
+    if ((U < 0. || V < 0. || W < 0.) && (U > 0. || V > 0. || W > 0.))
+        return false;
+    const double determinant = U + V + W;
+    if (determinant == 0.)
+        return false;
+    const double t = (U * az + V * bz + W * cz) * ray.sz / determinant;
+    if (!(t >= tNear && t < tFar))
+        return false;
+    hit = { t, V / determinant, W / determinant };
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Triangle pack kernels
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+/// @brief Plain C++ kernel, for CPUs without AVX2. The loop has no branches, so it vectorises.
+template<size_t N>
+LaneMask intersectPackPortable(const TrianglePack<N>& pack, const WatertightRay& ray, double tNear,
+                               double tFar, double* t, double* u, double* v)
+{
+    const double ox = ray.origin[ray.kx], oy = ray.origin[ray.ky], oz = ray.origin[ray.kz];
+    LaneMask mask{ 0 };
+    for (size_t i{}; i < N; ++i)
+    {
+        const double az = pack.a[ray.kz][i] - oz;
+        const double bz = pack.b[ray.kz][i] - oz;
+        const double cz = pack.c[ray.kz][i] - oz;
+        const double ax = pack.a[ray.kx][i] - ox - ray.sx * az;
+        const double ay = pack.a[ray.ky][i] - oy - ray.sy * az;
+        const double bx = pack.b[ray.kx][i] - ox - ray.sx * bz;
+        const double by = pack.b[ray.ky][i] - oy - ray.sy * bz;
+        const double cx = pack.c[ray.kx][i] - ox - ray.sx * cz;
+        const double cy = pack.c[ray.ky][i] - oy - ray.sy * cz;
+        const double U = cx * by - cy * bx;
+        const double V = ax * cy - ay * cx;
+        const double W = bx * ay - by * ax;
+        const double determinant = U + V + W;
+        const double tHit = (U * az + V * bz + W * cz) * ray.sz / determinant;
+        const bool isOutside = (U < 0. || V < 0. || W < 0.) && (U > 0. || V > 0. || W > 0.);
+        const bool isHit = !isOutside && determinant != 0. && tHit >= tNear && tHit < tFar;
+        t[i] = tHit;
+        u[i] = V / determinant;
+        v[i] = W / determinant;
+        mask |= static_cast<LaneMask>(isHit) << i;
+    }
+    return mask & ((1u << pack.count) - 1);
+}
+
+#ifdef RT_ACCEL_X86_SIMD
+/// @brief Four lanes of one axis of a pack's corners, relative to the ray's origin and sheared.
+template<size_t N>
+__attribute__((target("avx2")))
+inline __m256d shearAVX2(const double (&corner)[3][N], size_t axis, size_t first, __m256d origin,
+                         __m256d shear, __m256d z)
+{
+    return _mm256_sub_pd(_mm256_sub_pd(_mm256_load_pd(&corner[axis][first]), origin), _mm256_mul_pd(shear, z));
+}
+
+/// @brief AVX2 kernel for four lanes of a pack, starting at a given one. Only called once the CPU
+/// is known to support it.
+template<size_t N>
+__attribute__((target("avx2")))
+LaneMask intersectQuadAVX2(const TrianglePack<N>& pack, size_t first, const WatertightRay& ray,
+                           double tNear, double tFar, double* t, double* u, double* v)
+{
+    const __m256d ox = _mm256_set1_pd(ray.origin[ray.kx]);
+    const __m256d oy = _mm256_set1_pd(ray.origin[ray.ky]);
+    const __m256d oz = _mm256_set1_pd(ray.origin[ray.kz]);
+    const __m256d sx = _mm256_set1_pd(ray.sx);
+    const __m256d sy = _mm256_set1_pd(ray.sy);
+    const __m256d az = _mm256_sub_pd(_mm256_load_pd(&pack.a[ray.kz][first]), oz);
+    const __m256d bz = _mm256_sub_pd(_mm256_load_pd(&pack.b[ray.kz][first]), oz);
+    const __m256d cz = _mm256_sub_pd(_mm256_load_pd(&pack.c[ray.kz][first]), oz);
+    const __m256d ax = shearAVX2(pack.a, ray.kx, first, ox, sx, az);
+    const __m256d ay = shearAVX2(pack.a, ray.ky, first, oy, sy, az);
+    const __m256d bx = shearAVX2(pack.b, ray.kx, first, ox, sx, bz);
+    const __m256d by = shearAVX2(pack.b, ray.ky, first, oy, sy, bz);
+    const __m256d cx = shearAVX2(pack.c, ray.kx, first, ox, sx, cz);
+    const __m256d cy = shearAVX2(pack.c, ray.ky, first, oy, sy, cz);
+    const __m256d U = _mm256_sub_pd(_mm256_mul_pd(cx, by), _mm256_mul_pd(cy, bx));
+    const __m256d V = _mm256_sub_pd(_mm256_mul_pd(ax, cy), _mm256_mul_pd(ay, cx));
+    const __m256d W = _mm256_sub_pd(_mm256_mul_pd(bx, ay), _mm256_mul_pd(by, ax));
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d anyNegative = _mm256_or_pd(_mm256_or_pd(_mm256_cmp_pd(U, zero, _CMP_LT_OQ),
+                                                          _mm256_cmp_pd(V, zero, _CMP_LT_OQ)),
+                                             _mm256_cmp_pd(W, zero, _CMP_LT_OQ));
+    const __m256d anyPositive = _mm256_or_pd(_mm256_or_pd(_mm256_cmp_pd(U, zero, _CMP_GT_OQ),
+                                                          _mm256_cmp_pd(V, zero, _CMP_GT_OQ)),
+                                             _mm256_cmp_pd(W, zero, _CMP_GT_OQ));
+    const __m256d determinant = _mm256_add_pd(_mm256_add_pd(U, V), W);
+    const __m256d T = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(U, az), _mm256_mul_pd(V, bz)),
+                                    _mm256_mul_pd(W, cz));
+    const __m256d tHit = _mm256_div_pd(_mm256_mul_pd(T, _mm256_set1_pd(ray.sz)), determinant);
+    __m256d isHit = _mm256_andnot_pd(_mm256_and_pd(anyNegative, anyPositive),
+                                     _mm256_cmp_pd(determinant, zero, _CMP_NEQ_OQ));
+    isHit = _mm256_and_pd(isHit, _mm256_cmp_pd(tHit, _mm256_set1_pd(tNear), _CMP_GE_OQ));
+    isHit = _mm256_and_pd(isHit, _mm256_cmp_pd(tHit, _mm256_set1_pd(tFar), _CMP_LT_OQ));
+    _mm256_storeu_pd(t + first, tHit);
+    _mm256_storeu_pd(u + first, _mm256_div_pd(V, determinant));
+    _mm256_storeu_pd(v + first, _mm256_div_pd(W, determinant));
+    return static_cast<LaneMask>(_mm256_movemask_pd(isHit)) << first;
+}
+
+template<size_t N>
+__attribute__((target("avx2")))
+LaneMask intersectPackAVX2(const TrianglePack<N>& pack, const WatertightRay& ray, double tNear,
+                           double tFar, double* t, double* u, double* v)
+{
+    LaneMask mask = intersectQuadAVX2(pack, 0, ray, tNear, tFar, t, u, v);
+    if (N == 8 && pack.count > 4)
+        mask |= intersectQuadAVX2(pack, 4, ray, tNear, tFar, t, u, v);
+    return mask & ((1u << pack.count) - 1);
+}
+#endif
+
+template<size_t N>
+LaneMask intersectPack(const TrianglePack<N>& pack, const WatertightRay& ray, double tNear,
+                       double tFar, double* t, double* u, double* v)
+{
+#ifdef RT_ACCEL_X86_SIMD
+    using Kernel = LaneMask (*)(const TrianglePack<N>&, const WatertightRay&, double, double,
+                                double*, double*, double*);
+    // the eight wide BVH is only picked for CPUs with AVX2
+    static const Kernel kernel = detectNodeWidth() == NodeWidth::eight ? intersectPackAVX2<N>
+                                                                       : intersectPackPortable<N>;
+    return kernel(pack, ray, tNear, tFar, t, u, v);
+#else
+    return intersectPackPortable(pack, ray, tNear, tFar, t, u, v);
+#endif
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+LaneMask intersectTrianglePack(const TrianglePack<4>& pack, const WatertightRay& ray, double tNear,
+                               double tFar, double* t, double* u, double* v)
+{
+    return intersectPack(pack, ray, tNear, tFar, t, u, v);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+LaneMask intersectTrianglePack(const TrianglePack<8>& pack, const WatertightRay& ray, double tNear,
+                               double tFar, double* t, double* u, double* v)
+{
+    return intersectPack(pack, ray, tNear, tFar, t, u, v);
+}
+}
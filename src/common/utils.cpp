@@ -1,5 +1,7 @@
 #include "raytracer/common/utils.hpp"
 
+#include <cstring>
+
 namespace rt
 {
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -25,4 +27,24 @@ bool Utils::isDouble(const std::string& s)
     double val = strtod(s.c_str(), &end);
     return end != s.c_str() && *end == '\0' && val != HUGE_VAL;
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Utils::hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    constexpr uint64_t PRIME{ 0x100000001b3 };
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash{ seed };
+    size_t i{};
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * PRIME;
+        // fold the high bits back down, which a multiply alone never carries into the low ones
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ bytes[i]) * PRIME;
+    return hash;
+}
 }
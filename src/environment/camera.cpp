@@ -1,4 +1,5 @@
 #include "raytracer/environment/camera.hpp"
+#include <algorithm>
 #include <chrono>
 
 namespace rt
@@ -13,6 +14,16 @@ Camera::Camera(uint32_t _hSize, uint32_t _vSize, double fieldOfView)
   vSizeF(static_cast<double>(_vSize)),
   fieldOfView(fieldOfView)
 {
+    updateProjection();
+    // default transform is identity
+    setTransform(TransformationMatrix::identity());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Camera::updateProjection() noexcept
+{
+    hSizeF = static_cast<double>(_hSize);
+    vSizeF = static_cast<double>(_vSize);
     // the canvas is placed one world unit away from the "front" of the camera
     // we calculate the width of half of the canvas by projecting a triangular FOV
     // out from the camera's "eye"
@@ -33,8 +44,6 @@ Camera::Camera(uint32_t _hSize, uint32_t _vSize, double fieldOfView)
     }
     // determine pixel size for the canvas (we assume pixels are square)
     pixelSize = (halfWidth * 2.0) / hSizeF;
-    // default transform is identity
-    setTransform(TransformationMatrix::identity());
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -51,8 +60,11 @@ Ray Camera::getRayForCanvasPixel(uint32_t pixelX, uint32_t pixelY)
     const auto pixel     = inverseTransform * Point{ worldX, worldY, -1.0 };
     const auto origin    = inverseTransform * Point{ 0., 0., 0. };
     const auto direction = (pixel - origin).normalize();
-
-    return { origin, direction };
+    // each ray is a thin cone through its pixel; the canvas is one unit away, so the cone grows
+    //  by one pixel width per unit travelled
+    Ray ray{ origin, direction };
+    ray.setCone(0., pixelSize);
+    return ray;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -70,15 +82,22 @@ Canvas Camera::render(World world)
               << _hSize * _vSize << " pixels to render...\n";
     uint32_t nRowsDone{};
     Canvas image{ _hSize, _vSize };
-    for (uint32_t y{}; y < _vSize; ++y)
+    // neighbouring pixels are traced together, in packets of 4x2 pixel blocks
+    using Block = RayPacket<8>;
+    for (uint32_t y{}; y < _vSize; y += Block::BLOCK_HEIGHT)
     {
-        for (uint32_t x{}; x < _hSize; ++x)
+        for (uint32_t x{}; x < _hSize; x += Block::BLOCK_WIDTH)
         {
-            auto ray   = getRayForCanvasPixel(x, y);
-            auto pixel = world.traceRayToPixel(ray, World::MAX_RAYS);
-            image.writePixel(x, y, pixel);
+            const auto packet = getRayPacketForCanvasBlock<Block::SIZE>(x, y);
+            const auto pixels = world.tracePacketToPixels(packet, World::MAX_RAYS);
+            for (size_t lane{}; lane < Block::SIZE; ++lane)
+            {
+                if (packet.isActive(lane))
+                    image.writePixel(x + lane % Block::BLOCK_WIDTH,
+                                     y + lane / Block::BLOCK_WIDTH, pixels[lane]);
+            }
         }
-        nRowsDone++;
+        nRowsDone = std::min(_vSize, nRowsDone + Block::BLOCK_HEIGHT);
         std::cout << nRowsDone << "/" << _vSize << " rows\n";
     }
     auto t1= std::chrono::high_resolution_clock::now();
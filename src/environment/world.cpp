@@ -1,6 +1,9 @@
 #include "raytracer/environment/world.hpp"
 #include "raytracer/environment/lighting.hpp"
 #include "raytracer/shapes/sphere.hpp"
+#include "raytracer/common/static_vector.hpp"
+
+#include <algorithm>
 
 
 namespace rt
@@ -8,53 +11,61 @@ namespace rt
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// IntersectionState
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-IntersectionState::IntersectionState(Intersection& i, Ray& ray, Intersections& xs)
+IntersectionState::IntersectionState(const Intersection& i, const Ray& ray, const Intersections& xs)
 :   shape(*i.shape),
+    instance(i.instance),
+    material(i.getMaterial()),
     t(i.t),
     point(ray.position(t)),
     eye(-ray.getDirection()),
     normal(shape.normalAt(point, i)),
-    isInsideShape(Tuple::dot(normal, eye) < 0)
+    isInsideShape(Tuple::dot(normal, eye) < 0),
+    footprint(ray.footprintAt(t)),
+    coneSpread(ray.getConeSpread()),
+    hit(&i),
+    xs(&xs)
 {
     // invert the normal if we are inside the shape object, so that the shading
     //  will illuminate the surface properly
     if (isInsideShape)
         normal = -normal;
-    //
     pointAboveSurface = point + (normal * EPSILON);
-    pointBelowSurface = point - (normal * EPSILON);
-    // reflecting the ray's direction vector around the shape's normal is how we get
-    //  the reflection vector
-    vReflect = Vector::reflect(ray.getDirection(), normal);
-    findRefractiveIndices(i, xs);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void IntersectionState::findRefractiveIndices(Intersection& i, Intersections& xs)
+void IntersectionState::findRefractiveIndices()
 {
-    // compute n1 and n2 refractive indices
-    for (const Intersection& x: xs.getIntersections()) {
+    if (hasRefractiveIndices)
+        return;
+    hasRefractiveIndices = true;
+    // the shapes the ray is inside of at each intersection, innermost last. Instanced shapes are
+    //  told apart by the Instance they were hit through.
+    StaticVector<const Intersection*, MAX_NESTED_SHAPES> containers{};
+    const auto innermostRefraction = [&containers]() {
+        return containers.empty() ? 1.0 : containers.back()->getMaterial().refraction;
+    };
+    for (const Intersection& x: xs->getIntersections()) {
         // find n1
-        if (x == i)
-        {
-            if (refractedShapes.empty())
-                n1 = 1.0;
-            else
-                n1 = refractedShapes.back()->getMaterial().refraction;
-        }
+        if (x == *hit)
+            n1 = innermostRefraction();
         // remove shape if exiting object, else, it is entering, so push it on
-        const int indexOfShape = refractedShapesContains(x.shape);
-        if (indexOfShape >= 0)
-            refractedShapes.erase(refractedShapes.begin() + indexOfShape);
+        const auto it = std::find_if(containers.begin(), containers.end(), [&x](const Intersection* c) {
+            return c->shape == x.shape && c->instance == x.instance;
+        });
+        if (it != containers.end())
+            containers.erase(static_cast<size_t>(it - containers.begin()));
         else
-            refractedShapes.push_back(x.shape);
+        {
+            // only the innermost shapes decide the refractive indices; forget the outermost
+            //  when nested too deeply (ie: rays passing through many open surfaces)
+            if (containers.size() == containers.capacity())
+                containers.erase(0);
+            containers.push_back(&x);
+        }
         // find n2
-        if (x == i)
+        if (x == *hit)
         {
-            if (refractedShapes.empty())
-                n2 = 1.0;
-            else
-                n2 = refractedShapes.back()->getMaterial().refraction;
+            n2 = innermostRefraction();
             break; // finally, we terminate if it's the hit
         }
     }
@@ -88,6 +99,16 @@ void World::addLight(const Light& light)
 void World::addShape(Shape* shape)
 {
     objects.push_back(shape);
+    shape->setBuildQuality(accel.getQuality());
+    accel.invalidate();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void World::setBuildQuality(Accel::BuildQuality quality)
+{
+    accel.setQuality(quality);
+    for (auto o: objects)
+        o->setBuildQuality(quality);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -116,26 +137,43 @@ bool World::containsObject(const Shape& shape)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections World::intersect(Ray ray)
+Intersections World::intersect(const Ray& ray)
 {
-    // intersect each object in the World with a Ray,
+    // intersect each object in the World whose bounds the ray passes through,
     //  building a collection of aggregated Intersections
     Intersections ints{};
-    for(const auto& o: objects) {
-        ints = ints + o->intersect(ray);
-    }
+    accel.update(objects);
+    accel.forEachShape(ray, -INF,
+                       [&](Shape* o, double&) { ints = ints + o->intersect(ray); },
+                       [&](Intersection hit, double&) { ints.add(hit); });
     return ints;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Intersection World::getHitForRay(const Ray& ray)
+{
+    Intersection closest = Intersection::makeMissedHit();
+    accel.update(objects);
+    const auto keepClosest = [&](Intersection hit, double& tFar) {
+        if (hit.isHit() && (!closest.isHit() || hit.t < closest.t))
+        {
+            closest = hit;
+            // nothing past the closest hit can be the hit, so the rest of the BVH is culled
+            tFar = std::min(tFar, hit.t);
+        }
+    };
+    accel.forEachShape(ray, 0., [&](Shape* o, double& tFar) { keepClosest(o->intersect(ray).findHit(), tFar); },
+                       keepClosest);
+    return closest;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 Colour World::shadeIntersectionState(IntersectionState iState, size_t nRaysRemain)
 {
-    const bool isShadowed = isPointInShadow(iState.pointAboveSurface);
-    const Colour surface = iState.shape.lightPixel(getLight(), iState.pointAboveSurface,
-                                                         iState.eye, iState.normal, isShadowed);
+    const Colour surface = shadeSurface(iState);
     const Colour reflected = getReflectedColour(iState, nRaysRemain);
     const Colour refracted = getRefractedColour(iState, nRaysRemain);
-    if (iState.shape.isReflective() && iState.shape.isTransparent())
+    if (iState.isReflective() && iState.isTransparent())
     {
         // fresnel effect required; use Schlick approximation
         const double reflectance = getSchlickReflectance(iState);
@@ -146,69 +184,210 @@ Colour World::shadeIntersectionState(IntersectionState iState, size_t nRaysRemai
         return surface + reflected + refracted;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour World::shadeSurface(IntersectionState& iState)
+{
+    const bool isShadowed = isPointInShadow(iState.pointAboveSurface);
+    return shadeSurface(iState, getLight(), isShadowed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour World::shadeSurface(IntersectionState& iState, const Light& light, bool isShadowed)
+{
+    return iState.shape.lightPixel(light, iState.pointAboveSurface,
+                                   iState.eye, iState.normal, isShadowed,
+                                   iState.footprint, iState.instance);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+World::SecondaryWeights World::getSecondaryWeights(IntersectionState& iState)
+{
+    const Material& material = iState.material;
+    const bool isReflective = iState.isReflective();
+    const bool isTransparent = iState.isTransparent();
+    if (isReflective && isTransparent)
+    {
+        const double reflectance = getSchlickReflectance(iState);
+        return { material.reflectivity * reflectance, material.transparency * (1 - reflectance) };
+    }
+    return { isReflective ? material.reflectivity : 0., isTransparent ? material.transparency : 0. };
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 Colour World::traceRayToPixel(Ray ray, size_t nRaysRemain)
 {
-    Intersections xs = intersect(ray);
-    Intersection hit = xs.findHit();
-    return hit.isHit() ? shadeIntersection(hit, ray, xs, nRaysRemain) : Colour{};
+    // a ray still to be traced, with the product of the weights along its path to the camera
+    struct PendingRay
+    {
+        Ray ray;
+        double weight;
+        size_t nRaysRemain;
+    };
+    StaticVector<PendingRay, MAX_TRACE_STACK> pending{};
+    pending.push_back({ ray, 1., std::min(nRaysRemain, MAX_TRACE_STACK - 2) });
+    Colour pixel{};
+    while (!pending.empty())
+    {
+        PendingRay current = pending.back();
+        pending.pop_back();
+        Intersections xs = intersect(current.ray);
+        Intersection hit = xs.findHit();
+        if (!hit.isHit())
+            continue;
+        IntersectionState iState{ hit, current.ray, xs };
+        pixel = pixel + shadeSurface(iState) * current.weight;
+        if (current.nRaysRemain == 0)
+            continue;
+        // spawn secondary rays, but only those which can still make a visible difference
+        const auto [wReflected, wRefracted] = getSecondaryWeights(iState);
+        const double reflectedWeight = current.weight * wReflected;
+        const double refractedWeight = current.weight * wRefracted;
+        if (reflectedWeight >= MIN_RAY_WEIGHT)
+            pending.push_back({ getReflectedRay(iState), reflectedWeight, current.nRaysRemain - 1 });
+        if (refractedWeight >= MIN_RAY_WEIGHT)
+        {
+            if (auto refractedRay = getRefractedRay(iState))
+                pending.push_back({ *refractedRay, refractedWeight, current.nRaysRemain - 1 });
+        }
+    }
+    return pixel;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t N>
+void World::intersectPacket(const RayPacket<N>& packet, PacketHit<N>& hits)
+{
+    accel.update(objects);
+    accel.forEachShape(packet, hits, [&](Shape* o) { o->intersectPacket(packet, hits); });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t N>
+std::array<Colour, N> World::tracePacketToPixels(const RayPacket<N>& packet, size_t nRaysRemain)
+{
+    std::array<Colour, N> pixels{};
+    PacketHit<N> hits{ packet };
+    intersectPacket(packet, hits);
+    // lanes whose hits are shaded here; the rest either missed or diverge into secondary rays
+    LaneMask shaded{ 0 };
+    for (size_t lane{}; lane < N; ++lane)
+    {
+        if (hits.shape[lane] == nullptr)
+            continue;
+        const Material& material = hits.getIntersection(lane).getMaterial();
+        if (nRaysRemain > 0 && (material.reflectivity > 0. || !APPROX_EQ(material.transparency, 0.)))
+            pixels[lane] = traceRayToPixel(packet.getRay(lane), nRaysRemain);
+        else
+            shaded |= 1u << lane;
+    }
+    if (shaded == 0)
+        return pixels;
+    // the opaque hits need no refractive indices, so their state shares an empty list of
+    //  intersections
+    const Intersections noIntersections{};
+    std::array<Intersection, N> hit{};
+    StaticVector<IntersectionState, N> states{};
+    std::array<size_t, N> stateLane{};
+    RayPacket<N> shadowPacket{};
+    const Light light = getLight();
+    for (size_t lane{}; lane < N; ++lane)
+    {
+        if (!((shaded >> lane) & 1u))
+            continue;
+        hit[lane] = hits.getIntersection(lane);
+        const auto& iState = states.emplace_back(hit[lane], packet.getRay(lane), noIntersections);
+        stateLane[states.size() - 1] = lane;
+        // shadow rays start at neighbouring points and head for the same light, so they stay
+        //  coherent enough to trace as a packet too
+        const auto vToLight = light.position - iState.pointAboveSurface;
+        const double distance = vToLight.magnitude();
+        shadowPacket.setRay(lane, Ray{ iState.pointAboveSurface, vToLight.normalize(), 0., distance });
+    }
+    PacketHit<N> occluders{ shadowPacket };
+    intersectPacket(shadowPacket, occluders);
+    for (size_t i{}; i < states.size(); ++i)
+    {
+        const size_t lane = stateLane[i];
+        const bool isShadowed = occluders.shape[lane] != nullptr
+                                && occluders.getIntersection(lane).castsShadow();
+        pixels[lane] = shadeSurface(states[i], light, isShadowed);
+    }
+    return pixels;
+}
+
+template void World::intersectPacket(const RayPacket<4>&, PacketHit<4>&);
+template void World::intersectPacket(const RayPacket<8>&, PacketHit<8>&);
+template std::array<Colour, 4> World::tracePacketToPixels(const RayPacket<4>&, size_t);
+template std::array<Colour, 8> World::tracePacketToPixels(const RayPacket<8>&, size_t);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 bool World::isPointInShadow(Tuple point)
 {
     const auto vToLight = getLight().position - point;
     double distance = vToLight.magnitude();
-    Ray shadowRay{ point, vToLight.normalize() };
+    // only hits between the point and the light matter
+    Ray shadowRay{ point, vToLight.normalize(), 0., distance };
     Intersection hit = getHitForRay(shadowRay);
     if (hit.isHit())
     {
         // if tHit < distance, it means the hit lies between the point and the light source,
         //  which therefore means an object was hit (ie: not a light)
-        if (hit.t < distance && hit.shape->getCastsShadow())
+        if (hit.t < distance && hit.castsShadow())
             return true;
     }
     return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour World::getReflectedColour(IntersectionState &iState, size_t nRaysRemain)
+Ray World::getReflectedRay(IntersectionState& iState)
 {
-    if (!iState.shape.isReflective() || nRaysRemain <= 0)
-        return { 0, 0, 0 };
-    else
-    {
-        // 1. spawn new ray at hit's location, pointing toward vReflect
-        const Ray reflectionRay{ iState.pointAboveSurface, iState.vReflect };
-        // 2. trace pixel colour of the new ray and multiply it by reflectivity
-        const Colour cReflected = traceRayToPixel(reflectionRay, nRaysRemain - 1);
-        return cReflected * iState.shape.getMaterial().reflectivity;
-    }
+    // spawn new ray at hit's location, pointing toward vReflect
+    Ray reflectionRay{ iState.pointAboveSurface, iState.getReflectVector() };
+    reflectionRay.setCone(iState.footprint, iState.coneSpread);
+    return reflectionRay;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour World::getRefractedColour(IntersectionState &iState, size_t nRaysRemain)
+std::optional<Ray> World::getRefractedRay(IntersectionState& iState)
 {
-    if (!iState.shape.isTransparent() || nRaysRemain <= 0)
-        return { 0, 0, 0 };
     // find whether there is total internal reflection
-    const double nRatio = iState.n1 / iState.n2;
+    const double nRatio = iState.getN1() / iState.getN2();
     const double cos_i = Tuple::dot(iState.eye, iState.normal);
     // the sin^2_theta of an incoming ray:
     const double sin2_t = nRatio * nRatio * (1.0 - cos_i * cos_i);
     if (sin2_t > 1.0)
-        // there is total internal reflection; return black.
-        return { 0, 0, 0 };
+        // there is total internal reflection; nothing is refracted
+        return std::nullopt;
     double cos_t = std::sqrt(1.0 - sin2_t);
     Tuple direction = iState.normal * (nRatio * cos_i - cos_t)
                       - (iState.eye * nRatio);
-    Ray refractedRay{ iState.pointBelowSurface, direction };
+    Ray refractedRay{ iState.getPointBelowSurface(), direction };
+    refractedRay.setCone(iState.footprint, iState.coneSpread);
+    return refractedRay;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour World::getReflectedColour(IntersectionState &iState, size_t nRaysRemain)
+{
+    if (!iState.isReflective() || nRaysRemain <= 0)
+        return { 0, 0, 0 };
+    // trace pixel colour of the reflected ray and multiply it by reflectivity
+    const Colour cReflected = traceRayToPixel(getReflectedRay(iState), nRaysRemain - 1);
+    return cReflected * iState.material.reflectivity;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour World::getRefractedColour(IntersectionState &iState, size_t nRaysRemain)
+{
+    if (!iState.isTransparent() || nRaysRemain <= 0)
+        return { 0, 0, 0 };
+    const auto refractedRay = getRefractedRay(iState);
+    if (!refractedRay)
+        // there is total internal reflection; return black.
+        return { 0, 0, 0 };
     // the colour of the refracted ray, accounting for any opacity via the
     //  transparency value
-    const Colour cRefracted = traceRayToPixel(refractedRay, nRaysRemain - 1)
-                              * iState.shape.getMaterial().transparency;
-//    std::cout << cRefracted << "\n" << mat << "\n";
-    return cRefracted;
+    return traceRayToPixel(*refractedRay, nRaysRemain - 1) * iState.material.transparency;
 }
 
 World World::DefaultWorld()
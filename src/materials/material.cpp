@@ -37,9 +37,9 @@ bool operator==(const Material& a, const Material& b)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 Colour Material::lightPixel(Light lighting, Tuple pWorld, Tuple pShape,
-                            Tuple vEye, Tuple vNormal, bool isShadowed)
+                            Tuple vEye, Tuple vNormal, bool isShadowed, double footprint) const
 {
-    Colour colourToUse = hasPattern() ? pattern->colourAtShape(pShape) : colour;
+    Colour colourToUse = hasPattern() ? pattern->colourAtShape(pShape, footprint) : colour;
     // add together the material's ambient, diffuse and specular components.
     // components are weighted by the angles between the different vectors.
     // combine surface colour w. the light's colour
@@ -1,62 +1,188 @@
 #include "raytracer/materials/patterns.hpp"
+#include "raytracer/materials/texture_map.hpp"
+#include "raytracer/common/macros.hpp"
+
+#include <cmath>
+#include <vector>
 
 namespace rt
 {
+namespace
+{
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// Pattern
+// Pattern kernels, shared by the single point and batch evaluation paths.
+// Selecting kernels return true when colour b should be used.
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Pattern::Pattern(Colour a, Colour b)
-:   a(a),
-    b(b)
+inline bool isOdd(double v)
 {
-    setTransform(TransformationMatrix::identity());
+    return (static_cast<int64_t>(std::floor(v)) & 1) != 0;
 }
 
-Colour Pattern::colourAtShape(Tuple pShape)
+inline bool stripeSelectsB(double x)
 {
-    // 1. convert shape space point to pattern space
-    const auto pPattern = inverseTransform * pShape;
-    // 2. find the colour at the point in pattern space
-    return colourAt(pPattern);
+    return isOdd(x);
+}
+
+inline bool ringSelectsB(double x, double z)
+{
+    return isOdd(std::sqrt(x * x + z * z));
+}
+
+inline bool checkerSelectsB(double x, double y, double z)
+{
+    return ((static_cast<int64_t>(std::floor(x))
+             + static_cast<int64_t>(std::floor(y))
+             + static_cast<int64_t>(std::floor(z))) & 1) != 0;
+}
+
+inline double gradientFraction(double x)
+{
+    return x - std::floor(x);
+}
+
+inline Colour lerp(const Colour& a, const Colour& b, double t)
+{
+    return { a.R + (b.R - a.R) * t, a.G + (b.G - a.G) * t, a.B + (b.B - a.B) * t };
+}
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// StripedPattern
+// Pattern
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour StripedPattern::colourAt(Tuple point)
+Pattern::Pattern(Colour a, Colour b, PatternType type)
+:   a(a),
+    b(b),
+    type(type)
 {
-    return static_cast<int>(floor(point.x)) % 2 == 0 ? a : b;
+    setTransform(TransformationMatrix::identity());
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Pattern::Pattern(Pattern* a, Pattern* b, PatternType type)
+:   Pattern(Colour{}, Colour{}, type)
+{
+    setNested(a, b);
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// GradientPattern
+Colour Pattern::colourAt(Tuple point)
+{
+    // a custom pattern which doesn't override colourAt() has nothing to evaluate
+    return type == PatternType::custom ? a : evaluate(point);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour GradientPattern::colourAt(Tuple point)
+Colour Pattern::colourAtShape(Tuple pShape, double footprint)
 {
-    // basic linear interpolation btwn 2 colours, based on x component of vector
-    return a + (b - a) * (point.x - floor(point.x));
+    // 1. convert shape space point to pattern space
+    const auto pPattern = hasTransform ? inverseTransform * pShape : pShape;
+    // 2. find the colour at the point in pattern space
+    return type == PatternType::custom ? colourAt(pPattern)
+                                       : evaluate(pPattern, footprint * footprintScale);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Pattern::colourAtShape(const TupleBatch& pShape, std::span<Colour> out)
+{
+    ASSERT(out.size() >= pShape.size(), "output span is smaller than the batch of points");
+    if (!hasTransform)
+    {
+        evaluateBatch(pShape, out);
+        return;
+    }
+    TupleBatch pPattern{ pShape.size(), pShape.w };
+    inverseTransform.transformBatch(pShape, pPattern);
+    evaluateBatch(pPattern, out);
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// RingPattern
+Colour Pattern::evaluate(const Tuple& p, double footprint)
+{
+    switch (type)
+    {
+    case PatternType::stripes:
+        return stripeSelectsB(p.x) ? colourB(p, footprint) : colourA(p, footprint);
+    case PatternType::gradient:
+        // basic linear interpolation btwn 2 colours, based on x component of vector
+        return lerp(colourA(p, footprint), colourB(p, footprint), gradientFraction(p.x));
+    case PatternType::rings:
+        return ringSelectsB(p.x, p.z) ? colourB(p, footprint) : colourA(p, footprint);
+    case PatternType::checkers:
+        return checkerSelectsB(p.x, p.y, p.z) ? colourB(p, footprint) : colourA(p, footprint);
+    case PatternType::blended:
+        return lerp(colourA(p, footprint), colourB(p, footprint),
+                    static_cast<BlendedPattern*>(this)->getWeight());
+    case PatternType::image:
+        return static_cast<TextureMap*>(this)->sampleAt(p, footprint);
+    case PatternType::custom:
+    default:
+        return colourAt(p);
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour RingPattern::colourAt(Tuple point)
+void Pattern::evaluateBatch(const TupleBatch& p, std::span<Colour> out)
 {
-    const int posXY = floor(static_cast<double>(sqrt(point.x*point.x + point.z+point.z)));
-    return posXY % 2 == 0 ? a : b;
+    const size_t n = p.size();
+    if (type == PatternType::custom)
+    {
+        for (size_t i{}; i < n; ++i)
+            out[i] = colourAt(p.get(i));
+        return;
+    }
+    if (type == PatternType::image)
+    {
+        const auto* map = static_cast<TextureMap*>(this);
+        for (size_t i{}; i < n; ++i)
+            out[i] = map->sampleAt(p.get(i), 0.);
+        return;
+    }
+    // both inputs are evaluated over the whole batch, which keeps every loop below branch-free
+    std::vector<Colour> cb(n);
+    colourABatch(p, out);
+    colourBBatch(p, cb);
+    // the per-point weight of colour b; 0 or 1 for the selecting patterns
+    std::vector<double> t(n);
+    switch (type)
+    {
+    case PatternType::stripes:
+        for (size_t i{}; i < n; ++i) t[i] = stripeSelectsB(p.x[i]);
+        break;
+    case PatternType::gradient:
+        for (size_t i{}; i < n; ++i) t[i] = gradientFraction(p.x[i]);
+        break;
+    case PatternType::rings:
+        for (size_t i{}; i < n; ++i) t[i] = ringSelectsB(p.x[i], p.z[i]);
+        break;
+    case PatternType::checkers:
+        for (size_t i{}; i < n; ++i) t[i] = checkerSelectsB(p.x[i], p.y[i], p.z[i]);
+        break;
+    case PatternType::blended:
+        std::fill(t.begin(), t.end(), static_cast<BlendedPattern*>(this)->getWeight());
+        break;
+    default:
+        break;
+    }
+    for (size_t i{}; i < n; ++i)
+        out[i] = lerp(out[i], cb[i], t[i]);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// RingPattern
+void Pattern::colourABatch(const TupleBatch& p, std::span<Colour> out)
+{
+    if (nestedA != nullptr)
+        nestedA->colourAtShape(p, out);
+    else
+        std::fill(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(p.size()), a);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour CheckersPattern::colourAt(Tuple point)
+void Pattern::colourBBatch(const TupleBatch& p, std::span<Colour> out)
 {
-    const int toFloor = static_cast<int>(floor(point.x))
-                        + static_cast<int>(floor(point.y))
-                        + static_cast<int>(floor(point.z));
-    return toFloor % 2 == 0 ? a : b;
+    if (nestedB != nullptr)
+        nestedB->colourAtShape(p, out);
+    else
+        std::fill(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(p.size()), b);
 }
 }
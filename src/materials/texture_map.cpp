@@ -0,0 +1,504 @@
+#include "raytracer/materials/texture_map.hpp"
+#include "raytracer/common/macros.hpp"
+#include "raytracer/common/utils.hpp"
+#include "raytracer/logging/logging.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <numbers>
+
+namespace rt
+{
+namespace
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Modulo which is always positive, so that textures repeat the same way on both sides of 0.
+inline double positiveMod(double value, double m)
+{
+    const double r = std::fmod(value, m);
+    return r < 0. ? r + m : r;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Resolve a texel coordinate which may lie outside of the image.
+inline uint32_t address(int64_t i, uint32_t size, TextureAddress mode)
+{
+    const auto n = static_cast<int64_t>(size);
+    if (mode == TextureAddress::repeat)
+        return static_cast<uint32_t>(((i % n) + n) % n);
+    return static_cast<uint32_t>(std::clamp<int64_t>(i, 0, n - 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Distance between two texture coordinates, allowing for them to wrap around.
+inline double wrappedDistance(double a, double b)
+{
+    const double d = std::abs(a - b);
+    return std::min(d, 1. - d);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Image file parsing
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Read the next whitespace separated number of a PPM header, skipping any comments.
+bool readPPMHeaderValue(std::istream& in, uint32_t& value)
+{
+    while (true)
+    {
+        const int c = in.peek();
+        if (c == EOF)
+            return false;
+        if (c == '#')
+            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        else if (std::isspace(c))
+            in.get();
+        else
+            break;
+    }
+    return static_cast<bool>(in >> value);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline uint32_t readBigEndian32(const uint8_t* bytes)
+{
+    return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16)
+         | (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+}
+
+// the largest image the loaders will accept, to guard against corrupt headers
+constexpr uint64_t MAX_IMAGE_PIXELS{ 1ull << 28 };
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// UVMap
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace UVMap
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+UV planar(const Tuple& p)
+{
+    return { positiveMod(p.x, 1.), positiveMod(p.z, 1.) };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+UV spherical(const Tuple& p)
+{
+    // azimuthal angle around the y axis, from -pi to pi, and polar angle from the +y axis
+    const double theta = std::atan2(p.x, p.z);
+    const double radius = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+    const double phi = std::acos(std::clamp(p.y / radius, -1., 1.));
+    // flip u so that it increases counter-clockwise when viewed from above
+    const double rawU = theta / (2. * std::numbers::pi);
+    return { 1. - (rawU + 0.5), 1. - phi / std::numbers::pi };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+UV cylindrical(const Tuple& p)
+{
+    const double theta = std::atan2(p.x, p.z);
+    const double rawU = theta / (2. * std::numbers::pi);
+    return { 1. - (rawU + 0.5), positiveMod(p.y, 1.) };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+CubeFace cubeFace(const Tuple& p)
+{
+    const double coord = std::max({ std::abs(p.x), std::abs(p.y), std::abs(p.z) });
+    if (coord == p.x)
+        return CubeFace::right;
+    if (coord == -p.x)
+        return CubeFace::left;
+    if (coord == p.y)
+        return CubeFace::up;
+    if (coord == -p.y)
+        return CubeFace::down;
+    if (coord == p.z)
+        return CubeFace::front;
+    return CubeFace::back;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+UV cube(const Tuple& p, CubeFace face)
+{
+    switch (face)
+    {
+    case CubeFace::left:
+        return { positiveMod(p.z + 1., 2.) / 2., positiveMod(p.y + 1., 2.) / 2. };
+    case CubeFace::front:
+        return { positiveMod(p.x + 1., 2.) / 2., positiveMod(p.y + 1., 2.) / 2. };
+    case CubeFace::right:
+        return { positiveMod(1. - p.z, 2.) / 2., positiveMod(p.y + 1., 2.) / 2. };
+    case CubeFace::back:
+        return { positiveMod(1. - p.x, 2.) / 2., positiveMod(p.y + 1., 2.) / 2. };
+    case CubeFace::up:
+        return { positiveMod(p.x + 1., 2.) / 2., positiveMod(1. - p.z, 2.) / 2. };
+    case CubeFace::down:
+    default:
+        return { positiveMod(p.x + 1., 2.) / 2., positiveMod(p.z + 1., 2.) / 2. };
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+UV map(UVMapping mapping, const Tuple& p)
+{
+    switch (mapping)
+    {
+    case UVMapping::planar:
+        return planar(p);
+    case UVMapping::spherical:
+        return spherical(p);
+    case UVMapping::cylindrical:
+        return cylindrical(p);
+    case UVMapping::cube:
+    default:
+        return cube(p, cubeFace(p));
+    }
+}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MipMappedImage
+////////////////////////////////////////////////////////////////////////////////////////////////////
+MipMappedImage::Level::Level(uint32_t width, uint32_t height)
+:   width(width),
+    height(height),
+    tilesX((width + TILE_SIZE - 1) / TILE_SIZE)
+{
+    const size_t tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    texels.resize(static_cast<size_t>(tilesX) * tilesY * TILE_SIZE * TILE_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+MipMappedImage::MipMappedImage(uint32_t width, uint32_t height, std::span<const Colour> pixels)
+{
+    ASSERT(width > 0 && height > 0, "an image must have at least one pixel");
+    ASSERT(pixels.size() >= static_cast<size_t>(width) * height, "too few pixels for the image size");
+    Level& base = levels.emplace_back(width, height);
+    for (uint32_t y{}; y < height; ++y)
+    {
+        for (uint32_t x{}; x < width; ++x)
+        {
+            const Colour& c = pixels[static_cast<size_t>(y) * width + x];
+            base.at(x, y) = { static_cast<float>(c.R), static_cast<float>(c.G), static_cast<float>(c.B) };
+        }
+    }
+    while (levels.back().width > 1 || levels.back().height > 1)
+        addLevel();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void MipMappedImage::addLevel()
+{
+    const Level& src = levels.back();
+    Level dst{ std::max(1u, src.width / 2), std::max(1u, src.height / 2) };
+    for (uint32_t y{}; y < dst.height; ++y)
+    {
+        // a 2x2 box filter, which collapses to 2x1 (or 1x2) once an axis is down to one texel
+        const uint32_t y0 = std::min(y * 2, src.height - 1);
+        const uint32_t y1 = std::min(y * 2 + 1, src.height - 1);
+        for (uint32_t x{}; x < dst.width; ++x)
+        {
+            const uint32_t x0 = std::min(x * 2, src.width - 1);
+            const uint32_t x1 = std::min(x * 2 + 1, src.width - 1);
+            const Texel& a = src.at(x0, y0);
+            const Texel& b = src.at(x1, y0);
+            const Texel& c = src.at(x0, y1);
+            const Texel& d = src.at(x1, y1);
+            dst.at(x, y) = { (a.r + b.r + c.r + d.r) * 0.25f,
+                             (a.g + b.g + c.g + d.g) * 0.25f,
+                             (a.b + b.b + c.b + d.b) * 0.25f };
+        }
+    }
+    levels.push_back(std::move(dst));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour MipMappedImage::texelAt(size_t level, uint32_t x, uint32_t y) const
+{
+    const Texel& t = levels[level].at(x, y);
+    return { t.r, t.g, t.b };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+double MipMappedImage::levelOfDetail(double footprint) const
+{
+    // the footprint covers this many level 0 texels; each level halves the count
+    const double texels = footprint * static_cast<double>(std::max(getWidth(), getHeight()));
+    if (!(texels > 1.))
+        return 0.;
+    return std::min(std::log2(texels), static_cast<double>(levels.size() - 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour MipMappedImage::sampleLevel(UV uv, size_t level, TextureAddress addressU,
+                                   TextureAddress addressV) const
+{
+    const Level& l = levels[level];
+    // texel centres sit at half coordinates, and image rows run from the top down
+    const double x = uv.u * l.width - 0.5;
+    const double y = (1. - uv.v) * l.height - 0.5;
+    const double xFloor = std::floor(x);
+    const double yFloor = std::floor(y);
+    const auto fx = static_cast<float>(x - xFloor);
+    const auto fy = static_cast<float>(y - yFloor);
+    const auto ix = static_cast<int64_t>(xFloor);
+    const auto iy = static_cast<int64_t>(yFloor);
+    const uint32_t x0 = address(ix, l.width, addressU);
+    const uint32_t x1 = address(ix + 1, l.width, addressU);
+    const uint32_t y0 = address(iy, l.height, addressV);
+    const uint32_t y1 = address(iy + 1, l.height, addressV);
+    const Texel& a = l.at(x0, y0);
+    const Texel& b = l.at(x1, y0);
+    const Texel& c = l.at(x0, y1);
+    const Texel& d = l.at(x1, y1);
+    const auto bilerp = [&](float ta, float tb, float tc, float td) {
+        const float top = ta + (tb - ta) * fx;
+        const float bottom = tc + (td - tc) * fx;
+        return static_cast<double>(top + (bottom - top) * fy);
+    };
+    return { bilerp(a.r, b.r, c.r, d.r), bilerp(a.g, b.g, c.g, d.g), bilerp(a.b, b.b, c.b, d.b) };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour MipMappedImage::sample(UV uv, double footprint, TextureAddress addressU,
+                              TextureAddress addressV) const
+{
+    const double lod = levelOfDetail(footprint);
+    const auto level = static_cast<size_t>(lod);
+    const double t = lod - static_cast<double>(level);
+    const Colour fine = sampleLevel(uv, level, addressU, addressV);
+    if (t <= 0. || level + 1 >= levels.size())
+        return fine;
+    const Colour coarse = sampleLevel(uv, level + 1, addressU, addressV);
+    return fine + (coarse - fine) * t;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+std::unique_ptr<MipMappedImage> MipMappedImage::fromFile(const std::string& fileName)
+{
+    Log::init();
+    std::ifstream file{ fileName, std::ios::binary };
+    if (!file.is_open())
+    {
+        CORE_ERROR("image file cannot be opened: {}", fileName);
+        return nullptr;
+    }
+    switch (file.peek())
+    {
+    case 'P':
+        return fromPPM(file);
+    case 'q':
+        return fromQOI(file);
+    default:
+        CORE_ERROR("image file is not a PPM or QOI image: {}", fileName);
+        return nullptr;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+std::unique_ptr<MipMappedImage> MipMappedImage::fromPPM(std::istream& in)
+{
+    Log::init();
+    char magic[2]{};
+    in.read(magic, 2);
+    const bool isAscii = magic[0] == 'P' && magic[1] == '3';
+    const bool isBinary = magic[0] == 'P' && magic[1] == '6';
+    if (!isAscii && !isBinary)
+    {
+        CORE_ERROR("unsupported PPM type; only P3 and P6 images can be read");
+        return nullptr;
+    }
+    uint32_t width{}, height{}, maxValue{};
+    if (!readPPMHeaderValue(in, width) || !readPPMHeaderValue(in, height)
+        || !readPPMHeaderValue(in, maxValue) || width == 0 || height == 0
+        || maxValue == 0 || maxValue > 65535
+        || static_cast<uint64_t>(width) * height > MAX_IMAGE_PIXELS)
+    {
+        CORE_ERROR("malformed PPM header");
+        return nullptr;
+    }
+    const double scale = 1. / static_cast<double>(maxValue);
+    std::vector<Colour> pixels(static_cast<size_t>(width) * height);
+    if (isAscii)
+    {
+        for (auto& pixel: pixels)
+        {
+            uint32_t r{}, g{}, b{};
+            if (!(in >> r >> g >> b))
+            {
+                CORE_ERROR("PPM image data ended early");
+                return nullptr;
+            }
+            pixel = { r * scale, g * scale, b * scale };
+        }
+    }
+    else
+    {
+        // a single whitespace character separates the header from the binary data
+        in.get();
+        const size_t bytesPerValue = maxValue < 256 ? 1 : 2;
+        std::vector<uint8_t> data(pixels.size() * 3 * bytesPerValue);
+        in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (static_cast<size_t>(in.gcount()) != data.size())
+        {
+            CORE_ERROR("PPM image data ended early");
+            return nullptr;
+        }
+        const auto value = [&](size_t i) -> double {
+            if (bytesPerValue == 1)
+                return data[i] * scale;
+            return ((static_cast<uint32_t>(data[2 * i]) << 8) | data[2 * i + 1]) * scale;
+        };
+        for (size_t i{}; i < pixels.size(); ++i)
+            pixels[i] = { value(3 * i), value(3 * i + 1), value(3 * i + 2) };
+    }
+    return std::make_unique<MipMappedImage>(width, height, pixels);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+std::unique_ptr<MipMappedImage> MipMappedImage::fromQOI(std::istream& in)
+{
+    Log::init();
+    // "Quite OK Image" format, see https://qoiformat.org/qoi-specification.pdf
+    const std::vector<uint8_t> data{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    constexpr size_t HEADER_SIZE{ 14 };
+    if (data.size() < HEADER_SIZE || data[0] != 'q' || data[1] != 'o' || data[2] != 'i' || data[3] != 'f')
+    {
+        CORE_ERROR("malformed QOI header");
+        return nullptr;
+    }
+    const uint32_t width = readBigEndian32(&data[4]);
+    const uint32_t height = readBigEndian32(&data[8]);
+    if (width == 0 || height == 0 || static_cast<uint64_t>(width) * height > MAX_IMAGE_PIXELS)
+    {
+        CORE_ERROR("QOI image has an invalid size: {}x{}", width, height);
+        return nullptr;
+    }
+    struct Rgba
+    {
+        uint8_t r, g, b, a;
+    };
+    std::array<Rgba, 64> seen{};
+    Rgba px{ 0, 0, 0, 255 };
+    uint32_t run{};
+    size_t pos{ HEADER_SIZE };
+    std::vector<Colour> pixels(static_cast<size_t>(width) * height);
+    for (auto& pixel: pixels)
+    {
+        if (run > 0)
+            --run;
+        else
+        {
+            if (pos >= data.size())
+            {
+                CORE_ERROR("QOI image data ended early");
+                return nullptr;
+            }
+            const uint8_t op = data[pos++];
+            const size_t extra = op == 0xfe ? 3 : op == 0xff ? 4 : (op & 0xc0) == 0x80 ? 1 : 0;
+            if (pos + extra > data.size())
+            {
+                CORE_ERROR("QOI image data ended early");
+                return nullptr;
+            }
+            if (op == 0xfe)          // QOI_OP_RGB
+            {
+                px.r = data[pos]; px.g = data[pos + 1]; px.b = data[pos + 2];
+            }
+            else if (op == 0xff)     // QOI_OP_RGBA
+            {
+                px = { data[pos], data[pos + 1], data[pos + 2], data[pos + 3] };
+            }
+            else if ((op & 0xc0) == 0x00)    // QOI_OP_INDEX
+                px = seen[op];
+            else if ((op & 0xc0) == 0x40)    // QOI_OP_DIFF
+            {
+                px.r = static_cast<uint8_t>(px.r + ((op >> 4) & 0x03) - 2);
+                px.g = static_cast<uint8_t>(px.g + ((op >> 2) & 0x03) - 2);
+                px.b = static_cast<uint8_t>(px.b + (op & 0x03) - 2);
+            }
+            else if ((op & 0xc0) == 0x80)    // QOI_OP_LUMA
+            {
+                const int dg = (op & 0x3f) - 32;
+                const uint8_t drdb = data[pos];
+                px.r = static_cast<uint8_t>(px.r + dg - 8 + ((drdb >> 4) & 0x0f));
+                px.g = static_cast<uint8_t>(px.g + dg);
+                px.b = static_cast<uint8_t>(px.b + dg - 8 + (drdb & 0x0f));
+            }
+            else                             // QOI_OP_RUN
+                run = op & 0x3f;
+            pos += extra;
+            seen[(px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64] = px;
+        }
+        constexpr double scale{ 1. / 255. };
+        pixel = { px.r * scale, px.g * scale, px.b * scale };
+    }
+    return std::make_unique<MipMappedImage>(width, height, pixels);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// TextureMap
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TextureMap::TextureMap(const MipMappedImage* image, UVMapping mapping)
+:   Pattern(Colour{}, Colour{}, PatternType::image),
+    mapping(mapping)
+{
+    ASSERT(image != nullptr, "a texture map needs an image");
+    ASSERT(mapping != UVMapping::cube, "cube mapping needs an image for each face");
+    images.fill(image);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TextureMap::TextureMap(const std::array<const MipMappedImage*, 6>& faces)
+:   Pattern(Colour{}, Colour{}, PatternType::image),
+    mapping(UVMapping::cube),
+    images(faces)
+{
+    for ([[maybe_unused]] const auto* face: faces)
+        ASSERT(face != nullptr, "a cube map needs an image for each face");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Colour TextureMap::sampleAt(const Tuple& pPattern, double footprint) const
+{
+    const double footprintUV = footprint > 0. ? footprintToUV(pPattern, footprint) : 0.;
+    if (mapping == UVMapping::cube)
+    {
+        // faces are separate images, so filtering must not wrap around onto the opposite edge
+        const CubeFace face = UVMap::cubeFace(pPattern);
+        return images[static_cast<size_t>(face)]->sample(UVMap::cube(pPattern, face), footprintUV,
+                                                         TextureAddress::clamp, TextureAddress::clamp);
+    }
+    // spheres are not continuous across their poles, so v does not wrap
+    const auto addressV = mapping == UVMapping::spherical ? TextureAddress::clamp : TextureAddress::repeat;
+    return images[0]->sample(UVMap::map(mapping, pPattern), footprintUV, TextureAddress::repeat, addressV);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+double TextureMap::footprintToUV(const Tuple& pPattern, double footprint) const
+{
+    // finite differences of the projection along each axis, one footprint wide. Offsets which
+    //  move off the surface (eg: along a sphere's radius) barely change uv, so the largest change
+    //  is taken as the footprint across the surface.
+    const CubeFace face = UVMap::cubeFace(pPattern);
+    const auto project = [&](const Tuple& p) {
+        return mapping == UVMapping::cube ? UVMap::cube(p, face) : UVMap::map(mapping, p);
+    };
+    const UV centre = project(pPattern);
+    double widest{};
+    for (const auto& offset: { Vector{ footprint, 0., 0. }, Vector{ 0., footprint, 0. },
+                               Vector{ 0., 0., footprint } })
+    {
+        const UV uv = project(pPattern + offset);
+        widest = std::max({ widest, wrappedDistance(uv.u, centre.u), wrappedDistance(uv.v, centre.v) });
+    }
+    return widest;
+}
+}
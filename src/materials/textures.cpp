@@ -1,8 +1,210 @@
 #include "raytracer/materials/textures.hpp"
+#include "raytracer/common/macros.hpp"
+
+#include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstdint>
+#include <thread>
 
 namespace rt::Texture
 {
+namespace
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Vectorised noise kernels
+//  Branch-free ports of FastNoiseLite's 3D OpenSimplex2 and Perlin noise, written as straight-line
+//  code over plain arrays so that the compiler can vectorise whole batches of points. They follow
+//  FastNoiseLite's arithmetic step for step, so they agree with GetNoise() to float precision.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FastNoiseLite settings which Noise always leaves at their defaults
+constexpr int32_t FNL_SEED{ 1337 };
+constexpr float FNL_LACUNARITY{ 2.0f };
+constexpr float FNL_GAIN{ 0.5f };
+
+constexpr int32_t PRIME_X{ 501125321 };
+constexpr int32_t PRIME_Y{ 1136930381 };
+constexpr int32_t PRIME_Z{ 1720413743 };
+
+// the 3D gradient table from FastNoiseLite (MIT licence, (c) 2023 Jordan Peck, Contributors)
+alignas(64) constexpr float GRADIENTS_3D[]{
+    0, 1, 1, 0,  0,-1, 1, 0,  0, 1,-1, 0,  0,-1,-1, 0,
+    1, 0, 1, 0, -1, 0, 1, 0,  1, 0,-1, 0, -1, 0,-1, 0,
+    1, 1, 0, 0, -1, 1, 0, 0,  1,-1, 0, 0, -1,-1, 0, 0,
+    0, 1, 1, 0,  0,-1, 1, 0,  0, 1,-1, 0,  0,-1,-1, 0,
+    1, 0, 1, 0, -1, 0, 1, 0,  1, 0,-1, 0, -1, 0,-1, 0,
+    1, 1, 0, 0, -1, 1, 0, 0,  1,-1, 0, 0, -1,-1, 0, 0,
+    0, 1, 1, 0,  0,-1, 1, 0,  0, 1,-1, 0,  0,-1,-1, 0,
+    1, 0, 1, 0, -1, 0, 1, 0,  1, 0,-1, 0, -1, 0,-1, 0,
+    1, 1, 0, 0, -1, 1, 0, 0,  1,-1, 0, 0, -1,-1, 0, 0,
+    0, 1, 1, 0,  0,-1, 1, 0,  0, 1,-1, 0,  0,-1,-1, 0,
+    1, 0, 1, 0, -1, 0, 1, 0,  1, 0,-1, 0, -1, 0,-1, 0,
+    1, 1, 0, 0, -1, 1, 0, 0,  1,-1, 0, 0, -1,-1, 0, 0,
+    0, 1, 1, 0,  0,-1, 1, 0,  0, 1,-1, 0,  0,-1,-1, 0,
+    1, 0, 1, 0, -1, 0, 1, 0,  1, 0,-1, 0, -1, 0,-1, 0,
+    1, 1, 0, 0, -1, 1, 0, 0,  1,-1, 0, 0, -1,-1, 0, 0,
+    1, 1, 0, 0,  0,-1, 1, 0, -1, 1, 0, 0,  0,-1,-1, 0
+};
+
+// hashing relies on 32 bit wrap-around, which is only well defined for unsigned integers
+inline int32_t wrapMul(int32_t a, int32_t b)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+}
+
+inline int32_t wrapAdd(int32_t a, int32_t b)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
+
+inline int32_t fastFloor(float f)
+{
+    const auto i = static_cast<int32_t>(f);
+    return f >= 0 ? i : i - 1;
+}
+
+inline int32_t fastRound(float f)
+{
+    // select the offset rather than the arithmetic, which keeps the conversion unconditional
+    return static_cast<int32_t>(f + (f >= 0 ? 0.5f : -0.5f));
+}
+
+/// @brief Keep v when keep is true, otherwise return 0. Done with bitwise ops, as SIMD code does.
+inline float maskIf(bool keep, float v)
+{
+    return std::bit_cast<float>(std::bit_cast<int32_t>(v) & (keep ? -1 : 0));
+}
+
+inline float lerp(float a, float b, float t)
+{
+    return a + t * (b - a);
+}
+
+inline float interpQuintic(float t)
+{
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+inline float gradCoord(int32_t seed, int32_t xp, int32_t yp, int32_t zp, float xd, float yd, float zd)
+{
+    int32_t hash = wrapMul(seed ^ xp ^ yp ^ zp, 0x27d4eb2d);
+    hash ^= hash >> 15;
+    hash &= 63 << 2;
+    return xd * GRADIENTS_3D[hash] + yd * GRADIENTS_3D[hash | 1] + zd * GRADIENTS_3D[hash | 2];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add the contribution of one of OpenSimplex2's two offset lattices: its closest vertex,
+/// and the next closest vertex along one axis.
+inline void openSimplex2Lattice(int32_t seed, int32_t i, int32_t j, int32_t k,
+                                float x0, float y0, float z0, float ax0, float ay0, float az0,
+                                int32_t xNSign, int32_t yNSign, int32_t zNSign, float a, float& value)
+{
+    // contributions are always computed and then masked off, which keeps the kernel free of
+    // branches (the compiler turns selects back into branches around the arithmetic they select)
+    value += maskIf(a > 0, (a * a) * (a * a) * gradCoord(seed, i, j, k, x0, y0, z0));
+
+    // the next closest vertex is along whichever axis is furthest from the closest vertex
+    const bool alongX = (ax0 >= ay0) & (ax0 >= az0);
+    const bool alongY = !alongX & (ay0 > ax0) & (ay0 >= az0);
+    const bool alongZ = !alongX & !alongY;
+    const float x1 = x0 + maskIf(alongX, static_cast<float>(xNSign));
+    const float y1 = y0 + maskIf(alongY, static_cast<float>(yNSign));
+    const float z1 = z0 + maskIf(alongZ, static_cast<float>(zNSign));
+    const float step = maskIf(alongX, static_cast<float>(xNSign * 2) * x1)
+                     + maskIf(alongY, static_cast<float>(yNSign * 2) * y1)
+                     + maskIf(alongZ, static_cast<float>(zNSign * 2) * z1);
+    const float b = (a + 1) - step;
+    const int32_t i1 = wrapAdd(i, alongX ? -xNSign * PRIME_X : 0);
+    const int32_t j1 = wrapAdd(j, alongY ? -yNSign * PRIME_Y : 0);
+    const int32_t k1 = wrapAdd(k, alongZ ? -zNSign * PRIME_Z : 0);
+    value += maskIf(b > 0, (b * b) * (b * b) * gradCoord(seed, i1, j1, k1, x1, y1, z1));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief 3D OpenSimplex2 noise, at a point which has already been rotated into noise space.
+inline float openSimplex2(int32_t seed, float x, float y, float z)
+{
+    int32_t i = fastRound(x);
+    int32_t j = fastRound(y);
+    int32_t k = fastRound(z);
+    float x0 = x - static_cast<float>(i);
+    float y0 = y - static_cast<float>(j);
+    float z0 = z - static_cast<float>(k);
+    const int32_t xNSign = static_cast<int32_t>(-1.0f - x0) | 1;
+    const int32_t yNSign = static_cast<int32_t>(-1.0f - y0) | 1;
+    const int32_t zNSign = static_cast<int32_t>(-1.0f - z0) | 1;
+    float ax0 = static_cast<float>(xNSign) * -x0;
+    float ay0 = static_cast<float>(yNSign) * -y0;
+    float az0 = static_cast<float>(zNSign) * -z0;
+    i = wrapMul(i, PRIME_X);
+    j = wrapMul(j, PRIME_Y);
+    k = wrapMul(k, PRIME_Z);
+
+    float value = 0;
+    float a = (0.6f - x0 * x0) - (y0 * y0 + z0 * z0);
+    openSimplex2Lattice(seed, i, j, k, x0, y0, z0, ax0, ay0, az0, xNSign, yNSign, zNSign, a, value);
+
+    // step over to the second lattice, which is offset by half a cell along every axis
+    ax0 = 0.5f - ax0;
+    ay0 = 0.5f - ay0;
+    az0 = 0.5f - az0;
+    x0 = static_cast<float>(xNSign) * ax0;
+    y0 = static_cast<float>(yNSign) * ay0;
+    z0 = static_cast<float>(zNSign) * az0;
+    a += (0.75f - ax0) - (ay0 + az0);
+    i = wrapAdd(i, (xNSign >> 1) & PRIME_X);
+    j = wrapAdd(j, (yNSign >> 1) & PRIME_Y);
+    k = wrapAdd(k, (zNSign >> 1) & PRIME_Z);
+    openSimplex2Lattice(~seed, i, j, k, x0, y0, z0, ax0, ay0, az0, -xNSign, -yNSign, -zNSign, a, value);
+    return value * 32.69428253173828125f;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief 3D Perlin noise, at a point in noise space.
+inline float perlin(int32_t seed, float x, float y, float z)
+{
+    int32_t x0 = fastFloor(x);
+    int32_t y0 = fastFloor(y);
+    int32_t z0 = fastFloor(z);
+    const float xd0 = x - static_cast<float>(x0);
+    const float yd0 = y - static_cast<float>(y0);
+    const float zd0 = z - static_cast<float>(z0);
+    const float xd1 = xd0 - 1;
+    const float yd1 = yd0 - 1;
+    const float zd1 = zd0 - 1;
+    const float xs = interpQuintic(xd0);
+    const float ys = interpQuintic(yd0);
+    const float zs = interpQuintic(zd0);
+    x0 = wrapMul(x0, PRIME_X);
+    y0 = wrapMul(y0, PRIME_Y);
+    z0 = wrapMul(z0, PRIME_Z);
+    const int32_t x1 = wrapAdd(x0, PRIME_X);
+    const int32_t y1 = wrapAdd(y0, PRIME_Y);
+    const int32_t z1 = wrapAdd(z0, PRIME_Z);
+
+    const float xf00 = lerp(gradCoord(seed, x0, y0, z0, xd0, yd0, zd0),
+                            gradCoord(seed, x1, y0, z0, xd1, yd0, zd0), xs);
+    const float xf10 = lerp(gradCoord(seed, x0, y1, z0, xd0, yd1, zd0),
+                            gradCoord(seed, x1, y1, z0, xd1, yd1, zd0), xs);
+    const float xf01 = lerp(gradCoord(seed, x0, y0, z1, xd0, yd0, zd1),
+                            gradCoord(seed, x1, y0, z1, xd1, yd0, zd1), xs);
+    const float xf11 = lerp(gradCoord(seed, x0, y1, z1, xd0, yd1, zd1),
+                            gradCoord(seed, x1, y1, z1, xd1, yd1, zd1), xs);
+    return lerp(lerp(xf00, xf10, ys), lerp(xf01, xf11, ys), zs) * 0.964921414852142333984375f;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Evaluate a noise kernel over a batch of points, accumulating out += amp * noise.
+template <float (*Kernel)(int32_t, float, float, float)>
+void accumulateNoise(int32_t seed, float amp, const float* x, const float* y, const float* z,
+                     float* out, size_t n)
+{
+    for (size_t i{}; i < n; ++i)
+        out[i] += Kernel(seed, x[i], y[i], z[i]) * amp;
+}
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Generative Texture
@@ -32,6 +234,39 @@ Tuple Generative::applyToNormal(Tuple normal, Tuple point)
     return Vector{ normal.x + P.x, normal.y + P.y, normal.z + P.z }.normalize();
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Generative::applyToNormals(TupleBatch& normals, const TupleBatch& points)
+{
+    ASSERT(normals.size() == points.size(), "each normal needs a matching point");
+    const size_t n = points.size();
+    TupleBatch pTexture{ n, points.w };
+    inverseTransform.transformBatch(points, pTexture);
+    TupleBatch P{ n, 0.0 };
+    getPerturbations(pTexture, P);
+    for (size_t i{}; i < n; ++i)
+    {
+        const double x = normals.x[i] + P.x[i];
+        const double y = normals.y[i] + P.y[i];
+        const double z = normals.z[i] + P.z[i];
+        const double M = std::sqrt(x * x + y * y + z * z);
+        normals.x[i] = x / M;
+        normals.y[i] = y / M;
+        normals.z[i] = z / M;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Generative::getPerturbations(const TupleBatch& points, TupleBatch& out)
+{
+    out.resize(points.size());
+    out.w = 0.0;
+    for (size_t i{}; i < points.size(); ++i)
+    {
+        auto p = points.get(i);
+        out.set(i, getPerturbation(p));
+    }
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Waves
@@ -51,6 +286,27 @@ Tuple Waves::getPerturbation(Tuple& point)
     return Vector{ sin_x * A.x, sin_x * A.y, sin_x * A.z };
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Waves::getPerturbations(const TupleBatch& points, TupleBatch& out)
+{
+    const size_t n = points.size();
+    out.resize(n);
+    out.w = 0.0;
+    const double* py = points.y.data();
+    double* ox = out.x.data();
+    double* oy = out.y.data();
+    double* oz = out.z.data();
+    for (size_t i{}; i < n; ++i)
+    {
+        // fmod(v, 1.0) is v - trunc(v), which vectorises where fmod() doesn't
+        const double v = py[i] * frequency;
+        const double sin_x = std::sin((v - std::trunc(v)) * TWO_PI);
+        ox[i] = sin_x * A.x;
+        oy[i] = sin_x * A.y;
+        oz[i] = sin_x * A.z;
+    }
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Noise
@@ -70,13 +326,210 @@ Noise::Noise()
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 Tuple Noise::getPerturbation(Tuple& point)
 {
-    auto x = static_cast<float>(point.x * C.x);
-    auto y = static_cast<float>(point.y * C.y);
-    auto z = static_cast<float>(point.z * C.z);
+    const Point pNoise{ point.x * C.x, point.y * C.y, point.z * C.z };
+    float nx;
+    if (baked && baked->contains(pNoise))
+        nx = baked->sample(pNoise);
+    else
+        nx = evaluateNoise(static_cast<float>(pNoise.x),
+                           static_cast<float>(pNoise.y),
+                           static_cast<float>(pNoise.z));
+    return Vector{ nx * A.x, nx * A.y, nx * A.z };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Noise::getPerturbations(const TupleBatch& points, TupleBatch& out)
+{
+    const size_t n = points.size();
+    out.resize(n);
+    out.w = 0.0;
+    // convert to float noise space, the same way getPerturbation() does for a single point
+    std::vector<float> x(n), y(n), z(n), nx(n);
+    for (size_t i{}; i < n; ++i)
+    {
+        x[i] = static_cast<float>(points.x[i] * C.x);
+        y[i] = static_cast<float>(points.y[i] * C.y);
+        z[i] = static_cast<float>(points.z[i] * C.z);
+    }
+    if (baked)
+    {
+        for (size_t i{}; i < n; ++i)
+        {
+            const Point pNoise{ points.x[i] * C.x, points.y[i] * C.y, points.z[i] * C.z };
+            nx[i] = baked->contains(pNoise) ? baked->sample(pNoise) : evaluateNoise(x[i], y[i], z[i]);
+        }
+    }
+    else if (hasBatchKernel())
+        evaluateNoiseBatch(x, y, z, nx);
+    else
+    {
+        for (size_t i{}; i < n; ++i)
+            nx[i] = evaluateNoise(x[i], y[i], z[i]);
+    }
+    for (size_t i{}; i < n; ++i)
+    {
+        out.x[i] = nx[i] * A.x;
+        out.y[i] = nx[i] * A.y;
+        out.z[i] = nx[i] * A.z;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Noise::hasBatchKernel() const
+{
+    return !warpIsActive
+           && (noiseType == NoiseType::simplex || noiseType == NoiseType::perlin)
+           && (fractalType == FractalType::none || fractalType == FractalType::fbm);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Noise::evaluateNoiseBatch(std::vector<float>& x, std::vector<float>& y, std::vector<float>& z,
+                               std::vector<float>& out) const
+{
+    const size_t n = x.size();
+    // frequency, then OpenSimplex2's default rotation (not skew), as in FastNoiseLite
+    const auto frequency = static_cast<float>(density);
+    const bool isSimplex = noiseType == NoiseType::simplex;
+    for (size_t i{}; i < n; ++i)
+    {
+        x[i] *= frequency;
+        y[i] *= frequency;
+        z[i] *= frequency;
+        if (isSimplex)
+        {
+            constexpr auto R3 = static_cast<float>(2.0 / 3.0);
+            const float r = (x[i] + y[i] + z[i]) * R3;
+            x[i] = r - x[i];
+            y[i] = r - y[i];
+            z[i] = r - z[i];
+        }
+    }
+    const auto accumulate = isSimplex ? accumulateNoise<openSimplex2> : accumulateNoise<perlin>;
+    std::fill(out.begin(), out.end(), 0.f);
+    if (fractalType == FractalType::none)
+    {
+        accumulate(FNL_SEED, 1.f, x.data(), y.data(), z.data(), out.data(), n);
+        return;
+    }
+    // fBm: each octave raises the frequency by the lacunarity and lowers the amplitude by the gain
+    float ampFractal{ 1.f };
+    float amp{ FNL_GAIN };
+    for (int octave{ 1 }; octave < nOctaves; ++octave)
+    {
+        ampFractal += amp;
+        amp *= FNL_GAIN;
+    }
+    amp = 1 / ampFractal;
+    for (int octave{}; octave < nOctaves; ++octave)
+    {
+        accumulate(FNL_SEED + octave, amp, x.data(), y.data(), z.data(), out.data(), n);
+        for (size_t i{}; i < n; ++i)
+        {
+            x[i] *= FNL_LACUNARITY;
+            y[i] *= FNL_LACUNARITY;
+            z[i] *= FNL_LACUNARITY;
+        }
+        amp *= FNL_GAIN;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float Noise::evaluateNoise(float x, float y, float z) const
+{
     if (warpIsActive)
         warpNoise.DomainWarp(x, y, z);
-    float nx = noise.GetNoise(x, y, z);
-    return Vector{ nx * A.x, nx * A.y, nx * A.z };
+    return noise.GetNoise(x, y, z);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Noise::bake(const BoundingBox& region, size_t resolution)
+{
+    ASSERT(region.isFinite() && !region.isEmpty(), "noise can only be baked over a finite region");
+    // the volume lives in noise space, so that later changes to the texture transform or its
+    // coefficients simply fall back to live noise outside the baked region, rather than going stale
+    const auto toNoiseSpace = Transform::scale(C.x, C.y, C.z) * inverseTransform;
+    auto volume = std::make_shared<NoiseVolume>(region.transform(toNoiseSpace), resolution);
+    // each thread bakes whole z slices; the noise generators are only ever read from
+    const size_t nSlices = volume->getDimension(2);
+    const size_t nThreads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, nSlices);
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(nThreads);
+        for (size_t t{}; t < nThreads; ++t)
+        {
+            threads.emplace_back([this, &volume, t, nThreads, nSlices]() {
+                for (size_t k{ t }; k < nSlices; k += nThreads)
+                    for (size_t j{}; j < volume->getDimension(1); ++j)
+                        for (size_t i{}; i < volume->getDimension(0); ++i)
+                        {
+                            const auto p = volume->positionOf(i, j, k);
+                            volume->set(i, j, k, evaluateNoise(static_cast<float>(p.x),
+                                                               static_cast<float>(p.y),
+                                                               static_cast<float>(p.z)));
+                        }
+            });
+        }
+    }
+    baked = std::move(volume);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// NoiseVolume
+////////////////////////////////////////////////////////////////////////////////////////////////////
+NoiseVolume::NoiseVolume(const BoundingBox& region, size_t resolution)
+:   region(region)
+{
+    ASSERT(resolution >= 2, "a noise volume needs at least 2 samples along each axis");
+    const auto size = region.size();
+    const double longest = std::max({ size.x, size.y, size.z });
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        const double extent = size(axis);
+        const double fraction = longest > 0. ? extent / longest : 0.;
+        dims[axis] = std::max<size_t>(2, static_cast<size_t>(
+                     std::ceil(static_cast<double>(resolution - 1) * fraction)) + 1);
+        nBricks[axis] = (dims[axis] + BRICK_SIZE - 1) / BRICK_SIZE;
+        // a flat axis (ie: a plane) still gets 2 samples, at the same position
+        cellsPerUnit[axis] = extent > 0. ? static_cast<double>(dims[axis] - 1) / extent : 0.;
+    }
+    data.resize(nBricks[0] * nBricks[1] * nBricks[2] * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Tuple NoiseVolume::positionOf(size_t i, size_t j, size_t k) const
+{
+    const std::array<size_t, 3> index{ i, j, k };
+    Point p{};
+    for (size_t axis{}; axis < 3; ++axis)
+        p(axis) = cellsPerUnit[axis] > 0.
+                  ? region.min(axis) + static_cast<double>(index[axis]) / cellsPerUnit[axis]
+                  : region.min(axis);
+    return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+float NoiseVolume::sample(const Tuple& p) const
+{
+    // find the cell containing p, and how far along it p lies on each axis
+    std::array<size_t, 3> i0{};
+    std::array<float, 3> f{};
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        const double maxCell = static_cast<double>(dims[axis] - 1);
+        const double u = std::clamp((p(axis) - region.min(axis)) * cellsPerUnit[axis], 0., maxCell);
+        const double cell = std::min(std::floor(u), maxCell - 1.);
+        i0[axis] = static_cast<size_t>(cell);
+        f[axis] = static_cast<float>(u - cell);
+    }
+    const auto [i, j, k] = i0;
+    // interpolate along x, then y, then z
+    const auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+    const float c00 = lerp(at(i, j, k), at(i + 1, j, k), f[0]);
+    const float c10 = lerp(at(i, j + 1, k), at(i + 1, j + 1, k), f[0]);
+    const float c01 = lerp(at(i, j, k + 1), at(i + 1, j, k + 1), f[0]);
+    const float c11 = lerp(at(i, j + 1, k + 1), at(i + 1, j + 1, k + 1), f[0]);
+    return lerp(lerp(c00, c10, f[1]), lerp(c01, c11, f[1]), f[2]);
 }
 
 
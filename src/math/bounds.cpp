@@ -0,0 +1,153 @@
+#include "raytracer/math/bounds.hpp"
+
+#include "raytracer/common/static_vector.hpp"
+
+#include <algorithm>
+
+namespace rt
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BoundingBox::add(const Tuple& p)
+{
+    min.x = std::min(min.x, p.x);
+    min.y = std::min(min.y, p.y);
+    min.z = std::min(min.z, p.z);
+    max.x = std::max(max.x, p.x);
+    max.y = std::max(max.y, p.y);
+    max.z = std::max(max.z, p.z);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void BoundingBox::add(const BoundingBox& other)
+{
+    if (other.isEmpty())
+        return;
+    add(other.min);
+    add(other.max);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoundingBox::contains(const Tuple& p) const
+{
+    return p.x >= min.x && p.x <= max.x
+        && p.y >= min.y && p.y <= max.y
+        && p.z >= min.z && p.z <= max.z;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoundingBox::contains(const BoundingBox& other) const
+{
+    return contains(other.min) && contains(other.max);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoundingBox::isFinite() const
+{
+    return std::isfinite(min.x) && std::isfinite(min.y) && std::isfinite(min.z)
+        && std::isfinite(max.x) && std::isfinite(max.y) && std::isfinite(max.z);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+double BoundingBox::surfaceArea() const
+{
+    if (isEmpty())
+        return 0.;
+    const auto d = size();
+    return 2. * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoundingBox::intersects(const Ray& ray, double tFar) const
+{
+    const auto& origin = ray.getOrigin();
+    const auto& invDirection = ray.getInvDirection();
+    double tNear = ray.getTMin();
+    for (size_t axis{}; axis < 3; ++axis)
+    {
+        // the sign bit picks which slab plane the ray meets first, instead of swapping t values
+        const bool isNegative = ray.isNegative(axis);
+        const double t0 = ((isNegative ? max(axis) : min(axis)) - origin(axis)) * invDirection(axis);
+        const double t1 = ((isNegative ? min(axis) : max(axis)) - origin(axis)) * invDirection(axis);
+        // written so that a NaN (a ray lying exactly in a slab plane) leaves the range untouched
+        tNear = t0 > tNear ? t0 : tNear;
+        tFar = t1 < tFar ? t1 : tFar;
+    }
+    return tNear <= tFar;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+BoundingBox BoundingBox::transform(const TransformationMatrix& M) const
+{
+    if (isEmpty())
+        return {};
+    // Arvo's method: each output axis is the translation plus the smallest/largest contribution
+    // of every input axis. Zero matrix terms are skipped, so that infinite extents (ie: planes)
+    // only spread into the axes they actually rotate into, instead of producing 0 * INF = NaN.
+    BoundingBox out{ Point{ M(0, 3), M(1, 3), M(2, 3) }, Point{ M(0, 3), M(1, 3), M(2, 3) } };
+    for (size_t row{}; row < 3; ++row)
+    {
+        for (size_t col{}; col < 3; ++col)
+        {
+            const double m = M(row, col);
+            if (m == 0.)
+                continue;
+            const double a = m * min(col);
+            const double b = m * max(col);
+            out.min(row) += std::min(a, b);
+            out.max(row) += std::max(a, b);
+        }
+    }
+    return out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+BoundingBox BoundingBox::overlap(const BoundingBox& other) const
+{
+    BoundingBox out{ Point{ std::max(min.x, other.min.x), std::max(min.y, other.min.y), std::max(min.z, other.min.z) },
+                     Point{ std::min(max.x, other.max.x), std::min(max.y, other.max.y), std::min(max.z, other.max.z) } };
+    return out.isEmpty() ? BoundingBox{} : out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+BoundingBox BoundingBox::ofTriangleWithin(const Tuple& p1, const Tuple& p2, const Tuple& p3,
+                                          const BoundingBox& box)
+{
+    // each of the six planes can add at most one vertex to the polygon
+    using Polygon = StaticVector<Tuple, 9>;
+    Polygon polygon{}, clipped{};
+    polygon.push_back(p1);
+    polygon.push_back(p2);
+    polygon.push_back(p3);
+    // keep the side of the plane where sign * (p(axis) - bound) <= 0
+    const auto clip = [&](size_t axis, double bound, double sign) {
+        clipped.clear();
+        for (size_t i{}; i < polygon.size(); ++i)
+        {
+            const Tuple& a = polygon[i];
+            const Tuple& b = polygon[(i + 1) % polygon.size()];
+            const double da = sign * (a(axis) - bound);
+            const double db = sign * (b(axis) - bound);
+            if (da <= 0.)
+                clipped.push_back(a);
+            if ((da < 0. && db > 0.) || (da > 0. && db < 0.))
+            {
+                Tuple crossing = a + (b - a) * (da / (da - db));
+                crossing(axis) = bound;  // exactly on the plane, despite rounding
+                clipped.push_back(crossing);
+            }
+        }
+        polygon = clipped;
+    };
+    for (size_t axis{}; axis < 3 && !polygon.empty(); ++axis)
+    {
+        clip(axis, box.min(axis), -1.);
+        if (!polygon.empty())
+            clip(axis, box.max(axis), 1.);
+    }
+    BoundingBox out{};
+    for (const auto& p: polygon)
+        out.add(p);
+    // rounding may leave the clipped vertices a hair outside of the box
+    return out.overlap(box);
+}
+}
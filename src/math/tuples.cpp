@@ -120,6 +120,20 @@ std::ostream& operator<<(std::ostream& os, const Tuple& tuple)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// TupleBatch
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TupleBatch::TupleBatch(std::span<const Tuple> tuples)
+:   x(tuples.size()),
+    y(tuples.size()),
+    z(tuples.size()),
+    w(tuples.empty() ? 1.0 : tuples.front().w)
+{
+    for (size_t i{}; i < tuples.size(); ++i)
+        set(i, tuples[i]);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Vector
 ////////////////////////////////////////////////////////////////////////////////////////////////////
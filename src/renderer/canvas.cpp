@@ -13,7 +13,7 @@ void Canvas::writePixel(uint32_t x, uint32_t y, Colour colour)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour Canvas::pixelAt(uint32_t x, uint32_t y)
+Colour Canvas::pixelAt(uint32_t x, uint32_t y) const
 {
     return pixels.get(x, y);
 }
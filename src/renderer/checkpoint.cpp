@@ -0,0 +1,185 @@
+#include "raytracer/renderer/checkpoint.hpp"
+#include "raytracer/logging/logging.hpp"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace rt::Render {
+namespace {
+constexpr char MAGIC[8]{ 'R', 'T', 'C', 'K', 'P', 'O', 'I', 'N' };
+constexpr uint32_t VERSION{ 1 };
+
+/**
+ * @brief The start of a checkpoint file. Tile records follow it until the end of the file.
+ */
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nTiles;
+    uint64_t key;
+};
+
+/**
+ * @brief A pixel as saved; floats halve the file, and are plenty for 8bit images
+ */
+struct SavedPixel {
+    float R, G, B;
+};
+static_assert(sizeof(SavedPixel) == 3 * sizeof(float));
+
+size_t recordSize(size_t area) {
+    return sizeof(uint32_t) + area * sizeof(SavedPixel);
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Checkpoint::open(const std::filesystem::path& path, const TileCursor& layout, const std::vector<uint32_t>& passes,
+                      Canvas& image) {
+    file = path;
+    rects.resize(layout.getTileCount());
+    for (uint32_t n{ }; n < rects.size(); ++n) {
+        rects[n] = layout.getRect(n);
+    }
+    isRestored.assign(rects.size(), 0);
+    nRestored = 0;
+    const auto key = getLayoutKey(image.getWidth(), image.getHeight(), passes);
+    const auto nValidBytes = restore(key, image);
+    std::error_code error;
+    if (nValidBytes > 0) {
+        // a record cut short is dropped, so new records follow on from the last whole one
+        std::filesystem::resize_file(file, nValidBytes, error);
+        out.open(file, std::ios::binary | std::ios::app);
+    } else {
+        out.open(file, std::ios::binary | std::ios::trunc);
+        CheckpointHeader header{ };
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.nTiles = static_cast<uint32_t>(rects.size());
+        header.key = key;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.flush();
+    }
+    tLastFlush = std::chrono::steady_clock::now();
+    if (error || !out) {
+        RENDER_WARN("cannot write checkpoint {}, the job will render without one", file.string());
+        out.close();
+        return false;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Checkpoint::record(const Tile& t, const Canvas& image) {
+    ASSERT(t.nTile < rects.size(), "tile is not one of the checkpointed job's");
+    const auto& r = rects[t.nTile];
+    std::scoped_lock lock{ m_file };
+    if (!out.is_open()) return;
+    const auto offset = pending.size();
+    pending.resize(offset + recordSize(r.area()));
+    auto* p = pending.data() + offset;
+    std::memcpy(p, &t.nTile, sizeof(t.nTile));
+    p += sizeof(t.nTile);
+    // the whole rect is saved, since a tile which yielded comes back with only its last rows.
+    //  Pixels go column by column, the order the canvas holds them in
+    for (uint32_t x{ r.x0 }; x < r.x1; ++x) {
+        for (uint32_t y{ r.y0 }; y < r.y1; ++y) {
+            const auto c = image.pixelAt(x, y);
+            const SavedPixel saved{ static_cast<float>(c.R), static_cast<float>(c.G), static_cast<float>(c.B) };
+            std::memcpy(p, &saved, sizeof(saved));
+            p += sizeof(saved);
+        }
+    }
+    if (std::chrono::steady_clock::now() - tLastFlush >= FLUSH_INTERVAL) {
+        writePending();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Checkpoint::flush() {
+    std::scoped_lock lock{ m_file };
+    if (out.is_open()) {
+        writePending();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Checkpoint::remove() {
+    std::scoped_lock lock{ m_file };
+    out.close();
+    pending.clear();
+    std::error_code error;
+    std::filesystem::remove(file, error);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Checkpoint::getLayoutKey(uint32_t width, uint32_t height, const std::vector<uint32_t>& passes) const {
+    auto key = Utils::hashValue(width);
+    key = Utils::hashValue(height, key);
+    // the rects are the same for passes of any block size, yet their pixels aren't
+    for (const auto blockSize: passes) {
+        key = Utils::hashValue(blockSize, key);
+    }
+    for (const auto& r: rects) {
+        key = Utils::hashValue(r, key);
+    }
+    return key;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t Checkpoint::restore(uint64_t key, Canvas& image) {
+    std::ifstream in{ file, std::ios::binary };
+    if (!in) return 0;
+    CheckpointHeader header{ };
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+        || header.version != VERSION
+        || header.nTiles != rects.size()
+        || header.key != key) {
+        return 0;
+    }
+    size_t nValidBytes{ sizeof(header) };
+    // the finest pass restored over each rect, by its top left corner
+    std::unordered_map<uint64_t, uint32_t> finestPass;
+    const auto cornerOf = [](const TileRect& r) { return static_cast<uint64_t>(r.x0) << 32 | r.y0; };
+    std::vector<SavedPixel> pixels;
+    uint32_t nTile{ };
+    while (in.read(reinterpret_cast<char*>(&nTile), sizeof(nTile))) {
+        if (nTile >= rects.size()) break;
+        const auto& r = rects[nTile];
+        pixels.resize(r.area());
+        if (!in.read(reinterpret_cast<char*>(pixels.data()), static_cast<std::streamsize>(r.area() * sizeof(SavedPixel)))) {
+            break;
+        }
+        // records are in the order the tiles finished, so the image ends up as it was left
+        auto* p = pixels.data();
+        for (uint32_t x{ r.x0 }; x < r.x1; ++x) {
+            for (uint32_t y{ r.y0 }; y < r.y1; ++y, ++p) {
+                image.writePixel(x, y, Colour{ p->R, p->G, p->B });
+            }
+        }
+        auto it = finestPass.try_emplace(cornerOf(r), r.nPass).first;
+        it->second = std::max(it->second, r.nPass);
+        nValidBytes += recordSize(r.area());
+    }
+    // coarser passes over a rect already rendered more finely would only overwrite it
+    for (size_t i{ }; i < rects.size(); ++i) {
+        const auto it = finestPass.find(cornerOf(rects[i]));
+        if (it != finestPass.end() && rects[i].nPass <= it->second) {
+            isRestored[i] = 1;
+            ++nRestored;
+        }
+    }
+    return nValidBytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Checkpoint::writePending() {
+    if (!pending.empty()) {
+        out.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+        out.flush();
+        pending.clear();
+    }
+    tLastFlush = std::chrono::steady_clock::now();
+}
+
+}
@@ -0,0 +1,79 @@
+#include "raytracer/renderer/dynamic_resolution.hpp"
+
+#include <cmath>
+
+namespace rt::Render {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void DynamicResolution::prepare(Job& job, bool isCameraMoving) {
+    const auto blockSize = getBlockSize();
+    job.type = JobType::realtime;
+    if (isCameraMoving) {
+        // one coarse pass, which is dropped if it can't make the frame
+        job.passes = { blockSize };
+        job.budget = targetFrameTime;
+        return;
+    }
+    // at rest, the same coarse pass shows first, then each pass halves the blocks down to 1px
+    job.passes.clear();
+    for (auto B = blockSize; B > 1; B /= 2) {
+        job.passes.push_back(B);
+    }
+    job.passes.push_back(1);
+    job.budget = std::chrono::nanoseconds{ 0 };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+JobID DynamicResolution::submitFrame(JobScheduler& scheduler, Job job, bool isCameraMoving) {
+    if (const auto last = lastFrame.load(std::memory_order_relaxed); last != JobID_INVALID) {
+        scheduler.cancel(last);
+    }
+    prepare(job, isCameraMoving);
+    const auto id = scheduler.submit(std::move(job));
+    lastFrame.store(id, std::memory_order_relaxed);
+    if (isCameraMoving) {
+        std::scoped_lock lock{ m_frames };
+        movingFrames.push_back(id);
+        // frames whose end is never reported (ie: without a finalizer) are let go
+        if (movingFrames.size() > MAX_MOVING_FRAMES) {
+            movingFrames.pop_front();
+        }
+    }
+    return id;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void DynamicResolution::onFrameEnded(const JobSummary& summary) {
+    {
+        std::scoped_lock lock{ m_frames };
+        const auto it = std::ranges::find(movingFrames, summary.id);
+        if (it == movingFrames.end()) return;
+        movingFrames.erase(it);
+    }
+    const bool isDone = summary.nPassesComplete > 0;
+    const auto frameTime = std::chrono::duration<double, std::nano>(summary.tComplete - summary.tSubmit).count();
+    const auto target = static_cast<double>(targetFrameTime.count());
+    double ratio{ };
+    if (isDone) {
+        ratio = frameTime / target;
+    } else if (summary.isDeadlineHit) {
+        // a frame cut off at its deadline took longer than it shows, by an unknown amount
+        ratio = 2.;
+    } else {
+        // superseded by the next frame; one which had its time and still wasn't done is too slow,
+        //  by as much as the share of it rendered suggests
+        if (frameTime < target) return;
+        const auto nPixels = static_cast<double>(summary.target.buffer.getWidth()) * summary.target.buffer.getHeight();
+        const double shareDone = nPixels > 0. ? static_cast<double>(summary.nPixelsComplete) / nPixels : 0.;
+        ratio = shareDone > 0. ? std::max(frameTime / shareDone / target, 1. + DEADBAND) : 2.;
+    }
+    if (std::abs(ratio - 1.) < DEADBAND) return;
+    // the rays traced go with the square of the block size
+    const double scale = blockScale.load(std::memory_order_relaxed);
+    const double wanted = scale * std::sqrt(ratio);
+    const double next = std::clamp(scale + SMOOTHING * (wanted - scale), 1., MAX_BLOCK_SIZE);
+    blockScale.store(next, std::memory_order_relaxed);
+    RENDER_DEBUG("frame took {:.2f}x its target, block size now {}", ratio, toBlockSize(next));
+}
+
+}
@@ -1,5 +1,6 @@
 #include "raytracer/renderer/intersection.hpp"
 #include "raytracer/shapes/shape.hpp"
+#include "raytracer/shapes/instance.hpp"
 
 
 namespace rt
@@ -27,7 +28,19 @@ bool Intersection::operator<(const Intersection& b) const
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 bool Intersection::operator==(const Intersection& b) const
 {
-    return t == b.t && shape == b.shape && u == b.u && v == b.v;
+    return t == b.t && shape == b.shape && u == b.u && v == b.v && instance == b.instance;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+const Material& Intersection::getMaterial() const
+{
+    return instance != nullptr ? instance->getMaterialFor(*shape) : shape->getMaterial();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Intersection::castsShadow() const
+{
+    return shape->getCastsShadow() && (instance == nullptr || instance->getCastsShadow());
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
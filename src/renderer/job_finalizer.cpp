@@ -1,7 +1,128 @@
 #include "raytracer/renderer/job_finalizer.hpp"
 #include "raytracer/renderer/job_scheduler.hpp"
 
+#include <fstream>
+
 namespace rt::Render {
 ////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobFinalizer::run() {
+    RENDER_DEBUG("JobFinalizer running");
+    batch.reserve(BATCH_SIZE);
+
+    while (isRunning.load(std::memory_order_relaxed)) {
+        finalizeAll();
+        // sleep until signalled for jobs or shutdown
+        using namespace std::literals::chrono_literals;
+        if (signal.try_acquire_for(50ms)) {
+            isSignalled.clear(std::memory_order_release);
+        }
+        std::scoped_lock lock{ m_finalized };
+        evict(std::chrono::steady_clock::now());
+    }
+    // jobs which ended before the stop are still finalized
+    finalizeAll();
+    RENDER_DEBUG("JobFinalizer stopped");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobFinalizer::finalizeAll() {
+    while (!queue.empty()) {
+        // batches are taken first, so producers get their slots back before any encoding
+        while (batch.size() < BATCH_SIZE) {
+            auto* job = queue.front();
+            if (job == nullptr) break;
+            batch.emplace_back(std::move(*job));
+            queue.pop();
+        }
+        for (auto& job: batch) {
+            if (!job.summary.target.isWrittenToDisk) {
+                complete(job);
+                continue;
+            }
+            const auto& buffer = job.summary.target.buffer;
+            auto encoded = buffer.generatePPMHeader() + buffer.toPPM() + "\n";
+            {
+                std::scoped_lock lock{ m_writes };
+                writes.push_back({ std::move(job), std::move(encoded) });
+            }
+            cv_writes.notify_one();
+        }
+        batch.clear();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobFinalizer::runWriter() {
+    std::unique_lock lock{ m_writes };
+    while (true) {
+        cv_writes.wait(lock, [&] { return !writes.empty() || !isWriterRunning; });
+        if (writes.empty()) break;
+        auto write = std::move(writes.front());
+        writes.pop_front();
+        lock.unlock();
+        const auto& path = write.job.summary.target.path;
+        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+        if (!file.write(write.encoded.data(), static_cast<std::streamsize>(write.encoded.size()))) {
+            RENDER_ERROR("failed writing job id {} to {}", write.job.summary.id, path);
+        }
+        file.close();
+        complete(write.job);
+        lock.lock();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobFinalizer::complete(JobToFinalize& job) {
+    RENDER_INFO("finalized job id: {}", job.summary.id);
+    if (job.callback != nullptr) {
+        std::scoped_lock lock{ m_callbacks };
+        job.callback(job.summary);
+    }
+    const auto id = job.summary.id;
+    {
+        std::scoped_lock lock{ m_finalized };
+        if (job.callback != nullptr && !retention.isBufferKeptAfterCallback) {
+            job.summary.target.releaseBuffer();
+        }
+        if (finalized.contains(id)) [[unlikely]] {
+            RENDER_ERROR("duplicate job summary with id {} in finalizer", id);
+            eraseSummary(id);
+        }
+        const auto now = std::chrono::steady_clock::now();
+        const auto bytes = sizeof(JobSummary) + job.summary.target.getMemoryUse();
+        lru.push_front(id);
+        finalized.emplace(id, FinalizedEntry{ std::make_shared<JobSummary>(std::move(job.summary)),
+                                              lru.begin(), now, bytes });
+        finalizedBytes += bytes;
+        evict(now);
+    }
+    // the summary holds all that's left to know about the job
+    if (scheduler != nullptr) {
+        scheduler->eraseJobState(id);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobFinalizer::evict(std::chrono::steady_clock::time_point now) {
+    while (!lru.empty() && (finalized.size() > retention.maxCount || finalizedBytes > retention.maxBytes)) {
+        eraseSummary(lru.back());
+    }
+    if (retention.maxAge == std::chrono::nanoseconds::max()) return;
+    for (auto it = lru.begin(); it != lru.end();) {
+        const auto id = *it++;
+        if (now - finalized.at(id).tFinalized > retention.maxAge) {
+            eraseSummary(id);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobFinalizer::eraseSummary(JobID id) {
+    const auto it = finalized.find(id);
+    if (it == finalized.end()) return;
+    finalizedBytes -= it->second.bytes;
+    lru.erase(it->second.inLru);
+    finalized.erase(it);
+}
 
-}
\ No newline at end of file
+}
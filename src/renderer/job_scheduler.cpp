@@ -1,8 +1,106 @@
 #include "raytracer/renderer/job_scheduler.hpp"
 #include "raytracer/renderer/job_finalizer.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
 namespace rt::Render {
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TileQueue::push(Tile t) {
+    const auto c = classOf(t.state->job.type);
+    t.tQueued = std::chrono::steady_clock::now();
+    t.isAged = false;
+    // a class only starts aging once it has something waiting
+    if (heaps[c].empty()) {
+        tLastServed[c] = t.tQueued;
+    }
+    heaps[c].push_back(std::move(t));
+    std::push_heap(heaps[c].begin(), heaps[c].end(), heapOrder(c));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Tile TileQueue::take() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto c = selectClass(now);
+    auto& heap = heaps[c];
+    std::pop_heap(heap.begin(), heap.end(), heapOrder(c));
+    auto t = std::move(heap.back());
+    heap.pop_back();
+    // served out of turn, the tile isn't to be preempted by the classes it was taken ahead of
+    t.isAged = std::any_of(heaps.begin(), heaps.begin() + c, [](const auto& h) { return !h.empty(); });
+    auto& s = stats[c];
+    const auto wait = now - t.tQueued;
+    ++s.nTaken;
+    s.totalWait += wait;
+    s.maxWait = std::max(s.maxWait, wait);
+    s.maxGap = std::max(s.maxGap, now - tLastServed[c]);
+    tLastServed[c] = now;
+    return t;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<Tile> TileQueue::drain() {
+    std::vector<Tile> all;
+    all.reserve(size());
+    for (auto& heap: heaps) {
+        std::ranges::move(heap, std::back_inserter(all));
+        heap.clear();
+    }
+    return all;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<Tile> TileQueue::takeTilesOf(JobID id) {
+    std::vector<Tile> taken;
+    for (size_t c{ }; c < N_CLASSES; ++c) {
+        auto& heap = heaps[c];
+        const auto kept = std::partition(heap.begin(), heap.end(), [&](const Tile& t) { return t.jobID != id; });
+        if (kept == heap.end()) continue;
+        std::move(kept, heap.end(), std::back_inserter(taken));
+        heap.erase(kept, heap.end());
+        // the rest keep their times queued, so the class's aging carries on where it was
+        std::ranges::make_heap(heap, heapOrder(c));
+    }
+    return taken;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void TileQueue::setOrder(JobType type, ClassOrder order) {
+    const auto c = classOf(type);
+    orders[c] = order;
+    std::ranges::make_heap(heaps[c], heapOrder(c));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+PKey TileQueue::orderKey(const Tile& t, size_t c) const {
+    if (orders[c] == ClassOrder::interleaved) return t.priority;
+    // [type | rank | pass | dist], so a job's passes all come before the next job's
+    const auto p = t.priority;
+    return (p & 0xFF00000000000000) | ((p & 0xFFFFFFFF) << 24) | ((p >> 32) & 0xFFFFFF);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t TileQueue::selectClass(std::chrono::steady_clock::time_point now) const {
+    size_t selected{ N_CLASSES };
+    std::chrono::nanoseconds mostOverdue{ 0 };
+    for (size_t c{ }; c < N_CLASSES; ++c) {
+        if (heaps[c].empty()) continue;
+        if (selected == N_CLASSES) {
+            selected = c;
+            continue;
+        }
+        // a less urgent class passed over for too long is served ahead of the more urgent ones
+        const auto overdue = (now - tLastServed[c]) - agingLimits[c];
+        if (overdue > mostOverdue) {
+            mostOverdue = overdue;
+            selected = c;
+        }
+    }
+    return selected == N_CLASSES ? 0 : selected;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void JobScheduler::attachToFinalizer(JobFinalizer& f) {
     finalizer = &f;
@@ -10,12 +108,416 @@ void JobScheduler::attachToFinalizer(JobFinalizer& f) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void JobScheduler::setCompleteAndFinalize(const std::shared_ptr<JobState>& state) {
+JobID JobScheduler::trySubmit(Job job) {
+    const auto tileSize = prepareJob(job);
+    const auto c = TileQueue::classOf(job.type);
+    const auto nTiles = (job.width + tileSize - 1) / tileSize * ((job.height + tileSize - 1) / tileSize)
+                        * static_cast<uint32_t>(job.passes.size());
+    {
+        std::scoped_lock lock{ m_tiles };
+        const bool isQueueClear = std::all_of(pending.begin(), pending.begin() + c + 1,
+                                              [](const auto& jobsOfType) { return jobsOfType.empty(); });
+        if (!isQueueClear || !fitsTileBudget(nTiles)) return JobID_INVALID;
+        // held for the job while it's set up, so it can't be crowded out meanwhile
+        nTilesInFlight.fetch_add(nTiles, std::memory_order_relaxed);
+    }
+    auto state = makeJobState(std::move(job), tileSize);
+    std::vector<std::shared_ptr<JobState>> endedJobs;
+    {
+        std::scoped_lock lock{ m_tiles };
+        nTilesInFlight.fetch_sub(nTiles, std::memory_order_relaxed);
+        jobs.emplace(state->job.id, state);
+        admit(state);
+        endedJobs.swap(ended);
+    }
+    finalize(endedJobs);
+    cv_tiles.notify_all();
+    return state->job.id;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::setTileBudget(uint32_t nTiles) {
+    bool isAdmitted;
+    std::vector<std::shared_ptr<JobState>> endedJobs;
+    {
+        std::scoped_lock lock{ m_tiles };
+        tileBudget = nTiles;
+        isAdmitted = admitPending();
+        endedJobs.swap(ended);
+    }
+    finalize(endedJobs);
+    if (isAdmitted) {
+        cv_tiles.notify_all();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::cancel(JobID id) {
+    bool isAdmitted;
+    std::vector<std::shared_ptr<JobState>> endedJobs;
+    {
+        std::scoped_lock lock{ m_tiles };
+        auto it = jobs.find(id);
+        if (it == jobs.end()) return;
+        const auto state = it->second;
+        state->isCancelled = true;
+        // a job still waiting to be admitted has no tiles out, and ends here
+        auto& jobsOfType = pending[TileQueue::classOf(state->job.type)];
+        if (const auto p = std::ranges::find(jobsOfType, state); p != jobsOfType.end()) {
+            jobsOfType.erase(p);
+            endJob(state);
+        } else {
+            // its tiles go now, rather than as workers come across them, so the job ends once no
+            //  worker is in the middle of one
+            dropUnqueuedTiles(state);
+            for (auto* queue: { &tiles, &parked }) {
+                for (const auto& t: queue->takeTilesOf(id)) {
+                    dropQueuedTile(t);
+                }
+            }
+            publishQueuedPriority();
+        }
+        isAdmitted = admitPending();
+        endedJobs.swap(ended);
+    }
+    finalize(endedJobs);
+    if (isAdmitted) {
+        cv_tiles.notify_all();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::setMode(Mode newMode) {
+    ASSERT(newMode != Mode::invalid, "cannot switch to an invalid rendering mode");
+    std::vector<std::shared_ptr<JobState>> endedJobs;
+    {
+        std::scoped_lock lock{ m_tiles };
+        if (mode.exchange(newMode) == newMode) return;
+        RENDER_DEBUG("switching rendering mode to {}", static_cast<int>(newMode));
+        requeue(tiles);
+        requeue(parked);
+        publishQueuedPriority();
+        // the jobs the mode parks make room in the budget for the ones it allows
+        for (const auto& [jobID, state]: jobs) {
+            if (state->isStarted.load(std::memory_order_relaxed)) {
+                updateBudgetShare(*state);
+            }
+        }
+        admitPending();
+        endedJobs.swap(ended);
+    }
+    finalize(endedJobs);
+    cv_tiles.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool JobScheduler::pause(JobID id) {
+    bool isAdmitted{ false };
+    std::vector<std::shared_ptr<JobState>> endedJobs;
+    {
+        std::scoped_lock lock{ m_tiles };
+        auto it = jobs.find(id);
+        if (it == jobs.end() || it->second->isCompleted.load(std::memory_order_relaxed)) return false;
+        if (!it->second->isPaused.exchange(true)) {
+            RENDER_DEBUG("pausing job ID {}", id);
+            // only the job's own tiles move, so the others keep their times queued, and aging
+            for (auto& t: tiles.takeTilesOf(id)) {
+                parked.push(std::move(t));
+            }
+            publishQueuedPriority();
+            // a paused job makes room for others until it resumes
+            if (it->second->isStarted.load(std::memory_order_relaxed)) {
+                updateBudgetShare(*it->second);
+            }
+            isAdmitted = admitPending();
+            endedJobs.swap(ended);
+        }
+    }
+    finalize(endedJobs);
+    if (isAdmitted) {
+        cv_tiles.notify_all();
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool JobScheduler::resume(JobID id) {
+    {
+        std::scoped_lock lock{ m_tiles };
+        auto it = jobs.find(id);
+        if (it == jobs.end() || it->second->isCompleted.load(std::memory_order_relaxed)) return false;
+        if (!it->second->isPaused.exchange(false)) return true;
+        RENDER_DEBUG("resuming job ID {}", id);
+        for (auto& t: parked.takeTilesOf(id)) {
+            enqueue(std::move(t));
+        }
+        publishQueuedPriority();
+        // its share is taken back even over the budget, as the job was admitted before those
+        //  which took its place
+        if (it->second->isStarted.load(std::memory_order_relaxed)) {
+            updateBudgetShare(*it->second);
+        }
+    }
+    cv_tiles.notify_all();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::yieldTile(Tile t) {
+    handBack(t);
+    t.isDispatched = false;
+    bool isAdmitted{ false };
+    std::vector<std::shared_ptr<JobState>> endedJobs;
+    {
+        std::scoped_lock lock{ m_tiles };
+        if (t.state->isCancelled.load(std::memory_order_relaxed)) {
+            // cancelled since the worker last checked, so the job's queued tiles are already gone
+            dropQueuedTile(t);
+            isAdmitted = admitPending();
+            endedJobs.swap(ended);
+        } else {
+            enqueue(std::move(t));
+            publishQueuedPriority();
+        }
+    }
+    finalize(endedJobs);
+    if (isAdmitted) {
+        cv_tiles.notify_all();
+    } else {
+        cv_tiles.notify_one();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::setClassOrder(JobType type, ClassOrder order) {
+    std::scoped_lock lock{ m_tiles };
+    tiles.setOrder(type, order);
+    parked.setOrder(type, order);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::setAgingLimit(JobType type, std::chrono::nanoseconds limit) {
+    std::scoped_lock lock{ m_tiles };
+    tiles.setAgingLimit(type, limit);
+    parked.setAgingLimit(type, limit);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t JobScheduler::fitJobToBudget(Job& job, double nsPerRay, uint32_t nWorkers) {
+    ASSERT(job.budget.count() > 0, "only jobs with a budget are fit to one");
+    const auto raysForPass = [&](uint32_t blockSize) {
+        const auto B = std::max(1u, blockSize);
+        return static_cast<double>((job.width + B - 1) / B) * static_cast<double>((job.height + B - 1) / B);
+    };
+    // time across all the workers, in nanoseconds
+    const double budget = static_cast<double>(job.budget.count()) * std::max(1u, nWorkers);
+    double spent{ };
+    size_t nKept{ };
+    for (const auto blockSize: job.passes) {
+        const double cost = raysForPass(blockSize) * nsPerRay;
+        if (nKept > 0 && spent + cost > budget) break;
+        spent += cost;
+        ++nKept;
+    }
+    job.passes.resize(std::max<size_t>(nKept, 1));
+    // the coarsest pass alone doesn't fit, so reflections and refractions are cut back
+    if (spent > 2. * budget) {
+        job.rayDepth = 0;
+    } else if (spent > budget) {
+        job.rayDepth = std::min<size_t>(job.rayDepth, 1);
+    }
+    // tiles are sized for the finest pass, which has the most rays per tile
+    const auto finest = std::max(1u, job.passes.back());
+    const double budgetPerTile = budget / std::max(1u, nWorkers) / MIN_TILES_PER_WORKER;
+    uint32_t tileSize{ TILE_SIZE };
+    const auto raysPerTile = [&](uint32_t size) {
+        const auto n = static_cast<double>((size + finest - 1) / finest);
+        return n * n;
+    };
+    while (tileSize > MIN_TILE_SIZE && raysPerTile(tileSize) * nsPerRay > budgetPerTile) {
+        tileSize /= 2;
+    }
+    RENDER_DEBUG("budget of {} ns fits {} passes, ray depth {}, {}px tiles", job.budget.count(),
+                 job.passes.size(), job.rayDepth, tileSize);
+    return tileSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TileCursor JobScheduler::makeTileCursor(const Job& job, uint32_t tileSize) {
+    ASSERT(job.type != JobType::invalid, "job type must be specified before getting tiles");
+    TileCursor c;
+    c.width = job.width;
+    c.height = job.height;
+    c.tileSize = tileSize;
+    c.nCols = (job.width + tileSize - 1) / tileSize;
+    c.nRows = (job.height + tileSize - 1) / tileSize;
+    c.nPasses = static_cast<uint32_t>(job.passes.size());
+    c.cells.resize(c.getCellCount());
+    std::iota(c.cells.begin(), c.cells.end(), 0u);
+    // every pass visits the cells by their distance from the centre, as their priority keys rank them
+    std::ranges::stable_sort(c.cells, { }, [&](uint32_t cell) {
+        const auto r = c.getRect(cell);
+        return getPriorityKeyForTile(job.type, 0, (r.x0 + r.x1) / 2, (r.y0 + r.y1) / 2, job.width, job.height);
+    });
+    return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<JobState> JobScheduler::makeJobState(Job job, uint32_t tileSize) {
+    auto state = std::make_shared<JobState>(std::move(job));
+    state->cursor = makeTileCursor(state->job, tileSize);
+    state->nTiles = state->cursor.getTileCount();
+    state->tSubmit = std::chrono::steady_clock::now();
+    if (state->job.budget.count() > 0) {
+        state->deadline = state->tSubmit + state->job.budget;
+    }
+    // older and heavier jobs rank first among tiles otherwise equal; a pending job keeps its age
+    state->rank = getJobRank(state->job.weight);
+    state->nPassTilesRemain = std::make_unique<std::atomic<uint32_t>[]>(state->job.passes.size());
+    for (uint32_t nPass{ }; nPass < state->cursor.nPasses; ++nPass) {
+        state->nPassTilesRemain[nPass] = state->cursor.getCellCount();
+    }
+    // a job resumed from its checkpoint only queues the tiles which are still missing
+    if (!state->job.checkpointFile.empty()) {
+        restoreCheckpoint(state);
+    }
+    state->nTilesRemain = state->nTiles - state->nTilesComplete.load(std::memory_order_relaxed);
+    return state;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::restoreCheckpoint(const std::shared_ptr<JobState>& state) {
+    auto checkpoint = std::make_shared<Checkpoint>();
+    if (!checkpoint->open(state->job.checkpointFile, state->cursor, state->job.passes, state->job.target.buffer)) return;
+    state->checkpoint = checkpoint;
+    if (checkpoint->getRestoredCount() == 0) return;
+    uint64_t nPixels{ };
+    for (uint32_t n{ }; n < state->nTiles; ++n) {
+        if (checkpoint->isTileRestored(n)) {
+            const auto r = state->cursor.getRect(n);
+            nPixels += r.area();
+            --state->nPassTilesRemain[r.nPass];
+        }
+    }
+    state->nTilesComplete = checkpoint->getRestoredCount();
+    state->nPixelsComplete = nPixels;
+    state->tLastTile = state->tSubmit;
+    RENDER_INFO("job ID {} resumed from checkpoint {}, with {} of {} tiles restored", state->job.id,
+                state->job.checkpointFile.string(), checkpoint->getRestoredCount(), state->nTiles);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool JobScheduler::buildWorldFor(std::unique_lock<std::mutex>& lock, const JobState& state) {
+    auto& world = state.job.world;
+    const auto quality = type_to_build_quality(state.job.type);
+    if (world.getBuildQuality() == quality) return true;
+    ++nWaitingForIdle;
+    cv_tiles.wait(lock, [&] { return nTilesDispatched.load() == 0 || inShutdown; });
+    --nWaitingForIdle;
+    if (inShutdown) return false;
+    // another worker may have switched it while this one waited
+    if (world.getBuildQuality() != quality) {
+        RENDER_DEBUG("switching the world's build quality for job ID {}", state.job.id);
+        world.setBuildQuality(quality);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool JobScheduler::admitPending() {
+    bool isAdmitted{ false };
+    for (auto& jobsOfType: pending) {
+        while (!jobsOfType.empty()) {
+            // strictly in order, so a large job isn't passed over by a stream of small ones
+            const auto& next = *jobsOfType.front();
+            if (isDispatchable(next) && !fitsTileBudget(next.nTiles)) return isAdmitted;
+            const auto state = std::move(jobsOfType.front());
+            jobsOfType.pop_front();
+            admit(state);
+            isAdmitted = true;
+        }
+    }
+    return isAdmitted;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::admit(const std::shared_ptr<JobState>& state) {
+    state->isStarted = true;
+    updateBudgetShare(*state);
+    if (state->nTilesRemain.load(std::memory_order_relaxed) == 0) {
+        // every tile was restored from its checkpoint, or it has none, so there is nothing to render
+        endJob(state);
+        return;
+    }
+    // queue is loaded with the job's first tiles, or they're parked if the mode doesn't allow the job
+    for (uint32_t n{ }; n < TILES_QUEUED_PER_JOB && queueNextTile(state); ++n) { }
+    publishQueuedPriority();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::updateBudgetShare(JobState& state) {
+    if (isDispatchable(state)) {
+        if (state.isBudgeted.exchange(true)) return;
+        nTilesInFlight.fetch_add(state.nTiles, std::memory_order_relaxed);
+        // a worker may have completed the job meanwhile, without the share to give back
+        if (state.isCompleted.load() && state.isBudgeted.exchange(false)) {
+            nTilesInFlight.fetch_sub(state.nTiles, std::memory_order_relaxed);
+        }
+    } else if (state.isBudgeted.exchange(false)) {
+        nTilesInFlight.fetch_sub(state.nTiles, std::memory_order_relaxed);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool JobScheduler::queueNextTile(const std::shared_ptr<JobState>& state) {
+    auto& cursor = state->cursor;
+    while (!cursor.isDone()) {
+        const auto n = cursor.next();
+        if (state->checkpoint != nullptr && state->checkpoint->isTileRestored(n)) continue;
+        enqueue(makeTile(state, cursor, n));
+        return true;
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::dropUnqueuedTiles(const std::shared_ptr<JobState>& state) {
+    auto& cursor = state->cursor;
+    uint32_t nDropped{ };
+    while (!cursor.isDone()) {
+        const auto n = cursor.next();
+        nDropped += state->checkpoint == nullptr || !state->checkpoint->isTileRestored(n);
+    }
+    // on last tile in job, send to Finalizer
+    if (nDropped > 0 && state->nTilesRemain.fetch_sub(nDropped) <= nDropped) {
+        endJob(state);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::setComplete(const std::shared_ptr<JobState>& state) {
     if (state == nullptr) return;
     RENDER_DEBUG("completing job ID {}", state->job.id);
     state->isCompleted = true;
+    // the job's tiles leave the budget, if they were counted against it
+    if (state->isBudgeted.exchange(false)) {
+        nTilesInFlight.fetch_sub(state->nTiles, std::memory_order_relaxed);
+    }
     const auto allTilesWereRendered = state->nTilesComplete.load(std::memory_order::relaxed) == state->nTiles;
     state->tComplete = allTilesWereRendered ? state->tLastTile : std::chrono::steady_clock::now();
+    // a job cut short keeps its checkpoint to resume from, and one rendered in full has no more use for it
+    if (state->checkpoint != nullptr) {
+        if (allTilesWereRendered) {
+            state->checkpoint->remove();
+        } else {
+            state->checkpoint->flush();
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void JobScheduler::finalize(const std::shared_ptr<JobState>& state) {
+    if (state == nullptr) return;
     if (finalizer != nullptr) {
         finalizer->push({ makeSummary(state), state->onJobEnd });
     } else [[unlikely]] {
@@ -3,35 +3,21 @@
 namespace rt
 {
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Ray::Ray(Tuple origin, Tuple direction)
+Ray::Ray(Tuple origin, Tuple direction, double tMin, double tMax)
 : origin(origin),
-  direction(direction)
+  direction(direction),
+  invDirection(Vector{ 1. / direction.x, 1. / direction.y, 1. / direction.z }),
+  sign{ invDirection.x < 0., invDirection.y < 0., invDirection.z < 0. },
+  tMin(tMin),
+  tMax(tMax)
 {
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Tuple Ray::getOrigin() const
+Ray Ray::transform(const TransformationMatrix& t) const
 {
-    return origin;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-Tuple Ray::getDirection() const
-{
-    return direction;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-Tuple Ray::position(double t)
-{
-    return origin + direction * t;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-Ray Ray::transform(Matrix<double, 4> t) const
-{
-    auto o = t * origin;
-    auto d = t * direction;
-    return {o, d};
+    Ray transformed{ t * origin, t * direction, tMin, tMax };
+    transformed.setCone(coneWidth, coneSpread);
+    return transformed;
 }
 }
@@ -1,4 +1,78 @@
 #include "raytracer/renderer/renderer.hpp"
 
+namespace rt::Render {
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Worker::renderTile(Tile& t) {
+    auto& job = t.state->job;
+    auto& image = job.target.buffer;
+    using Block = RayPacket<8>;
+    // full resolution passes are traced in packets, so a row is a packet high (two scanlines);
+    //  coarser passes trace one ray per block, filling the block, so a row is a block high
+    const bool isFullResolution = t.blockSize <= 1;
+    const uint32_t rowHeight = isFullResolution ? Block::BLOCK_HEIGHT : t.blockSize;
+    // the time taken per ray feeds the scheduler's plans for jobs with a budget
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint32_t yFirst{ t.y0 };
+    uint64_t nRays{ };
+    const auto recordThroughput = [&]() {
+        scheduler.recordThroughput(nRays, std::chrono::steady_clock::now() - t0);
+    };
+    for (uint32_t y{ t.y0 }; y < t.y1; y += rowHeight) {
+        const uint32_t yEnd = std::min(t.y1, y + rowHeight);
+        if (isFullResolution) {
+            for (uint32_t x{ t.x0 }; x < t.x1; x += Block::BLOCK_WIDTH) {
+                const auto packet = job.camera.getRayPacketForCanvasBlock<Block::SIZE>(x, y);
+                const auto pixels = job.world.tracePacketToPixels(packet, job.rayDepth);
+                for (size_t lane{ }; lane < Block::SIZE; ++lane) {
+                    const auto px = x + static_cast<uint32_t>(lane % Block::BLOCK_WIDTH);
+                    const auto py = y + static_cast<uint32_t>(lane / Block::BLOCK_WIDTH);
+                    nRays += packet.isActive(lane);
+                    if (packet.isActive(lane) && px < t.x1 && py < yEnd) {
+                        image.writePixel(px, py, pixels[lane]);
+                    }
+                }
+            }
+        } else {
+            for (uint32_t x{ t.x0 }; x < t.x1; x += t.blockSize) {
+                const auto colour = job.world.traceRayToPixel(job.camera.getRayForCanvasPixel(x, y),
+                                                              job.rayDepth);
+                ++nRays;
+                for (uint32_t py{ y }; py < yEnd; ++py) {
+                    for (uint32_t px{ x }; px < std::min(t.x1, x + t.blockSize); ++px) {
+                        image.writePixel(px, py, colour);
+                    }
+                }
+            }
+        }
+        t.state->nPixelsComplete.fetch_add(static_cast<uint64_t>(t.x1 - t.x0) * (yEnd - y),
+                                           std::memory_order_relaxed);
+        if (yEnd < t.y1 && t.state->isCancelled.load(std::memory_order_relaxed)) {
+            RENDER_DEBUG("<{}> worker dropping cancelled job ID {} at row {}", id, t.jobID, yEnd);
+            recordThroughput();
+            scheduler.dropTile(t);
+            return false;
+        }
+        if (yEnd < t.y1 && t.state->isPastDeadline()) {
+            RENDER_DEBUG("<{}> worker dropping job ID {} at its deadline", id, t.jobID);
+            recordThroughput();
+            t.state->isDeadlineHit = true;
+            publishRows(t, yFirst, yEnd);
+            scheduler.dropTile(t);
+            return false;
+        }
+        if (yEnd < t.y1 && scheduler.shouldYield(t)) {
+            RENDER_DEBUG("<{}> worker yielding job ID {} at row {}", id, t.jobID, yEnd);
+            recordThroughput();
+            publishRows(t, yFirst, yEnd);
+            t.y0 = yEnd;
+            scheduler.yieldTile(t);
+            return false;
+        }
+    }
+    recordThroughput();
+    publishRows(t, yFirst, t.y1);
+    return true;
+}
 
+}
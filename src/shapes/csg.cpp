@@ -85,7 +85,7 @@ bool CSG::includes(Shape* s) const
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections CSG::localIntersect(Ray localRay)
+Intersections CSG::localIntersect(const Ray& localRay)
 {
     const auto xsLeft = children.at(0)->intersect(localRay);
     const auto xsRight = children.at(1)->intersect(localRay);
@@ -26,11 +26,13 @@ Tuple Cube::localNormalAt(Tuple localPoint, Intersection iHit)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections Cube::localIntersect(Ray localRay)
+Intersections Cube::localIntersect(const Ray& localRay)
 {
-    auto x = checkAxis(localRay.getOrigin().x, localRay.getDirection().x);
-    auto y = checkAxis(localRay.getOrigin().y, localRay.getDirection().y);
-    auto z = checkAxis(localRay.getOrigin().z, localRay.getDirection().z);
+    const auto& origin = localRay.getOrigin();
+    const auto& invDirection = localRay.getInvDirection();
+    auto x = checkAxis(origin.x, invDirection.x, localRay.isNegative(0));
+    auto y = checkAxis(origin.y, invDirection.y, localRay.isNegative(1));
+    auto z = checkAxis(origin.z, invDirection.z, localRay.isNegative(2));
 
     const double tMin = std::max({ x.min, y.min, z.min });
     const double tMax = std::min({ x.max, y.max, z.max });
@@ -48,23 +50,11 @@ Intersections Cube::localIntersect(Ray localRay)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Cube::IntersectionTimes Cube::checkAxis(double origin, double direction)
+Cube::IntersectionTimes Cube::checkAxis(double origin, double invDirection, bool isNegative)
 {
-    IntersectionTimes t{};
-    const double tMin_num = (-1.0 - origin);
-    const double tMax_num = (1.0 - origin);
-
-    t.min = tMin_num / direction;
-    t.max = tMax_num / direction;
-
-    if (t.min > t.max)
-    {
-        const double temp = t.min;
-        t.min             = t.max;
-        t.max             = temp;
-    }
-
-    return t;
+    // a ray travelling in the negative direction meets the +1 plane first
+    const double near = isNegative ? 1.0 : -1.0;
+    return { (near - origin) * invDirection, (-near - origin) * invDirection };
 }
 
 }
\ No newline at end of file
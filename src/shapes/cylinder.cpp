@@ -5,12 +5,12 @@ namespace rt
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Cylinder
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections Cylinder::localIntersect(Ray localRay)
+Intersections Cylinder::localIntersect(const Ray& localRay)
 {
     Intersections xs{};
-    const auto dir    = localRay.getDirection();
-    const auto origin = localRay.getOrigin();
-    const double a    = dir.x * dir.x + dir.z * dir.z;
+    const auto& dir    = localRay.getDirection();
+    const auto& origin = localRay.getOrigin();
+    const double a     = dir.x * dir.x + dir.z * dir.z;
     if (APPROX_EQ(a, 0.0))
         // ray parallel to y-axis, only possible cap intersection
         intersectCaps(localRay, xs);
@@ -23,10 +23,10 @@ Intersections Cylinder::localIntersect(Ray localRay)
         if (discriminant >= 0.0)
         {
             // find t values for the two intersections
-            const double SQRT_D = std::sqrt(discriminant);
-            const double TWO_A  = 2.0 * a;
-            double t0           = (-b - SQRT_D) / TWO_A;
-            double t1           = (-b + SQRT_D) / TWO_A;
+            const double SQRT_D   = std::sqrt(discriminant);
+            const double INV_2A   = 0.5 / a;
+            double t0             = (-b - SQRT_D) * INV_2A;
+            double t1             = (-b + SQRT_D) * INV_2A;
             if (t0 > t1) Utils::swap(t0, t1);
             // find y coord at each point of intersection; if it's btwn min and max
             //  bounds, then the ix. is valid
@@ -65,21 +65,22 @@ Tuple Cylinder::localNormalAt(Tuple localPoint, Intersection iHit)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void Cylinder::intersectCaps(Ray& r, Intersections& xs)
+void Cylinder::intersectCaps(const Ray& r, Intersections& xs)
 {
-    const auto origin = r.getOrigin();
-    const auto dir    = r.getDirection();
+    const auto& origin = r.getOrigin();
+    const auto& dir    = r.getDirection();
     // caps only matter if cylinder is closed
     if (!isClosed || APPROX_EQ(dir.y, 0.0)) return;
     // check for lower cap by intersecting with plane at y=cyl.minY
-    double t = (minY - origin.y) / dir.y;
+    const double invDirY = r.getInvDirection().y;
+    double t = (minY - origin.y) * invDirY;
     if (checkCap(r, t))
     {
         Intersection ix{ t, this };
         xs.add(ix);
     }
     // check for upper cap by intersecting with plane at y=cyl.maxY
-    t = (maxY - origin.y) / dir.y;
+    t = (maxY - origin.y) * invDirY;
     if (checkCap(r, t))
     {
         Intersection ix{ t, this };
@@ -88,10 +89,10 @@ void Cylinder::intersectCaps(Ray& r, Intersections& xs)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-bool Cylinder::checkCap(Ray& r, double t)
+bool Cylinder::checkCap(const Ray& r, double t)
 {
-    const auto origin = r.getOrigin();
-    const auto dir    = r.getDirection();
+    const auto& origin = r.getOrigin();
+    const auto& dir    = r.getDirection();
     const double x    = origin.x + t * dir.x;
     const double z    = origin.z + t * dir.z;
     return (x * x + z * z) <= 1.0;
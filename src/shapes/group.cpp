@@ -5,14 +5,49 @@ namespace rt
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Group
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections Group::localIntersect(Ray localRay)
+Intersections Group::localIntersect(const Ray& localRay)
 {
     Intersections xs{};
-    // aggregate the intersections of all the child shapes
-    for (auto s : children) xs = xs + s->intersect(localRay);
+    // aggregate the intersections of all the child shapes whose bounds the ray passes through.
+    //  Every intersection is kept, since refraction and CSG need them all.
+    accel.update(children);
+    accel.forEachShape(localRay, -INF,
+                       [&](Shape* s, double&) { xs = xs + s->intersect(localRay); },
+                       [&](Intersection hit, double&) { xs.add(hit); });
     return xs;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Group::localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits)
+{
+    intersectChildren(localPacket, hits);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Group::localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits)
+{
+    intersectChildren(localPacket, hits);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t N>
+void Group::intersectChildren(const RayPacket<N>& localPacket, PacketHit<N>& hits)
+{
+    if (children.empty())
+        return;
+    // each box test decides for the whole packet; lanes which miss a box can't hit a child
+    //  in it closer than they already have, so they may ride along with the others
+    accel.update(children);
+    accel.forEachShape(localPacket, hits, [&](Shape* s) { s->intersectPacket(localPacket, hits); });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Group::markChildMoved(Shape& child)
+{
+    accel.markMoved(child);
+    notifyMoved();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 Tuple Group::localNormalAt(Tuple localPoint, Intersection iHit)
 {
@@ -42,4 +77,33 @@ bool Group::includes(Shape* s) const
     return includesShape;
 }
 
-}
\ No newline at end of file
+////////////////////////////////////////////////////////////////////////////////////////////////////
+BoundingBox Group::bounds() const
+{
+    // the BVH keeps the bounds of every child up to date, which saves visiting them all
+    if (accel.isUpToDate())
+        return accel.getBounds();
+    BoundingBox box{};
+    for (const auto c: children)
+        box.add(c->parentSpaceBounds());
+    return box;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Group::setBuildQuality(Accel::BuildQuality quality)
+{
+    accel.setQuality(quality);
+    for (auto c: children)
+        c->setBuildQuality(quality);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Group::contentHash() const
+{
+    uint64_t hash{ Utils::HASH_SEED };
+    for (const auto c: children)
+        hash = Utils::hashValue(c->contentHash(), hash);
+    return hashWithTransform(hash);
+}
+}
@@ -0,0 +1,119 @@
+#include "raytracer/shapes/instance.hpp"
+#include "raytracer/common/macros.hpp"
+
+#include <array>
+#include <vector>
+
+namespace rt
+{
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instance
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Instance::Instance(Shape* geometry)
+:   Shape(),
+    geometry(geometry)
+{
+    ASSERT(geometry != nullptr, "An Instance needs geometry to place.");
+    geometry->instances.push_back(this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Instance::Instance(const Instance& other)
+:   Shape(other),
+    geometry(other.geometry),
+    hasMaterial(other.hasMaterial)
+{
+    geometry->instances.push_back(this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Instance& Instance::operator=(const Instance& other)
+{
+    if (this == &other)
+        return *this;
+    std::erase(geometry->instances, this);
+    Shape::operator=(other);
+    geometry = other.geometry;
+    hasMaterial = other.hasMaterial;
+    geometry->instances.push_back(this);
+    return *this;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Instance::~Instance()
+{
+    std::erase(geometry->instances, this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Intersections Instance::localIntersect(const Ray& localRay)
+{
+    Intersections xs = geometry->intersect(localRay);
+    for (size_t i{}; i < xs.count(); ++i)
+        xs(i).instance = this;
+    return xs;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Instance::localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits)
+{
+    intersectGeometry(localPacket, hits);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Instance::localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits)
+{
+    intersectGeometry(localPacket, hits);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template<size_t N>
+void Instance::intersectGeometry(const RayPacket<N>& localPacket, PacketHit<N>& hits)
+{
+    // a lane's hit is only ever replaced by a closer one, so lanes whose t has changed were
+    //  hit through this Instance
+    std::array<double, N> tBefore{};
+    for (size_t lane{}; lane < N; ++lane)
+        tBefore[lane] = hits.t[lane];
+    geometry->intersectPacket(localPacket, hits);
+    for (size_t lane{}; lane < N; ++lane)
+    {
+        if (hits.t[lane] != tBefore[lane])
+            hits.instance[lane] = this;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+Tuple Instance::localNormalAt(Tuple localPoint, Intersection iHit)
+{
+    // the geometry's shapes see the Instance's object space as the world
+    iHit.instance = nullptr;
+    return iHit.shape->normalAt(localPoint, iHit);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+BoundingBox Instance::bounds() const
+{
+    return geometry->parentSpaceBounds();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Instance::includes(Shape* s) const
+{
+    return this == s || geometry->includes(s);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Instance::setMaterial(Material newMaterial)
+{
+    material = newMaterial;
+    hasMaterial = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Instance::setColour(Colour colour)
+{
+    material.colour = colour;
+    hasMaterial = true;
+}
+}
@@ -14,7 +14,7 @@ Tuple Plane::localNormalAt(Tuple localPoint, Intersection iHit)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections Plane::localIntersect(Ray localRay)
+Intersections Plane::localIntersect(const Ray& localRay)
 {
     Intersections intersections{};
     const auto directionY = localRay.getDirection().y;
@@ -23,7 +23,7 @@ Intersections Plane::localIntersect(Ray localRay)
     if (std::abs(directionY) >= EPSILON)
     {
         // ray is *not* parallel to plane -> one intersection exists
-        const double t = -localRay.getOrigin().y / directionY;
+        const double t = -localRay.getOrigin().y * localRay.getInvDirection().y;
         Intersection i{ t, this };
         intersections.add(i);
     }
@@ -1,5 +1,8 @@
 #include "raytracer/shapes/shape.hpp"
 #include "raytracer/shapes/group.hpp"
+#include "raytracer/shapes/instance.hpp"
+
+#include <cmath>
 
 
 namespace rt
@@ -32,6 +35,41 @@ void Shape::setTransform(TransformationMatrix t)
 {
     transformation = t;
     inverseTransform = t.inverse();
+    notifyMoved();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Shape::notifyMoved()
+{
+    moveCount.fetch_add(1, std::memory_order_release);
+    if (parent != nullptr)
+        parent->markChildMoved(*this);
+    else if (!instances.empty())
+    {
+        // shared geometry is held by nothing but its Instances, whose bounds move with it
+        for (auto* instance: instances)
+            instance->notifyMoved();
+    }
+    else
+        hasMoved = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Shape::contentHash() const
+{
+    const auto box = bounds();
+    return hashWithTransform(Utils::hashValue(box));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Shape::hashWithTransform(uint64_t hash) const
+{
+    for (size_t row{}; row < 4; ++row)
+    {
+        for (size_t col{}; col < 4; ++col)
+            hash = Utils::hashValue(transformation(row, col), hash);
+    }
+    return hash;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -40,15 +78,30 @@ void Shape::setMaterial(Material newMaterial) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Colour Shape::lightPixel(Light lighting, Tuple pWorld, Tuple vEye, Tuple vNormal, bool isShadowed)
+Colour Shape::lightPixel(Light lighting, Tuple pWorld, Tuple vEye, Tuple vNormal, bool isShadowed,
+                         double footprint, Instance* instance)
 {
-    return material.lightPixel(lighting, pWorld, worldToObject(pWorld),
-                               vEye, vNormal, isShadowed);
+    // instanced shapes see the Instance's object space as their world
+    const auto toObject = [&](Tuple p) {
+        return worldToObject(instance != nullptr ? instance->worldToObject(p) : p);
+    };
+    const Material& lit = instance != nullptr ? instance->getMaterialFor(*this) : material;
+    const auto pShape = toObject(pWorld);
+    if (footprint > 0. && lit.hasPattern())
+    {
+        // take the footprint into object space by transforming an offset of the same length
+        const double side = footprint / std::sqrt(3.);
+        footprint = (toObject(pWorld + Vector{ side, side, side }) - pShape).magnitude();
+    }
+    return lit.lightPixel(lighting, pWorld, pShape, vEye, vNormal, isShadowed, footprint);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 Tuple Shape::normalAt(Tuple worldPoint, Intersection iHit)
 {
+    // instanced shapes see the Instance's object space as their world
+    if (iHit.instance != nullptr)
+        worldPoint = iHit.instance->worldToObject(worldPoint);
     const auto localPoint = worldToObject(worldPoint);
     const auto localNormal = localNormalAt(localPoint, iHit);
     Tuple normal{};
@@ -56,6 +109,8 @@ Tuple Shape::normalAt(Tuple worldPoint, Intersection iHit)
         normal = material.getTexture()->applyToNormal(normalToWorld(localNormal), localPoint);
     else
         normal = normalToWorld(localNormal);
+    if (iHit.instance != nullptr)
+        normal = iHit.instance->normalToWorld(normal);
     return normal;
 }
 
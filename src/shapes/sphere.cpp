@@ -12,30 +12,41 @@ Tuple Sphere::localNormalAt(Tuple localPoint, Intersection iHit)
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections Sphere::localIntersect(Ray localRay)
+Intersections Sphere::localIntersect(const Ray& localRay)
 {
     Intersections intersections;
     // we use the sphere-transformed ray's direction and
     //  origin in our calculations
-    const Tuple rayDirection{ localRay.getDirection() };
-    const Tuple rayOrigin{ localRay.getOrigin() };
-    const auto vSphereToRay = rayOrigin - position;
+    const Tuple& rayDirection{ localRay.getDirection() };
+    const auto vSphereToRay = localRay.getOrigin() - position;
     const auto a = Tuple::dot(rayDirection, rayDirection);
     const auto b = 2.0 * Tuple::dot(rayDirection, vSphereToRay);
     const auto c = Tuple::dot(vSphereToRay, vSphereToRay) - 1.0;
     const auto discriminant = b * b - 4.0 * a * c;
-    const auto SQRT_D = std::sqrt(discriminant);
-    const auto TWO_A = a * 2.0;
     if (discriminant >= 0)
     {
-        Intersection i1{ (-b - SQRT_D) / TWO_A, this };
-        Intersection i2{ (-b + SQRT_D) / TWO_A, this };
+        const auto SQRT_D = std::sqrt(discriminant);
+        const auto INV_2A = 0.5 / a;
+        Intersection i1{ (-b - SQRT_D) * INV_2A, this };
+        Intersection i2{ (-b + SQRT_D) * INV_2A, this };
         intersections.add( i1 );
         intersections.add( i2 );
     }
     return intersections;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+void Sphere::localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits)
+{
+    Packet::intersectSphere(position, localPacket, hits, this);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+void Sphere::localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits)
+{
+    Packet::intersectSphere(position, localPacket, hits, this);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 Sphere Sphere::glassySphere()
 {
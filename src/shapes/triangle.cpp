@@ -1,4 +1,5 @@
 #include "raytracer/shapes/triangle.hpp"
+#include "raytracer/accel/triangles.hpp"
 
 namespace rt
 {
@@ -18,41 +19,34 @@ Triangle::Triangle(Tuple p1, Tuple p2, Tuple p3)
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-Intersections Triangle::localIntersect(Ray localRay)
+Intersections Triangle::localIntersect(const Ray& localRay)
 {
-    // ray-triangle intersection algorithm based on
-    // https://www.tandfonline.com/doi/abs/10.1080/10867651.1997.10487468
+    // watertight ray-triangle intersection, from
+    // https://jcgt.org/published/0002/01/05/
+    // so that rays through an edge shared with another triangle can't slip between the two
     Intersections xs{};
-    const auto dirCrossE2 = cross(localRay.getDirection(), e2);
-    const double determinant = Tuple::dot(e1, dirCrossE2);
-
-    if (std::abs(determinant) >= EPSILON)
+    Accel::TriangleHit hit;
+    if (Accel::intersectTriangle(Accel::WatertightRay{ localRay }, p1, p2, p3, -INF, INF, hit))
     {
-        const double f = 1.0 / determinant;
-        auto p1ToOrigin = localRay.getOrigin() - p1;
-        const double u = f * Tuple::dot(p1ToOrigin, dirCrossE2);
-
-        if (u >= 0. && u <= 1.)
-        {
-            auto origCrossE1 = cross(p1ToOrigin, e1);
-            const double v = f * Tuple::dot(localRay.getDirection(), origCrossE1);
-            if (v >= 0 && (u + v) <= 1.)
-            {
-                // we have an intersection. Since it's a triangle, we store the
-                // u and v intersection location, for possible
-                // interpolation with later
-                Intersection x0{
-                    f * Tuple::dot(e2, origCrossE1),
-                    this, u, v
-                };
-                xs.add(x0);
-            }
-        }
+        // u and v are kept for interpolating normals across the face
+        Intersection x0{ hit.t, this, hit.u, hit.v };
+        xs.add(x0);
     }
-    // if we've reached this point, there is no intersection
     return xs;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Triangle::localIntersectPacket(const RayPacket<4>& localPacket, PacketHit<4>& hits)
+{
+    Packet::intersectTriangle(p1, p2, p3, localPacket, hits, this);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void Triangle::localIntersectPacket(const RayPacket<8>& localPacket, PacketHit<8>& hits)
+{
+    Packet::intersectTriangle(p1, p2, p3, localPacket, hits, this);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 Tuple Triangle::localNormalAt(Tuple localPoint, Intersection iHit)
 {
@@ -61,6 +55,38 @@ Tuple Triangle::localNormalAt(Tuple localPoint, Intersection iHit)
     return normal;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+BoundingBox Triangle::bounds() const
+{
+    BoundingBox box{};
+    box.add(p1);
+    box.add(p2);
+    box.add(p3);
+    return box;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+BoundingBox Triangle::parentSpaceBoundsWithin(const BoundingBox& box) const
+{
+    return BoundingBox::ofTriangleWithin(transformation * p1, transformation * p2, transformation * p3, box);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Triangle::getParentSpaceCorners(Tuple (&corners)[3]) const
+{
+    corners[0] = transformation * p1;
+    corners[1] = transformation * p2;
+    corners[2] = transformation * p3;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Triangle::contentHash() const
+{
+    const Tuple points[3]{ p1, p2, p3 };
+    return hashWithTransform(Utils::hashValue(points));
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // SmoothTriangle
@@ -0,0 +1,154 @@
+#include "gtest/gtest.h"
+#include "raytracer/math/bounds.hpp"
+#include "raytracer/shapes/sphere.hpp"
+#include "raytracer/shapes/plane.hpp"
+#include "raytracer/shapes/cube.hpp"
+#include "raytracer/shapes/cylinder.hpp"
+#include "raytracer/shapes/triangle.hpp"
+#include "raytracer/shapes/group.hpp"
+
+using namespace rt;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// BoundingBox
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(BoundingBoxBasics, DefaultBoxIsEmpty)
+{
+    BoundingBox box{};
+    EXPECT_TRUE(box.isEmpty());
+    EXPECT_FALSE(box.contains(Point{ 0, 0, 0 }));
+}
+
+TEST(BoundingBoxBasics, AddingPointsGrowsBox)
+{
+    BoundingBox box{};
+    box.add(Point{ -5, 2, 0 });
+    box.add(Point{ 7, 0, -3 });
+    EXPECT_FALSE(box.isEmpty());
+    EXPECT_EQ(box.min, Point(-5, 0, -3));
+    EXPECT_EQ(box.max, Point(7, 2, 0));
+    EXPECT_TRUE(box.contains(Point{ 1, 1, -1 }));
+    EXPECT_FALSE(box.contains(Point{ 1, 3, -1 }));
+}
+
+TEST(BoundingBoxBasics, AddingBoxesGrowsBox)
+{
+    BoundingBox a{ Point{ -5, -2, 0 }, Point{ 7, 4, 4 } };
+    const BoundingBox b{ Point{ 8, -7, -2 }, Point{ 14, 2, 8 } };
+    a.add(b);
+    EXPECT_EQ(a.min, Point(-5, -7, -2));
+    EXPECT_EQ(a.max, Point(14, 4, 8));
+    EXPECT_TRUE(a.contains(b));
+}
+
+TEST(BoundingBoxBasics, TransformedBoxBoundsTheResult)
+{
+    const BoundingBox box{ Point{ -1, -1, -1 }, Point{ 1, 1, 1 } };
+    const auto M = Transform::rotateX(QUARTER_PI) * Transform::rotateY(QUARTER_PI);
+    const auto out = box.transform(M);
+    EXPECT_EQ(out.min, Point(-1.41421, -1.70711, -1.70711));
+    EXPECT_EQ(out.max, Point(1.41421, 1.70711, 1.70711));
+}
+
+TEST(BoundingBoxBasics, OverlapIsSharedByBothBoxes)
+{
+    const BoundingBox a{ Point{ -1, -1, -1 }, Point{ 2, 2, 2 } };
+    const BoundingBox b{ Point{ 1, 0, -3 }, Point{ 4, 1, 0 } };
+    const auto shared = a.overlap(b);
+    EXPECT_EQ(shared.min, Point(1, 0, -1));
+    EXPECT_EQ(shared.max, Point(2, 1, 0));
+    EXPECT_TRUE(a.overlap(BoundingBox{ Point{ 3, 3, 3 }, Point{ 4, 4, 4 } }).isEmpty());
+}
+
+TEST(BoundingBoxBasics, TriangleClippedToBoxIsBoundedTightly)
+{
+    // a long triangle along the x axis, cut by a box around its middle
+    const Point p1{ -10, 0, 0 }, p2{ 10, 0, 0 }, p3{ -10, 2, 0 };
+    const BoundingBox box{ Point{ -1, -1, -1 }, Point{ 1, 5, 1 } };
+    const auto clipped = BoundingBox::ofTriangleWithin(p1, p2, p3, box);
+    EXPECT_EQ(clipped.min, Point(-1, 0, 0));
+    EXPECT_EQ(clipped.max, Point(1, 1.1, 0));
+    // whole triangles inside the box are bounded as usual, and missed boxes are empty
+    const BoundingBox all{ Point{ -20, -20, -20 }, Point{ 20, 20, 20 } };
+    EXPECT_EQ(BoundingBox::ofTriangleWithin(p1, p2, p3, all).max, Point(10, 2, 0));
+    const BoundingBox above{ Point{ 5, 5, -1 }, Point{ 6, 6, 1 } };
+    EXPECT_TRUE(BoundingBox::ofTriangleWithin(p1, p2, p3, above).isEmpty());
+}
+
+TEST(BoundingBoxBasics, TransformingInfiniteBoxStaysValid)
+{
+    const BoundingBox box{ Point{ -INF, 0, -INF }, Point{ INF, 0, INF } };
+    const auto out = box.transform(Transform::translation(0., 2., 0.));
+    EXPECT_EQ(out.min.y, 2.);
+    EXPECT_EQ(out.max.y, 2.);
+    EXPECT_EQ(out.min.x, -INF);
+    EXPECT_FALSE(out.isFinite());
+}
+
+TEST(BoundingBoxes, RaySlabTest)
+{
+    const BoundingBox box{ Point{ -1, -1, -1 }, Point{ 1, 1, 1 } };
+    EXPECT_TRUE(box.intersects(Ray{ Point{ 0, 0, -5 }, Vector{ 0, 0, 1 } }));
+    EXPECT_TRUE(box.intersects(Ray{ Point{ 5, 0.5, 0 }, Vector{ -1, 0, 0 } }));
+    EXPECT_FALSE(box.intersects(Ray{ Point{ 0, 2, -5 }, Vector{ 0, 0, 1 } }));
+    EXPECT_FALSE(box.intersects(Ray{ Point{ -2, 0, -2 }, Vector{ 2, 4, 6 } }));
+    // a ray starting inside the box always hits it
+    EXPECT_TRUE(box.intersects(Ray{ Point{ 0, 0, 0 }, Vector{ 0.3, -0.2, 0.9 } }));
+    // a ray lying in one of the slab planes
+    EXPECT_TRUE(box.intersects(Ray{ Point{ 1, 0, -5 }, Vector{ 0, 0, 1 } }));
+}
+
+TEST(BoundingBoxes, RaySlabTestRespectsRange)
+{
+    const BoundingBox box{ Point{ -1, -1, -1 }, Point{ 1, 1, 1 } };
+    // behind the ray's origin
+    EXPECT_FALSE(box.intersects(Ray{ Point{ 0, 0, 5 }, Vector{ 0, 0, 1 } }));
+    // beyond the end of the ray's range, ie: past a light
+    Ray r{ Point{ 0, 0, -5 }, Vector{ 0, 0, 1 } };
+    r.setRange(0., 3.);
+    EXPECT_FALSE(box.intersects(r));
+    r.setRange(0., 4.5);
+    EXPECT_TRUE(box.intersects(r));
+}
+
+TEST(BoundingBoxes, RaySlabTestAgainstInfiniteBox)
+{
+    EXPECT_TRUE(BoundingBox::infinite().intersects(Ray{ Point{ 3, 4, 5 }, Vector{ 0, 1, 0 } }));
+    const auto plane = Plane{}.bounds();
+    EXPECT_TRUE(plane.intersects(Ray{ Point{ 0, 1, 0 }, Vector{ 0.5, -1, 0 } }));
+    EXPECT_FALSE(plane.intersects(Ray{ Point{ 0, 1, 0 }, Vector{ 0.5, 1, 0 } }));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shape bounds
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(ShapeBounds, PrimitivesHaveObjectSpaceBounds)
+{
+    EXPECT_EQ(Sphere{}.bounds().max, Point(1, 1, 1));
+    EXPECT_EQ(Cube{}.bounds().min, Point(-1, -1, -1));
+    const auto plane = Plane{}.bounds();
+    EXPECT_EQ(plane.min.y, 0.);
+    EXPECT_EQ(plane.max.x, INF);
+    Cylinder cyl{};
+    cyl.setHeight(3., -2.);
+    EXPECT_EQ(cyl.bounds().min, Point(-1, -2, -1));
+    EXPECT_EQ(cyl.bounds().max, Point(1, 3, 1));
+    const Triangle tri{ Point{ -3, 7, 2 }, Point{ 6, 2, -4 }, Point{ 2, -1, -1 } };
+    EXPECT_EQ(tri.bounds().min, Point(-3, -1, -4));
+    EXPECT_EQ(tri.bounds().max, Point(6, 7, 2));
+}
+
+TEST(ShapeBounds, GroupBoundsIncludeTransformedChildren)
+{
+    Sphere s{};
+    s.setTransform(Transform::translation(2., 5., -3.) * Transform::scale(2., 2., 2.));
+    Cylinder c{};
+    c.setHeight(2., -2.);
+    c.setTransform(Transform::translation(-4., -1., 4.) * Transform::scale(0.5, 1., 0.5));
+    Group g{};
+    g.addChild(&s);
+    g.addChild(&c);
+    const auto box = g.bounds();
+    EXPECT_EQ(box.min, Point(-4.5, -3, -5));
+    EXPECT_EQ(box.max, Point(4, 7, 4.5));
+}
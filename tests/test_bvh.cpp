@@ -0,0 +1,833 @@
+#include "gtest/gtest.h"
+#include "raytracer/accel/bvh.hpp"
+#include "raytracer/accel/morton.hpp"
+#include "raytracer/accel/shape_bvh.hpp"
+#include "raytracer/environment/world.hpp"
+#include "raytracer/shapes/sphere.hpp"
+#include "raytracer/shapes/plane.hpp"
+#include "raytracer/shapes/group.hpp"
+#include "raytracer/shapes/triangle.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace rt;
+using namespace rt::Accel;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BVH building and traversal
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class BVHTraversal: public ::testing::Test
+{
+  protected:
+    std::mt19937 rng{ 1234 };
+    std::vector<BoundingBox> boxes;
+    std::vector<Ray> rays;
+
+    void SetUp() override {
+        std::uniform_real_distribution<double> position{ -10., 10. };
+        std::uniform_real_distribution<double> size{ 0.05, 1. };
+        for (size_t i{}; i < 500; ++i)
+        {
+            const Point p{ position(rng), position(rng), position(rng) };
+            boxes.emplace_back(p, p + Vector{ size(rng), size(rng), size(rng) });
+        }
+        for (size_t i{}; i < 200; ++i)
+        {
+            const Point from{ position(rng), position(rng), -20. };
+            const Point to{ position(rng), position(rng), 20. };
+            rays.emplace_back(from, (to - from).normalize());
+        }
+        // rays parallel to the axes, one of them lying exactly in the plane of a box's face
+        rays.emplace_back(Point{ -20., 0.5, 0.5 }, Vector{ 1., 0., 0. });
+        rays.emplace_back(Point{ boxes[0].min.x, boxes[0].min.y + 0.01, -20. }, Vector{ 0., 0., 1. });
+    }
+
+    /// @brief Every box a ray passes through, found by testing them all.
+    std::set<uint32_t> bruteForce(const Ray& ray) const
+    {
+        std::set<uint32_t> hit;
+        for (uint32_t i{}; i < boxes.size(); ++i)
+            if (boxes[i].intersects(ray))
+                hit.insert(i);
+        return hit;
+    }
+
+    /// @brief Distance along a ray to where it enters a box, which stands in for a primitive's hit.
+    static double entryDistance(const BoundingBox& box, const Ray& ray)
+    {
+        double tEnter{ 0. };
+        for (size_t axis{}; axis < 3; ++axis)
+        {
+            const double t0 = (box.min(axis) - ray.getOrigin()(axis)) * ray.getInvDirection()(axis);
+            const double t1 = (box.max(axis) - ray.getOrigin()(axis)) * ray.getInvDirection()(axis);
+            if (!std::isnan(t0) && !std::isnan(t1))
+                tEnter = std::max(tEnter, std::min(t0, t1));
+        }
+        return tEnter;
+    }
+
+    /// @brief Expect every primitive to be in one leaf, inside the bounds of the leaf and each of its
+    /// ancestors, and no leaf to be too full or too deep.
+    void expectValidTree(const BinaryBVH& bvh, std::span<const BoundingBox> primitives)
+    {
+        const auto& nodes = bvh.getNodes();
+        auto indices = bvh.getPrimitiveIndices();
+        std::sort(indices.begin(), indices.end());
+        for (uint32_t i{}; i < primitives.size(); ++i)
+            ASSERT_EQ(indices[i], i);
+        size_t nInLeaves{};
+        std::vector<std::pair<uint32_t, size_t>> stack{ { 0, 0 } };
+        while (!stack.empty())
+        {
+            const auto [index, depth] = stack.back();
+            stack.pop_back();
+            const auto& node = nodes[index];
+            EXPECT_LE(depth, BinaryBVH::MAX_DEPTH);
+            if (node.isLeaf())
+            {
+                EXPECT_LE(node.count, BinaryBVH::MAX_LEAF_SIZE);
+                nInLeaves += node.count;
+                for (uint32_t i{ node.offset }; i < node.offset + node.count; ++i)
+                    EXPECT_TRUE(node.bounds.contains(primitives[bvh.getPrimitiveIndices()[i]]));
+                continue;
+            }
+            EXPECT_TRUE(node.bounds.contains(nodes[index + 1].bounds));
+            EXPECT_TRUE(node.bounds.contains(nodes[node.offset].bounds));
+            stack.push_back({ index + 1, depth + 1 });
+            stack.push_back({ node.offset, depth + 1 });
+        }
+        EXPECT_EQ(nInLeaves, primitives.size());
+    }
+
+    /// @brief Expect a traversal to visit every box that the ray passes through.
+    template<typename Tree>
+    void expectVisitsEveryHitBox(const Tree& tree)
+    {
+        for (const auto& ray: rays)
+        {
+            std::set<uint32_t> visited;
+            tree.traverse(ray, [&](uint32_t i, double&) {
+                EXPECT_TRUE(visited.insert(i).second) << "primitive visited twice";
+            });
+            for (auto i: bruteForce(ray))
+                EXPECT_TRUE(visited.contains(i));
+        }
+    }
+};
+
+TEST_F(BVHTraversal, BuildKeepsEveryPrimitiveOnce)
+{
+    BinaryBVH bvh{};
+    bvh.build(boxes);
+    auto indices = bvh.getPrimitiveIndices();
+    std::sort(indices.begin(), indices.end());
+    for (uint32_t i{}; i < boxes.size(); ++i)
+        EXPECT_EQ(indices[i], i);
+    size_t nInLeaves{};
+    for (const auto& node: bvh.getNodes())
+    {
+        if (node.isLeaf())
+        {
+            EXPECT_LE(node.count, BinaryBVH::MAX_LEAF_SIZE);
+            nInLeaves += node.count;
+            for (uint32_t i{ node.offset }; i < node.offset + node.count; ++i)
+                EXPECT_TRUE(node.bounds.contains(boxes[bvh.getPrimitiveIndices()[i]]));
+        }
+    }
+    EXPECT_EQ(nInLeaves, boxes.size());
+    EXPECT_TRUE(bvh.getBounds().contains(boxes[42]));
+}
+
+TEST_F(BVHTraversal, InnerNodesBoundTheirChildren)
+{
+    BinaryBVH bvh{};
+    bvh.build(boxes);
+    const auto& nodes = bvh.getNodes();
+    for (uint32_t i{}; i < nodes.size(); ++i)
+    {
+        if (nodes[i].isLeaf())
+            continue;
+        EXPECT_TRUE(nodes[i].bounds.contains(nodes[i + 1].bounds));
+        EXPECT_TRUE(nodes[i].bounds.contains(nodes[nodes[i].offset].bounds));
+    }
+}
+
+TEST_F(BVHTraversal, SAHCostIsLowerThanTestingEveryPrimitive)
+{
+    BinaryBVH bvh{};
+    bvh.build(boxes);
+    EXPECT_GT(bvh.getSAHCost(), 0.);
+    EXPECT_LT(bvh.getSAHCost(), static_cast<double>(boxes.size()) / 4.);
+}
+
+TEST_F(BVHTraversal, BinaryTreeVisitsEveryHitBox)
+{
+    BinaryBVH bvh{};
+    bvh.build(boxes);
+    expectVisitsEveryHitBox(bvh);
+}
+
+TEST_F(BVHTraversal, FourWideTreeVisitsEveryHitBox)
+{
+    BinaryBVH binary{};
+    binary.build(boxes);
+    WideBVH<4> bvh{};
+    bvh.build(binary);
+    EXPECT_LT(bvh.getNodes().size(), binary.getNodes().size() / 2);
+    expectVisitsEveryHitBox(bvh);
+}
+
+TEST_F(BVHTraversal, EightWideTreeVisitsEveryHitBox)
+{
+    BinaryBVH binary{};
+    binary.build(boxes);
+    WideBVH<8> bvh{};
+    bvh.build(binary);
+    EXPECT_LT(bvh.getNodes().size(), binary.getNodes().size() / 4);
+    expectVisitsEveryHitBox(bvh);
+}
+
+TEST_F(BVHTraversal, ShrinkingTheFarLimitFindsTheClosestBox)
+{
+    for (auto width: { NodeWidth::four, NodeWidth::eight })
+    {
+        BVH bvh{ width };
+        bvh.build(boxes);
+        for (const auto& ray: rays)
+        {
+            double closest{ INF };
+            bvh.traverse(ray, [&](uint32_t i, double& tFar) {
+                if (!boxes[i].intersects(ray, tFar))
+                    return;
+                closest = std::min(closest, entryDistance(boxes[i], ray));
+                tFar = std::min(tFar, closest);
+            });
+            double expected{ INF };
+            for (auto i: bruteForce(ray))
+                expected = std::min(expected, entryDistance(boxes[i], ray));
+            EXPECT_DOUBLE_EQ(closest, expected);
+        }
+    }
+}
+
+TEST_F(BVHTraversal, CoincidentPrimitivesStillSplit)
+{
+    const std::vector<BoundingBox> same(100, BoundingBox{ Point{ 0., 0., 0. }, Point{ 1., 1., 1. } });
+    BVH bvh{};
+    bvh.build(same);
+    size_t nVisited{};
+    bvh.traverse(Ray{ Point{ 0.5, 0.5, -5. }, Vector{ 0., 0., 1. } }, [&](uint32_t, double&) { ++nVisited; });
+    EXPECT_EQ(nVisited, 100u);
+    expectValidTree(bvh.getBinary(), same);
+}
+
+TEST_F(BVHTraversal, EmptyTreeVisitsNothing)
+{
+    BVH bvh{};
+    bvh.build({});
+    bool visited{ false };
+    bvh.traverse(rays[0], [&](uint32_t, double&) { visited = true; });
+    EXPECT_FALSE(visited);
+    EXPECT_TRUE(bvh.isEmpty());
+}
+
+TEST_F(BVHTraversal, NodeWidthMatchesCPU)
+{
+    const auto width = detectNodeWidth();
+    EXPECT_TRUE(width == NodeWidth::four || width == NodeWidth::eight);
+    EXPECT_EQ(BVH{}.getWidth(), width);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Linear BVH builds
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_F(BVHTraversal, MortonCodesInterleaveBits)
+{
+    const auto interleave = [](uint64_t x, uint64_t y, uint64_t z, size_t bitsPerAxis) {
+        uint64_t code{};
+        for (size_t i{}; i < bitsPerAxis; ++i)
+        {
+            code |= ((x >> i) & 1) << (3 * i + 2);
+            code |= ((y >> i) & 1) << (3 * i + 1);
+            code |= ((z >> i) & 1) << (3 * i);
+        }
+        return code;
+    };
+    std::uniform_int_distribution<uint32_t> cell{ 0, (1u << 21) - 1 };
+    for (size_t i{}; i < 100; ++i)
+    {
+        const uint32_t x{ cell(rng) }, y{ cell(rng) }, z{ cell(rng) };
+        EXPECT_EQ(Morton::encode63(x, y, z), interleave(x, y, z, 21));
+        EXPECT_EQ(Morton::encode30(x & 0x3FF, y & 0x3FF, z & 0x3FF), interleave(x & 0x3FF, y & 0x3FF, z & 0x3FF, 10));
+    }
+    EXPECT_EQ(Morton::encode30(1023, 1023, 1023), (1u << 30) - 1);
+    EXPECT_EQ(Morton::axisOfBit(62), 0);
+    EXPECT_EQ(Morton::axisOfBit(28), 1);
+    EXPECT_EQ(Morton::axisOfBit(0), 2);
+}
+
+TEST_F(BVHTraversal, RadixSortIsStable)
+{
+    std::uniform_int_distribution<uint64_t> code{ 0, (uint64_t{ 1 } << 63) - 1 };
+    for (size_t nThreads: { 1, 4 })
+    {
+        std::vector<Morton::Key<uint64_t>> keys(100'000);
+        for (uint32_t i{}; i < keys.size(); ++i)
+            // few distinct high bits, so that many keys are equal and the low digits are skipped
+            keys[i] = { (code(rng) >> 48) << 40, i };
+        auto expected = keys;
+        std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.code < b.code; });
+        Morton::radixSort(keys, 63, nThreads);
+        for (size_t i{}; i < keys.size(); ++i)
+        {
+            ASSERT_EQ(keys[i].code, expected[i].code);
+            ASSERT_EQ(keys[i].primitive, expected[i].primitive);
+        }
+    }
+}
+
+TEST_F(BVHTraversal, LinearBuildKeepsEveryPrimitiveOnce)
+{
+    for (auto bits: { MortonBits::thirty, MortonBits::sixtyThree })
+    {
+        for (bool refineTop: { false, true })
+        {
+            BinaryBVH bvh{};
+            bvh.buildLinear(boxes, { bits, refineTop, 0 });
+            expectValidTree(bvh, boxes);
+            EXPECT_TRUE(bvh.getBounds().contains(boxes[42]));
+        }
+    }
+}
+
+TEST_F(BVHTraversal, LinearTreesVisitEveryHitBox)
+{
+    for (bool refineTop: { false, true })
+    {
+        BinaryBVH binary{};
+        binary.buildLinear(boxes, { MortonBits::thirty, refineTop, 0 });
+        expectVisitsEveryHitBox(binary);
+        WideBVH<4> wide4{};
+        wide4.build(binary);
+        expectVisitsEveryHitBox(wide4);
+        WideBVH<8> wide8{};
+        wide8.build(binary);
+        expectVisitsEveryHitBox(wide8);
+    }
+    BVH bvh{};
+    bvh.build(boxes, BuildMethod::linear);
+    expectVisitsEveryHitBox(bvh);
+}
+
+TEST_F(BVHTraversal, LinearBuildOfCoincidentPrimitivesIsShallow)
+{
+    const std::vector<BoundingBox> same(1000, BoundingBox{ Point{ 0., 0., 0. }, Point{ 1., 1., 1. } });
+    BinaryBVH bvh{};
+    bvh.buildLinear(same);
+    expectValidTree(bvh, same);
+}
+
+TEST_F(BVHTraversal, ParallelLinearBuildMatchesOneThread)
+{
+    // enough primitives to split the build between threads, and treelets between the top levels
+    std::uniform_real_distribution<double> position{ -100., 100. };
+    std::vector<BoundingBox> many;
+    for (size_t i{}; i < 100'000; ++i)
+    {
+        const Point p{ position(rng), position(rng), position(rng) };
+        many.emplace_back(p, p + Vector{ 0.5, 0.5, 0.5 });
+    }
+    BinaryBVH serial{}, parallel{};
+    serial.buildLinear(many, { MortonBits::sixtyThree, true, 1 });
+    parallel.buildLinear(many, { MortonBits::sixtyThree, true, 4 });
+    expectValidTree(parallel, many);
+    ASSERT_EQ(parallel.getNodes().size(), serial.getNodes().size());
+    EXPECT_EQ(parallel.getPrimitiveIndices(), serial.getPrimitiveIndices());
+    for (size_t i{}; i < serial.getNodes().size(); ++i)
+    {
+        EXPECT_EQ(parallel.getNodes()[i].offset, serial.getNodes()[i].offset);
+        EXPECT_EQ(parallel.getNodes()[i].count, serial.getNodes()[i].count);
+    }
+    // the SAH top makes up most of the gap to a full SAH build
+    BinaryBVH unrefined{}, sah{};
+    unrefined.buildLinear(many, { MortonBits::sixtyThree, false, 4 });
+    sah.build(many);
+    EXPECT_LE(parallel.getSAHCost(), unrefined.getSAHCost());
+    EXPECT_LT(parallel.getSAHCost(), 1.5 * sah.getSAHCost());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Refitting
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST_F(BVHTraversal, RefitTreesVisitEveryHitBox)
+{
+    BinaryBVH binary{};
+    binary.build(boxes);
+    WideBVH<4> wide4{};
+    wide4.build(binary);
+    WideBVH<8> wide8{};
+    wide8.build(binary);
+    std::vector<uint32_t> moved;
+    for (uint32_t i{}; i < boxes.size(); i += 7)
+    {
+        boxes[i] = boxes[i].transform(Transform::translation(0.5, -1., 2.));
+        moved.push_back(i);
+    }
+    const auto& refitted = binary.refit(boxes, moved);
+    EXPECT_LT(refitted.size(), binary.getNodes().size());
+    wide4.refit(binary, refitted);
+    wide8.refit(binary, refitted);
+    expectValidTree(binary, boxes);
+    expectVisitsEveryHitBox(binary);
+    expectVisitsEveryHitBox(wide4);
+    expectVisitsEveryHitBox(wide8);
+}
+
+TEST_F(BVHTraversal, RefitTracksSAHCost)
+{
+    BinaryBVH bvh{};
+    bvh.build(boxes);
+    for (uint32_t i{}; i < boxes.size(); i += 2)
+        boxes[i] = boxes[i].transform(Transform::translation(0., 0., 30.));
+    std::vector<uint32_t> moved(boxes.size() / 2);
+    for (uint32_t i{}; i < moved.size(); ++i)
+        moved[i] = 2 * i;
+    bvh.refit(boxes, moved);
+    double expected{};
+    for (const auto& node: bvh.getNodes())
+        expected += node.bounds.surfaceArea() / bvh.getBounds().surfaceArea()
+                    * (node.isLeaf() ? node.count * BinaryBVH::INTERSECTION_COST : BinaryBVH::TRAVERSAL_COST);
+    EXPECT_NEAR(bvh.getSAHCost(), expected, 1e-9 * expected);
+}
+
+TEST_F(BVHTraversal, ParallelRefitMatchesOneThread)
+{
+    std::uniform_real_distribution<double> position{ -100., 100. };
+    std::vector<BoundingBox> many;
+    for (size_t i{}; i < 200'000; ++i)
+    {
+        const Point p{ position(rng), position(rng), position(rng) };
+        many.emplace_back(p, p + Vector{ 0.5, 0.5, 0.5 });
+    }
+    BinaryBVH serial{};
+    serial.buildLinear(many);
+    BinaryBVH parallel{ serial };
+    std::vector<uint32_t> moved;
+    for (uint32_t i{}; i < many.size(); i += 3)
+    {
+        many[i] = many[i].transform(Transform::translation(1., 0., -1.));
+        moved.push_back(i);
+    }
+    serial.refit(many, moved, 1);
+    parallel.refit(many, moved, 4);
+    expectValidTree(parallel, many);
+    for (size_t i{}; i < serial.getNodes().size(); ++i)
+    {
+        EXPECT_EQ(parallel.getNodes()[i].bounds.min, serial.getNodes()[i].bounds.min);
+        EXPECT_EQ(parallel.getNodes()[i].bounds.max, serial.getNodes()[i].bounds.max);
+    }
+    EXPECT_NEAR(parallel.getSAHCost(), serial.getSAHCost(), 1e-9 * serial.getSAHCost());
+}
+
+TEST_F(BVHTraversal, DegradedTreesAreRebuilt)
+{
+    BVH bvh{};
+    bvh.build(boxes);
+    // a small move keeps the tree much as good as it was
+    boxes[3] = boxes[3].transform(Transform::translation(0.1, 0., 0.));
+    EXPECT_FALSE(bvh.refit(boxes, std::vector<uint32_t>{ 3 }));
+    EXPECT_LT(bvh.getSAHCostGrowth(), 1.01);
+    // scattering half of the boxes leaves their old nodes spanning the whole scene
+    std::uniform_real_distribution<double> position{ -500., 500. };
+    std::vector<uint32_t> moved;
+    for (uint32_t i{}; i < boxes.size(); i += 2)
+    {
+        boxes[i] = boxes[i].transform(Transform::translation(position(rng), position(rng), position(rng)));
+        moved.push_back(i);
+    }
+    EXPECT_TRUE(bvh.refit(boxes, moved));
+    EXPECT_DOUBLE_EQ(bvh.getSAHCostGrowth(), 1.);
+    expectVisitsEveryHitBox(bvh);
+}
+
+
+TEST_F(BVHTraversal, SavedTreesLoadAsTheyWereBuilt)
+{
+    const auto file = std::filesystem::temp_directory_path() / "rt_test_saved_tree.bvh";
+    BVH built{};
+    built.build(boxes);
+    ASSERT_TRUE(built.save(file, 42));
+    BVH loaded{};
+    ASSERT_TRUE(loaded.load(file, 42));
+    EXPECT_EQ(loaded.getBinary().getPrimitiveIndices(), built.getBinary().getPrimitiveIndices());
+    EXPECT_EQ(loaded.getBinary().getNodes().size(), built.getBinary().getNodes().size());
+    EXPECT_DOUBLE_EQ(loaded.getBinary().getSAHCost(), built.getBinary().getSAHCost());
+    expectVisitsEveryHitBox(loaded);
+    // loaded trees refit like built ones
+    boxes[3] = boxes[3].transform(Transform::translation(0.1, 0., 0.));
+    EXPECT_FALSE(loaded.refit(boxes, std::vector<uint32_t>{ 3 }));
+    expectVisitsEveryHitBox(loaded);
+    std::filesystem::remove(file);
+}
+
+TEST_F(BVHTraversal, MismatchedCachesAreNotLoaded)
+{
+    const auto file = std::filesystem::temp_directory_path() / "rt_test_mismatched_tree.bvh";
+    BVH built{};
+    built.build(boxes);
+    ASSERT_TRUE(built.save(file, 42));
+    BVH other{};
+    other.build(std::span{ boxes }.first(10));
+    // trees are left as they were when the load fails
+    EXPECT_FALSE(other.load(file, 43));
+    EXPECT_FALSE(other.load(std::filesystem::temp_directory_path() / "rt_test_missing_tree.bvh", 42));
+    BVH otherWidth{ built.getWidth() == NodeWidth::eight ? NodeWidth::four : NodeWidth::eight };
+    EXPECT_FALSE(otherWidth.load(file, 42));
+    std::filesystem::resize_file(file, std::filesystem::file_size(file) - 4);
+    EXPECT_FALSE(other.load(file, 42));
+    EXPECT_EQ(other.getBinary().getPrimitiveIndices().size(), 10u);
+    std::filesystem::remove(file);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Spatial split BVHs
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class SpatialBVHs: public BVHTraversal
+{
+  protected:
+    std::vector<std::unique_ptr<Triangle>> triangles;
+
+    void SetUp() override {
+        BVHTraversal::SetUp();
+        // long, thin triangles lying across the scene, so their boxes are mostly empty and overlap
+        std::uniform_real_distribution<double> position{ -10., 10. };
+        std::uniform_real_distribution<double> offset{ -0.2, 0.2 };
+        boxes.clear();
+        for (size_t i{}; i < 300; ++i)
+        {
+            const Point from{ position(rng), position(rng), position(rng) };
+            const Point to{ position(rng), position(rng), position(rng) };
+            const auto side = from + Vector{ offset(rng), offset(rng), offset(rng) };
+            triangles.push_back(std::make_unique<Triangle>(from, to, side));
+            boxes.push_back(triangles.back()->parentSpaceBounds());
+        }
+    }
+
+    ClipPrimitive clip() const
+    {
+        return [this](uint32_t i, const BoundingBox& box) { return triangles[i]->parentSpaceBoundsWithin(box); };
+    }
+};
+
+TEST_F(SpatialBVHs, SplitTrianglesAreBoundedByTheirLeaves)
+{
+    BinaryBVH bvh{};
+    const SpatialBuildSettings settings{};
+    bvh.buildSpatial(boxes, clip(), settings);
+    EXPECT_TRUE(bvh.hasDuplicates());
+    const auto& indices = bvh.getPrimitiveIndices();
+    EXPECT_LE(indices.size(), static_cast<size_t>(boxes.size() * (1. + settings.duplicationBudget)) + 1);
+    // each triangle is cut up between leaves, which together still bound all of it
+    std::vector<BoundingBox> leafBounds(boxes.size());
+    const auto& nodes = bvh.getNodes();
+    for (uint32_t i{}; i < nodes.size(); ++i)
+    {
+        const auto& node = nodes[i];
+        if (!node.isLeaf())
+        {
+            EXPECT_TRUE(node.bounds.contains(nodes[i + 1].bounds));
+            EXPECT_TRUE(node.bounds.contains(nodes[node.offset].bounds));
+            continue;
+        }
+        EXPECT_LE(node.count, BinaryBVH::MAX_LEAF_SIZE);
+        for (uint32_t j{ node.offset }; j < node.offset + node.count; ++j)
+            leafBounds[indices[j]].add(node.bounds.overlap(boxes[indices[j]]));
+    }
+    for (size_t i{}; i < boxes.size(); ++i)
+    {
+        EXPECT_EQ(leafBounds[i].min, boxes[i].min) << i;
+        EXPECT_EQ(leafBounds[i].max, boxes[i].max) << i;
+    }
+}
+
+TEST_F(SpatialBVHs, SpatialSplitsLowerTheSAHCost)
+{
+    BinaryBVH sah{}, spatial{};
+    sah.build(boxes);
+    spatial.buildSpatial(boxes, clip());
+    EXPECT_LT(spatial.getSAHCost(), sah.getSAHCost());
+}
+
+TEST_F(SpatialBVHs, NoBudgetMeansNoDuplicates)
+{
+    BinaryBVH bvh{};
+    bvh.buildSpatial(boxes, clip(), { .duplicationBudget = 0. });
+    EXPECT_FALSE(bvh.hasDuplicates());
+    expectValidTree(bvh, boxes);
+}
+
+TEST_F(SpatialBVHs, TreesVisitEveryHitTriangle)
+{
+    BVH bvh{};
+    bvh.build(boxes, clip());
+    EXPECT_EQ(bvh.getMethod(), BuildMethod::spatial);
+    for (const auto& ray: rays)
+    {
+        std::set<uint32_t> visited;
+        bvh.traverse(ray, [&](uint32_t i, double&) { visited.insert(i); });
+        for (uint32_t i{}; i < triangles.size(); ++i)
+        {
+            if (triangles[i]->intersect(ray).count() > 0)
+            {
+                EXPECT_TRUE(visited.contains(i)) << i;
+            }
+        }
+    }
+}
+
+TEST_F(SpatialBVHs, HighQualityShapeTreesMatchFastOnes)
+{
+    Group fast{}, high{};
+    for (auto& t: triangles)
+    {
+        fast.addChild(t.get());
+        high.addChild(t.get());
+    }
+    high.setBuildQuality(BuildQuality::high);
+    for (const auto& ray: rays)
+    {
+        // split triangles are still only hit once
+        const auto expected = fast.intersect(ray);
+        const auto xs = high.intersect(ray);
+        ASSERT_EQ(xs.count(), expected.count());
+        for (size_t i{}; i < xs.count(); ++i)
+        {
+            EXPECT_DOUBLE_EQ(xs(i).t, expected(i).t);
+            EXPECT_EQ(xs(i).shape, expected(i).shape);
+        }
+    }
+}
+
+TEST_F(SpatialBVHs, HighQualityShapeTreesAreRebuiltWhenShapesMove)
+{
+    World w{};
+    for (auto& t: triangles)
+        w.addShape(t.get());
+    w.setBuildQuality(BuildQuality::high);
+    const Ray ray{ Point{ 50., 50., -50. }, Vector{ 0., 0., 1. } };
+    EXPECT_FALSE(w.getHitForRay(ray).isHit());
+    // move the triangle so that the ray passes through its centroid
+    auto& t = *triangles[7];
+    const auto centroid = (t.getP1() + t.getP2() + t.getP3()) / 3.;
+    t.setTransform(Transform::translation(50. - centroid.x, 50. - centroid.y, 0.));
+    EXPECT_TRUE(w.getHitForRay(ray).isHit());
+    EXPECT_EQ(w.getHitForRay(ray).shape, triangles[7].get());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Shape BVHs
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class ShapeBVHs: public ::testing::Test
+{
+  protected:
+    std::vector<std::unique_ptr<Sphere>> spheres;
+
+    void SetUp() override {
+        for (int x{ -4 }; x <= 4; ++x)
+        {
+            for (int y{ -4 }; y <= 4; ++y)
+            {
+                auto s = std::make_unique<Sphere>();
+                s->setTransform(Transform::translation(2. * x, 2. * y, 0.) * Transform::scale(0.6, 0.6, 0.6));
+                spheres.push_back(std::move(s));
+            }
+        }
+    }
+};
+
+TEST_F(ShapeBVHs, GroupIntersectionsMatchEveryChild)
+{
+    Group g{};
+    for (auto& s: spheres)
+        g.addChild(s.get());
+    for (double x{ -9. }; x <= 9.; x += 0.7)
+    {
+        const Ray ray{ Point{ x, 0.3 * x, -5. }, Vector{ 0.01, 0., 1. } };
+        Intersections expected{};
+        for (auto& s: spheres)
+            expected = expected + s->intersect(ray);
+        const auto xs = g.intersect(ray);
+        ASSERT_EQ(xs.count(), expected.count());
+        for (size_t i{}; i < xs.count(); ++i)
+        {
+            EXPECT_DOUBLE_EQ(xs(i).t, expected(i).t);
+            EXPECT_EQ(xs(i).shape, expected(i).shape);
+        }
+    }
+}
+
+TEST_F(ShapeBVHs, WorldHitsMatchFullIntersection)
+{
+    World w{};
+    Plane floor{};
+    floor.setTransform(Transform::translation(0., -9., 0.));
+    w.addShape(&floor);
+    for (auto& s: spheres)
+        w.addShape(s.get());
+    for (double x{ -9. }; x <= 9.; x += 0.5)
+    {
+        const Ray ray{ Point{ x, 10., -10. }, Vector{ 0., -1., 1. }.normalize() };
+        auto hit = w.getHitForRay(ray);
+        auto expected = w.intersect(ray).findHit();
+        EXPECT_EQ(hit.shape, expected.shape);
+        EXPECT_DOUBLE_EQ(hit.t, expected.t);
+    }
+}
+
+TEST_F(ShapeBVHs, MovedShapesAreFoundAfterInvalidating)
+{
+    World w{};
+    for (auto& s: spheres)
+        w.addShape(s.get());
+    const Ray ray{ Point{ 0., 0., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_EQ(w.getHitForRay(ray).shape, spheres[40].get());
+    spheres[40]->setTransform(Transform::translation(20., 0., 0.));
+    spheres[0]->setTransform(Transform::translation(0., 0., 5.));
+    w.invalidateBVH();
+    EXPECT_EQ(w.getHitForRay(ray).shape, spheres[0].get());
+}
+
+TEST_F(ShapeBVHs, MovedShapesAreRefit)
+{
+    World w{};
+    for (auto& s: spheres)
+        w.addShape(s.get());
+    const Ray ray{ Point{ 0., 0., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_EQ(w.getHitForRay(ray).shape, spheres[40].get());
+    spheres[40]->setTransform(Transform::translation(20., 0., 0.));
+    spheres[0]->setTransform(Transform::translation(0., 0., 5.));
+    EXPECT_EQ(w.getHitForRay(ray).shape, spheres[0].get());
+    EXPECT_FALSE(spheres[0]->hasMovedSinceRefit());
+}
+
+TEST_F(ShapeBVHs, RefitsUntilTheTreeDegrades)
+{
+    std::vector<Shape*> shapes;
+    for (auto& s: spheres)
+        shapes.push_back(s.get());
+    ShapeBVH accel{ ShapeBVH::MoveTracking::checked };
+    accel.update(shapes);
+    EXPECT_EQ(accel.getBuildCount(), 1u);
+    spheres[3]->setTransform(Transform::translation(-8., -2.5, 0.));
+    EXPECT_FALSE(accel.getBounds().contains(spheres[3]->parentSpaceBounds()));
+    accel.update(shapes);
+    EXPECT_EQ(accel.getBuildCount(), 1u);
+    EXPECT_TRUE(accel.getBounds().contains(spheres[3]->parentSpaceBounds()));
+    // shuffling the spheres around the grid stretches every node over most of it
+    std::vector<TransformationMatrix> transforms;
+    for (auto& s: spheres)
+        transforms.push_back(s->getTransform());
+    std::shuffle(transforms.begin(), transforms.end(), std::mt19937{ 42 });
+    for (size_t i{}; i < spheres.size(); ++i)
+        spheres[i]->setTransform(transforms[i]);
+    accel.update(shapes);
+    EXPECT_EQ(accel.getBuildCount(), 2u);
+}
+
+TEST_F(ShapeBVHs, MovingAChildRefitsEveryAncestor)
+{
+    World w{};
+    Group outer{}, inner{};
+    for (size_t i{}; i < 8; ++i)
+        inner.addChild(spheres[i].get());
+    outer.addChild(&inner);
+    for (size_t i{ 8 }; i < 30; ++i)
+        outer.addChild(spheres[i].get());
+    w.addShape(&outer);
+    for (size_t i{ 30 }; i < spheres.size(); ++i)
+        w.addShape(spheres[i].get());
+    const Ray ray{ Point{ 0., 0., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_EQ(w.getHitForRay(ray).shape, spheres[40].get());
+    // nearer than sphere 40, and from within two levels of groups
+    spheres[2]->setTransform(Transform::translation(0., 0., -2.) * Transform::scale(0.5, 0.5, 0.5));
+    EXPECT_EQ(w.getHitForRay(ray).shape, spheres[2].get());
+    EXPECT_TRUE(outer.bounds().contains(spheres[2]->parentSpaceBounds()));
+    outer.setTransform(Transform::translation(0., 0., 20.));
+    EXPECT_EQ(w.getHitForRay(ray).shape, spheres[40].get());
+}
+
+TEST_F(ShapeBVHs, AddingToNestedGroupsInvalidatesParents)
+{
+    Group outer{}, inner{};
+    for (size_t i{}; i < 8; ++i)
+        outer.addChild(spheres[i].get());
+    outer.addChild(&inner);
+    const Ray ray{ Point{ 0., 0., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_EQ(outer.intersect(ray).count(), 0u);
+    inner.addChild(spheres[40].get());
+    EXPECT_EQ(outer.intersect(ray).count(), 2u);
+}
+
+TEST_F(ShapeBVHs, CopiedGroupsBuildTheirOwnTree)
+{
+    Group g{};
+    for (auto& s: spheres)
+        g.addChild(s.get());
+    const Ray ray{ Point{ 0., 0., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_EQ(g.intersect(ray).count(), 2u);
+    const Group copy{ g };
+    EXPECT_EQ(const_cast<Group&>(copy).intersect(ray).count(), 2u);
+}
+
+TEST_F(ShapeBVHs, CachedTreesAreLoadedInsteadOfBuilt)
+{
+    const auto file = std::filesystem::temp_directory_path() / "rt_test_cached_shapes.bvh";
+    std::filesystem::remove(file);
+    std::vector<Shape*> shapes;
+    for (auto& s: spheres)
+        shapes.push_back(s.get());
+    ShapeBVH first{}, reloaded{}, edited{};
+    first.setCacheFile(file);
+    first.update(shapes);
+    EXPECT_EQ(first.getBuildCount(), 1u);
+    EXPECT_TRUE(std::filesystem::exists(file));
+    // the same shapes, as after a reload, load the saved tree
+    reloaded.setCacheFile(file);
+    reloaded.update(shapes);
+    EXPECT_EQ(reloaded.getBuildCount(), 0u);
+    EXPECT_EQ(reloaded.getLoadCount(), 1u);
+    const Ray ray{ Point{ 0., 0., -5. }, Vector{ 0., 0., 1. } };
+    std::vector<Shape*> visited;
+    reloaded.forEachShape(ray, [&](Shape* s, double&) { visited.push_back(s); });
+    EXPECT_TRUE(std::ranges::contains(visited, spheres[40].get()));
+    // moving a shape changes the hash, so the tree is built again
+    spheres[40]->setTransform(Transform::translation(0.5, 0., 0.) * spheres[40]->getTransform());
+    edited.setCacheFile(file);
+    edited.update(shapes);
+    EXPECT_EQ(edited.getBuildCount(), 1u);
+    EXPECT_EQ(edited.getLoadCount(), 0u);
+    std::filesystem::remove(file);
+}
+
+TEST_F(ShapeBVHs, ContentHashesFollowGeometryAndTransforms)
+{
+    Group g{};
+    for (auto& s: spheres)
+        g.addChild(s.get());
+    const auto hash = g.contentHash();
+    EXPECT_EQ(g.contentHash(), hash);
+    spheres[7]->setTransform(Transform::translation(0., 0., 1.) * spheres[7]->getTransform());
+    EXPECT_NE(g.contentHash(), hash);
+    Triangle a{ Point{ 0., 1., 0. }, Point{ -1., 0., 0. }, Point{ 1., 0., 0. } };
+    Triangle b{ Point{ 0., 0., 0. }, Point{ -1., 1., 0. }, Point{ 1., 0., 0. } };
+    // the same bounds, but not the same triangle
+    EXPECT_EQ(a.bounds().min, b.bounds().min);
+    EXPECT_EQ(a.bounds().max, b.bounds().max);
+    EXPECT_NE(a.contentHash(), b.contentHash());
+}
@@ -0,0 +1,248 @@
+#include "raytracer/shapes/instance.hpp"
+#include "raytracer/shapes/group.hpp"
+#include "raytracer/shapes/sphere.hpp"
+#include "raytracer/shapes/cube.hpp"
+#include "raytracer/shapes/plane.hpp"
+#include "raytracer/environment/world.hpp"
+#include "raytracer/environment/camera.hpp"
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace rt;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instance Basics
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class InstanceBasics: public ::testing::Test
+{
+  protected:
+    Group geometry{};
+    Sphere s{};
+
+    void SetUp() override {
+        s.setColour(Colour{ 0.2, 0.4, 0.6 });
+        geometry.addChild(&s);
+    }
+};
+
+TEST_F(InstanceBasics, HitsReportTheGeometryAndTheInstance)
+{
+    Instance a{ &geometry };
+    a.setTransform(Transform::translation(5., 0., 0.));
+    const Ray r{ Point{ 5., 0., -5. }, Vector{ 0., 0., 1. } };
+    auto xs = a.intersect(r);
+    ASSERT_EQ(xs.count(), 2);
+    EXPECT_DOUBLE_EQ(xs(0).t, 4.);
+    EXPECT_DOUBLE_EQ(xs(1).t, 6.);
+    EXPECT_EQ(xs(0).shape, &s);
+    EXPECT_EQ(xs(0).instance, &a);
+    // the geometry itself stays where it was
+    EXPECT_EQ(geometry.intersect(r).count(), 0);
+}
+
+TEST_F(InstanceBasics, InstancesShareTheirGeometry)
+{
+    Instance a{ &geometry }, b{ &geometry };
+    a.setTransform(Transform::translation(-3., 0., 0.));
+    b.setTransform(Transform::translation(3., 0., 0.) * Transform::scale(2., 2., 2.));
+    EXPECT_EQ(&a.getGeometry(), &b.getGeometry());
+    EXPECT_EQ(a.parentSpaceBounds().min, Point(-4., -1., -1.));
+    EXPECT_EQ(b.parentSpaceBounds().max, Point(5., 2., 2.));
+    // the geometry keeps no track of its instances, and is not grouped by them
+    EXPECT_FALSE(s.getGroup().isGrouped());
+    EXPECT_TRUE(a.includes(&s));
+    EXPECT_TRUE(b.includes(&s));
+}
+
+TEST_F(InstanceBasics, NormalsAreTakenThroughTheInstance)
+{
+    // the same placement as an ordinary group, so the normals should match
+    const auto placement = Transform::rotateY(HALF_PI) * Transform::scale(1., 2., 3.);
+    Instance instance{ &geometry };
+    instance.setTransform(placement);
+    Group g{};
+    Sphere copy{};
+    g.setTransform(placement);
+    g.addChild(&copy);
+    const Point p{ 1.7321, 1.1547, -5.5774 };
+    Intersection hit{ 0., &s };
+    hit.instance = &instance;
+    EXPECT_EQ(s.normalAt(p, hit), copy.normalAt(p));
+}
+
+TEST_F(InstanceBasics, InstancesMayOverrideTheGeometryMaterial)
+{
+    Instance plain{ &geometry }, painted{ &geometry };
+    painted.setColour(Colour{ 1., 0., 0. });
+    EXPECT_FALSE(plain.overridesMaterial());
+    EXPECT_TRUE(painted.overridesMaterial());
+    Intersection hit{ 1., &s };
+    hit.instance = &plain;
+    EXPECT_EQ(hit.getMaterial().colour, Colour(0.2, 0.4, 0.6));
+    hit.instance = &painted;
+    EXPECT_EQ(hit.getMaterial().colour, Colour(1., 0., 0.));
+    painted.clearMaterial();
+    EXPECT_EQ(hit.getMaterial().colour, Colour(0.2, 0.4, 0.6));
+}
+
+TEST_F(InstanceBasics, InstancesOptOutOfShadowsOnTheirOwn)
+{
+    Instance a{ &geometry };
+    Intersection hit{ 1., &s };
+    hit.instance = &a;
+    EXPECT_TRUE(hit.castsShadow());
+    a.setCastsShadow(false);
+    EXPECT_FALSE(hit.castsShadow());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instanced Worlds
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class InstancedWorlds: public ::testing::Test
+{
+  protected:
+    /// one piece of geometry, placed in the instanced world several times...
+    Group geometry{};
+    Sphere ball{};
+    Cube box{};
+    std::vector<Instance> instances{};
+    /// ...and the same scene again, built with a copy of the geometry for each placement
+    std::vector<Group> copies{};
+    std::vector<Sphere> balls{};
+    std::vector<Cube> boxes{};
+    Plane floor{};
+    World instanced{}, copied{};
+    Camera camera{ 16, 12, HALF_PI };
+
+    static constexpr size_t N_PLACEMENTS{ 4 };
+
+    void SetUp() override {
+        ball.setColour(Colour{ 0.8, 1., 0.6 });
+        ball.setReflectivity(0.3);
+        box.setTransform(Transform::translation(0., 1.5, 0.) * Transform::scale(0.5, 0.5, 0.5));
+        box.setColour(Colour{ 0.3, 0.3, 0.9 });
+        geometry.addChild(&ball);
+        geometry.addChild(&box);
+        floor.setTransform(Transform::translation(0., -1., 0.));
+        instances.reserve(N_PLACEMENTS);
+        copies.resize(N_PLACEMENTS);
+        balls.resize(N_PLACEMENTS);
+        boxes.resize(N_PLACEMENTS);
+        for (size_t i{}; i < N_PLACEMENTS; ++i)
+        {
+            const auto x = -4.5 + 3. * static_cast<double>(i);
+            const auto placement = Transform::translation(x, 0., 2. * static_cast<double>(i % 2))
+                                   * Transform::rotateY(0.4 * static_cast<double>(i));
+            auto& instance = instances.emplace_back(&geometry);
+            instance.setTransform(placement);
+            balls[i] = ball;
+            boxes[i] = box;
+            copies[i].setTransform(placement);
+            copies[i].addChild(&balls[i]);
+            copies[i].addChild(&boxes[i]);
+        }
+        // one placement is painted over, the way a material override should look
+        instances[1].setColour(Colour{ 1., 0.2, 0.2 });
+        boxes[1].setColour(Colour{ 1., 0.2, 0.2 });
+        balls[1].setMaterial(boxes[1].getMaterial());
+        for (auto* w: { &instanced, &copied })
+        {
+            w->addLight(PointLight{ Point{ -10., 10., -10. }, Colour{ 1., 1., 1. } });
+            w->addShape(&floor);
+        }
+        for (size_t i{}; i < N_PLACEMENTS; ++i)
+        {
+            instanced.addShape(&instances[i]);
+            copied.addShape(&copies[i]);
+        }
+        camera.setTransform(Transform::viewTransform(Point{ 0., 3., -8. }, Point{ 0., 0., 1. },
+                                                     Vector{ 0., 1., 0. }));
+    }
+};
+
+TEST_F(InstancedWorlds, RenderLikeCopiesOfTheGeometry)
+{
+    for (uint32_t y{}; y < camera.getVSize(); ++y)
+    {
+        for (uint32_t x{}; x < camera.getHSize(); ++x)
+        {
+            const auto ray = camera.getRayForCanvasPixel(x, y);
+            EXPECT_EQ(instanced.traceRayToPixel(ray, World::MAX_RAYS),
+                      copied.traceRayToPixel(ray, World::MAX_RAYS)) << x << ", " << y;
+        }
+    }
+}
+
+TEST_F(InstancedWorlds, PacketsMatchSingleRays)
+{
+    using Block = RayPacket<8>;
+    for (uint32_t y{}; y < camera.getVSize(); y += Block::BLOCK_HEIGHT)
+    {
+        for (uint32_t x{}; x < camera.getHSize(); x += Block::BLOCK_WIDTH)
+        {
+            const auto packet = camera.getRayPacketForCanvasBlock<8>(x, y);
+            const auto pixels = instanced.tracePacketToPixels(packet, World::MAX_RAYS);
+            for (size_t lane{}; lane < 8; ++lane)
+            {
+                if (!packet.isActive(lane))
+                    continue;
+                EXPECT_EQ(pixels[lane], instanced.traceRayToPixel(packet.getRay(lane), World::MAX_RAYS))
+                    << x << ", " << y << ", " << lane;
+            }
+        }
+    }
+}
+
+TEST_F(InstancedWorlds, MovingAnInstanceRefitsTheTopLevel)
+{
+    const Ray r{ Point{ 20., 0., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_FALSE(instanced.getHitForRay(r).isHit());
+    instances[0].setTransform(Transform::translation(20., 0., 0.));
+    auto hit = instanced.getHitForRay(r);
+    ASSERT_TRUE(hit.isHit());
+    EXPECT_EQ(hit.shape, &ball);
+    EXPECT_EQ(hit.instance, &instances[0]);
+}
+
+TEST_F(InstancedWorlds, MovingTheGeometryRefitsEveryInstance)
+{
+    // the first instance isn't rotated, so its ball is straight ahead of a ray at its x
+    const Ray high{ Point{ -4.5, 20., -5. }, Vector{ 0., 0., 1. } };
+    const Ray low{ Point{ -4.5, 0., -5. }, Vector{ 0., 0., 1. } };
+    ASSERT_TRUE(instanced.getHitForRay(low).isHit());
+    EXPECT_FALSE(instanced.getHitForRay(high).isHit());
+    geometry.setTransform(Transform::translation(0., 20., 0.));
+    auto hit = instanced.getHitForRay(high);
+    ASSERT_TRUE(hit.isHit());
+    EXPECT_EQ(hit.shape, &ball);
+    EXPECT_EQ(hit.instance, &instances[0]);
+    EXPECT_FALSE(geometry.hasMovedSinceRefit());
+}
+
+TEST_F(InstancedWorlds, MovingAShapeInTheGeometryRefitsEveryInstance)
+{
+    const Ray high{ Point{ -4.5, 20., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_FALSE(instanced.getHitForRay(high).isHit());
+    ball.setTransform(Transform::translation(0., 20., 0.));
+    auto hit = instanced.getHitForRay(high);
+    ASSERT_TRUE(hit.isHit());
+    EXPECT_EQ(hit.shape, &ball);
+    EXPECT_EQ(hit.instance, &instances[0]);
+}
+
+TEST_F(InstancedWorlds, CopiesOfAnInstanceAreToldWhenTheGeometryMoves)
+{
+    World w{}, v{};
+    Instance copy{ instances[0] };
+    Instance assigned{ &box };
+    assigned = instances[0];
+    w.addShape(&copy);
+    v.addShape(&assigned);
+    const Ray high{ Point{ -4.5, 20., -5. }, Vector{ 0., 0., 1. } };
+    EXPECT_FALSE(w.getHitForRay(high).isHit());
+    EXPECT_FALSE(v.getHitForRay(high).isHit());
+    geometry.setTransform(Transform::translation(0., 20., 0.));
+    EXPECT_EQ(w.getHitForRay(high).instance, &copy);
+    EXPECT_EQ(v.getHitForRay(high).instance, &assigned);
+}
@@ -212,6 +212,69 @@ TEST_F(MiscPatterns, CheckersRepeatInZ)
     EXPECT_EQ(checkers.colourAt(Point{0, 0, 1.01}), black);
 }
 
+TEST_F(MiscPatterns, BuiltInPatternsAreNotCustom)
+{
+    EXPECT_EQ(StripedPattern(white, black).getType(), PatternType::stripes);
+    EXPECT_EQ(GradientPattern(white, black).getType(), PatternType::gradient);
+    EXPECT_EQ(RingPattern(white, black).getType(), PatternType::rings);
+    EXPECT_EQ(CheckersPattern(white, black).getType(), PatternType::checkers);
+    EXPECT_EQ(BlendedPattern(white, black).getType(), PatternType::blended);
+}
 
+TEST_F(MiscPatterns, BlendedPatternMixesColours)
+{
+    BlendedPattern blend{ white, black, 0.25 };
+    EXPECT_EQ(blend.colourAt(Point{0, 0, 0}), Colour(0.75, 0.75, 0.75));
+    blend.setWeight(1.0);
+    EXPECT_EQ(blend.colourAt(Point{0, 0, 0}), black);
+}
 
+TEST_F(MiscPatterns, StripesOfNestedCheckers)
+{
+    const Colour red{ 1, 0, 0 };
+    CheckersPattern checkers{ white, black };
+    StripedPattern solid{ red, red };
+    StripedPattern stripes{ &checkers, &solid };
+    EXPECT_TRUE(stripes.isNested());
+    EXPECT_EQ(stripes.colourAt(Point{0.5, 0, 0}), white);
+    EXPECT_EQ(stripes.colourAt(Point{0.5, 1.5, 0}), black);
+    EXPECT_EQ(stripes.colourAt(Point{1.5, 0, 0}), red);
+}
 
+TEST_F(MiscPatterns, NestedPatternAppliesItsOwnTransform)
+{
+    CheckersPattern checkers{ white, black };
+    checkers.setTransform(Transform::translation(0., 1., 0.));
+    BlendedPattern blend{ &checkers, &checkers, 0.5 };
+    EXPECT_EQ(blend.colourAt(Point{0.5, 0.5, 0.5}), black);
+}
+
+TEST_F(MiscPatterns, BatchEvaluationMatchesSinglePoints)
+{
+    CheckersPattern checkers{ white, black };
+    checkers.setTransform(Transform::scale(0.5, 0.5, 0.5));
+    GradientPattern gradient{ Colour{1, 0, 0}, Colour{0, 0, 1} };
+    BlendedPattern blend{ &checkers, &gradient, 0.3 };
+    RingPattern rings{ &blend, &checkers };
+    rings.setTransform(Transform::rotateY(0.4) * Transform::translation(0.3, 0., -1.2));
+
+    const std::vector<Tuple> points{
+        Point{0, 0, 0}, Point{0.4, 1.2, -0.7}, Point{-2.3, 0.1, 3.9}, Point{5.5, -3.3, 0.25},
+        Point{-0.01, 0.99, -1.01}, Point{1.7, 2.2, 2.7}, Point{-4.4, -0.6, 0.8}
+    };
+    const TupleBatch batch{ points };
+    std::vector<Colour> out(points.size());
+    rings.colourAtShape(batch, out);
+    for (size_t i{}; i < points.size(); ++i)
+        EXPECT_EQ(out[i], rings.colourAtShape(points[i]));
+}
+
+TEST_F(BasePatternClass, CustomPatternBatchUsesColourAt)
+{
+    const std::vector<Tuple> points{ Point{1, 2, 3}, Point{-1, 0.5, 4} };
+    pattern.setTransform(Transform::scale(2., 2., 2.));
+    std::vector<Colour> out(points.size());
+    pattern.colourAtShape(TupleBatch{ points }, out);
+    EXPECT_EQ(out[0], (Colour{ 0.5, 1, 1.5 }));
+    EXPECT_EQ(out[1], (Colour{ -0.5, 0.25, 2 }));
+}
@@ -0,0 +1,319 @@
+#include "gtest/gtest.h"
+#include "raytracer/renderer/ray_packet.hpp"
+#include "raytracer/environment/world.hpp"
+#include "raytracer/environment/camera.hpp"
+#include "raytracer/shapes/sphere.hpp"
+#include "raytracer/shapes/plane.hpp"
+#include "raytracer/shapes/cube.hpp"
+#include "raytracer/shapes/triangle.hpp"
+#include "raytracer/shapes/group.hpp"
+#include "raytracer/shapes/csg.hpp"
+
+using namespace rt;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Ray Packets
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class RayPackets: public ::testing::Test
+{
+  protected:
+    /// @brief A fan of rays from z = -5 across the unit square about the origin.
+    template<size_t N>
+    static RayPacket<N> fanOfRays(double spread)
+    {
+        RayPacket<N> packet{};
+        for (size_t lane{}; lane < N; ++lane)
+        {
+            const double x = -spread + 2. * spread * static_cast<double>(lane) / (N - 1);
+            packet.setRay(lane, Ray{ Point{ 0., 0.1, -5. }, Vector{ x, 0., 5. }.normalize() });
+        }
+        return packet;
+    }
+    /// @brief The closest hit of a single ray against a shape, in the same terms as a packet hit.
+    static double scalarHit(Shape& shape, const Ray& ray)
+    {
+        auto xs = shape.intersect(ray);
+        auto hit = xs.findHit();
+        return hit.isHit() ? hit.t : INF;
+    }
+};
+
+TEST_F(RayPackets, LanesRoundTripRays)
+{
+    Ray ray{ Point{ 1., 2., 3. }, Vector{ 0., -1., 0. }, 0.5, 10. };
+    ray.setCone(0.1, 0.01);
+    RayPacket<4> packet{};
+    packet.setRay(2, ray);
+    EXPECT_EQ(packet.active, 0b0100u);
+    EXPECT_TRUE(packet.isActive(2));
+    EXPECT_FALSE(packet.isActive(0));
+    const auto out = packet.getRay(2);
+    EXPECT_EQ(out.getOrigin(), ray.getOrigin());
+    EXPECT_EQ(out.getDirection(), ray.getDirection());
+    EXPECT_EQ(out.getTMin(), 0.5);
+    EXPECT_EQ(out.getTMax(), 10.);
+    EXPECT_EQ(out.getConeSpread(), 0.01);
+}
+
+TEST_F(RayPackets, TransformMatchesSingleRays)
+{
+    const auto M = Transform::translation(1., -2., 3.) * Transform::rotateY(0.3)
+                   * Transform::scale(2., 1., 0.5);
+    const auto packet = fanOfRays<8>(1.);
+    const auto transformed = packet.transform(M);
+    for (size_t lane{}; lane < 8; ++lane)
+    {
+        const auto expected = packet.getRay(lane).transform(M);
+        const auto actual = transformed.getRay(lane);
+        EXPECT_EQ(actual.getOrigin(), expected.getOrigin());
+        EXPECT_EQ(actual.getDirection(), expected.getDirection());
+        EXPECT_EQ(transformed.idx[lane], expected.getInvDirection().x);
+    }
+}
+
+TEST_F(RayPackets, BoxKernelMatchesScalarSlabTest)
+{
+    const BoundingBox box{ Point{ -1., -1., -1. }, Point{ 1., 1., 1. } };
+    auto packet = fanOfRays<8>(2.);
+    // a ray lying exactly in a slab plane, with a zero direction component
+    packet.setRay(7, Ray{ Point{ 1., 0., -5. }, Vector{ 0., 0., 1. } });
+    const PacketHit<8> hits{ packet };
+    const LaneMask mask = Packet::intersectBox(box, packet, hits);
+    for (size_t lane{}; lane < 8; ++lane)
+        EXPECT_EQ(((mask >> lane) & 1u) != 0, box.intersects(packet.getRay(lane))) << lane;
+    EXPECT_NE(mask, 0u);
+    EXPECT_NE(mask, RayPacket<8>::ALL_LANES);
+}
+
+TEST_F(RayPackets, BoxKernelSkipsBoxesPastTheClosestHit)
+{
+    const BoundingBox box{ Point{ -1., -1., -1. }, Point{ 1., 1., 1. } };
+    const auto packet = fanOfRays<4>(0.2);
+    PacketHit<4> hits{ packet };
+    EXPECT_EQ(Packet::intersectBox(box, packet, hits), RayPacket<4>::ALL_LANES);
+    for (double& t: hits.t)
+        t = 2.;
+    EXPECT_EQ(Packet::intersectBox(box, packet, hits), 0u);
+}
+
+TEST_F(RayPackets, SphereKernelMatchesScalarIntersection)
+{
+    Sphere s{};
+    s.setTransform(Transform::translation(0.3, 0., 0.) * Transform::scale(1.2, 0.8, 1.));
+    const auto packet = fanOfRays<8>(1.5);
+    PacketHit<8> hits{ packet };
+    s.intersectPacket(packet, hits);
+    EXPECT_NE(hits.getHitMask(), 0u);
+    EXPECT_NE(hits.getHitMask(), RayPacket<8>::ALL_LANES);
+    for (size_t lane{}; lane < 8; ++lane)
+    {
+        const double expected = scalarHit(s, packet.getRay(lane));
+        if (expected == INF)
+            EXPECT_EQ(hits.shape[lane], nullptr);
+        else
+        {
+            EXPECT_EQ(hits.shape[lane], &s);
+            EXPECT_DOUBLE_EQ(hits.t[lane], expected);
+        }
+    }
+}
+
+TEST_F(RayPackets, SphereKernelFindsFarSideFromInside)
+{
+    Sphere s{};
+    RayPacket<4> packet{};
+    packet.setRay(0, Ray{ Point{ 0., 0., 0. }, Vector{ 0., 0., 1. } });
+    PacketHit<4> hits{ packet };
+    s.intersectPacket(packet, hits);
+    EXPECT_EQ(hits.getHitMask(), 0b0001u);
+    EXPECT_DOUBLE_EQ(hits.t[0], 1.);
+}
+
+TEST_F(RayPackets, TriangleKernelMatchesScalarIntersection)
+{
+    SmoothTriangle tri{ Point{ 0., 1., 0. }, Point{ -1., 0., 0. }, Point{ 1., 0., 0. },
+                        Vector{ 0., 1., 0. }, Vector{ -1., 0., 0. }, Vector{ 1., 0., 0. } };
+    const auto packet = fanOfRays<8>(1.5);
+    PacketHit<8> hits{ packet };
+    tri.intersectPacket(packet, hits);
+    EXPECT_NE(hits.getHitMask(), 0u);
+    EXPECT_NE(hits.getHitMask(), RayPacket<8>::ALL_LANES);
+    for (size_t lane{}; lane < 8; ++lane)
+    {
+        auto xs = tri.intersect(packet.getRay(lane));
+        if (xs.count() == 0)
+        {
+            EXPECT_EQ(hits.shape[lane], nullptr);
+            continue;
+        }
+        EXPECT_EQ(hits.shape[lane], &tri);
+        EXPECT_DOUBLE_EQ(hits.t[lane], xs(0).t);
+        EXPECT_DOUBLE_EQ(hits.u[lane], xs(0).u);
+        EXPECT_DOUBLE_EQ(hits.v[lane], xs(0).v);
+    }
+}
+
+TEST_F(RayPackets, InactiveLanesNeverHit)
+{
+    Sphere s{};
+    auto packet = fanOfRays<4>(0.1);
+    packet.active = 0b1010u;
+    PacketHit<4> hits{ packet };
+    s.intersectPacket(packet, hits);
+    Plane p{};
+    p.intersectPacket(packet, hits);
+    EXPECT_EQ(hits.getHitMask(), 0b1010u);
+}
+
+TEST_F(RayPackets, ShapesWithoutKernelsFallBackToSingleRays)
+{
+    Cube c{};
+    c.setTransform(Transform::translation(0., 0., 2.));
+    Sphere s{};
+    const auto packet = fanOfRays<4>(0.1);
+    PacketHit<4> hits{ packet };
+    c.intersectPacket(packet, hits);
+    s.intersectPacket(packet, hits);
+    for (size_t lane{}; lane < 4; ++lane)
+    {
+        // the sphere is in front of the cube
+        EXPECT_EQ(hits.shape[lane], &s);
+        EXPECT_DOUBLE_EQ(hits.t[lane], scalarHit(s, packet.getRay(lane)));
+    }
+}
+
+TEST_F(RayPackets, GroupsOnlyHitChildrenInsideTheirBounds)
+{
+    Group g{};
+    Sphere s1{}, s2{};
+    s1.setTransform(Transform::translation(-3., 0., 0.));
+    s2.setTransform(Transform::translation(3., 0., 0.));
+    g.addChild(&s1);
+    g.addChild(&s2);
+    g.setTransform(Transform::translation(0., 0., 1.));
+    const auto packet = fanOfRays<8>(4.);
+    PacketHit<8> hits{ packet };
+    g.intersectPacket(packet, hits);
+    for (size_t lane{}; lane < 8; ++lane)
+    {
+        auto xs = g.intersect(packet.getRay(lane));
+        const auto hit = xs.findHit();
+        EXPECT_EQ(hits.shape[lane], hit.shape) << lane;
+    }
+    EXPECT_NE(hits.getHitMask(), 0u);
+}
+
+TEST_F(RayPackets, CSGPacketsKeepOnlyFilteredHits)
+{
+    Sphere a{}, b{};
+    b.setTransform(Transform::translation(0., 0., -0.5));
+    auto c = CSG::Difference(&a, &b);
+    const auto packet = fanOfRays<4>(0.1);
+    PacketHit<4> hits{ packet };
+    c.intersectPacket(packet, hits);
+    for (size_t lane{}; lane < 4; ++lane)
+    {
+        auto xs = c.intersect(packet.getRay(lane));
+        const auto hit = xs.findHit();
+        EXPECT_EQ(hits.shape[lane], hit.shape);
+        EXPECT_DOUBLE_EQ(hits.t[lane], hit.t);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Packet tracing
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PacketTracing: public ::testing::Test
+{
+  protected:
+    World w{};
+    Plane floor{};
+    Sphere matte{}, mirror{}, glass{}, occluder{};
+    Camera camera{ 11, 9, HALF_PI };
+
+    void SetUp() override {
+        w.addLight(PointLight{ Point{ -10., 10., -10. }, Colour{ 1., 1., 1. } });
+        floor.setTransform(Transform::translation(0., -1., 0.));
+        matte.setColour(Colour{ 0.8, 1., 0.6 });
+        mirror.setTransform(Transform::translation(-2., 0., 1.));
+        mirror.setReflectivity(0.8);
+        glass = Sphere::glassySphere();
+        glass.setTransform(Transform::translation(2., 0., 1.));
+        occluder.setTransform(Transform::translation(-3., 2., -3.) * Transform::scale(0.5, 0.5, 0.5));
+        for (auto s: std::initializer_list<Shape*>{ &floor, &matte, &mirror, &glass, &occluder })
+            w.addShape(s);
+        camera.setTransform(Transform::viewTransform(Point{ 0., 1.5, -5. }, Point{ 0., 0., 0. },
+                                                     Vector{ 0., 1., 0. }));
+    }
+
+    /// @brief Trace every block of the canvas as packets, and compare each pixel to a single ray.
+    template<size_t N>
+    void expectPacketsMatchSingleRays()
+    {
+        using Block = RayPacket<N>;
+        size_t nPixels{};
+        for (uint32_t y{}; y < camera.getVSize(); y += Block::BLOCK_HEIGHT)
+        {
+            for (uint32_t x{}; x < camera.getHSize(); x += Block::BLOCK_WIDTH)
+            {
+                const auto packet = camera.getRayPacketForCanvasBlock<N>(x, y);
+                const auto pixels = w.tracePacketToPixels(packet, World::MAX_RAYS);
+                for (size_t lane{}; lane < N; ++lane)
+                {
+                    const uint32_t px = x + lane % Block::BLOCK_WIDTH;
+                    const uint32_t py = y + lane / Block::BLOCK_WIDTH;
+                    if (!packet.isActive(lane))
+                    {
+                        EXPECT_TRUE(px >= camera.getHSize() || py >= camera.getVSize());
+                        continue;
+                    }
+                    const auto expected = w.traceRayToPixel(camera.getRayForCanvasPixel(px, py),
+                                                            World::MAX_RAYS);
+                    EXPECT_EQ(pixels[lane], expected) << px << ", " << py;
+                    ++nPixels;
+                }
+            }
+        }
+        EXPECT_EQ(nPixels, camera.getHSize() * camera.getVSize());
+    }
+};
+
+TEST_F(PacketTracing, CameraBlocksMatchSingleRays)
+{
+    const auto packet = camera.getRayPacketForCanvasBlock<8>(2, 3);
+    EXPECT_EQ(packet.active, RayPacket<8>::ALL_LANES);
+    const auto ray = camera.getRayForCanvasPixel(3, 4);
+    EXPECT_EQ(packet.getRay(5).getDirection(), ray.getDirection());
+    EXPECT_EQ(packet.getRay(5).getConeSpread(), camera.getPixelSize());
+    // the last column and row of blocks hang over the edge of the canvas
+    const auto edge = camera.getRayPacketForCanvasBlock<8>(8, 8);
+    EXPECT_EQ(edge.active, 0b0111u);
+}
+
+TEST_F(PacketTracing, FourWidePacketsMatchSingleRays)
+{
+    expectPacketsMatchSingleRays<4>();
+}
+
+TEST_F(PacketTracing, EightWidePacketsMatchSingleRays)
+{
+    expectPacketsMatchSingleRays<8>();
+}
+
+TEST_F(PacketTracing, ShadowPacketsRespectShadowOptOut)
+{
+    occluder.setCastsShadow(false);
+    expectPacketsMatchSingleRays<8>();
+}
+
+TEST_F(PacketTracing, PacketsWithoutBouncesShadeOnlyTheSurface)
+{
+    const auto packet = camera.getRayPacketForCanvasBlock<4>(0, 4);
+    const auto pixels = w.tracePacketToPixels(packet, 0);
+    for (size_t lane{}; lane < 4; ++lane)
+    {
+        const auto ray = packet.getRay(lane);
+        EXPECT_EQ(pixels[lane], w.traceRayToPixel(ray, 0));
+    }
+}
@@ -21,6 +21,30 @@ TEST(Raycasting, RayIsConstructed)
     EXPECT_EQ(dir, r.getDirection());
 }
 
+TEST(Raycasting, RayCachesInverseDirectionAndSigns)
+{
+    auto r = Ray(Point(1, 2, 3), Vector(2, -4, 0));
+    EXPECT_EQ(r.getInvDirection().x, 0.5);
+    EXPECT_EQ(r.getInvDirection().y, -0.25);
+    EXPECT_EQ(r.getInvDirection().z, INF);
+    EXPECT_FALSE(r.isNegative(0));
+    EXPECT_TRUE(r.isNegative(1));
+    EXPECT_FALSE(r.isNegative(2));
+}
+
+TEST(Raycasting, RayRangeDefaultsToAheadOfOrigin)
+{
+    auto r = Ray(Point(0, 0, 0), Vector(0, 0, 1));
+    EXPECT_EQ(r.getTMin(), 0.);
+    EXPECT_EQ(r.getTMax(), INF);
+    r.setRange(0.5, 10.);
+    // the range and cached fields survive a transform, since t is unchanged by it
+    const auto r2 = r.transform(Transform::scale(1., 1., 2.));
+    EXPECT_EQ(r2.getTMin(), 0.5);
+    EXPECT_EQ(r2.getTMax(), 10.);
+    EXPECT_EQ(r2.getInvDirection().z, 0.5);
+}
+
 TEST(Raycasting, ComputePointFromDistance)
 {
     auto ray = Ray(Point{2, 3, 4}, Vector{1, 0, 0});
@@ -268,7 +292,7 @@ TEST(Raycasting, PrecomputingTheReflectionVector)
     Intersection i{ HALF_SQRT_2, &plane };
     Intersections xs{ i };
     IntersectionState iState{ i, r, xs };
-    EXPECT_EQ(iState.vReflect, (Vector{ 0, HALF_SQRT_2, HALF_SQRT_2}));
+    EXPECT_EQ(iState.getReflectVector(), (Vector{ 0, HALF_SQRT_2, HALF_SQRT_2}));
 }
 
 
@@ -310,43 +334,60 @@ TEST_F(RefractiveIntersections, PrecomputingRefractiveIndices_0)
     //  computed properly at six different points of intersection, between three overlaid
     //  and glassy refractive spheres
     auto iState = IntersectionState{ i0, r, xs };
-    EXPECT_EQ(iState.n1, 1.0);
-    EXPECT_EQ(iState.n2, 1.5);
+    EXPECT_EQ(iState.getN1(), 1.0);
+    EXPECT_EQ(iState.getN2(), 1.5);
 }
 
 TEST_F(RefractiveIntersections, PrecomputingRefractiveIndices_1)
 {
     auto iState = IntersectionState{ i1, r, xs };
-    EXPECT_EQ(iState.n1, 1.5);
-    EXPECT_EQ(iState.n2, 2.0);
+    EXPECT_EQ(iState.getN1(), 1.5);
+    EXPECT_EQ(iState.getN2(), 2.0);
 }
 
 TEST_F(RefractiveIntersections, PrecomputingRefractiveIndices_2)
 {
     auto iState = IntersectionState{ i2, r, xs };
-    EXPECT_EQ(iState.n1, 2.0);
-    EXPECT_EQ(iState.n2, 2.5);
+    EXPECT_EQ(iState.getN1(), 2.0);
+    EXPECT_EQ(iState.getN2(), 2.5);
 }
 
 TEST_F(RefractiveIntersections, PrecomputingRefractiveIndices_3)
 {
     auto iState = IntersectionState{ i3, r, xs };
-    EXPECT_EQ(iState.n1, 2.5);
-    EXPECT_EQ(iState.n2, 2.5);
+    EXPECT_EQ(iState.getN1(), 2.5);
+    EXPECT_EQ(iState.getN2(), 2.5);
 }
 
 TEST_F(RefractiveIntersections, PrecomputingRefractiveIndices_4)
 {
     auto iState = IntersectionState{ i4, r, xs };
-    EXPECT_EQ(iState.n1, 2.5);
-    EXPECT_EQ(iState.n2, 1.5);
+    EXPECT_EQ(iState.getN1(), 2.5);
+    EXPECT_EQ(iState.getN2(), 1.5);
 }
 
 TEST_F(RefractiveIntersections, PrecomputingRefractiveIndices_5)
 {
     auto iState = IntersectionState{ i5, r, xs };
-    EXPECT_EQ(iState.n1, 1.5);
-    EXPECT_EQ(iState.n2, 1.0);
+    EXPECT_EQ(iState.getN1(), 1.5);
+    EXPECT_EQ(iState.getN2(), 1.0);
+}
+
+TEST_F(RefractiveIntersections, DeeplyNestedShapesUseInnermostIndices)
+{
+    // a ray entering more nested shapes than are tracked still finds the innermost indices
+    std::vector<Sphere> shells(IntersectionState::MAX_NESTED_SHAPES + 8);
+    Intersections nested{};
+    for (size_t k{}; k < shells.size(); ++k)
+    {
+        shells[k].setRefraction(1.0, 1.0 + 0.01 * static_cast<double>(k));
+        Intersection entry{ static_cast<double>(k + 1), &shells[k] };
+        nested.add(entry);
+    }
+    const Intersection hit = nested.getIntersections().back();
+    auto iState = IntersectionState{ hit, r, nested };
+    EXPECT_DOUBLE_EQ(iState.getN1(), shells[shells.size() - 2].getMaterial().refraction);
+    EXPECT_DOUBLE_EQ(iState.getN2(), shells.back().getMaterial().refraction);
 }
 
 TEST_F(RefractiveIntersections, UnderPointIsCalculated)
@@ -359,6 +400,6 @@ TEST_F(RefractiveIntersections, UnderPointIsCalculated)
     Intersection i{ 5, &s };
     Intersections xs{ i };
     IntersectionState iState{ i, r, xs };
-    EXPECT_TRUE(iState.pointBelowSurface.z > EPSILON / 2.);
-    EXPECT_TRUE(iState.point.z < iState.pointBelowSurface.z);
+    EXPECT_TRUE(iState.getPointBelowSurface().z > EPSILON / 2.);
+    EXPECT_TRUE(iState.point.z < iState.getPointBelowSurface().z);
 }
@@ -6,7 +6,14 @@
 #include "raytracer/logging/logging.hpp"
 #include "raytracer/renderer/job_scheduler.hpp"
 #include "raytracer/renderer/job_finalizer.hpp"
+#include "raytracer/renderer/dynamic_resolution.hpp"
+#include "raytracer/common/mpsc_queue.hpp"
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <semaphore>
+#include <sstream>
 
 using namespace rt;
 using namespace rt::Render;
@@ -316,6 +323,105 @@ TEST_F(RenderJobSchedulerTests, QueueTopIsLowestPKeyValue) {
     EXPECT_TRUE(sched->tiles.empty());
 }
 
+TEST_F(RenderJobSchedulerTests, QueueServesStarvedTypesPastTheirAgingLimit) {
+    // a less urgent type of job gets a tile once it has waited past its aging limit,
+    //  then goes back behind the more urgent types
+    auto realtime = std::make_shared<JobState>(Job{ camera, world, JobType::realtime });
+    auto background = std::make_shared<JobState>(Job{ camera, world, JobType::background });
+    TileQueue q;
+    q.setAgingLimit(JobType::background, std::chrono::milliseconds{ 2 });
+    for (uint32_t i{ }; i < 4; ++i) {
+        auto t = Tile{ realtime };
+        t.x0 = i;
+        t.priority = sched->getPriorityKeyForTile(JobType::realtime, 0, 0, 0, 8, 8);
+        q.push(t);
+    }
+    auto t_bg = Tile{ background };
+    t_bg.priority = sched->getPriorityKeyForTile(JobType::background, 0, 4, 4, 8, 8);
+    q.push(t_bg);
+    EXPECT_EQ(q.top().state, realtime);
+    EXPECT_EQ(q.urgentPriority() >> 56, type_to_priority(JobType::realtime));
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 5 });
+    EXPECT_EQ(q.take(), t_bg);
+    EXPECT_EQ(q.top().state, realtime);
+    EXPECT_EQ(q.size(), 4);
+}
+
+TEST_F(RenderJobSchedulerTests, OldestJobFirstFinishesJobsInTurn) {
+    // by default jobs of a type interleave pass by pass, while oldest first finishes
+    //  each job's passes before starting on the next job's
+    cam.setHSize(32); cam.setVSize(32);
+    const auto submitOffline = [&] {
+        Job job{ cam, world, JobType::offline };
+        job.passes = { 2, 1 };
+        const auto id = sched->submit(job);
+        // ranks are in milliseconds, so each job is a tick older than the next
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 2 });
+        return id;
+    };
+    sched->setMode(Mode::render_only);
+    const auto first = submitOffline();
+    const auto second = submitOffline();
+    std::vector<std::pair<JobID, uint32_t>> order;
+    while (!sched->tiles.empty()) {
+        const auto t = sched->tiles.take();
+        order.emplace_back(t.jobID, t.nPass);
+    }
+    const std::vector<std::pair<JobID, uint32_t>> interleaved{ { first, 0 }, { second, 0 },
+                                                               { first, 1 }, { second, 1 } };
+    EXPECT_EQ(order, interleaved);
+
+    sched->setClassOrder(JobType::offline, ClassOrder::oldest_first);
+    const auto third = submitOffline();
+    const auto fourth = submitOffline();
+    order.clear();
+    while (!sched->tiles.empty()) {
+        const auto t = sched->tiles.take();
+        order.emplace_back(t.jobID, t.nPass);
+    }
+    const std::vector<std::pair<JobID, uint32_t>> inTurn{ { third, 0 }, { third, 1 },
+                                                          { fourth, 0 }, { fourth, 1 } };
+    EXPECT_EQ(order, inTurn);
+}
+
+TEST_F(RenderJobSchedulerTests, HeavierJobsRankFirst) {
+    // the low bits of a job's tile keys rank it by age, with heavier jobs given a headstart
+    const auto light = sched->getJobRank(1);
+    const auto heavy = sched->getJobRank(4);
+    EXPECT_LT(heavy, light);
+    EXPECT_EQ(light - heavy, JobScheduler::WEIGHT_HEADSTART_MS * 3 / 4);
+    EXPECT_EQ(light >> 32, 0);
+    // a job submitted later, but heavy enough, goes ahead of an earlier one
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+    EXPECT_LT(sched->getJobRank(2), light);
+}
+
+TEST_F(RenderJobSchedulerTests, BackgroundJobsAreNotStarvedByRealtimeLoad) {
+    // with realtime jobs always waiting, background tiles are still taken
+    //  within their aging limit, and the waits are measured
+    const auto limit = std::chrono::milliseconds{ 5 };
+    sched->setAgingLimit(JobType::background, limit);
+    sched->submit(Job{ cam, world, JobType::background }); // 64 tiles
+    cam.setHSize(64); cam.setVSize(64);
+    const auto tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds{ 100 };
+    while (std::chrono::steady_clock::now() < tEnd) {
+        if (sched->tiles.heaps[TileQueue::classOf(JobType::realtime)].size() < 8) {
+            sched->submit(Job{ cam, world, JobType::realtime });
+        }
+        auto t = sched->getNextTile();
+        ASSERT_TRUE(t.has_value());
+        std::this_thread::sleep_for(std::chrono::microseconds{ 500 });
+        sched->setTileComplete(*t);
+    }
+    const auto background = sched->getWaitStats(JobType::background);
+    const auto realtime = sched->getWaitStats(JobType::realtime);
+    EXPECT_GT(background.nTaken, 4);
+    EXPECT_GT(realtime.nTaken, background.nTaken);
+    // a tile may come up just after the limit, while a worker finishes a realtime tile
+    EXPECT_LT(background.maxGap, limit + std::chrono::milliseconds{ 20 });
+    EXPECT_LE(background.totalWait, background.maxWait * background.nTaken);
+}
+
 TEST_F(RenderJobSchedulerTests, GetNextJobID) {
     //  the next job ID is returned from the scheduler
     EXPECT_EQ(sched->jobID, JobID_INVALID);
@@ -331,6 +437,7 @@ TEST_F(RenderJobSchedulerTests, JobIsSubmitted) {
     cam.setHSize(64);
     cam.setVSize(64);
     sched->jobID = 9000;
+    sched->setMode(Mode::render_only);
     Job job{ cam, world, JobType::offline };
     auto t0 = std::chrono::steady_clock::now();
     auto id = sched->submit(job);
@@ -365,10 +472,375 @@ TEST_F(RenderJobSchedulerTests, JobIsSubmitted) {
     EXPECT_TRUE(state->isStarted.load());
 }
 
+TEST_F(RenderJobSchedulerTests, LargeJobsQueueTheirTilesLazily) {
+    // a job queues only its first few tiles, and makes the next as each is taken,
+    //  in the same order as if they had all been queued at once
+    Job job{ cam, world, JobType::background };
+    job.passes = { 4, 1 };
+    const auto id = sched->submit(job);
+    auto s = sched->getJobState(id);
+    EXPECT_EQ(s->nTiles, 128);
+    EXPECT_EQ(s->nTilesRemain.load(), 128);
+    EXPECT_EQ(sched->tiles.size(), JobScheduler::TILES_QUEUED_PER_JOB);
+    std::vector<Tile> taken;
+    while (!s->isCompleted.load()) {
+        EXPECT_LE(sched->tiles.size(), JobScheduler::TILES_QUEUED_PER_JOB);
+        auto t = sched->getNextTile();
+        ASSERT_TRUE(t);
+        if (!taken.empty()) {
+            EXPECT_GE(t->priority, taken.back().priority);
+        }
+        taken.push_back(*t);
+        sched->setTileComplete(*t);
+    }
+    EXPECT_TRUE(sched->tiles.empty());
+    for (const auto& t: JobScheduler::getTilesForJobState(s)) {
+        const auto it = std::ranges::find(taken, t.nTile, &Tile::nTile);
+        ASSERT_NE(it, taken.end());
+        EXPECT_EQ(*it, t);
+        EXPECT_EQ(it->nPass, t.nPass);
+    }
+    EXPECT_EQ(taken.size(), 128);
+}
+
+TEST_F(RenderJobSchedulerTests, JobsBeyondTheTileBudgetWaitTheirTurn) {
+    // jobs wait pending while the tiles of those admitted would go over the budget,
+    //  and are admitted in order as admitted jobs end; trySubmit won't wait
+    cam.setHSize(64); cam.setVSize(64); // 4 tiles
+    sched->setTileBudget(8);
+    const auto first = sched->submit({ cam, world, JobType::realtime });
+    const auto second = sched->submit({ cam, world, JobType::background });
+    const auto third = sched->submit({ cam, world, JobType::background });
+    EXPECT_EQ(sched->getPendingJobCount(), 1);
+    EXPECT_EQ(sched->tiles.size(), 8);
+    EXPECT_TRUE(sched->getJobState(second)->isStarted.load());
+    auto waiting = sched->getJobState(third);
+    ASSERT_NE(waiting, nullptr);
+    EXPECT_FALSE(waiting->isStarted.load());
+    EXPECT_EQ(sched->trySubmit({ cam, world, JobType::background }), JobID_INVALID);
+    EXPECT_EQ(sched->trySubmit({ cam, world, JobType::realtime }), JobID_INVALID);
+    // the realtime job's tiles go first, and its end makes room for the pending job
+    for (int i{ }; i < 4; ++i) {
+        auto t = sched->getNextTile();
+        ASSERT_TRUE(t);
+        EXPECT_EQ(t->jobID, first);
+        sched->setTileComplete(*t);
+    }
+    EXPECT_EQ(sched->getPendingJobCount(), 0);
+    EXPECT_TRUE(waiting->isStarted.load());
+    EXPECT_EQ(sched->tiles.size(), 8);
+    // a pending job can be cancelled before it is admitted
+    const auto fourth = sched->submit({ cam, world, JobType::background });
+    EXPECT_EQ(sched->getPendingJobCount(), 1);
+    sched->cancel(fourth);
+    EXPECT_EQ(sched->getPendingJobCount(), 0);
+    EXPECT_TRUE(sched->getJobState(fourth)->isCompleted.load());
+}
+
+TEST_F(RenderJobSchedulerTests, ParkedJobsDontHoldTheBudget) {
+    // a job the mode doesn't allow leaves its share of the budget to the jobs
+    //  which can run, and takes it back once the mode allows it
+    sched->setTileBudget(100);
+    cam.setHSize(320); cam.setVSize(320); // 100 tiles
+    const auto offline = sched->submit({ cam, world, JobType::offline });
+    EXPECT_TRUE(sched->getJobState(offline)->isStarted.load());
+    cam.setHSize(64); cam.setVSize(64); // 4 tiles
+    const auto realtime = sched->trySubmit({ cam, world, JobType::realtime });
+    ASSERT_NE(realtime, JobID_INVALID);
+    EXPECT_EQ(sched->getPendingJobCount(), 0);
+    // in render_only the offline job takes the budget back, and the realtime job's is freed
+    sched->setMode(Mode::render_only);
+    EXPECT_EQ(sched->nTilesInFlight.load(), 100);
+    EXPECT_EQ(sched->trySubmit({ cam, world, JobType::offline }), JobID_INVALID);
+    sched->setMode(Mode::live_gui);
+    EXPECT_EQ(sched->nTilesInFlight.load(), 4);
+    // and a job ending while parked has nothing to give back
+    sched->cancel(offline);
+    sched->cancel(realtime);
+    EXPECT_EQ(sched->nTilesInFlight.load(), 0);
+}
+
+TEST_F(RenderJobSchedulerTests, PausedJobsDontHoldTheBudget) {
+    // a paused job makes room for those pending until it's resumed
+    sched->setTileBudget(100);
+    cam.setHSize(320); cam.setVSize(320); // 100 tiles
+    const auto large = sched->submit({ cam, world, JobType::realtime });
+    cam.setHSize(64); cam.setVSize(64); // 4 tiles
+    const auto small = sched->submit({ cam, world, JobType::realtime });
+    EXPECT_EQ(sched->getPendingJobCount(), 1);
+    EXPECT_TRUE(sched->pause(large));
+    EXPECT_EQ(sched->getPendingJobCount(), 0);
+    EXPECT_TRUE(sched->getJobState(small)->isStarted.load());
+    EXPECT_EQ(sched->nTilesInFlight.load(), 4);
+    // resumed, the job takes its share back, even over the budget
+    EXPECT_TRUE(sched->resume(large));
+    EXPECT_EQ(sched->nTilesInFlight.load(), 104);
+    EXPECT_EQ(sched->trySubmit({ cam, world, JobType::realtime }), JobID_INVALID);
+    sched->cancel(large);
+    EXPECT_EQ(sched->nTilesInFlight.load(), 4);
+}
+
+TEST_F(RenderJobSchedulerTests, JobLargerThanTheBudgetIsAdmittedAlone) {
+    // a job with more tiles than the whole budget runs once nothing else is in flight,
+    //  and cancelling it drops its tiles, queued or not, making room at once
+    sched->setTileBudget(4);
+    const auto large = sched->trySubmit({ cam, world, JobType::background }); // 64 tiles
+    ASSERT_NE(large, JobID_INVALID);
+    cam.setHSize(32); cam.setVSize(32);
+    EXPECT_EQ(sched->trySubmit({ cam, world, JobType::background }), JobID_INVALID);
+    sched->cancel(large);
+    auto s = sched->getJobState(large);
+    EXPECT_TRUE(sched->tiles.empty());
+    EXPECT_TRUE(s->isCompleted.load());
+    EXPECT_EQ(s->nTilesRemain.load(), 0);
+    EXPECT_NE(sched->trySubmit({ cam, world, JobType::background }), JobID_INVALID);
+}
+
+TEST_F(RenderJobSchedulerTests, OfflineJobsBuildHighQualityTrees) {
+    // offline renders trace for long enough to pay for spatial split
+    //  BVHs, while realtime renders keep the fast builds. The World is
+    //  switched as tiles are dispatched, never on submit
+    cam.setHSize(16);
+    cam.setVSize(16);
+    sched->setMode(Mode::render_only);
+    sched->submit({ cam, world, JobType::offline });
+    EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::fast);
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::high);
+    // a realtime job submitted while the offline tile is out leaves the World be
+    sched->submit({ cam, world, JobType::realtime });
+    EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::high);
+    sched->setTileComplete(*t);
+    sched->setMode(Mode::live_gui);
+    auto r = sched->getNextTile();
+    ASSERT_TRUE(r);
+    EXPECT_EQ(r->state->job.type, JobType::realtime);
+    EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::fast);
+}
+
+TEST_F(RenderJobSchedulerTests, BuildQualitySwitchesOnceTilesAreHandedBack) {
+    // a realtime tile waits for the offline tile still out before the
+    //  World is rebuilt for it
+    cam.setHSize(16);
+    cam.setVSize(16);
+    sched->setMode(Mode::render_only);
+    sched->submit({ cam, world, JobType::offline });
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    sched->submit({ cam, world, JobType::realtime });
+    sched->setMode(Mode::live_gui);
+    std::atomic<bool> isTaken{ false };
+    auto th = std::jthread{ [&]() {
+        auto r = sched->getNextTile();
+        isTaken = r.has_value();
+    } };
+    std::this_thread::sleep_for(20ms);
+    EXPECT_FALSE(isTaken.load());
+    EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::high);
+    sched->yieldTile(*t);
+    th.join();
+    EXPECT_TRUE(isTaken.load());
+    EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::fast);
+}
+
 TEST_F(RenderJobSchedulerTests, IgnoreOfflineJobsInLiveGUIMode) {
     // submitting an offline type render job is ignored when
     //  the scheduler is in Live GUI rendering mode
-    EXPECT_TRUE(false);
+    EXPECT_EQ(sched->getMode(), Mode::live_gui);
+    cam.setHSize(64);
+    cam.setVSize(64);
+    const auto offline = sched->submit({ cam, world, JobType::offline });
+    EXPECT_TRUE(sched->tiles.empty());
+    EXPECT_EQ(sched->parked.size(), 4);
+    // realtime jobs are still dispatched around it
+    const auto realtime = sched->submit({ cam, world, JobType::realtime });
+    for (int i{ }; i < 4; ++i) {
+        auto t = sched->getNextTile();
+        ASSERT_TRUE(t);
+        EXPECT_EQ(t->jobID, realtime);
+    }
+    EXPECT_TRUE(sched->tiles.empty());
+    // the offline job's tiles are kept, not discarded
+    auto s = sched->getJobState(offline);
+    ASSERT_NE(s, nullptr);
+    EXPECT_EQ(s->nTilesRemain.load(), 4);
+    EXPECT_FALSE(s->isCompleted.load());
+}
+
+TEST_F(RenderJobSchedulerTests, ParkedTilesResumeWhenModeChanges) {
+    // render_only mode dispatches only offline jobs, parking everything
+    //  else, and each mode switch resumes the tiles the other one parked
+    cam.setHSize(64);
+    cam.setVSize(64);
+    const auto offline = sched->submit({ cam, world, JobType::offline });
+    const auto background = sched->submit({ cam, world, JobType::background });
+    EXPECT_EQ(sched->tiles.size(), 4);
+    sched->setMode(Mode::render_only);
+    EXPECT_EQ(sched->getMode(), Mode::render_only);
+    EXPECT_EQ(sched->tiles.size(), 4);
+    EXPECT_EQ(sched->parked.size(), 4);
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_EQ(t->jobID, offline);
+    sched->setTileComplete(*t);
+    // back in the GUI, the background job resumes and the rest of the offline job waits
+    sched->setMode(Mode::live_gui);
+    EXPECT_EQ(sched->tiles.size(), 4);
+    EXPECT_EQ(sched->parked.size(), 3);
+    t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_EQ(t->jobID, background);
+    // cancelling a job drops its parked tiles, ending it
+    sched->cancel(offline);
+    EXPECT_TRUE(sched->parked.empty());
+    auto s = sched->getJobState(offline);
+    ASSERT_NE(s, nullptr);
+    EXPECT_TRUE(s->isCompleted.load());
+    EXPECT_EQ(s->nTilesComplete.load(), 1);
+}
+
+TEST_F(RenderJobSchedulerTests, YieldsToMoreUrgentJobs) {
+    // a worker part way through a tile yields when a tile of a more
+    //  urgent job is queued, or its own job is parked
+    cam.setHSize(32);
+    cam.setVSize(32);
+    sched->submit({ cam, world, JobType::background });
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_FALSE(sched->shouldYield(*t));
+    // a job of the same type doesn't preempt it
+    sched->submit({ cam, world, JobType::background });
+    EXPECT_FALSE(sched->shouldYield(*t));
+    const auto realtime = sched->submit({ cam, world, JobType::realtime });
+    EXPECT_TRUE(sched->shouldYield(*t));
+    // the rest of the tile is handed back, and comes back after the realtime tile
+    t->y0 = 16;
+    sched->yieldTile(*t);
+    auto next = sched->getNextTile();
+    ASSERT_TRUE(next);
+    EXPECT_EQ(next->jobID, realtime);
+    EXPECT_FALSE(sched->shouldYield(*t));
+    sched->setMode(Mode::render_only);
+    EXPECT_TRUE(sched->shouldYield(*t));
+    // its job still counts it as one tile remaining
+    EXPECT_EQ(t->state->nTilesRemain.load(), 1);
+}
+
+TEST_F(RenderJobSchedulerTests, TileYieldedAfterItsJobIsCancelledIsDropped) {
+    // a job cancelled between a worker's last check and its yield has had its
+    //  queued tiles swept already, so the rest of the tile ends the job too
+    cam.setHSize(32);
+    cam.setVSize(32);
+    const auto id = sched->submit({ cam, world, JobType::background });
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_TRUE(sched->pause(id));
+    sched->cancel(id);
+    EXPECT_FALSE(t->state->isCompleted.load());
+    t->y0 = 16;
+    sched->yieldTile(*t);
+    EXPECT_TRUE(t->state->isCompleted.load());
+    EXPECT_EQ(t->state->nTilesRemain.load(), 0);
+    EXPECT_TRUE(sched->tiles.empty());
+    EXPECT_TRUE(sched->parked.empty());
+}
+
+TEST_F(RenderJobSchedulerTests, PausingAJobLeavesOthersAging) {
+    // only the paused job's tiles are parked, so the tiles of other jobs
+    //  keep their times queued, and their classes their time since last served
+    cam.setHSize(32);
+    cam.setVSize(32);
+    const auto paused = sched->submit({ cam, world, JobType::background });
+    const auto other = sched->submit({ cam, world, JobType::realtime });
+    const auto c = TileQueue::classOf(JobType::realtime);
+    const auto tQueued = sched->tiles.heaps[c].front().tQueued;
+    const auto tLastServed = sched->tiles.tLastServed[c];
+    std::this_thread::sleep_for(1ms);
+    EXPECT_TRUE(sched->pause(paused));
+    EXPECT_EQ(sched->parked.size(), 1);
+    ASSERT_EQ(sched->tiles.size(), 1);
+    EXPECT_EQ(sched->tiles.heaps[c].front().jobID, other);
+    EXPECT_EQ(sched->tiles.heaps[c].front().tQueued, tQueued);
+    EXPECT_EQ(sched->tiles.tLastServed[c], tLastServed);
+    // and resuming moves only the paused job's tiles back
+    EXPECT_TRUE(sched->resume(paused));
+    EXPECT_TRUE(sched->parked.empty());
+    EXPECT_EQ(sched->tiles.heaps[c].front().tQueued, tQueued);
+    EXPECT_EQ(sched->tiles.tLastServed[c], tLastServed);
+}
+
+TEST_F(RenderJobSchedulerTests, FitsJobsToTheirBudget) {
+    // a job with a budget keeps the passes which fit in it, at the measured throughput
+    cam.setHSize(256);
+    cam.setVSize(256);
+    Job job{ cam, world, JobType::realtime };
+    job.passes = { 16, 4, 1 };
+    // 256 + 4096 rays fit in 5ms at 1us per ray, but the last pass's 65536 rays don't
+    job.budget = 5ms;
+    auto tileSize = JobScheduler::fitJobToBudget(job, 1000., 1);
+    EXPECT_EQ(job.passes, (std::vector<uint32_t>{ 16, 4 }));
+    EXPECT_EQ(job.rayDepth, World::MAX_RAYS);
+    // 32px tiles of the 4px pass are 64 rays, so each worker gets plenty
+    EXPECT_EQ(tileSize, 32);
+    // twice the workers fit the last pass too
+    job.passes = { 16, 4, 1 };
+    job.budget = 40ms;
+    tileSize = JobScheduler::fitJobToBudget(job, 1000., 2);
+    EXPECT_EQ(job.passes, (std::vector<uint32_t>{ 16, 4, 1 }));
+    EXPECT_EQ(tileSize, 32);
+    tileSize = JobScheduler::fitJobToBudget(job, 10000., 2);
+    EXPECT_EQ(job.passes, (std::vector<uint32_t>{ 16, 4 }));
+    // tiles of a full resolution pass shrink until each worker gets several in the budget
+    job.passes = { 1 };
+    job.budget = 3ms;
+    tileSize = JobScheduler::fitJobToBudget(job, 1000., 1);
+    EXPECT_EQ(tileSize, 16);
+    // the coarsest pass is kept even when it doesn't fit, with fewer bounces
+    job.passes = { 1 };
+    job.budget = 1ms;
+    tileSize = JobScheduler::fitJobToBudget(job, 1000., 1);
+    EXPECT_EQ(job.passes, (std::vector<uint32_t>{ 1 }));
+    EXPECT_EQ(job.rayDepth, 0);
+    EXPECT_EQ(tileSize, 8);
+}
+
+TEST_F(RenderJobSchedulerTests, DeadlineEndsJobWithThePassesDone) {
+    // when a job's budget runs out, its remaining tiles are dropped and
+    //  it completes with the passes which were rendered in full
+    cam.setHSize(64);
+    cam.setVSize(64);
+    Job job{ cam, world, JobType::realtime };
+    job.passes = { 32, 1 };
+    job.budget = 50ms;
+    sched->nsPerRay = 1.;
+    const auto id = sched->submit(job);
+    auto s = sched->getJobState(id);
+    ASSERT_NE(s, nullptr);
+    EXPECT_EQ(s->job.passes.size(), 2);
+    EXPECT_EQ(s->nTiles, 8);
+    // the coarse pass is rendered in time
+    for (int i{ }; i < 4; ++i) {
+        auto t = sched->getNextTile();
+        ASSERT_TRUE(t);
+        EXPECT_EQ(t->nPass, 0);
+        sched->setTileComplete(*t);
+    }
+    auto summary = JobScheduler::makeSummary(s);
+    EXPECT_EQ(summary.nPassesComplete, 1);
+    EXPECT_FALSE(summary.isDeadlineHit);
+    std::this_thread::sleep_for(60ms);
+    // nothing else is handed out, and the job ends
+    auto th = std::jthread{ [&] {
+        std::this_thread::sleep_for(15ms);
+        sched->shutdown();
+    } };
+    EXPECT_FALSE(sched->getNextTile());
+    EXPECT_TRUE(s->isCompleted.load());
+    summary = JobScheduler::makeSummary(s);
+    EXPECT_TRUE(summary.isDeadlineHit);
+    EXPECT_EQ(summary.nPassesComplete, 1);
+    EXPECT_EQ(summary.nPasses, 2);
 }
 
 TEST_F(RenderJobSchedulerTests, GetNoTileWhenEmpty) {
@@ -389,6 +861,7 @@ TEST_F(RenderJobSchedulerTests, GetNextPriorityTile) {
     // a single job is added to the queue and all details
     //  are verified
     EXPECT_EQ(sched->jobs.size(), 0);
+    sched->setMode(Mode::render_only);
     cam.setHSize(96);
     cam.setVSize(32); // 3x1 tiles
     Job job{ cam, world, JobType::offline };
@@ -427,6 +900,7 @@ TEST_F(RenderJobSchedulerTests, GetJobState) {
 TEST_F(RenderJobSchedulerTests, SetTileUpdatesCounts) {
     // calling .setTileComplete() increments and decrements the
     //  proper counters on JobState
+    sched->setMode(Mode::render_only);
     cam.setHSize(64);
     cam.setVSize(64);
     const auto id = sched->submit({
@@ -449,6 +923,7 @@ TEST_F(RenderJobSchedulerTests, SetTileUpdatesCounts) {
 TEST_F(RenderJobSchedulerTests, SetTileCompleteFinishesJob) {
     // completing the final tile in a job finishes it
     //  (nb: no Finalizer connected, so we can verify the state in the local job register)
+    sched->setMode(Mode::render_only);
     cam.setHSize(64);
     cam.setVSize(64);
     const auto id = sched->submit({
@@ -498,11 +973,9 @@ TEST_F(RenderJobSchedulerTests, JobIsCancelled) {
     // the job state reflects being cancelled
     auto state = sched->getJobState(id);
     ASSERT_NE(state, nullptr);
-    EXPECT_EQ(state->nTilesRemain.load(), 61);
     EXPECT_TRUE(state->isCancelled.load(std::memory_order_relaxed));
-    // no more tiles received
-    auto t = sched->getNextTile();
-    EXPECT_FALSE(t);
+    // its tiles are dropped at once, queued or not, so no more are received
+    EXPECT_TRUE(sched->tiles.empty());
     // no tiles remain and the job is marked completed
     auto s = sched->getJobState(id);
     ASSERT_NE(s, nullptr);
@@ -658,12 +1131,232 @@ TEST_F(RenderJobFinalizerIntegration, AttachFinalizerToScheduler) {
 
 TEST_F(RenderJobFinalizerIntegration, FinalizedToDisk) {
     // a job is finalized and rendered to disk as a file
-    EXPECT_TRUE(false);
+    auto summary = JobScheduler::makeSummary(st);
+    summary.target.path = "finalized_to_disk.ppm";
+    summary.target.isWrittenToDisk = true;
+    summary.target.buffer.writePixel(3, 4, Colour{ 1., 0.5, 0. });
+    std::filesystem::remove(summary.target.path);
+    std::atomic<bool> isFileThere{ false };
+    finalizer.start();
+    finalizer.push({ summary, [&](const JobSummary& s) {
+        // the image is written before the callback is made
+        isFileThere = std::filesystem::exists(s.target.path);
+    } });
+    finalizer.stop();
+    EXPECT_TRUE(isFileThere);
+    std::ifstream file{ summary.target.path };
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const auto& buffer = summary.target.buffer;
+    EXPECT_EQ(contents.str(), buffer.generatePPMHeader() + buffer.toPPM() + "\n");
+    EXPECT_NE(finalizer.getSummary(id), nullptr);
+    std::filesystem::remove(summary.target.path);
 }
 
 TEST_F(RenderJobFinalizerIntegration, FinalizedToBuffer) {
     // a job is finalized to an image buffer (only)
-    EXPECT_TRUE(false);
+    auto summary = JobScheduler::makeSummary(st);
+    summary.target.path = "finalized_to_buffer.ppm";
+    summary.target.buffer.writePixel(3, 4, Colour{ 1., 0.5, 0. });
+    std::filesystem::remove(summary.target.path);
+    finalizer.start();
+    finalizer.push({ summary, nullptr });
+    finalizer.stop();
+    EXPECT_FALSE(std::filesystem::exists(summary.target.path));
+    auto res = finalizer.getSummary(id);
+    ASSERT_NE(res, nullptr);
+    EXPECT_EQ(res->target.buffer.pixelAt(3, 4), Colour(1., 0.5, 0.));
+}
+
+TEST_F(RenderJobFinalizerIntegration, CallbacksNeverOverlap) {
+    // jobs written to disk are called back from the writer stage, and others
+    //  from the first stage, yet no two callbacks run at once
+    auto toDisk = JobScheduler::makeSummary(st);
+    toDisk.target.path = "slow_write.ppm";
+    toDisk.target.isWrittenToDisk = true;
+    auto toBuffer = JobScheduler::makeSummary(st);
+    toBuffer.id = id + 1;
+    std::binary_semaphore isDiskCallbackHeld{ 0 }, isDiskCallbackEntered{ 0 };
+    std::atomic<bool> isBufferCalledBack{ false };
+    finalizer.start();
+    // the writer stage is held up in the disk job's callback, which doesn't hold up pushes
+    finalizer.push({ toDisk, [&](const JobSummary&) {
+        isDiskCallbackEntered.release();
+        isDiskCallbackHeld.acquire();
+    } });
+    isDiskCallbackEntered.acquire();
+    finalizer.push({ toBuffer, [&](const JobSummary&) { isBufferCalledBack = true; } });
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(isBufferCalledBack);
+    isDiskCallbackHeld.release();
+    finalizer.stop();
+    EXPECT_TRUE(isBufferCalledBack);
+    std::filesystem::remove(toDisk.target.path);
+}
+
+TEST_F(RenderJobFinalizerIntegration, ManyThreadsPushJobs) {
+    // jobs end on whichever worker finishes them, so several threads push at once,
+    //  overrunning the queue, and every job is finalized once
+    constexpr uint32_t N_THREADS{ 4 }, N_PER_THREAD{ 600 };
+    std::atomic<uint32_t> nCalledBack{ 0 };
+    finalizer.setRetention({ .maxCount = N_THREADS * N_PER_THREAD });
+    finalizer.start();
+    std::vector<std::jthread> producers;
+    for (uint32_t n{ }; n < N_THREADS; ++n) {
+        producers.emplace_back([&, n] {
+            for (uint32_t i{ }; i < N_PER_THREAD; ++i) {
+                JobSummary s{ ImageTarget{ 1, 1 } };
+                s.id = n * N_PER_THREAD + i;
+                finalizer.push({ s, [&](const JobSummary&) { ++nCalledBack; } });
+            }
+        });
+    }
+    producers.clear();
+    finalizer.stop();
+    EXPECT_EQ(nCalledBack.load(), N_THREADS * N_PER_THREAD);
+    for (JobID i{ }; i < N_THREADS * N_PER_THREAD; ++i) {
+        ASSERT_NE(finalizer.getSummary(i), nullptr);
+    }
+}
+
+TEST_F(RenderJobFinalizerIntegration, JobsEndedOverAFullQueueDontHoldTheScheduler) {
+    // the finalizer erases the states of the jobs it's done with from the scheduler, so jobs
+    //  ending while its queue is full mustn't wait for room with the scheduler held
+    constexpr uint32_t N_JOBS{ JobFinalizer::QUEUE_SIZE + 8 };
+    sched->attachToFinalizer(finalizer);
+    // each job is cancelled with its only tile queued, so it ends with the scheduler held
+    Camera tiny{ 8, 8, HALF_PI };
+    const Job small{ tiny, world, JobType::background };
+    std::vector<JobID> ids;
+    for (uint32_t n{ }; n < N_JOBS; ++n) {
+        ids.push_back(sched->submit(small));
+    }
+    // the first stage is held up in the first job's callback while the others fill the queue
+    std::binary_semaphore isCallbackHeld{ 0 }, isCallbackEntered{ 0 };
+    sched->getJobState(ids.front())->onJobEnd = [&](const JobSummary&) {
+        isCallbackEntered.release();
+        isCallbackHeld.acquire();
+    };
+    finalizer.start();
+    sched->cancel(ids.front());
+    isCallbackEntered.acquire();
+    auto cancels = std::async(std::launch::async, [&] {
+        for (size_t n{ 1 }; n < ids.size(); ++n) {
+            sched->cancel(ids[n]);
+        }
+    });
+    EXPECT_EQ(cancels.wait_for(1s), std::future_status::timeout);
+    isCallbackHeld.release();
+    ASSERT_EQ(cancels.wait_for(10s), std::future_status::ready);
+    finalizer.stop();
+    EXPECT_EQ(sched->getJobState(ids.back()), nullptr);
+}
+
+TEST_F(RenderJobFinalizerIntegration, RetentionEvictsLeastRecentlyUsed) {
+    // past the count limit, the summary least recently finalized or looked up goes first
+    finalizer.setRetention({ .maxCount = 2 });
+    const auto finalize = [&](JobID n) {
+        JobToFinalize job{ JobSummary{ ImageTarget{ 4, 4 } }, nullptr };
+        job.summary.id = n;
+        finalizer.complete(job);
+    };
+    finalize(1);
+    finalize(2);
+    EXPECT_NE(finalizer.getSummary(1), nullptr);
+    finalize(3);
+    EXPECT_EQ(finalizer.getSummaryCount(), 2);
+    EXPECT_NE(finalizer.getSummary(1), nullptr);
+    EXPECT_EQ(finalizer.getSummary(2), nullptr);
+    EXPECT_NE(finalizer.getSummary(3), nullptr);
+    // a summary being looked at outlives its eviction
+    auto held = finalizer.getSummary(3);
+    finalizer.setRetention({ .maxCount = 0 });
+    EXPECT_EQ(finalizer.getSummaryCount(), 0);
+    EXPECT_EQ(finalizer.getMemoryUse(), 0);
+    EXPECT_EQ(held->id, 3);
+}
+
+TEST_F(RenderJobFinalizerIntegration, RetentionLimitsBytesAndAge) {
+    // summaries are evicted to keep their memory under the byte limit,
+    //  and once they are older than the age limit
+    const auto finalize = [&](JobID n) {
+        JobToFinalize job{ JobSummary{ ImageTarget{ 64, 64 } }, nullptr };
+        job.summary.id = n;
+        finalizer.complete(job);
+    };
+    finalize(1);
+    const auto bytesEach = finalizer.getMemoryUse();
+    EXPECT_GT(bytesEach, 64 * 64 * sizeof(Colour));
+    finalizer.setRetention({ .maxBytes = bytesEach * 3 });
+    for (JobID n{ 2 }; n <= 5; ++n) {
+        finalize(n);
+    }
+    EXPECT_EQ(finalizer.getSummaryCount(), 3);
+    EXPECT_EQ(finalizer.getMemoryUse(), bytesEach * 3);
+    EXPECT_EQ(finalizer.getSummary(2), nullptr);
+    EXPECT_NE(finalizer.getSummary(5), nullptr);
+    std::this_thread::sleep_for(5ms);
+    finalize(6);
+    finalizer.setRetention({ .maxAge = 2ms });
+    EXPECT_EQ(finalizer.getSummaryCount(), 1);
+    EXPECT_NE(finalizer.getSummary(6), nullptr);
+}
+
+TEST_F(RenderJobFinalizerIntegration, ReleasesBuffersAfterCallbacks) {
+    // once a callback has had a job's image, its pixels are freed,
+    //  unless the retention policy says to keep them
+    const auto finalize = [&](JobID n) {
+        JobToFinalize job{ JobSummary{ ImageTarget{ 64, 64 } }, [](const JobSummary& s) {
+            EXPECT_EQ(s.target.buffer.getWidth(), 64);
+        } };
+        job.summary.id = n;
+        finalizer.complete(job);
+    };
+    finalize(1);
+    EXPECT_EQ(finalizer.getSummary(1)->target.buffer.getWidth(), 0);
+    EXPECT_LT(finalizer.getMemoryUse(), 64 * 64 * sizeof(Colour));
+    finalizer.setRetention({ .isBufferKeptAfterCallback = true });
+    finalize(2);
+    EXPECT_EQ(finalizer.getSummary(2)->target.buffer.getWidth(), 64);
+}
+
+TEST_F(RenderJobFinalizerIntegration, ReportsMemoryUseOfBothRegistries) {
+    // the scheduler's job states and the finalizer's summaries both count
+    //  their images, and a finalized job's state is released from the scheduler
+    sched->attachToFinalizer(finalizer);
+    const auto image = static_cast<size_t>(cam.getHSize()) * cam.getVSize() * sizeof(Colour);
+    EXPECT_GT(sched->getMemoryUse(), image);
+    EXPECT_EQ(finalizer.getMemoryUse(), 0);
+    sched->cancel(id);
+    sched->setMode(Mode::render_only);
+    finalizer.start();
+    while (sched->tiles.size() > 0) {
+        (void) sched->getNextTile();
+    }
+    finalizer.stop();
+    EXPECT_EQ(sched->getMemoryUse(), 0);
+    EXPECT_GT(finalizer.getMemoryUse(), image);
+}
+
+TEST(MPSCQueue, TakesItemsInOrderAndReportsFull) {
+    // a single producer's items come out in order, and pushes fail
+    //  once the (power of two) capacity is reached
+    MPSCQueue<int> q{ 3 };
+    EXPECT_EQ(q.getCapacity(), 4);
+    EXPECT_TRUE(q.empty());
+    for (int i{ }; i < 4; ++i) {
+        EXPECT_TRUE(q.try_push(i));
+    }
+    EXPECT_FALSE(q.try_push(4));
+    for (int lap{ }; lap < 3; ++lap) {
+        for (int i{ }; i < 4; ++i) {
+            ASSERT_NE(q.front(), nullptr);
+            EXPECT_EQ(*q.front(), lap * 4 + i);
+            q.pop();
+            EXPECT_TRUE(q.try_push((lap + 1) * 4 + i));
+        }
+    }
+    EXPECT_FALSE(q.empty());
 }
 
 TEST_F(RenderJobFinalizerIntegration, GetSummaryOfFinalizedJob) {
@@ -686,6 +1379,7 @@ TEST_F(RenderJobFinalizerIntegration, FinalizesFromScheduler) {
     //   the job is automatically enqueued to the finalizer, which
     //   is appropriately finalized
     sched->attachToFinalizer(finalizer);
+    sched->setMode(Mode::render_only);
     finalizer.start();
     // complete the job by marking all tiles complete
     const auto nTiles = st->nTiles;
@@ -716,6 +1410,7 @@ protected:
 
     void SetUp() override {
         RenderJobSchedulerTests::SetUp();
+        sched->setMode(Mode::render_only);
         worker = std::make_unique<Worker>(ID, *sched);
     }
 };
@@ -755,14 +1450,16 @@ TEST_F(RenderWorkerTests, ConsumesTileFromScheduler) {
     auto s = sched->getJobState(id);
     auto n_init = s->nTilesRemain.load();
     EXPECT_EQ(n_init, 64);
-    auto th = std::jthread{[&]() {
-        std::this_thread::sleep_for(50ms);
-        sched->shutdown();
-    }};
     worker->start();
-    std::this_thread::sleep_for(10ms);
+    // a whole tile is rendered first, which takes as long as the machine needs
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (s->nTilesRemain.load() == n_init && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
     auto n_final = s->nTilesRemain.load();
     EXPECT_LT(n_final, n_init);
+    sched->shutdown();
+    worker->stop();
 }
 
 TEST_F(RenderWorkerTests, RendersToFrameBuffer) {
@@ -779,6 +1476,592 @@ TEST_F(RenderWorkerTests, RendersToFrameBuffer) {
     //  just verifying that pixels have been written and state has changed
     EXPECT_TRUE(s->job.target.buffer.isBlank());
     // start rendering
-    EXPECT_TRUE(false);
+    worker->start();
+    for (int i{ }; i < 500 && !s->isCompleted.load(); ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    sched->shutdown();
+    worker->stop();
+    EXPECT_TRUE(s->isCompleted.load());
+    EXPECT_EQ(s->nTilesComplete.load(), 4);
+    EXPECT_EQ(s->nPixelsComplete.load(), 64 * 64);
+    EXPECT_FALSE(s->job.target.buffer.isBlank());
+    // the rendering time was measured, for planning jobs with budgets
+    EXPECT_NE(sched->getNsPerRay(), JobScheduler::DEFAULT_NS_PER_RAY);
+}
+
+TEST_F(RenderWorkerTests, PublishesTileEventsAsTheyLand) {
+    // each tile rendered is published to the job's event stream, so a GUI
+    //  can blit only the regions of the image which have changed
+    cam.setHSize(64); cam.setVSize(48);
+    auto job = Job{ cam, world, JobType::offline };
+    job.passes = { 4, 1 };
+    job.tileEvents = std::make_shared<TileEventStream>();
+    auto id = sched->submit(job);
+    auto s = sched->getJobState(id);
+    worker->start();
+    for (int i{ }; i < 500 && !s->isCompleted.load(); ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    sched->shutdown();
+    worker->stop();
+    ASSERT_TRUE(s->isCompleted.load());
+    uint64_t area[2]{ };
+    const auto n = job.tileEvents->drain([&](const TileEvent& e) {
+        EXPECT_EQ(e.jobID, id);
+        EXPECT_LT(e.x0, e.x1);
+        EXPECT_LT(e.y0, e.y1);
+        EXPECT_LE(e.x1, 64u);
+        EXPECT_LE(e.y1, 48u);
+        ASSERT_LT(e.nPass, 2u);
+        area[e.nPass] += static_cast<uint64_t>(e.x1 - e.x0) * (e.y1 - e.y0);
+    });
+    EXPECT_EQ(n, s->nTiles);
+    EXPECT_EQ(area[0], 64 * 48);
+    EXPECT_EQ(area[1], 64 * 48);
+    EXPECT_EQ(job.tileEvents->takeDroppedCount(), 0);
+}
+
+TEST_F(RenderWorkerTests, PublishesRowsRenderedBeforeYielding) {
+    // the rows of a tile rendered before yielding it are published,
+    //  and the rest once it is picked up again
+    cam.setHSize(32); cam.setVSize(32);
+    auto job = Job{ cam, world, JobType::offline };
+    job.tileEvents = std::make_shared<TileEventStream>();
+    sched->submit(job);
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    sched->setMode(Mode::live_gui);
+    EXPECT_FALSE(worker->renderTile(*t));
+    std::vector<TileEvent> events;
+    job.tileEvents->drain([&](const TileEvent& e) { events.push_back(e); });
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].y0, 0);
+    EXPECT_EQ(events[0].y1, 2);
+    EXPECT_EQ(events[0].x1, 32);
+    sched->setMode(Mode::render_only);
+    t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_TRUE(worker->renderTile(*t));
+    events.clear();
+    job.tileEvents->drain([&](const TileEvent& e) { events.push_back(e); });
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].y0, 2);
+    EXPECT_EQ(events[0].y1, 32);
+}
+
+TEST_F(RenderWorkerTests, DropsTileEventsForCancelledJobs) {
+    // nothing is published for a job which is cancelled, even by a worker
+    //  already part way through one of its tiles
+    cam.setHSize(32); cam.setVSize(32);
+    auto job = Job{ cam, world, JobType::offline };
+    job.tileEvents = std::make_shared<TileEventStream>();
+    auto id = sched->submit(job);
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    sched->cancel(id);
+    worker->renderTile(*t);
+    EXPECT_EQ(job.tileEvents->drain([](const TileEvent&) { }), 0);
+}
+
+TEST_F(RenderWorkerTests, StopsCancelledTileAtTheNextRow) {
+    // a worker part way through a tile of a cancelled job drops the rest
+    //  of it at the end of the row it's on, ending the job
+    cam.setHSize(32); cam.setVSize(32);
+    auto id = sched->submit(Job{ cam, world, JobType::offline });
+    auto s = sched->getJobState(id);
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    sched->cancel(id);
+    EXPECT_FALSE(worker->renderTile(*t));
+    EXPECT_EQ(s->nPixelsComplete.load(), 32 * 2);
+    EXPECT_EQ(s->nTilesRemain.load(), 0);
+    EXPECT_EQ(s->nTilesComplete.load(), 0);
+    EXPECT_TRUE(s->isCompleted.load());
+}
+
+TEST_F(RenderWorkerTests, AgedTilesAreRenderedThroughUnderRealtimeLoad) {
+    // a background tile taken past its aging limit is rendered whole, rather
+    //  than yielding to the realtime tiles it was taken ahead of after a row
+    sched->setMode(Mode::live_gui);
+    sched->setAgingLimit(JobType::background, 20ms);
+    auto background = sched->getJobState(sched->submit(Job{ cam, world, JobType::background })); // 64 tiles
+    cam.setHSize(64); cam.setVSize(64);
+    // a few realtime jobs are kept in flight, so their tiles are always waiting
+    std::deque<std::shared_ptr<JobState>> realtime;
+    worker->start();
+    const auto tEnd = std::chrono::steady_clock::now() + 1s;
+    while (std::chrono::steady_clock::now() < tEnd) {
+        std::erase_if(realtime, [](const auto& s) { return s->isCompleted.load(); });
+        while (realtime.size() < 4) {
+            realtime.push_back(sched->getJobState(sched->submit(Job{ cam, world, JobType::realtime })));
+        }
+        std::this_thread::sleep_for(100us);
+    }
+    sched->shutdown();
+    worker->stop();
+    const auto nTaken = sched->getWaitStats(JobType::background).nTaken;
+    const auto nComplete = background->nTilesComplete.load();
+    EXPECT_GE(nComplete, 8);
+    // all but one out when the worker stopped, or taken in a lull in the realtime load
+    EXPECT_GE(nComplete + 2, nTaken);
 }
 
+TEST_F(RenderWorkerTests, KeepsRenderingAfterCancellingQueuedTiles) {
+    // cancelling a job with tiles still queued, while a worker renders one
+    //  of them, ends it at once; the worker carries on with the next job
+    cam.setHSize(128); cam.setVSize(128);
+    auto first = sched->getJobState(sched->submit(Job{ cam, world, JobType::offline }));
+    worker->start();
+    for (int i{ }; i < 500 && first->nPixelsComplete.load() == 0; ++i) {
+        std::this_thread::sleep_for(1ms);
+    }
+    sched->cancel(first->job.id);
+    // only the tile the worker is on is left, and it stops at the end of its row
+    EXPECT_LE(first->nTilesRemain.load(), 1);
+    cam.setHSize(64); cam.setVSize(64);
+    auto second = sched->getJobState(sched->submit(Job{ cam, world, JobType::offline }));
+    for (int i{ }; i < 500 && !second->isCompleted.load(); ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_TRUE(first->isCompleted.load());
+    EXPECT_LT(first->nTilesComplete.load(), first->nTiles);
+    EXPECT_TRUE(second->isCompleted.load());
+    EXPECT_EQ(second->nTilesComplete.load(), second->nTiles);
+    sched->shutdown();
+    worker->stop();
+}
+
+TEST_F(RenderWorkerTests, KeepsRenderingAfterAJobRunsOutOfTime) {
+    // a job out of time before its first tile is taken has every tile
+    //  discarded; the worker waits for the next job rather than stopping
+    sched->setMode(Mode::live_gui);
+    cam.setHSize(64); cam.setVSize(64);
+    Job late{ cam, world, JobType::realtime };
+    late.budget = 1ns;
+    auto first = sched->getJobState(sched->submit(late));
+    std::this_thread::sleep_for(1ms);
+    worker->start();
+    for (int i{ }; i < 500 && !first->isCompleted.load(); ++i) {
+        std::this_thread::sleep_for(1ms);
+    }
+    ASSERT_TRUE(first->isCompleted.load());
+    EXPECT_TRUE(first->isDeadlineHit.load());
+    auto second = sched->getJobState(sched->submit(Job{ cam, world, JobType::realtime }));
+    for (int i{ }; i < 500 && !second->isCompleted.load(); ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_TRUE(second->isCompleted.load());
+    EXPECT_EQ(second->nTilesComplete.load(), second->nTiles);
+    sched->shutdown();
+    worker->stop();
+}
+
+TEST_F(RenderWorkerTests, PausedJobResumesWhereItLeftOff) {
+    // pausing a job parks its queued tiles and the rest of any tile being
+    //  rendered, and resuming queues them again, keeping the pixels done
+    cam.setHSize(64); cam.setVSize(32);
+    auto id = sched->submit(Job{ cam, world, JobType::offline });
+    auto s = sched->getJobState(id);
+    EXPECT_FALSE(sched->pause(id + 1));
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_TRUE(sched->pause(id));
+    EXPECT_TRUE(sched->tiles.empty());
+    EXPECT_EQ(sched->parked.size(), 1);
+    EXPECT_TRUE(sched->shouldYield(*t));
+    EXPECT_FALSE(worker->renderTile(*t));
+    EXPECT_EQ(s->nPixelsComplete.load(), 32 * 2);
+    EXPECT_EQ(sched->parked.size(), 2);
+    // a change of mode leaves it paused
+    sched->setMode(Mode::live_gui);
+    sched->setMode(Mode::render_only);
+    EXPECT_TRUE(sched->tiles.empty());
+    EXPECT_FALSE(s->isCompleted.load());
+    EXPECT_TRUE(sched->resume(id));
+    EXPECT_TRUE(sched->parked.empty());
+    EXPECT_EQ(sched->tiles.size(), 2);
+    while (!sched->tiles.empty()) {
+        auto next = sched->getNextTile();
+        ASSERT_TRUE(next);
+        EXPECT_TRUE(worker->renderTile(*next));
+        sched->setTileComplete(*next);
+    }
+    EXPECT_TRUE(s->isCompleted.load());
+    EXPECT_EQ(s->nPixelsComplete.load(), 64 * 32);
+    EXPECT_FALSE(sched->resume(id));
+}
+
+TEST_F(RenderWorkerTests, ResumesFromCheckpoint) {
+    // tiles finished before a job is cut short are saved to its checkpoint, and
+    //  submitting the job again restores their pixels and only queues the rest
+    const auto file = std::filesystem::temp_directory_path() / "rt_test_resume.checkpoint";
+    std::filesystem::remove(file);
+    cam.setHSize(64); cam.setVSize(64);
+    auto job = Job{ cam, world, JobType::offline };
+    job.checkpointFile = file;
+    auto first = sched->getJobState(sched->submit(job));
+    ASSERT_NE(first->checkpoint, nullptr);
+    for (int i{ }; i < 2; ++i) {
+        auto t = sched->getNextTile();
+        ASSERT_TRUE(t);
+        EXPECT_TRUE(worker->renderTile(*t));
+        sched->setTileComplete(*t);
+    }
+    sched->cancel(first->job.id);
+    ASSERT_TRUE(first->isCompleted.load());
+    EXPECT_TRUE(std::filesystem::exists(file));
+    auto second = sched->getJobState(sched->submit(job));
+    EXPECT_EQ(second->nTiles, 4);
+    EXPECT_EQ(second->nTilesComplete.load(), 2);
+    EXPECT_EQ(second->nTilesRemain.load(), 2);
+    EXPECT_EQ(second->nPixelsComplete.load(), 2 * 32 * 32);
+    EXPECT_EQ(sched->tiles.size(), 2);
+    const auto countDifferent = [](const Canvas& a, const Canvas& b) {
+        uint32_t n{ };
+        for (uint32_t y{ }; y < a.getHeight(); ++y) {
+            for (uint32_t x{ }; x < a.getWidth(); ++x) {
+                const auto p = a.pixelAt(x, y), q = b.pixelAt(x, y);
+                n += std::abs(p.R - q.R) > 1e-6 || std::abs(p.G - q.G) > 1e-6 || std::abs(p.B - q.B) > 1e-6;
+            }
+        }
+        return n;
+    };
+    EXPECT_EQ(countDifferent(first->job.target.buffer, second->job.target.buffer), 0);
+    // the rest are rendered, and the checkpoint is deleted with the job complete
+    while (!sched->tiles.empty()) {
+        auto t = sched->getNextTile();
+        ASSERT_TRUE(t);
+        EXPECT_TRUE(worker->renderTile(*t));
+        sched->setTileComplete(*t);
+    }
+    EXPECT_TRUE(second->isCompleted.load());
+    EXPECT_EQ(second->nTilesComplete.load(), 4);
+    EXPECT_EQ(second->nPixelsComplete.load(), 64 * 64);
+    EXPECT_FALSE(std::filesystem::exists(file));
+}
+
+TEST_F(RenderWorkerTests, CheckpointDropsRecordCutShort) {
+    // a record cut short by a crash is ignored, and new records follow on from the
+    //  last whole one; a checkpoint saved for another tile layout is started over
+    const auto file = std::filesystem::temp_directory_path() / "rt_test_truncated.checkpoint";
+    std::filesystem::remove(file);
+    cam.setHSize(64); cam.setVSize(32);
+    auto job = Job{ cam, world, JobType::offline };
+    job.checkpointFile = file;
+    auto first = sched->getJobState(sched->submit(job));
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_TRUE(worker->renderTile(*t));
+    sched->setTileComplete(*t);
+    sched->cancel(first->job.id);
+    ASSERT_TRUE(first->isCompleted.load());
+    const auto nBytes = std::filesystem::file_size(file);
+    {
+        std::ofstream out{ file, std::ios::binary | std::ios::app };
+        const uint32_t nTile{ 1 };
+        out.write(reinterpret_cast<const char*>(&nTile), sizeof(nTile));
+        out << std::string(100, 'x');
+    }
+    auto second = sched->getJobState(sched->submit(job));
+    EXPECT_EQ(second->nTilesComplete.load(), 1);
+    EXPECT_EQ(sched->tiles.size(), 1);
+    EXPECT_EQ(std::filesystem::file_size(file), nBytes);
+    sched->cancel(second->job.id);
+    ASSERT_TRUE(second->isCompleted.load());
+    // a different image size is a different layout
+    cam.setHSize(32);
+    auto other = Job{ cam, world, JobType::offline };
+    other.checkpointFile = file;
+    auto third = sched->getJobState(sched->submit(other));
+    EXPECT_EQ(third->nTilesComplete.load(), 0);
+    EXPECT_EQ(sched->tiles.size(), 1);
+    EXPECT_LT(std::filesystem::file_size(file), nBytes);
+    sched->cancel(third->job.id);
+    EXPECT_TRUE(third->isCompleted.load());
+    std::filesystem::remove(file);
+}
+
+TEST_F(RenderWorkerTests, CheckpointOfOtherPassesIsStartedOver) {
+    // passes of other block sizes cut the image into the same tiles, but
+    //  the pixels saved for them aren't the ones the job would render
+    const auto file = std::filesystem::temp_directory_path() / "rt_test_other_passes.checkpoint";
+    std::filesystem::remove(file);
+    cam.setHSize(64); cam.setVSize(32);
+    auto job = Job{ cam, world, JobType::offline };
+    job.passes = { 8, 1 };
+    job.checkpointFile = file;
+    auto first = sched->getJobState(sched->submit(job));
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_TRUE(worker->renderTile(*t));
+    sched->setTileComplete(*t);
+    sched->cancel(first->job.id);
+    ASSERT_TRUE(first->isCompleted.load());
+    job.passes = { 4, 1 };
+    auto second = sched->getJobState(sched->submit(job));
+    EXPECT_EQ(second->nTiles, first->nTiles);
+    EXPECT_EQ(second->nTilesComplete.load(), 0);
+    EXPECT_EQ(second->nPixelsComplete.load(), 0);
+    // the file was started over for the new passes, which resume from it as usual
+    t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_TRUE(worker->renderTile(*t));
+    sched->setTileComplete(*t);
+    sched->cancel(second->job.id);
+    ASSERT_TRUE(second->isCompleted.load());
+    auto third = sched->getJobState(sched->submit(job));
+    EXPECT_EQ(third->nTilesComplete.load(), 1);
+    sched->cancel(third->job.id);
+    EXPECT_TRUE(third->isCompleted.load());
+    std::filesystem::remove(file);
+}
+
+TEST(Checkpoint, SkipsCoarserPassesOfRestoredRects) {
+    // once a finer pass over a rect is restored, its coarser passes needn't be
+    //  rendered again, since they would only draw over it
+    const auto file = std::filesystem::temp_directory_path() / "rt_test_passes.checkpoint";
+    std::filesystem::remove(file);
+    World world{ };
+    Camera cam{ 64, 32, HALF_PI };
+    Job job{ cam, world, JobType::offline };
+    job.passes = { 4, 1 };
+    const auto state = std::make_shared<JobState>(job);
+    const auto tiles = JobScheduler::getTilesForJobState(state);
+    const auto layout = JobScheduler::makeTileCursor(job);
+    ASSERT_EQ(tiles.size(), 4);
+    EXPECT_EQ(tiles[3].nTile, 3);
+    EXPECT_EQ(tiles[3].nPass, 1);
+    {
+        Canvas image{ 64, 32 };
+        Checkpoint checkpoint;
+        ASSERT_TRUE(checkpoint.open(file, layout, job.passes, image));
+        EXPECT_EQ(checkpoint.getRestoredCount(), 0);
+        image.writePixel(40, 10, Colour{ 0.25, 0.5, 1. });
+        checkpoint.record(tiles[3], image);
+    }
+    Canvas image{ 64, 32 };
+    Checkpoint checkpoint;
+    ASSERT_TRUE(checkpoint.open(file, layout, job.passes, image));
+    EXPECT_EQ(checkpoint.getRestoredCount(), 2);
+    EXPECT_FALSE(checkpoint.isTileRestored(0));
+    EXPECT_TRUE(checkpoint.isTileRestored(1));
+    EXPECT_FALSE(checkpoint.isTileRestored(2));
+    EXPECT_TRUE(checkpoint.isTileRestored(3));
+    EXPECT_EQ(image.pixelAt(40, 10), Colour(0.25, 0.5, 1.));
+    checkpoint.remove();
+    EXPECT_FALSE(std::filesystem::exists(file));
+}
+
+TEST(TileEventStream, NeverBlocksWhenFull) {
+    // publishers drop events rather than wait on a slow consumer, and the
+    //  drops are counted so the consumer knows to refresh the whole image
+    TileEventStream events{ 2 };
+    EXPECT_TRUE(events.publish({ 1, 0, 0, 0, 8, 8 }));
+    EXPECT_TRUE(events.publish({ 1, 0, 8, 0, 16, 8 }));
+    EXPECT_FALSE(events.publish({ 1, 0, 16, 0, 24, 8 }));
+    EXPECT_EQ(events.takeDroppedCount(), 1);
+    EXPECT_EQ(events.takeDroppedCount(), 0);
+    std::vector<uint32_t> xs;
+    EXPECT_EQ(events.drain([&](const TileEvent& e) { xs.push_back(e.x0); }), 2);
+    EXPECT_EQ(xs, (std::vector<uint32_t>{ 0, 8 }));
+    EXPECT_TRUE(events.publish({ 1, 0, 16, 0, 24, 8 }));
+}
+
+TEST_F(RenderWorkerTests, SubmitsDuringAnOfflineRenderLeaveItsTreesAlone) {
+    // jobs submitted while workers trace an offline job through spatial
+    //  split trees don't rebuild the trees under them
+    std::vector<Sphere> spheres(3000);
+    for (size_t i{ }; i < spheres.size(); ++i) {
+        const auto x = static_cast<double>(i % 60) * 0.1 - 3.;
+        const auto y = static_cast<double>(i / 60) * 0.1 - 2.5;
+        spheres[i].setTransform(Transform::translation(x, y, 0.) * Transform::scale(0.04, 0.04, 0.04));
+        world.addShape(&spheres[i]);
+    }
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (uint32_t i{ }; i < 8; ++i) {
+        workers.emplace_back(std::make_unique<Worker>(i, *sched))->start();
+    }
+    cam.setHSize(64); cam.setVSize(64);
+    const auto offline = sched->getJobState(sched->submit({ cam, world, JobType::offline }));
+    for (int i{ }; i < 500 && offline->nPixelsComplete.load() == 0; ++i) {
+        std::this_thread::sleep_for(1ms);
+    }
+    std::vector<std::shared_ptr<JobState>> realtime;
+    cam.setHSize(16); cam.setVSize(16);
+    for (int i{ }; i < 500 && !offline->isCompleted.load(); ++i) {
+        realtime.push_back(sched->getJobState(sched->submit({ cam, world, JobType::realtime })));
+        sched->submit({ cam, world, JobType::offline });
+        EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::high);
+        std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_TRUE(offline->isCompleted.load());
+    EXPECT_EQ(offline->nTilesComplete.load(), offline->nTiles);
+    // the realtime jobs render once the mode allows them, on fast trees again
+    sched->setMode(Mode::live_gui);
+    for (int i{ }; i < 500 && !realtime.back()->isCompleted.load(); ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_TRUE(realtime.back()->isCompleted.load());
+    EXPECT_EQ(world.getBuildQuality(), Accel::BuildQuality::fast);
+    sched->shutdown();
+}
+
+TEST_F(RenderWorkerTests, YieldsTileToRealtimeJob) {
+    // a worker hands back the rest of an offline tile at the end of a
+    //  row when the mode parks it, having rendered the rows before
+    cam.setHSize(32); cam.setVSize(32);
+    auto id = sched->submit(Job{ cam, world, JobType::offline });
+    auto s = sched->getJobState(id);
+    auto t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    sched->setMode(Mode::live_gui);
+    EXPECT_FALSE(worker->renderTile(*t));
+    EXPECT_EQ(s->nPixelsComplete.load(), 32 * 2);
+    EXPECT_EQ(s->nTilesRemain.load(), 1);
+    // the rest of the tile is parked, and picked up where it left off
+    ASSERT_EQ(sched->parked.size(), 1);
+    EXPECT_EQ(sched->parked.top().y0, 2);
+    sched->setMode(Mode::render_only);
+    t = sched->getNextTile();
+    ASSERT_TRUE(t);
+    EXPECT_TRUE(worker->renderTile(*t));
+    EXPECT_EQ(s->nPixelsComplete.load(), 32 * 32);
+}
+
+
+
+/*
+ *  DynamicResolution
+ */
+class DynamicResolutionTests: public RenderJobSchedulerTests {
+protected:
+    DynamicResolution dynamic{ 16ms };
+
+    /// @brief Report a moving frame which took the given time to render its pass
+    void endFrame(JobID id, std::chrono::nanoseconds frameTime, bool isDeadlineHit = false) {
+        JobSummary s{ ImageTarget{ 8, 8 } };
+        s.id = id;
+        s.nPasses = 1;
+        s.nPassesComplete = isDeadlineHit ? 0 : 1;
+        s.isDeadlineHit = isDeadlineHit;
+        s.tSubmit = std::chrono::steady_clock::now();
+        s.tComplete = s.tSubmit + frameTime;
+        dynamic.onFrameEnded(s);
+    }
+    /// @brief Report a moving frame cancelled by the next one, with some share of its pass done
+    void supersedeFrame(JobID id, std::chrono::nanoseconds frameTime, double shareDone) {
+        JobSummary s{ ImageTarget{ 8, 8 } };
+        s.id = id;
+        s.nPasses = 1;
+        s.nPixelsComplete = static_cast<uint64_t>(shareDone * 64.);
+        s.tSubmit = std::chrono::steady_clock::now();
+        s.tComplete = s.tSubmit + frameTime;
+        dynamic.onFrameEnded(s);
+    }
+};
+
+TEST_F(DynamicResolutionTests, MovingFramesAreOneBudgetedPass) {
+    EXPECT_EQ(dynamic.getBlockSize(), 1);
+    Job job{ cam, world, JobType::background };
+    dynamic.prepare(job, true);
+    EXPECT_EQ(job.type, JobType::realtime);
+    EXPECT_EQ(job.passes, (std::vector<uint32_t>{ 1 }));
+    EXPECT_EQ(job.budget, 16ms);
+}
+
+TEST_F(DynamicResolutionTests, SlowFramesAreRenderedCoarser) {
+    // a frame taking 16x too long has 16x too many rays, so the
+    //  blocks grow towards 4x4 pixels, settling there
+    Job job{ cam, world, JobType::realtime };
+    for (int i{ }; i < 8; ++i) {
+        const auto id = dynamic.submitFrame(*sched, job, true);
+        const auto B = static_cast<double>(dynamic.getBlockSize());
+        endFrame(id, std::chrono::nanoseconds{ static_cast<int64_t>(256e6 / (B * B)) });
+    }
+    EXPECT_EQ(dynamic.getBlockSize(), 4);
+    // and frames which are quick again sharpen back up
+    for (int i{ }; i < 8; ++i) {
+        const auto id = dynamic.submitFrame(*sched, job, true);
+        endFrame(id, 2ms);
+    }
+    EXPECT_EQ(dynamic.getBlockSize(), 1);
+}
+
+TEST_F(DynamicResolutionTests, FramesCutOffAtTheDeadlineCoarsen) {
+    Job job{ cam, world, JobType::realtime };
+    // they're assumed to have taken twice the target, so it takes a few to change
+    JobID id{ };
+    for (int i{ }; i < 3; ++i) {
+        id = dynamic.submitFrame(*sched, job, true);
+        endFrame(id, 16ms, true);
+    }
+    EXPECT_EQ(dynamic.getBlockSize(), 2);
+    // frames near the target, and other jobs, change nothing
+    const auto B = dynamic.getBlockSize();
+    id = dynamic.submitFrame(*sched, job, true);
+    endFrame(id, 17ms);
+    endFrame(id + 100, 100ms);
+    EXPECT_EQ(dynamic.getBlockSize(), B);
+}
+
+TEST_F(DynamicResolutionTests, SupersededFramesAreMeasured) {
+    // while the camera keeps moving, each frame is cancelled by the next
+    //  before it finishes; those which had their time show how slow they are
+    Job job{ cam, world, JobType::realtime };
+    auto last = dynamic.submitFrame(*sched, job, true);
+    for (int i{ }; i < 4; ++i) {
+        const auto next = dynamic.submitFrame(*sched, job, true);
+        // a quarter done in twice the target is 8x too slow
+        supersedeFrame(last, 32ms, 0.25);
+        last = next;
+    }
+    EXPECT_GE(dynamic.getBlockSize(), 4);
+    // frames superseded before they had their time say nothing
+    const auto scale = dynamic.blockScale.load();
+    const auto next = dynamic.submitFrame(*sched, job, true);
+    supersedeFrame(last, 8ms, 0.25);
+    EXPECT_EQ(dynamic.blockScale.load(), scale);
+    // nor does a frame nothing was rendered of, unless it had its time
+    supersedeFrame(next, 16ms, 0.);
+    EXPECT_GT(dynamic.blockScale.load(), scale);
+}
+
+TEST_F(DynamicResolutionTests, FramesEndingAfterTheNextIsSubmittedCount) {
+    // a frame which finishes as the next is submitted is still measured
+    Job job{ cam, world, JobType::realtime };
+    const auto first = dynamic.submitFrame(*sched, job, true);
+    (void) dynamic.submitFrame(*sched, job, true);
+    endFrame(first, 64ms);
+    EXPECT_GT(dynamic.blockScale.load(), 1.);
+    // and only once
+    const auto scale = dynamic.blockScale.load();
+    endFrame(first, 64ms);
+    EXPECT_EQ(dynamic.blockScale.load(), scale);
+}
+
+TEST_F(DynamicResolutionTests, RefinesToFullResolutionAtRest) {
+    dynamic.blockScale = 8.;
+    Job job{ cam, world, JobType::realtime };
+    dynamic.prepare(job, false);
+    EXPECT_EQ(job.passes, (std::vector<uint32_t>{ 8, 4, 2, 1 }));
+    EXPECT_EQ(job.budget.count(), 0);
+    // refining frames aren't measured
+    const auto id = dynamic.submitFrame(*sched, job, false);
+    endFrame(id, 1s);
+    EXPECT_EQ(dynamic.getBlockSize(), 8);
+}
+
+TEST_F(DynamicResolutionTests, NewFramesCancelTheLastOne) {
+    cam.setHSize(64);
+    cam.setVSize(64);
+    Job job{ cam, world, JobType::realtime };
+    const auto first = dynamic.submitFrame(*sched, job, true);
+    const auto second = dynamic.submitFrame(*sched, job, true);
+    auto s = sched->getJobState(first);
+    ASSERT_NE(s, nullptr);
+    EXPECT_TRUE(s->isCancelled.load());
+    s = sched->getJobState(second);
+    ASSERT_NE(s, nullptr);
+    EXPECT_FALSE(s->isCancelled.load());
+}
@@ -24,7 +24,7 @@ class ShapeBasics: public ::testing::Test
             return Vector{ localPoint.x, localPoint.y, localPoint.z };
         };
 
-        Intersections localIntersect(Ray localRay) override
+        Intersections localIntersect(const Ray& localRay) override
         {
             objectRay = localRay;
             return Intersections{};
@@ -0,0 +1,375 @@
+#include "gtest/gtest.h"
+#include "raytracer/materials/texture_map.hpp"
+#include "raytracer/materials/material.hpp"
+#include "raytracer/environment/camera.hpp"
+#include "raytracer/shapes/sphere.hpp"
+
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace rt;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// UV Projections
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class UVProjections: public ::testing::Test
+{
+  protected:
+    static void expectUV(UV actual, double u, double v)
+    {
+        EXPECT_NEAR(actual.u, u, 1e-4);
+        EXPECT_NEAR(actual.v, v, 1e-4);
+    }
+};
+
+TEST_F(UVProjections, SphericalMappingOfPoints)
+{
+    expectUV(UVMap::spherical(Point{ 0, 0, -1 }), 0.0, 0.5);
+    expectUV(UVMap::spherical(Point{ 1, 0, 0 }), 0.25, 0.5);
+    expectUV(UVMap::spherical(Point{ 0, 0, 1 }), 0.5, 0.5);
+    expectUV(UVMap::spherical(Point{ -1, 0, 0 }), 0.75, 0.5);
+    expectUV(UVMap::spherical(Point{ 0, 1, 0 }), 0.5, 1.0);
+    expectUV(UVMap::spherical(Point{ 0, -1, 0 }), 0.5, 0.0);
+    expectUV(UVMap::spherical(Point{ std::sqrt(2.) / 2., std::sqrt(2.) / 2., 0 }), 0.25, 0.75);
+}
+
+TEST_F(UVProjections, PlanarMappingOfPoints)
+{
+    expectUV(UVMap::planar(Point{ 0.25, 0, 0.5 }), 0.25, 0.5);
+    expectUV(UVMap::planar(Point{ 0.25, 0, -0.25 }), 0.25, 0.75);
+    expectUV(UVMap::planar(Point{ 0.25, 0.5, -0.25 }), 0.25, 0.75);
+    expectUV(UVMap::planar(Point{ 1.25, 0, 0.5 }), 0.25, 0.5);
+    expectUV(UVMap::planar(Point{ 0.25, 0, -1.75 }), 0.25, 0.25);
+    expectUV(UVMap::planar(Point{ 1, 0, -1 }), 0.0, 0.0);
+    expectUV(UVMap::planar(Point{ 0, 0, 0 }), 0.0, 0.0);
+}
+
+TEST_F(UVProjections, CylindricalMappingOfPoints)
+{
+    expectUV(UVMap::cylindrical(Point{ 0, 0, -1 }), 0.0, 0.0);
+    expectUV(UVMap::cylindrical(Point{ 0, 0.5, -1 }), 0.0, 0.5);
+    expectUV(UVMap::cylindrical(Point{ 0, 1, -1 }), 0.0, 0.0);
+    expectUV(UVMap::cylindrical(Point{ 0.70711, 0.5, -0.70711 }), 0.125, 0.5);
+    expectUV(UVMap::cylindrical(Point{ 1, 0.5, 0 }), 0.25, 0.5);
+    expectUV(UVMap::cylindrical(Point{ 0.70711, 0.5, 0.70711 }), 0.375, 0.5);
+    expectUV(UVMap::cylindrical(Point{ 0, -0.25, 1 }), 0.5, 0.75);
+    expectUV(UVMap::cylindrical(Point{ -0.70711, 0.5, 0.70711 }), 0.625, 0.5);
+    expectUV(UVMap::cylindrical(Point{ -1, 1.25, 0 }), 0.75, 0.25);
+}
+
+TEST_F(UVProjections, CubeFaceOfPoints)
+{
+    EXPECT_EQ(UVMap::cubeFace(Point{ -1, 0.5, -0.25 }), CubeFace::left);
+    EXPECT_EQ(UVMap::cubeFace(Point{ 1.1, -0.75, 0.8 }), CubeFace::right);
+    EXPECT_EQ(UVMap::cubeFace(Point{ 0.1, 0.6, 0.9 }), CubeFace::front);
+    EXPECT_EQ(UVMap::cubeFace(Point{ -0.7, 0, -2 }), CubeFace::back);
+    EXPECT_EQ(UVMap::cubeFace(Point{ 0.5, 1, 0.9 }), CubeFace::up);
+    EXPECT_EQ(UVMap::cubeFace(Point{ -0.2, -1.3, 1.1 }), CubeFace::down);
+}
+
+TEST_F(UVProjections, CubeMappingOfPointsOnEachFace)
+{
+    expectUV(UVMap::cube(Point{ -0.5, 0.5, 1 }, CubeFace::front), 0.25, 0.75);
+    expectUV(UVMap::cube(Point{ 0.5, -0.5, 1 }, CubeFace::front), 0.75, 0.25);
+    expectUV(UVMap::cube(Point{ 0.5, 0.5, -1 }, CubeFace::back), 0.25, 0.75);
+    expectUV(UVMap::cube(Point{ -0.5, -0.5, -1 }, CubeFace::back), 0.75, 0.25);
+    expectUV(UVMap::cube(Point{ -1, 0.5, -0.5 }, CubeFace::left), 0.25, 0.75);
+    expectUV(UVMap::cube(Point{ -1, -0.5, 0.5 }, CubeFace::left), 0.75, 0.25);
+    expectUV(UVMap::cube(Point{ 1, 0.5, 0.5 }, CubeFace::right), 0.25, 0.75);
+    expectUV(UVMap::cube(Point{ 1, -0.5, -0.5 }, CubeFace::right), 0.75, 0.25);
+    expectUV(UVMap::cube(Point{ -0.5, 1, -0.5 }, CubeFace::up), 0.25, 0.75);
+    expectUV(UVMap::cube(Point{ 0.5, 1, 0.5 }, CubeFace::up), 0.75, 0.25);
+    expectUV(UVMap::cube(Point{ -0.5, -1, 0.5 }, CubeFace::down), 0.25, 0.75);
+    expectUV(UVMap::cube(Point{ 0.5, -1, -0.5 }, CubeFace::down), 0.75, 0.25);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Image loading
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class ImageLoading: public ::testing::Test
+{
+  protected:
+    static std::string bytes(std::initializer_list<int> values)
+    {
+        std::string s;
+        for (int v: values)
+            s.push_back(static_cast<char>(v));
+        return s;
+    }
+};
+
+TEST_F(ImageLoading, ReadsAsciiPPM)
+{
+    std::istringstream ppm{ "P3\n# a comment\n2 2\n255\n"
+                            "255 0 0   0 255 0\n"
+                            "0 0 255   255 255 255\n" };
+    const auto image = MipMappedImage::fromPPM(ppm);
+    ASSERT_NE(image, nullptr);
+    EXPECT_EQ(image->getWidth(), 2);
+    EXPECT_EQ(image->getHeight(), 2);
+    EXPECT_EQ(image->texelAt(0, 0, 0), (Colour{ 1, 0, 0 }));
+    EXPECT_EQ(image->texelAt(0, 1, 0), (Colour{ 0, 1, 0 }));
+    EXPECT_EQ(image->texelAt(0, 0, 1), (Colour{ 0, 0, 1 }));
+    EXPECT_EQ(image->texelAt(0, 1, 1), (Colour{ 1, 1, 1 }));
+}
+
+TEST_F(ImageLoading, ReadsBinaryPPM)
+{
+    std::istringstream ppm{ "P6 2 1 255\n" + bytes({ 255, 0, 0, 0, 51, 102 }) };
+    const auto image = MipMappedImage::fromPPM(ppm);
+    ASSERT_NE(image, nullptr);
+    EXPECT_EQ(image->texelAt(0, 0, 0), (Colour{ 1, 0, 0 }));
+    EXPECT_EQ(image->texelAt(0, 1, 0), (Colour{ 0, 0.2, 0.4 }));
+}
+
+TEST_F(ImageLoading, RejectsMalformedPPM)
+{
+    std::istringstream notPPM{ "P5 2 2 255\n" };
+    EXPECT_EQ(MipMappedImage::fromPPM(notPPM), nullptr);
+    std::istringstream truncated{ "P3 2 2 255\n1 2 3 4 5 6\n" };
+    EXPECT_EQ(MipMappedImage::fromPPM(truncated), nullptr);
+}
+
+TEST_F(ImageLoading, ReadsQOI)
+{
+    // a 2x2 image using the rgb, run, diff and index ops
+    std::istringstream qoi{ bytes({ 'q', 'o', 'i', 'f', 0, 0, 0, 2, 0, 0, 0, 2, 3, 0,
+                                    0xfe, 255, 0, 0,    // rgb: red
+                                    0xc0,               // run of one more red pixel
+                                    0x5e,               // diff: r - 1, g + 1
+                                    0x32,               // index: red again
+                                    0, 0, 0, 0, 0, 0, 0, 1 }) };
+    const auto image = MipMappedImage::fromQOI(qoi);
+    ASSERT_NE(image, nullptr);
+    EXPECT_EQ(image->texelAt(0, 0, 0), (Colour{ 1, 0, 0 }));
+    EXPECT_EQ(image->texelAt(0, 1, 0), (Colour{ 1, 0, 0 }));
+    EXPECT_EQ(image->texelAt(0, 0, 1), (Colour{ 254. / 255., 1. / 255., 0 }));
+    EXPECT_EQ(image->texelAt(0, 1, 1), (Colour{ 1, 0, 0 }));
+}
+
+TEST_F(ImageLoading, RejectsTruncatedQOI)
+{
+    std::istringstream qoi{ bytes({ 'q', 'o', 'i', 'f', 0, 0, 0, 2, 0, 0, 0, 2, 3, 0, 0xfe, 255 }) };
+    EXPECT_EQ(MipMappedImage::fromQOI(qoi), nullptr);
+}
+
+TEST_F(ImageLoading, MissingFileIsNotLoaded)
+{
+    EXPECT_EQ(MipMappedImage::fromFile("no_such_image.ppm"), nullptr);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Mipmaps
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class MipMaps: public ::testing::Test
+{
+  protected:
+    /// @brief A checkerboard image of single black and white texels.
+    static MipMappedImage checkerboard(uint32_t size)
+    {
+        std::vector<Colour> pixels(size * size);
+        for (uint32_t y{}; y < size; ++y)
+            for (uint32_t x{}; x < size; ++x)
+                pixels[y * size + x] = ((x + y) & 1) ? Colour{ 1, 1, 1 } : Colour{ 0, 0, 0 };
+        return { size, size, pixels };
+    }
+};
+
+TEST_F(MipMaps, ChainHalvesDownToASingleTexel)
+{
+    std::vector<Colour> pixels(40 * 12, Colour{ 0.5, 0.5, 0.5 });
+    MipMappedImage image{ 40, 12, pixels };
+    ASSERT_EQ(image.getLevelCount(), 6);
+    EXPECT_EQ(image.getWidth(1), 20);
+    EXPECT_EQ(image.getHeight(1), 6);
+    EXPECT_EQ(image.getWidth(3), 5);
+    EXPECT_EQ(image.getHeight(3), 1);
+    EXPECT_EQ(image.getWidth(5), 1);
+    EXPECT_EQ(image.getHeight(5), 1);
+    // texels which aren't tile aligned are stored and filtered correctly
+    EXPECT_EQ(image.texelAt(0, 39, 11), (Colour{ 0.5, 0.5, 0.5 }));
+    EXPECT_EQ(image.texelAt(5, 0, 0), (Colour{ 0.5, 0.5, 0.5 }));
+}
+
+TEST_F(MipMaps, LevelsAreBoxFiltered)
+{
+    const std::vector<Colour> pixels{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 1, 1 } };
+    MipMappedImage image{ 2, 2, pixels };
+    EXPECT_EQ(image.texelAt(1, 0, 0), (Colour{ 0.5, 0.5, 0.5 }));
+}
+
+TEST_F(MipMaps, LevelOfDetailFollowsFootprint)
+{
+    const auto image = checkerboard(256);
+    EXPECT_DOUBLE_EQ(image.levelOfDetail(0.), 0.);
+    EXPECT_DOUBLE_EQ(image.levelOfDetail(1. / 256.), 0.);
+    EXPECT_DOUBLE_EQ(image.levelOfDetail(4. / 256.), 2.);
+    // footprints wider than the image clamp to the last level
+    EXPECT_DOUBLE_EQ(image.levelOfDetail(10.), 8.);
+}
+
+TEST_F(MipMaps, SharpAtTexelCentresWithoutFootprint)
+{
+    const auto image = checkerboard(64);
+    // centre of texel (0, 0), in the top left of the image
+    const UV uv{ 0.5 / 64., 1. - 0.5 / 64. };
+    EXPECT_EQ(image.sample(uv, 0.), (Colour{ 0, 0, 0 }));
+    EXPECT_EQ(image.sample(UV{ 1.5 / 64., 1. - 0.5 / 64. }, 0.), (Colour{ 1, 1, 1 }));
+}
+
+TEST_F(MipMaps, WideFootprintsAverageAwayDetail)
+{
+    const auto image = checkerboard(64);
+    // a footprint of many texels would alias at level 0, but the mip chain averages it to grey
+    const Colour c = image.sample(UV{ 0.3, 0.7 }, 8. / 64.);
+    EXPECT_NEAR(c.R, 0.5, 1e-6);
+    EXPECT_NEAR(c.G, 0.5, 1e-6);
+    EXPECT_NEAR(c.B, 0.5, 1e-6);
+}
+
+TEST_F(MipMaps, AddressingRepeatsOrClamps)
+{
+    const std::vector<Colour> pixels{ { 1, 0, 0 }, { 0, 0, 1 } };
+    MipMappedImage image{ 2, 1, pixels };
+    // halfway between the last and first texel blends them when repeating
+    EXPECT_EQ(image.sampleLevel(UV{ 0., 0.5 }, 0), (Colour{ 0.5, 0, 0.5 }));
+    EXPECT_EQ(image.sampleLevel(UV{ 0., 0.5 }, 0, TextureAddress::clamp), (Colour{ 1, 0, 0 }));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Texture maps
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class TextureMaps: public ::testing::Test
+{
+  protected:
+    static MipMappedImage solid(Colour c)
+    {
+        const std::vector<Colour> pixels(4, c);
+        return { 2, 2, pixels };
+    }
+};
+
+TEST_F(TextureMaps, IsABuiltInPattern)
+{
+    const auto image = solid(Colour{ 0.2, 0.4, 0.6 });
+    TextureMap map{ &image, UVMapping::spherical };
+    EXPECT_EQ(map.getType(), PatternType::image);
+    EXPECT_EQ(map.getMapping(), UVMapping::spherical);
+    EXPECT_EQ(map.colourAtShape(Point{ 0, 1, 0 }), (Colour{ 0.2, 0.4, 0.6 }));
+}
+
+TEST_F(TextureMaps, CubeMapUsesAnImagePerFace)
+{
+    const auto left = solid(Colour{ 1, 0, 0 });
+    const auto front = solid(Colour{ 0, 1, 0 });
+    const auto right = solid(Colour{ 0, 0, 1 });
+    const auto back = solid(Colour{ 1, 1, 0 });
+    const auto up = solid(Colour{ 0, 1, 1 });
+    const auto down = solid(Colour{ 1, 1, 1 });
+    TextureMap map{ { &left, &front, &right, &back, &up, &down } };
+    EXPECT_EQ(map.colourAtShape(Point{ -1, 0, 0 }), (Colour{ 1, 0, 0 }));
+    EXPECT_EQ(map.colourAtShape(Point{ 0, 0, 1 }), (Colour{ 0, 1, 0 }));
+    EXPECT_EQ(map.colourAtShape(Point{ 1, 0, 0 }), (Colour{ 0, 0, 1 }));
+    EXPECT_EQ(map.colourAtShape(Point{ 0, 0, -1 }), (Colour{ 1, 1, 0 }));
+    EXPECT_EQ(map.colourAtShape(Point{ 0, 1, 0 }), (Colour{ 0, 1, 1 }));
+    EXPECT_EQ(map.colourAtShape(Point{ 0, -1, 0 }), (Colour{ 1, 1, 1 }));
+}
+
+TEST_F(TextureMaps, FootprintIsMeasuredInTextureSpace)
+{
+    const auto image = solid(Colour{ 1, 1, 1 });
+    TextureMap planar{ &image, UVMapping::planar };
+    EXPECT_NEAR(planar.footprintToUV(Point{ 0.5, 0, 0.5 }, 0.1), 0.1, 1e-9);
+    // v spans the half circle from pole to pole on a unit sphere, so it changes fastest
+    TextureMap spherical{ &image, UVMapping::spherical };
+    EXPECT_NEAR(spherical.footprintToUV(Point{ 0, 0, -1 }, 0.01), 0.01 / PI, 1e-5);
+}
+
+TEST_F(TextureMaps, DistantSurfacesSampleCoarserLevels)
+{
+    std::vector<Colour> pixels(64 * 64);
+    for (uint32_t y{}; y < 64; ++y)
+        for (uint32_t x{}; x < 64; ++x)
+            pixels[y * 64 + x] = ((x + y) & 1) ? Colour{ 1, 1, 1 } : Colour{ 0, 0, 0 };
+    MipMappedImage image{ 64, 64, pixels };
+    TextureMap map{ &image, UVMapping::planar };
+    const Tuple p{ Point{ 0.5 / 64., 0, 1. - 0.5 / 64. } };
+    EXPECT_EQ(map.colourAtShape(p), (Colour{ 0, 0, 0 }));
+    const Colour far = map.colourAtShape(p, 0.5);
+    EXPECT_NEAR(far.R, 0.5, 1e-6);
+}
+
+TEST_F(TextureMaps, PatternTransformScalesFootprint)
+{
+    std::vector<Colour> pixels(64 * 64);
+    for (uint32_t y{}; y < 64; ++y)
+        for (uint32_t x{}; x < 64; ++x)
+            pixels[y * 64 + x] = ((x + y) & 1) ? Colour{ 1, 1, 1 } : Colour{ 0, 0, 0 };
+    MipMappedImage image{ 64, 64, pixels };
+    TextureMap map{ &image, UVMapping::planar };
+    // scaling the pattern up 64x makes each texel a unit wide, so a footprint of one unit
+    //  is still only a single texel and stays sharp
+    map.setTransform(Transform::scale(64., 64., 64.));
+    EXPECT_EQ(map.colourAtShape(Point{ 0.5, 0, 63.5 }, 1. / 64.), (Colour{ 0, 0, 0 }));
+}
+
+TEST_F(TextureMaps, MaterialShadesWithTextureMap)
+{
+    const auto image = solid(Colour{ 0.2, 0.4, 0.6 });
+    TextureMap map{ &image, UVMapping::spherical };
+    Material m{};
+    m.setPattern(&map);
+    m.ambient = 1.;
+    m.diffuse = 0.;
+    m.specular = 0.;
+    const PointLight light{ Point{ 0, 0, -10 }, Colour{ 1, 1, 1 } };
+    const auto c = m.lightPixel(light, Point{ 0, 0, -1 }, Point{ 0, 0, -1 },
+                                Vector{ 0, 0, -1 }, Vector{ 0, 0, -1 }, false, 0.25);
+    EXPECT_EQ(c, (Colour{ 0.2, 0.4, 0.6 }));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Ray footprints
+////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(RayFootprint, CameraRaysGrowByAPixelPerUnit)
+{
+    Camera c{ 200, 100, HALF_PI };
+    const auto ray = c.getRayForCanvasPixel(100, 50);
+    EXPECT_DOUBLE_EQ(ray.footprintAt(0.), 0.);
+    EXPECT_DOUBLE_EQ(ray.footprintAt(1.), c.getPixelSize());
+    EXPECT_DOUBLE_EQ(ray.footprintAt(10.), 10. * c.getPixelSize());
+}
+
+TEST(RayFootprint, TransformedRaysKeepTheirCone)
+{
+    Ray r{ Point{ 0, 0, 0 }, Vector{ 0, 0, 1 } };
+    r.setCone(0.5, 0.01);
+    const auto r2 = r.transform(Transform::translation(1., 2., 3.));
+    EXPECT_DOUBLE_EQ(r2.footprintAt(10.), 0.6);
+}
+
+TEST(RayFootprint, ShapeTakesFootprintIntoObjectSpace)
+{
+    const auto image = []() {
+        const std::vector<Colour> pixels(4, Colour{ 1, 1, 1 });
+        return MipMappedImage{ 2, 2, pixels };
+    }();
+    TextureMap map{ &image, UVMapping::planar };
+    Sphere s{};
+    s.setTransform(Transform::scale(2., 2., 2.));
+    Material m{};
+    m.ambient = 1.;
+    m.setPattern(&map);
+    s.setMaterial(m);
+    const PointLight light{ Point{ 0, 0, -10 }, Colour{ 1, 1, 1 } };
+    // shading still works with a world space footprint on a scaled shape
+    const auto c = s.lightPixel(light, Point{ 0, 0, -2 }, Vector{ 0, 0, -1 }, Vector{ 0, 0, -1 },
+                                true, 0.5);
+    EXPECT_EQ(c, (Colour{ 1, 1, 1 }));
+}
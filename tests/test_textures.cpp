@@ -101,3 +101,184 @@ using namespace rt;
 //    perturbed = s1.normalAt(Point{-0.5, 0.75, 0.5});
 //    EXPECT_EQ(perturbed, Vector( 0.0, 1.0, 0.0 ));
 //}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Baked noise volumes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class BakedNoise: public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        noise.setDensity(0.5);
+        noise.setFractalType(Texture::Noise::FractalType::fbm);
+        noise.setOctaves(4);
+    }
+
+    Texture::Noise noise{};
+    const BoundingBox region{ Point{ -1, -1, -1 }, Point{ 1, 1, 1 } };
+};
+
+TEST_F(BakedNoise, VolumeIsBrickTiled)
+{
+    Texture::NoiseVolume volume{ BoundingBox{ Point{ 0, 0, 0 }, Point{ 4, 2, 0 } }, 17 };
+    EXPECT_EQ(volume.getDimension(0), 17);
+    EXPECT_EQ(volume.getDimension(1), 9);
+    EXPECT_EQ(volume.getDimension(2), 2);   // flat axes still get 2 samples
+    EXPECT_EQ(volume.positionOf(16, 8, 1), Point(4, 2, 0));
+    volume.set(16, 8, 1, 0.5f);
+    EXPECT_FLOAT_EQ(volume.at(16, 8, 1), 0.5f);
+}
+
+TEST_F(BakedNoise, VolumeInterpolatesTrilinearly)
+{
+    Texture::NoiseVolume volume{ BoundingBox{ Point{ 0, 0, 0 }, Point{ 1, 1, 1 } }, 2 };
+    // a linear field is reproduced exactly by trilinear interpolation
+    for (size_t k{}; k < 2; ++k)
+        for (size_t j{}; j < 2; ++j)
+            for (size_t i{}; i < 2; ++i)
+                volume.set(i, j, k, static_cast<float>(i + 2 * j + 4 * k));
+    EXPECT_FLOAT_EQ(volume.sample(Point{ 0.5, 0.5, 0.5 }), 3.5f);
+    EXPECT_FLOAT_EQ(volume.sample(Point{ 0.25, 0.75, 0.1 }), 0.25f + 1.5f + 0.4f);
+}
+
+TEST_F(BakedNoise, BakedPerturbationMatchesLiveNoise)
+{
+    const std::vector<Tuple> points{
+        Point{ 0, 0, 0 }, Point{ 0.31, -0.72, 0.18 }, Point{ -0.9, 0.45, -0.33 }, Point{ 1, 1, 1 }
+    };
+    std::vector<Tuple> live{};
+    for (auto p: points)
+        live.push_back(noise.getPerturbation(p));
+    noise.bake(region, 128);
+    EXPECT_TRUE(noise.isBaked());
+    for (size_t i{}; i < points.size(); ++i)
+    {
+        auto p = points[i];
+        const auto baked = noise.getPerturbation(p);
+        EXPECT_NEAR(baked.x, live[i].x, 0.01);
+        EXPECT_NEAR(baked.y, live[i].y, 0.01);
+        EXPECT_NEAR(baked.z, live[i].z, 0.01);
+    }
+}
+
+TEST_F(BakedNoise, PointsOutsideVolumeUseLiveNoise)
+{
+    Point outside{ 3.2, -1.7, 0.4 };
+    const auto live = noise.getPerturbation(outside);
+    noise.bake(region, 16);
+    EXPECT_EQ(noise.getPerturbation(outside), live);
+}
+
+TEST_F(BakedNoise, ChangingNoiseSettingsDiscardsBake)
+{
+    noise.bake(region, 16);
+    noise.setOctaves(2);
+    EXPECT_FALSE(noise.isBaked());
+    noise.bake(region, 16);
+    noise.setWarpType(Texture::Noise::WarpType::simplex);
+    EXPECT_FALSE(noise.isBaked());
+}
+
+TEST_F(BakedNoise, BakedVolumeIsShared)
+{
+    noise.bake(region, 16);
+    Texture::Noise other{};
+    other.setBakedVolume(noise.getBakedVolume());
+    EXPECT_EQ(other.getBakedVolume(), noise.getBakedVolume());
+    EXPECT_EQ(noise.getBakedVolume().use_count(), 3);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Batched perturbations
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class BatchedTextures: public ::testing::Test
+{
+  protected:
+    /// @brief Expect a batch of perturbations to match the perturbations of each single point.
+    static void expectBatchMatchesPoints(Texture::Generative& texture, const std::vector<Tuple>& points)
+    {
+        TupleBatch out{};
+        texture.getPerturbations(TupleBatch{ points }, out);
+        ASSERT_EQ(out.size(), points.size());
+        for (size_t i{}; i < points.size(); ++i)
+        {
+            auto p = points[i];
+            const auto P = texture.getPerturbation(p);
+            EXPECT_NEAR(out.x[i], P.x, 1e-5);
+            EXPECT_NEAR(out.y[i], P.y, 1e-5);
+            EXPECT_NEAR(out.z[i], P.z, 1e-5);
+        }
+    }
+
+    std::vector<Tuple> points{
+        Point{ 0, 0, 0 }, Point{ 0.31, -0.72, 0.18 }, Point{ -9.5, 4.45, -0.33 }, Point{ 1, 1, 1 },
+        Point{ 120.25, -33.1, 7.7 }, Point{ -0.5, 0.5, -0.5 }, Point{ 3.3, 2.2, -1.1 },
+        Point{ -250.0, 0.01, 99.9 }, Point{ 0.001, -0.001, 0.5 }
+    };
+};
+
+TEST_F(BatchedTextures, SimplexBatchMatchesSinglePoints)
+{
+    Texture::Noise noise{};
+    noise.setDensity(5.0);
+    EXPECT_TRUE(noise.hasBatchKernel());
+    expectBatchMatchesPoints(noise, points);
+}
+
+TEST_F(BatchedTextures, PerlinFbmBatchMatchesSinglePoints)
+{
+    Texture::Noise noise{};
+    noise.setNoiseType(Texture::Noise::NoiseType::perlin);
+    noise.setFractalType(Texture::Noise::FractalType::fbm);
+    noise.setOctaves(5);
+    noise.setDensity(0.8);
+    noise.setCoefficients(1.0, 2.0, 0.5);
+    EXPECT_TRUE(noise.hasBatchKernel());
+    expectBatchMatchesPoints(noise, points);
+}
+
+TEST_F(BatchedTextures, SimplexFbmBatchMatchesSinglePoints)
+{
+    Texture::Noise noise{};
+    noise.setFractalType(Texture::Noise::FractalType::fbm);
+    noise.setOctaves(3);
+    noise.setDensity(1.3);
+    expectBatchMatchesPoints(noise, points);
+}
+
+TEST_F(BatchedTextures, UnsupportedNoiseFallsBackToSinglePoints)
+{
+    Texture::Noise noise{};
+    noise.setNoiseType(Texture::Noise::NoiseType::cellular);
+    noise.setFractalType(Texture::Noise::FractalType::ridged);
+    noise.setWarpType(Texture::Noise::WarpType::simplex2);
+    noise.setWarpAmplitude(20.0);
+    EXPECT_FALSE(noise.hasBatchKernel());
+    expectBatchMatchesPoints(noise, points);
+}
+
+TEST_F(BatchedTextures, WavesBatchMatchesSinglePoints)
+{
+    Texture::Waves waves{};
+    waves.setFrequency(4);
+    waves.setAmplitude(0.15);
+    expectBatchMatchesPoints(waves, points);
+}
+
+TEST_F(BatchedTextures, NormalsAreBatchPerturbed)
+{
+    Texture::Noise noise{};
+    noise.setDensity(2.0);
+    noise.setAmplitude(0.3);
+    noise.setTransform(Transform::scale(0.5, 0.5, 0.5) * Transform::rotateZ(QUARTER_PI));
+    const Vector normal{ 0, 1, 0 };
+    TupleBatch normals{ points.size(), 0.0 };
+    for (size_t i{}; i < points.size(); ++i)
+        normals.set(i, normal);
+    noise.applyToNormals(normals, TupleBatch{ points });
+    for (size_t i{}; i < points.size(); ++i)
+        EXPECT_EQ(normals.get(i), noise.applyToNormal(normal, points[i]));
+}
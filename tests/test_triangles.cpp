@@ -2,6 +2,10 @@
 #include "raytracer/shapes/triangle.hpp"
 #include "raytracer/environment/world.hpp"
 #include "raytracer/renderer/ray.hpp"
+#include "raytracer/accel/triangles.hpp"
+#include "raytracer/shapes/group.hpp"
+
+#include <memory>
 
 using namespace rt;
 
@@ -144,3 +148,130 @@ TEST_F(SmoothTriangles, NormalIsPreparedByIntersectionState)
 
 
 
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Watertight triangle kernels
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class TriangleKernels: public ::testing::Test
+{
+  protected:
+    /// @brief A grid of triangles, tilted so no edge lines up with an axis.
+    void makeMesh(size_t n)
+    {
+        for (size_t i{}; i < n; ++i)
+        {
+            for (size_t j{}; j < n; ++j)
+            {
+                const auto x = static_cast<double>(i), y = static_cast<double>(j);
+                const auto a = Point{ x, y, 0.1 * x }, b = Point{ x + 1, y, 0.1 * x + 0.1 };
+                const auto c = Point{ x, y + 1, 0.1 * x }, d = Point{ x + 1, y + 1, 0.1 * x + 0.1 };
+                triangles.push_back(std::make_unique<Triangle>(a, b, c));
+                triangles.push_back(std::make_unique<Triangle>(b, d, c));
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Triangle>> triangles;
+};
+
+TEST_F(TriangleKernels, RaysThroughSharedEdgesHitOneSide)
+{
+    // two triangles making a square, and rays through the diagonal they share and the corners
+    //  they share, which a test that isn't watertight lets slip between them
+    const auto a = Point{ 0, 0, 0 }, b = Point{ 1, 0, 0 }, c = Point{ 0, 1, 0 }, d = Point{ 1, 1, 0 };
+    for (const auto& target: { Point{ 0.5, 0.5, 0 }, Point{ 0.3, 0.7, 0 }, Point{ 1. / 3., 2. / 3., 0 },
+                               Point{ 1, 0, 0 }, Point{ 0, 1, 0 } })
+    {
+        const auto origin = Point{ 0.2, -0.3, -2 };
+        const Ray r{ origin, target - origin };
+        const Accel::WatertightRay ray{ r };
+        Accel::TriangleHit hit{};
+        const bool isHit = Accel::intersectTriangle(ray, a, b, c, -INF, INF, hit)
+                           || Accel::intersectTriangle(ray, b, d, c, -INF, INF, hit);
+        EXPECT_TRUE(isHit);
+        EXPECT_NEAR(hit.t, 1., 1e-12);
+    }
+}
+
+TEST_F(TriangleKernels, HitsAreOnlyReportedInRange)
+{
+    const Ray r{ Point{ 0, 0.5, -2 }, Vector{ 0, 0, 1 } };
+    Accel::TriangleHit hit{};
+    const Accel::WatertightRay ray{ r };
+    const auto p1 = Point{ 0, 1, 0 }, p2 = Point{ -1, 0, 0 }, p3 = Point{ 1, 0, 0 };
+    EXPECT_TRUE(Accel::intersectTriangle(ray, p1, p2, p3, 0., INF, hit));
+    EXPECT_DOUBLE_EQ(hit.t, 2.);
+    EXPECT_FALSE(Accel::intersectTriangle(ray, p1, p2, p3, 0., 2., hit));
+    EXPECT_FALSE(Accel::intersectTriangle(ray, p1, p2, p3, 2.5, INF, hit));
+}
+
+TEST_F(TriangleKernels, PacksHitWhatEachTriangleHits)
+{
+    makeMesh(3);
+    Accel::TrianglePack<4> pack4{};
+    Accel::TrianglePack<8> pack8{};
+    for (size_t lane{}; lane < 7; ++lane)
+    {
+        auto& t = *triangles[lane];
+        if (lane < 4)
+            pack4.set(lane, t.getP1(), t.getP2(), t.getP3());
+        pack8.set(lane, t.getP1(), t.getP2(), t.getP3());
+    }
+    pack4.count = 4;
+    pack8.count = 7;
+    for (double x{ -0.25 }; x < 3.; x += 0.25)
+    {
+        for (double y{ -0.25 }; y < 3.; y += 0.25)
+        {
+            const Ray r{ Point{ x, y, -5 }, Vector{ 0.1, 0.05, 1 }.normalize() };
+            const Accel::WatertightRay ray{ r };
+            alignas(32) double t[8], u[8], v[8];
+            const auto mask4 = Accel::intersectTrianglePack(pack4, ray, 0., INF, t, u, v);
+            const auto mask8 = Accel::intersectTrianglePack(pack8, ray, 0., INF, t, u, v);
+            for (size_t lane{}; lane < 8; ++lane)
+            {
+                Accel::TriangleHit hit{};
+                const bool isHit = lane < 7 && Accel::intersectTriangle(ray, triangles[lane]->getP1(),
+                                                                        triangles[lane]->getP2(),
+                                                                        triangles[lane]->getP3(), 0., INF, hit);
+                EXPECT_EQ(((mask8 >> lane) & 1) != 0, isHit);
+                EXPECT_EQ(((mask4 >> lane) & 1) != 0, isHit && lane < 4);
+                if (isHit)
+                {
+                    EXPECT_DOUBLE_EQ(t[lane], hit.t);
+                    EXPECT_DOUBLE_EQ(u[lane], hit.u);
+                    EXPECT_DOUBLE_EQ(v[lane], hit.v);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(TriangleKernels, MeshGroupsHitWhatTheirTrianglesHit)
+{
+    // the group's BVH tests its leaves of triangles in packs, which must find the same hits
+    makeMesh(8);
+    Group mesh{};
+    for (auto& t: triangles)
+        mesh.addChild(t.get());
+    mesh.setTransform(Transform::rotateY(0.3) * Transform::translation(-4., -4., 0.));
+    for (double x{ -4.5 }; x < 4.5; x += 0.37)
+    {
+        for (double y{ -4.5 }; y < 4.5; y += 0.41)
+        {
+            const Ray r{ Point{ x, y, -10 }, Vector{ 0.05, -0.02, 1 }.normalize() };
+            Intersections expected{};
+            for (auto& t: triangles)
+                expected = expected + t->intersect(r.transform(mesh.getTransform().inverse()));
+            const auto xs = mesh.intersect(r);
+            ASSERT_EQ(xs.count(), expected.count());
+            for (size_t i{}; i < xs.count(); ++i)
+            {
+                EXPECT_EQ(xs(i).shape, expected(i).shape);
+                EXPECT_NEAR(xs(i).t, expected(i).t, 1e-9);
+                EXPECT_NEAR(xs(i).u, expected(i).u, 1e-9);
+                EXPECT_NEAR(xs(i).v, expected(i).v, 1e-9);
+            }
+        }
+    }
+}
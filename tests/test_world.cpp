@@ -320,6 +320,49 @@ TEST_F(WorldReflections, ReflectedColourAtMaximumRecursiveDepth)
     EXPECT_EQ(c, Colour(0, 0, 0));
 }
 
+TEST_F(WorldReflections, TracedRayMatchesShadedReflectiveIntersection)
+{
+    // the iterative ray tree gives the same pixel as shading the hit and its secondary rays
+    Plane plane{};
+    plane.setReflectivity(0.5);
+    plane.setTransform(Transform::translation(0., -1., 0.));
+    w.addShape(&plane);
+    Ray r{ Point{0, 0, -3}, Vector{0, -HALF_SQRT_2, HALF_SQRT_2} };
+    Colour c = w.traceRayToPixel(r, World::MAX_RAYS);
+    EXPECT_EQ(c, Colour(0.87677, 0.92436, 0.82918));
+}
+
+TEST_F(WorldReflections, FaintReflectionsAreNotTraced)
+{
+    // a reflection too faint to change the pixel is dropped, leaving only the surface colour
+    Plane plane{};
+    plane.setTransform(Transform::translation(0., -1., 0.));
+    w.addShape(&plane);
+    Ray r{ Point{0, 0, -3}, Vector{0, -HALF_SQRT_2, HALF_SQRT_2} };
+    const Colour matte = w.traceRayToPixel(r, World::MAX_RAYS);
+    plane.setReflectivity(World::MIN_RAY_WEIGHT / 2.);
+    const Colour faint = w.traceRayToPixel(r, World::MAX_RAYS);
+    EXPECT_DOUBLE_EQ(faint.R, matte.R);
+    EXPECT_DOUBLE_EQ(faint.G, matte.G);
+    EXPECT_DOUBLE_EQ(faint.B, matte.B);
+}
+
+TEST_F(WorldReflections, DeepRayTreesAreCappedByTheTraceStack)
+{
+    // asking for more bounces than the trace stack holds is clamped, rather than overflowing
+    World w2{};
+    w2.addLight(PointLight{ Point{0, 0, 0}, Colour{1, 1, 1} });
+    Plane upper{}, lower{};
+    lower.setReflectivity(1.0);
+    upper.setReflectivity(1.0);
+    lower.setTransform(Transform::translation(0., -1., 0.));
+    upper.setTransform(Transform::translation(0., 1., 0.));
+    w2.addShape(&lower);
+    w2.addShape(&upper);
+    Ray r{ Point{0, 0, 0}, Vector{0, 1, 0} };
+    EXPECT_EQ(w2.traceRayToPixel(r, 1000), w2.traceRayToPixel(r, World::MAX_TRACE_STACK - 2));
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// World Refractions